@@ -0,0 +1,348 @@
+#include "util/opts/log.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/buffer_lock.h"
+#include "device/device.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Measures the primitives on the path of every frame, on a device
+// capturing in memory: the ns/op of `buffer_use`, `buffer_consumed`,
+// `buffer_list_push_to_queue` and `buffer_lock_capture`/`buffer_lock_get`
+// on a single thread, and then with 2 to 64 threads contending for the
+// same buffer and for the same `buffer_lock_t`. The time spent
+// in `buffer_lock_capture` is the time its `lock` is held.
+//
+// Usage: buffer-bench [max-threads]
+
+#define BENCH_BUFFERS 8
+#define BENCH_OPS 1000000
+#define BENCH_CONTENDED_US (500 * 1000)
+#define BENCH_MAX_THREADS 64
+#define BENCH_MAX_SAMPLES (1024 * 1024)
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+DEFINE_BUFFER_LOCK(bench_lock, 0);
+
+static volatile bool bench_running;
+static pthread_barrier_t bench_barrier;
+
+static uint64_t bench_time_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bench_buffer_enqueue(buffer_t *buf, const char *who)
+{
+  return 0;
+}
+
+static int bench_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp)
+{
+  uint64_t mask = __atomic_load_n(&buf_list->enqueued_mask, __ATOMIC_ACQUIRE);
+  if (!mask) {
+    return -1;
+  }
+
+  *bufp = buf_list->bufs[__builtin_ctzll(mask)];
+  return 0;
+}
+
+static device_hw_t bench_hw = {
+  .buffer_enqueue = bench_buffer_enqueue,
+  .buffer_list_dequeue = bench_buffer_list_dequeue
+};
+
+static buffer_list_t *bench_open_buffer_list(const char *name, bool do_capture)
+{
+  static char data[4096];
+
+  device_t *dev = calloc(1, sizeof(device_t));
+  dev->name = "BENCH";
+  dev->hw = &bench_hw;
+
+  buffer_list_t *buf_list = calloc(1, sizeof(buffer_list_t));
+  buf_list->name = (char *)name;
+  buf_list->dev = dev;
+  buf_list->do_capture = do_capture;
+  buf_list->nbufs = BENCH_BUFFERS;
+  buf_list->queue_depth = MAX_BUFFER_QUEUE_DEPTH;
+  buf_list->bufs = calloc(BENCH_BUFFERS, sizeof(buffer_t*));
+
+  for (int i = 0; i < BENCH_BUFFERS; i++) {
+    buffer_t *buf = calloc(1, sizeof(buffer_t));
+    buf->name = "BENCH:buf";
+    buf->buf_list = buf_list;
+    buf->index = i;
+    buf->start = data;
+    buf->used = buf->length = sizeof(data);
+    buffer_set_enqueued(buf, true);
+    buf_list->bufs[i] = buf;
+  }
+
+  return buf_list;
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t bench_percentile(uint64_t *values, int n, int percentile)
+{
+  return n ? values[MIN(n * percentile / 100, n - 1)] : 0;
+}
+
+static void bench_print(const char *name, int threads, uint64_t ops, uint64_t elapsed_ns)
+{
+  printf("%-28s threads=%-2d ops=%-9" PRIu64 " ns/op=%.1f\n",
+    name, threads, ops, ops ? (double)elapsed_ns / ops : 0);
+}
+
+/* Single-threaded */
+
+static void bench_refs(buffer_list_t *capture)
+{
+  buffer_t *buf = buffer_list_dequeue(capture);
+  uint64_t start_ns = bench_time_ns();
+
+  for (int i = 0; i < BENCH_OPS; i++) {
+    buffer_use(buf);
+  }
+  uint64_t used_ns = bench_time_ns();
+
+  for (int i = 0; i < BENCH_OPS; i++) {
+    buffer_consumed(buf, "bench");
+  }
+  uint64_t consumed_ns = bench_time_ns();
+
+  bench_print("buffer_use", 1, BENCH_OPS, used_ns - start_ns);
+  bench_print("buffer_consumed", 1, BENCH_OPS, consumed_ns - used_ns);
+
+  // the last reference enqueues the buffer into the device
+  start_ns = bench_time_ns();
+  for (int i = 0; i < BENCH_OPS; i++) {
+    buffer_consumed(buf, "bench");
+    buf = buffer_list_dequeue(capture);
+  }
+  bench_print("buffer_consumed+dequeue", 1, BENCH_OPS, bench_time_ns() - start_ns);
+
+  buffer_consumed(buf, "bench");
+}
+
+static void bench_queue(buffer_list_t *capture, buffer_list_t *output)
+{
+  buffer_t *buf = buffer_list_dequeue(capture);
+  uint64_t start_ns = bench_time_ns();
+
+  for (int i = 0; i < BENCH_OPS; i++) {
+    buffer_list_push_to_queue(output, buf, 0);
+    buffer_consumed(buffer_list_pop_from_queue(output), "bench");
+  }
+  bench_print("push_to_queue+pop", 1, BENCH_OPS, bench_time_ns() - start_ns);
+
+  buffer_consumed(buf, "bench");
+}
+
+static void bench_lock_single(buffer_list_t *capture)
+{
+  int counter = 0;
+  uint64_t capture_ns = 0, get_ns = 0;
+
+  for (int i = 0; i < BENCH_OPS; i++) {
+    buffer_t *buf = buffer_list_dequeue(capture);
+
+    uint64_t start_ns = bench_time_ns();
+    buffer_lock_capture(&bench_lock, buf);
+    uint64_t captured_ns = bench_time_ns();
+    buffer_t *got = buffer_lock_get(&bench_lock, 100, &counter);
+    buffer_consumed(got, "bench");
+    uint64_t got_ns = bench_time_ns();
+
+    capture_ns += captured_ns - start_ns;
+    get_ns += got_ns - captured_ns;
+    buffer_consumed(buf, "bench");
+  }
+
+  bench_print("buffer_lock_capture", 1, BENCH_OPS, capture_ns);
+  bench_print("buffer_lock_get+consumed", 1, BENCH_OPS, get_ns);
+
+  buffer_lock_capture(&bench_lock, NULL);
+}
+
+/* Contended */
+
+typedef struct bench_thread_s {
+  pthread_t thread;
+  buffer_t *buf;
+  uint64_t ops;
+  uint64_t elapsed_ns;
+} bench_thread_t;
+
+static void *bench_refs_thread(bench_thread_t *thread)
+{
+  pthread_barrier_wait(&bench_barrier);
+  uint64_t start_ns = bench_time_ns();
+
+  while (bench_running) {
+    for (int i = 0; i < 1000; i++) {
+      buffer_use(thread->buf);
+      buffer_consumed(thread->buf, "bench");
+    }
+    thread->ops += 1000;
+  }
+
+  thread->elapsed_ns = bench_time_ns() - start_ns;
+  return NULL;
+}
+
+// All threads take and release references to the same buffer
+static void bench_refs_contended(buffer_list_t *capture, int nthreads)
+{
+  bench_thread_t threads[BENCH_MAX_THREADS] = {0};
+  buffer_t *buf = buffer_list_dequeue(capture);
+  uint64_t ops = 0, elapsed_ns = 0;
+
+  bench_running = true;
+  pthread_barrier_init(&bench_barrier, NULL, nthreads + 1);
+  for (int i = 0; i < nthreads; i++) {
+    threads[i].buf = buf;
+    pthread_create(&threads[i].thread, NULL, (void *(*)(void *))bench_refs_thread, &threads[i]);
+  }
+
+  pthread_barrier_wait(&bench_barrier);
+  usleep(BENCH_CONTENDED_US);
+  bench_running = false;
+
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(threads[i].thread, NULL);
+    ops += threads[i].ops;
+    elapsed_ns += threads[i].elapsed_ns;
+  }
+  pthread_barrier_destroy(&bench_barrier);
+
+  // the time of each thread for each of its own operations
+  bench_print("buffer_use+consumed", nthreads, ops, elapsed_ns);
+  buffer_consumed(buf, "bench");
+}
+
+static void *bench_reader_thread(bench_thread_t *thread)
+{
+  int counter = 0;
+
+  pthread_barrier_wait(&bench_barrier);
+
+  while (bench_running) {
+    uint64_t start_ns = bench_time_ns();
+    buffer_t *buf = buffer_lock_get(&bench_lock, 100, &counter);
+    if (!buf) {
+      continue;
+    }
+    buffer_consumed(buf, "bench");
+
+    thread->elapsed_ns += bench_time_ns() - start_ns;
+    thread->ops++;
+  }
+
+  return NULL;
+}
+
+// The readers wait for each of the buffers captured as fast as possible
+static void bench_lock_contended(buffer_list_t *capture, int nreaders)
+{
+  static uint64_t hold_ns[BENCH_MAX_SAMPLES];
+  bench_thread_t threads[BENCH_MAX_THREADS] = {0};
+  buffer_refs_stats_t stats_before = buffer_refs_stats;
+  uint64_t reads = 0, read_ns = 0, captures = 0, stalls = 0;
+  int n_samples = 0;
+
+  bench_running = true;
+  pthread_barrier_init(&bench_barrier, NULL, nreaders + 1);
+  for (int i = 0; i < nreaders; i++) {
+    pthread_create(&threads[i].thread, NULL, (void *(*)(void *))bench_reader_thread, &threads[i]);
+  }
+
+  pthread_barrier_wait(&bench_barrier);
+  uint64_t start_ns = bench_time_ns();
+  uint64_t end_ns = start_ns + BENCH_CONTENDED_US * 1000ULL;
+
+  while (bench_time_ns() < end_ns) {
+    buffer_t *buf = buffer_list_dequeue(capture);
+    if (!buf) {
+      // all the buffers are held by the readers
+      stalls++;
+      sched_yield();
+      continue;
+    }
+
+    uint64_t before_ns = bench_time_ns();
+    buffer_lock_capture(&bench_lock, buf);
+    uint64_t after_ns = bench_time_ns();
+    buffer_consumed(buf, "bench");
+
+    if (n_samples < BENCH_MAX_SAMPLES) {
+      hold_ns[n_samples++] = after_ns - before_ns;
+    }
+    captures++;
+  }
+
+  uint64_t elapsed_ns = bench_time_ns() - start_ns;
+  bench_running = false;
+
+  for (int i = 0; i < nreaders; i++) {
+    pthread_join(threads[i].thread, NULL);
+    reads += threads[i].ops;
+    read_ns += threads[i].elapsed_ns;
+  }
+  pthread_barrier_destroy(&bench_barrier);
+  buffer_lock_capture(&bench_lock, NULL);
+
+  qsort(hold_ns, n_samples, sizeof(uint64_t), bench_compare_u64);
+
+  printf("%-28s threads=%-2d captures/s=%-8.0f hold_p50=%" PRIu64 "ns hold_p99=%" PRIu64 "ns hold_max=%" PRIu64 "ns "
+    "stalls=%" PRIu64 " reads/s=%-9.0f read_ns/op=%.1f use_retries=%" PRIu64 " use_failed=%" PRIu64 "\n",
+    "buffer_lock_capture+get", nreaders,
+    captures * 1e9 / elapsed_ns,
+    bench_percentile(hold_ns, n_samples, 50),
+    bench_percentile(hold_ns, n_samples, 99),
+    n_samples ? hold_ns[n_samples - 1] : 0,
+    stalls,
+    reads * 1e9 / elapsed_ns,
+    reads ? (double)read_ns / reads : 0,
+    buffer_refs_stats.use_retries - stats_before.use_retries,
+    buffer_refs_stats.use_failed - stats_before.use_failed);
+}
+
+int main(int argc, const char *argv[])
+{
+  buffer_list_t *capture = bench_open_buffer_list("BENCH:capture", true);
+  buffer_list_t *output = bench_open_buffer_list("BENCH:output", false);
+  int max_threads = argc > 1 ? MIN(atoi(argv[1]), BENCH_MAX_THREADS) : BENCH_MAX_THREADS;
+
+  bench_lock.buf_list = capture;
+
+  bench_refs(capture);
+  bench_queue(capture, output);
+  bench_lock_single(capture);
+
+  for (int nthreads = 2; nthreads <= max_threads; nthreads *= 2) {
+    bench_refs_contended(capture, nthreads);
+  }
+
+  for (int nthreads = 2; nthreads <= max_threads; nthreads *= 2) {
+    bench_lock_contended(capture, nthreads);
+  }
+
+  return 0;
+}
@@ -0,0 +1,185 @@
+#include "util/opts/log.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/buffer_lock.h"
+#include "device/device.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// Measures the latency between `buffer_lock_capture` publishing a frame,
+// and each of the subscribers blocked in `buffer_lock_get` receiving it,
+// and how long the publisher itself spends in `buffer_lock_capture`.
+
+#define BENCH_BUFFERS 8
+#define BENCH_FRAMES 300
+#define BENCH_FRAME_INTERVAL_US 10000
+#define BENCH_MAX_SUBSCRIBERS 100
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+DEFINE_BUFFER_LOCK(bench_lock, 0);
+
+typedef struct bench_subscriber_s {
+  pthread_t thread;
+  int frames;
+  uint64_t *latency_us;
+} bench_subscriber_t;
+
+static volatile bool bench_running;
+
+static int bench_buffer_enqueue(buffer_t *buf, const char *who)
+{
+  return 0;
+}
+
+static int bench_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp)
+{
+  for (int i = 0; i < buf_list->nbufs; i++) {
+    if (buf_list->bufs[i]->enqueued) {
+      *bufp = buf_list->bufs[i];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+static device_hw_t bench_hw = {
+  .buffer_enqueue = bench_buffer_enqueue,
+  .buffer_list_dequeue = bench_buffer_list_dequeue
+};
+
+static buffer_list_t *bench_open_buffer_list()
+{
+  static char data[4096];
+
+  device_t *dev = calloc(1, sizeof(device_t));
+  dev->name = "BENCH";
+  dev->hw = &bench_hw;
+
+  buffer_list_t *buf_list = calloc(1, sizeof(buffer_list_t));
+  buf_list->name = "BENCH:capture";
+  buf_list->dev = dev;
+  buf_list->do_capture = true;
+  buf_list->nbufs = BENCH_BUFFERS;
+  buf_list->bufs = calloc(BENCH_BUFFERS, sizeof(buffer_t*));
+
+  for (int i = 0; i < BENCH_BUFFERS; i++) {
+    buffer_t *buf = calloc(1, sizeof(buffer_t));
+    buf->name = "BENCH:buf";
+    buf->buf_list = buf_list;
+    buf->index = i;
+    buf->start = data;
+    buf->used = buf->length = sizeof(data);
+    buffer_set_enqueued(buf, true);
+    buf_list->bufs[i] = buf;
+  }
+
+  return buf_list;
+}
+
+static void *bench_subscriber_thread(bench_subscriber_t *sub)
+{
+  int counter = 0;
+
+  while (bench_running) {
+    buffer_t *buf = buffer_lock_get(&bench_lock, 100, &counter);
+    if (!buf) {
+      continue;
+    }
+
+    if (sub->frames < BENCH_FRAMES) {
+      sub->latency_us[sub->frames++] = get_monotonic_time_us(NULL, NULL) - buf->captured_time_us;
+    }
+    buffer_consumed(buf, "bench");
+  }
+
+  return NULL;
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static void bench_run(buffer_list_t *buf_list, int nsubscribers)
+{
+  bench_subscriber_t subs[BENCH_MAX_SUBSCRIBERS] = {0};
+  uint64_t publish_us[BENCH_FRAMES];
+  int published = 0;
+
+  bench_running = true;
+
+  for (int i = 0; i < nsubscribers; i++) {
+    subs[i].latency_us = calloc(BENCH_FRAMES, sizeof(uint64_t));
+    pthread_create(&subs[i].thread, NULL, (void *(*)(void *))bench_subscriber_thread, &subs[i]);
+  }
+
+  // Let all subscribers block before publishing
+  usleep(100 * 1000);
+
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    usleep(BENCH_FRAME_INTERVAL_US);
+
+    buffer_t *buf = buffer_list_dequeue(buf_list);
+    if (!buf) {
+      continue;
+    }
+
+    buf->captured_time_us = get_monotonic_time_us(NULL, NULL);
+    buffer_lock_capture(&bench_lock, buf);
+    publish_us[published++] = get_monotonic_time_us(NULL, NULL) - buf->captured_time_us;
+    buffer_consumed(buf, "bench-publish");
+  }
+
+  usleep(100 * 1000);
+  bench_running = false;
+
+  int total = 0;
+  uint64_t *all = calloc(nsubscribers * BENCH_FRAMES, sizeof(uint64_t));
+
+  for (int i = 0; i < nsubscribers; i++) {
+    pthread_join(subs[i].thread, NULL);
+    memcpy(&all[total], subs[i].latency_us, subs[i].frames * sizeof(uint64_t));
+    total += subs[i].frames;
+    free(subs[i].latency_us);
+  }
+
+  qsort(all, total, sizeof(uint64_t), bench_compare_u64);
+  qsort(publish_us, published, sizeof(uint64_t), bench_compare_u64);
+
+  printf("subscribers=%3d published=%d publish_p50=%" PRIu64 "us publish_max=%" PRIu64 "us "
+    "received=%d wake_p50=%" PRIu64 "us wake_p90=%" PRIu64 "us wake_p99=%" PRIu64 "us wake_max=%" PRIu64 "us\n",
+    nsubscribers, published,
+    published ? publish_us[published / 2] : 0,
+    published ? publish_us[published - 1] : 0,
+    total,
+    total ? all[total / 2] : 0,
+    total ? all[total * 90 / 100] : 0,
+    total ? all[total * 99 / 100] : 0,
+    total ? all[total - 1] : 0);
+
+  free(all);
+
+  buffer_lock_capture(&bench_lock, NULL);
+}
+
+int main(int argc, const char *argv[])
+{
+  buffer_list_t *buf_list = bench_open_buffer_list();
+  int subscribers[] = { 1, 10, 100 };
+
+  for (int i = 0; i < 3; i++) {
+    bench_run(buf_list, subscribers[i]);
+  }
+
+  return 0;
+}
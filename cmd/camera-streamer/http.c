@@ -6,6 +6,10 @@
 #include "device/camera/camera.h"
 #include "output/output.h"
 #include "output/rtsp/rtsp.h"
+#include "util/metrics/metrics.h"
+#include "util/trace/trace.h"
+
+#include <math.h>
 
 extern unsigned char html_index_html[];
 extern unsigned int html_index_html_len;
@@ -80,6 +84,57 @@ void camera_http_option(http_worker_t *worker, FILE *stream)
   }
 }
 
+void camera_http_metrics(http_worker_t *worker, FILE *stream)
+{
+  char *body = NULL;
+  size_t length = 0;
+
+  FILE *metrics = open_memstream(&body, &length);
+  if (!metrics) {
+    http_500(stream, NULL);
+    return;
+  }
+
+  metrics_write_prometheus(metrics);
+  fclose(metrics);
+
+  http_write_response(stream, "200 OK", "text/plain; version=0.0.4", body, length);
+  free(body);
+}
+
+void camera_http_debug_trace(http_worker_t *worker, FILE *stream)
+{
+  char *seconds = http_get_param(worker, "seconds");
+  double duration = seconds ? strtod(seconds, NULL) : 5.0;
+  char *body = NULL;
+  size_t length = 0;
+
+  free(seconds);
+
+  if (!isfinite(duration) || duration <= 0) {
+    http_400(stream, "Invalid seconds.\n");
+    return;
+  }
+
+  unsigned duration_ms = MIN(duration, TRACE_MAX_DURATION_MS / 1000.0) * 1000;
+
+  FILE *trace = open_memstream(&body, &length);
+  if (!trace) {
+    http_500(stream, NULL);
+    return;
+  }
+
+  int ret = trace_collect(trace, duration_ms);
+  fclose(trace);
+
+  if (ret < 0) {
+    http_write_response(stream, "409 Conflict", NULL, "The trace is already being collected.\n", 0);
+  } else {
+    http_write_response(stream, "200 OK", "application/json", body, length);
+  }
+  free(body);
+}
+
 void http_cors_options(http_worker_t *worker, FILE *stream)
 {
   fprintf(stream, "HTTP/1.1 204 No Data\r\n");
@@ -97,6 +152,9 @@ http_method_t http_methods[] = {
   { "GET",  "/?action=stream", http_stream },
   { "GET",  "/video", http_detect_video },
   { "GET",  "/video.m3u8", http_m3u8_video },
+  { "GET",  "/hls/init.mp4", http_hls_init },
+  { "GET",  "/hls/segment.m4s", http_hls_segment },
+  { "GET",  "/hls/part.m4s", http_hls_part },
   { "GET",  "/video.h264", http_h264_video },
   { "GET",  "/video.mkv", http_mkv_video },
   { "GET",  "/video.mp4", http_mp4_video },
@@ -104,6 +162,8 @@ http_method_t http_methods[] = {
   { "POST", "/webrtc", http_webrtc_offer },
   { "GET",  "/option", camera_http_option },
   { "GET",  "/status", camera_status_json },
+  { "GET",  "/metrics", camera_http_metrics },
+  { "GET",  "/debug/trace", camera_http_debug_trace },
   { "GET",  "/", http_content, "text/html", html_index_html, 0, &html_index_html_len },
   { "OPTIONS", "*/", http_cors_options },
   { }
@@ -4,6 +4,7 @@
 #include "device/camera/camera.h"
 #include "output/rtsp/rtsp.h"
 #include "output/webrtc/webrtc.h"
+#include "output/output.h"
 #include "version.h"
 
 #include <signal.h>
@@ -15,6 +16,7 @@ extern http_server_options_t http_options;
 extern http_method_t http_methods[];
 extern rtsp_options_t rtsp_options;
 extern webrtc_options_t webrtc_options;
+extern hls_options_t hls_options;
 
 camera_t *camera;
 
@@ -87,6 +89,10 @@ int main(int argc, char *argv[])
     goto error;
   }
 
+  if (http_hls_start(&hls_options) < 0) {
+    goto error;
+  }
+
   while (true) {
     camera = camera_open(&camera_options);
     if (camera) {
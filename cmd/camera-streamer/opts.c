@@ -13,6 +13,7 @@ camera_options_t camera_options = {
   .height = 1080,
   .format = 0,
   .nbufs = 3,
+  .queue_depth = 4,
   .fps = 30,
   .allow_dma = true,
   .high_res_factor = 0.0,
@@ -28,9 +29,9 @@ camera_options_t camera_options = {
     .options = "compression_quality=80"
   },
   .video = {
-#ifdef USE_HW_H264
+#if defined(USE_HW_H264) || defined(USE_FFMPEG)
     .disabled = 0,
-#else // USE_HW_H264
+#else // USE_HW_H264 || USE_FFMPEG
     .disabled = 1,
 #endif
     .options =
@@ -47,7 +48,9 @@ camera_options_t camera_options = {
 
 http_server_options_t http_options = {
   .port = 8080,
-  .maxcons = 10
+  .maxcons = 10,
+  .stream_threads = 2,
+  .zerocopy = false
 };
 
 log_options_t log_options = {
@@ -63,6 +66,12 @@ rtsp_options_t rtsp_options = {
 webrtc_options_t webrtc_options = {
 };
 
+hls_options_t hls_options = {
+  .segment_ms = 1000,
+  .part_ms = 200,
+  .segments = 6
+};
+
 option_value_t camera_formats[] = {
   { "DEFAULT", 0 },
   { "YUYV", V4L2_PIX_FMT_YUYV },
@@ -100,6 +109,7 @@ option_t all_options[] = {
   DEFINE_OPTION(camera, height, uint, "Set the camera capture height."),
   DEFINE_OPTION_VALUES(camera, format, camera_formats, "Set the camera capture format."),
   DEFINE_OPTION(camera, nbufs, uint, "Set number of capture buffers. Preferred 2 or 3."),
+  DEFINE_OPTION(camera, queue_depth, uint, "Set number of key frames queued for each encoder or decoder."),
   DEFINE_OPTION(camera, fps, uint, "Set the desired capture framerate."),
   DEFINE_OPTION_DEFAULT(camera, allow_dma, bool, "1", "Prefer to use DMA access to reduce memory copy."),
   DEFINE_OPTION(camera, high_res_factor, float, "Set the desired high resolution output scale factor."),
@@ -108,29 +118,40 @@ option_t all_options[] = {
   DEFINE_OPTION(camera, auto_reconnect, uint, "Set the camera auto-reconnect delay in seconds."),
   DEFINE_OPTION_DEFAULT(camera, auto_focus, bool, "1", "Do auto-focus on start-up (does not work with all camera)."),
   DEFINE_OPTION_DEFAULT(camera, force_active, bool, "1", "Force camera to be always active."),
+  DEFINE_OPTION_DEFAULT(camera, threaded, bool, "1", "Service each device of the pipeline by its own thread."),
   DEFINE_OPTION_DEFAULT(camera, vflip, bool, "1", "Do vertical image flip (does not work with all camera)."),
   DEFINE_OPTION_DEFAULT(camera, hflip, bool, "1", "Do horizontal image flip (does not work with all camera)."),
 
   DEFINE_OPTION_PTR(camera, isp.options, list, "Set the ISP processing options. List all available options with `-camera-list_options`."),
+  DEFINE_OPTION_PTR(camera, decoder.options, list, "Set the JPEG/H264 decoder options. List all available options with `-camera-list_options`."),
 
   DEFINE_OPTION_PTR(camera, snapshot.options, list, "Set the JPEG compression options. List all available options with `-camera-list_options`."),
   DEFINE_OPTION(camera, snapshot.height, uint, "Override the snapshot height and maintain aspect ratio."),
+  DEFINE_OPTION(camera, snapshot.history, uint, "Keep the last N snapshot frames to answer requests from the past."),
 
   DEFINE_OPTION_DEFAULT(camera, stream.disabled, bool, "1", "Disable stream."),
   DEFINE_OPTION_PTR(camera, stream.options, list, "Set the JPEG compression options. List all available options with `-camera-list_options`."),
   DEFINE_OPTION(camera, stream.height, uint, "Override the stream height and maintain aspect ratio."),
+  DEFINE_OPTION(camera, stream.history, uint, "Keep the last N stream frames to answer requests from the past."),
 
   DEFINE_OPTION_DEFAULT(camera, video.disabled, bool, "1", "Disable video."),
   DEFINE_OPTION_PTR(camera, video.options, list, "Set the H264 encoding options. List all available options with `-camera-list_options`."),
   DEFINE_OPTION(camera, video.height, uint, "Override the video height and maintain aspect ratio."),
+  DEFINE_OPTION(camera, video.history, uint, "Keep the last N video frames to answer requests from the past."),
 
   DEFINE_OPTION_DEFAULT(camera, list_options, bool, "1", "List all available options and exit."),
 
   DEFINE_OPTION(http, port, uint, "Set the HTTP web-server port."),
-  DEFINE_OPTION(http, maxcons, uint, "Set maximum number of concurrent HTTP connections."),
+  DEFINE_OPTION(http, maxcons, uint, "Set maximum number of concurrent HTTP requests. Streams are not limited."),
+  DEFINE_OPTION(http, stream_threads, uint, "Set number of threads serving the HTTP streams."),
+  DEFINE_OPTION_DEFAULT(http, zerocopy, bool, "1", "Send stream frames with MSG_ZEROCOPY to avoid copying them into the socket."),
 
   DEFINE_OPTION_DEFAULT(rtsp, port, uint, "8554", "Set the RTSP server port (default: 8854)."),
 
+  DEFINE_OPTION(hls, segment_ms, uint, "Set the minimum duration of the HLS segments, started at key frames."),
+  DEFINE_OPTION(hls, part_ms, uint, "Set the duration of the LL-HLS partial segments."),
+  DEFINE_OPTION(hls, segments, uint, "Set the number of HLS segments kept in memory."),
+
   DEFINE_OPTION_DEFAULT(log, debug, bool, "1", "Enable debug logging."),
   DEFINE_OPTION_DEFAULT(log, verbose, bool, "1", "Enable verbose logging."),
   DEFINE_OPTION_DEFAULT(log, stats, uint, "1", "Print statistics every duration."),
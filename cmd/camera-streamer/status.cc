@@ -2,6 +2,7 @@ extern "C" {
 
 #include "util/http/http.h"
 #include "util/opts/fourcc.h"
+#include "device/buffer.h"
 #include "device/buffer_list.h"
 #include "device/buffer_lock.h"
 #include "device/camera/camera.h"
@@ -29,6 +30,12 @@ static nlohmann::json serialize_buf_list(buffer_list_t *buf_list)
   output["height"] = buf_list->fmt.height;
   output["format"] = fourcc_to_string(buf_list->fmt.format).buf;
   output["nbufs"] = buf_list->nbufs;
+  if (buf_list->last_process_time_us) {
+    output["last_process_time_us"] = buf_list->last_process_time_us;
+  }
+  if (buf_list->stats.errors) {
+    output["errors"] = buf_list->stats.errors;
+  }
 
   return output;
 }
@@ -50,9 +57,31 @@ static nlohmann::json serialize_buf_lock(buffer_lock_t *buf_lock)
     output["refs"] = buf_lock->refs;
     output["dropped"] = buf_lock->dropped;
   }
+
+  for (int i = 0; i < buf_lock->n_notify; i++) {
+    buffer_lock_notify_t *notify = buf_lock->notify[i];
+    nlohmann::json notify_json;
+    notify_json["frames"] = __atomic_load_n(&notify->frames, __ATOMIC_RELAXED);
+    notify_json["dropped"] = __atomic_load_n(&notify->dropped, __ATOMIC_RELAXED);
+    notify_json["queued"] = buffer_lock_notify_queued(notify);
+    output["notify"].push_back(notify_json);
+  }
   return output;
 }
 
+static nlohmann::json buffers_status_json()
+{
+  nlohmann::json buffers;
+
+  buffers["use_retries"] = __atomic_load_n(&buffer_refs_stats.use_retries, __ATOMIC_RELAXED);
+  buffers["use_failed"] = __atomic_load_n(&buffer_refs_stats.use_failed, __ATOMIC_RELAXED);
+  buffers["releases_inline"] = __atomic_load_n(&buffer_refs_stats.releases_inline, __ATOMIC_RELAXED);
+  buffers["releases_deferred"] = __atomic_load_n(&buffer_refs_stats.releases_deferred, __ATOMIC_RELAXED);
+  buffers["owner_wakeups"] = __atomic_load_n(&buffer_refs_stats.owner_wakeups, __ATOMIC_RELAXED);
+
+  return buffers;
+}
+
 static nlohmann::json devices_status_json()
 {
   nlohmann::json devices;
@@ -126,6 +155,7 @@ extern "C" void camera_status_json(http_worker_t *worker, FILE *stream)
   message["outputs"]["stream"] = serialize_buf_lock(&stream_lock);
   message["outputs"]["video"] = serialize_buf_lock(&video_lock);
 
+  message["buffers"] = buffers_status_json();
   message["devices"] = devices_status_json();
   message["links"] = links_status_json();
 
@@ -0,0 +1,128 @@
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+#include "util/convert/convert.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+// Converts a frame between each pair of the supported formats, with
+// the scalar and each of the supported SIMD kernels, on a single thread.
+// The SIMD output has to be the same as the scalar one.
+//
+// Usage: convert-bench [src-fourcc] [dst-fourcc]
+
+#define BENCH_TIME_US (100 * 1000)
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+static void bench_fill_frame(uint8_t *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (i + i / 1920 + (i * 7) % 13) & 0xFF;
+  }
+}
+
+static double bench_convert(convert_simd_t simd, const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt)
+{
+  uint64_t before = get_monotonic_time_us(NULL, NULL);
+  uint64_t after = before;
+  int iterations = 0;
+
+  do {
+    convert_frame_simd(simd, src, src_fmt, dst, dst_fmt);
+    after = get_monotonic_time_us(NULL, NULL);
+    iterations++;
+  } while (after - before < BENCH_TIME_US);
+
+  return (after - before) / 1000.0 / iterations;
+}
+
+static bool bench_matches(unsigned format, const char *filter)
+{
+  return !filter || !strcmp(fourcc_to_string(format).buf, filter);
+}
+
+int main(int argc, const char *argv[])
+{
+  unsigned formats[] = {
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_YVU420,
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_NV21,
+    V4L2_PIX_FMT_RGB24,
+    V4L2_PIX_FMT_BGR24,
+    V4L2_PIX_FMT_RGB565,
+    V4L2_PIX_FMT_SRGGB10P,
+    V4L2_PIX_FMT_SRGGB8,
+    V4L2_PIX_FMT_SRGGB10
+  };
+  struct {
+    unsigned width, height;
+  } sizes[] = {
+    { 1280, 720 },
+    { 1920, 1080 },
+    { 3840, 2160 },
+    { 1276, 718 } // not a multiple of the vectors
+  };
+  convert_simd_t simds[] = {
+    CONVERT_SIMD_SSE4,
+    CONVERT_SIMD_AVX2,
+    CONVERT_SIMD_NEON
+  };
+  const char *src_filter = argc > 1 ? argv[1] : NULL;
+  const char *dst_filter = argc > 2 ? argv[2] : NULL;
+  int failed = 0;
+
+  for (int i = 0; i < ARRAY_SIZE(formats); i++) {
+    for (int j = 0; j < ARRAY_SIZE(formats); j++) {
+      if (i == j || !convert_supported(formats[i], formats[j]))
+        continue;
+      if (!bench_matches(formats[i], src_filter) || !bench_matches(formats[j], dst_filter))
+        continue;
+
+      for (int k = 0; k < ARRAY_SIZE(sizes); k++) {
+        buffer_format_t src_fmt = { .width = sizes[k].width, .height = sizes[k].height, .format = formats[i] };
+        buffer_format_t dst_fmt = { .width = sizes[k].width, .height = sizes[k].height, .format = formats[j] };
+        size_t src_size = convert_frame_size(src_fmt);
+        size_t dst_size = convert_frame_size(dst_fmt);
+        uint8_t *src = malloc(src_size);
+        uint8_t *expected = calloc(1, dst_size);
+        uint8_t *dst = calloc(1, dst_size);
+        bench_fill_frame(src, src_size);
+
+        double scalar_ms = bench_convert(CONVERT_SIMD_NONE, src, src_fmt, expected, dst_fmt);
+        printf("%s => %s size=%ux%u simd=%-4s time=%.2fms rate=%.2fGB/s\n",
+          fourcc_to_string(formats[i]).buf, fourcc_to_string(formats[j]).buf,
+          sizes[k].width, sizes[k].height, convert_simd_name(CONVERT_SIMD_NONE),
+          scalar_ms, (src_size + dst_size) / scalar_ms / 1e6);
+
+        for (int s = 0; s < ARRAY_SIZE(simds); s++) {
+          if (!convert_simd_supported(simds[s]))
+            continue;
+
+          memset(dst, 0, dst_size);
+          double simd_ms = bench_convert(simds[s], src, src_fmt, dst, dst_fmt);
+          bool same = !memcmp(dst, expected, dst_size);
+          failed += !same;
+
+          printf("%s => %s size=%ux%u simd=%-4s time=%.2fms rate=%.2fGB/s speedup=%.1fx %s\n",
+            fourcc_to_string(formats[i]).buf, fourcc_to_string(formats[j]).buf,
+            sizes[k].width, sizes[k].height, convert_simd_name(simds[s]),
+            simd_ms, (src_size + dst_size) / simd_ms / 1e6, scalar_ms / simd_ms,
+            same ? "same" : "DIFFERENT");
+        }
+
+        free(dst);
+        free(expected);
+        free(src);
+      }
+    }
+  }
+
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,198 @@
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "device/links.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+// Runs the dummy camera feeding each of the software encoders through
+// `links_loop` at 720p and 1080p: once with the camera way faster than
+// the encoder to measure the fps, and once paced at 30fps to measure
+// the latency of a frame from capture to the encoded buffer, and the time
+// spent encoding it.
+
+#define BENCH_DURATION_US (3*1000*1000)
+#define BENCH_MAX_FPS 1000
+#define BENCH_PACED_FPS 30
+#define BENCH_MAX_FRAMES 1024
+#define BENCH_CAMERA_BUFFERS 4
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+typedef struct bench_stats_s {
+  int frames;
+  uint64_t latency_us[BENCH_MAX_FRAMES];
+  uint64_t process_us[BENCH_MAX_FRAMES];
+} bench_stats_t;
+
+static bench_stats_t bench_stats;
+static bool bench_running;
+
+static void bench_on_buffer(buffer_t *buf)
+{
+  if (bench_stats.frames < BENCH_MAX_FRAMES) {
+    bench_stats.latency_us[bench_stats.frames] = get_monotonic_time_us(NULL, NULL) - buf->captured_time_us;
+    bench_stats.process_us[bench_stats.frames] = buf->buf_list->last_process_time_us;
+  }
+  bench_stats.frames++;
+}
+
+static void *bench_links_thread(link_t *links)
+{
+  return (void*)(intptr_t)links_loop(links, true, false, &bench_running);
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint64_t bench_percentile(uint64_t *values, int n, int percentile)
+{
+  return n ? values[n * percentile / 100] : 0;
+}
+
+// A static frame: a gradient with some texture
+static int bench_write_frame(const char *path, unsigned width, unsigned height)
+{
+  size_t size = width * height * 2;
+  uint8_t *data = malloc(size);
+
+  for (unsigned y = 0; y < height; y++) {
+    uint8_t *line = data + y * width * 2;
+    for (unsigned x = 0; x < width; x++) {
+      line[x * 2] = (x + y + (x * y) % 31) & 0xFF;
+      line[x * 2 + 1] = x & 1 ? (y / 4) & 0xFF : (x / 8) & 0xFF;
+    }
+  }
+
+  FILE *f = fopen(path, "wb");
+  size_t written = f ? fwrite(data, 1, size, f) : 0;
+  if (f)
+    fclose(f);
+  free(data);
+  return written == size ? 0 : -1;
+}
+
+static void bench_run(const char *codec, unsigned capture_format, const char *frame_path, unsigned width, unsigned height, int fps)
+{
+  char path[64];
+  sprintf(path, "software:%s", codec);
+
+  device_t *camera = device_dummy_open("CAMERA", frame_path);
+  device_t *encoder = device_software_open("ENCODER", path);
+
+  if (!camera || !encoder) {
+    printf("codec=%s: not available\n", codec);
+    goto error;
+  }
+
+  buffer_format_t fmt = {
+    .width = width,
+    .height = height,
+    .format = V4L2_PIX_FMT_YUYV,
+    .bytesperline = width * 2,
+    .nbufs = BENCH_CAMERA_BUFFERS,
+    .interval_us = 1000 * 1000 / fps
+  };
+
+  buffer_list_t *camera_capture = device_open_buffer_list(camera, true, fmt, true);
+  buffer_list_t *encoder_output = device_open_buffer_list_output(encoder, camera_capture);
+  buffer_list_t *encoder_capture = device_open_buffer_list_capture2(encoder, NULL, encoder_output, capture_format, true);
+
+  if (!camera_capture || !encoder_output || !encoder_capture) {
+    printf("codec=%s: cannot open buffers\n", codec);
+    goto error;
+  }
+
+  camera_capture->do_timestamps = true;
+
+  link_t links[3];
+  memset(links, 0, sizeof(links));
+  links[0].capture_list = camera_capture;
+  links[0].output_lists[links[0].n_output_lists++] = encoder_output;
+  links[1].capture_list = encoder_capture;
+  links[1].callbacks[links[1].n_callbacks++] = (link_callbacks_t){ .name = "BENCH", .on_buffer = bench_on_buffer };
+
+  pthread_t thread;
+  void *ret = NULL;
+
+  memset(&bench_stats, 0, sizeof(bench_stats));
+  bench_running = true;
+  pthread_create(&thread, NULL, (void *(*)(void *))bench_links_thread, links);
+  usleep(BENCH_DURATION_US);
+  bench_running = false;
+  pthread_join(thread, &ret);
+
+  int n = MIN(bench_stats.frames, BENCH_MAX_FRAMES);
+  qsort(bench_stats.latency_us, n, sizeof(uint64_t), bench_compare_u64);
+  qsort(bench_stats.process_us, n, sizeof(uint64_t), bench_compare_u64);
+
+  printf("codec=%-4s size=%ux%u camera_fps=%-4d ret=%d fps=%.1f dropped=%d "
+    "encode_p50=%" PRIu64 "us encode_p99=%" PRIu64 "us latency_p50=%" PRIu64 "us latency_p99=%" PRIu64 "us\n",
+    codec, width, height, fps, (int)(intptr_t)ret,
+    bench_stats.frames * 1e6f / BENCH_DURATION_US,
+    camera_capture->stats.dropped,
+    bench_percentile(bench_stats.process_us, n, 50),
+    bench_percentile(bench_stats.process_us, n, 99),
+    bench_percentile(bench_stats.latency_us, n, 50),
+    bench_percentile(bench_stats.latency_us, n, 99));
+
+  device_set_stream(encoder, false);
+  device_set_stream(camera, false);
+
+error:
+  device_close(encoder);
+  device_close(camera);
+}
+
+int main(int argc, const char *argv[])
+{
+  struct {
+    const char *codec;
+    unsigned format;
+  } codecs[] = {
+    { "jpeg", V4L2_PIX_FMT_JPEG },
+    { "h264", V4L2_PIX_FMT_H264 }
+  };
+  struct {
+    unsigned width, height;
+  } sizes[] = {
+    { 1280, 720 },
+    { 1920, 1080 }
+  };
+
+  char frame_path[] = "/tmp/encoder-bench-XXXXXX";
+  int fd = mkstemp(frame_path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return -1;
+  }
+  close(fd);
+
+  for (int i = 0; i < ARRAY_SIZE(sizes); i++) {
+    if (bench_write_frame(frame_path, sizes[i].width, sizes[i].height) < 0) {
+      perror("write");
+      break;
+    }
+
+    for (int j = 0; j < ARRAY_SIZE(codecs); j++) {
+      bench_run(codecs[j].codec, codecs[j].format, frame_path, sizes[i].width, sizes[i].height, BENCH_MAX_FPS);
+      bench_run(codecs[j].codec, codecs[j].format, frame_path, sizes[i].width, sizes[i].height, BENCH_PACED_FPS);
+    }
+  }
+
+  unlink(frame_path);
+  return 0;
+}
@@ -0,0 +1,312 @@
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "device/links.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+// Runs a camera feeding a few emulated M2M encoders through `links_loop`,
+// once serviced by a single thread and once by a thread per device.
+// The encoders process asynchronously, like the hardware does, and each
+// encoder link has a slow callback, like WebRTC packetization.
+
+#define BENCH_FPS 120
+#define BENCH_GOP 30
+#define BENCH_ENCODERS 3
+#define BENCH_ENCODE_US 4000
+#define BENCH_CALLBACK_US 3000
+#define BENCH_DURATION_US (3*1000*1000)
+#define BENCH_MAX_FRAMES 1024
+#define BENCH_CAMERA_BUFFERS 4
+#define BENCH_ENCODER_BUFFERS 2
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+typedef struct bench_device_s {
+  device_t dev;
+  int capture_fds[2], output_fds[2];
+
+  pthread_t worker;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool running;
+  buffer_t *pending_outputs[MAX_BUFFER_LIST_BUFS];
+  buffer_t *pending_captures[MAX_BUFFER_LIST_BUFS];
+  int n_pending_outputs, n_pending_captures;
+
+  int frames;
+  uint64_t latency_us[BENCH_MAX_FRAMES];
+} bench_device_t;
+
+static char bench_data[4096];
+
+static void bench_pop(buffer_t **bufs, int *n)
+{
+  memmove(&bufs[0], &bufs[1], --(*n) * sizeof(buffer_t*));
+}
+
+static int bench_buffer_enqueue(buffer_t *buf, const char *who)
+{
+  bench_device_t *bench = (bench_device_t*)buf->buf_list->dev;
+  unsigned index = buf->index;
+
+  // The camera captures as soon as the buffer is enqueued, paced by `interval_us`
+  if (!bench->dev.output_list) {
+    return write(bench->capture_fds[1], &index, sizeof(index)) == sizeof(index) ? 0 : -1;
+  }
+
+  pthread_mutex_lock(&bench->lock);
+  if (buf->buf_list->do_capture) {
+    bench->pending_captures[bench->n_pending_captures++] = buf;
+  } else {
+    bench->pending_outputs[bench->n_pending_outputs++] = buf;
+  }
+  pthread_cond_signal(&bench->cond);
+  pthread_mutex_unlock(&bench->lock);
+  return 0;
+}
+
+static int bench_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp)
+{
+  bench_device_t *bench = (bench_device_t*)buf_list->dev;
+  int fd = buf_list->do_capture ? bench->capture_fds[0] : bench->output_fds[0];
+  unsigned index;
+
+  if (read(fd, &index, sizeof(index)) != sizeof(index) || index >= (unsigned)buf_list->nbufs) {
+    return -1;
+  }
+
+  *bufp = buf_list->bufs[index];
+
+  if (!bench->dev.output_list) {
+    (*bufp)->captured_time_us = get_monotonic_time_us(NULL, NULL);
+    (*bufp)->flags.is_keyframe = buf_list->stats.frames % BENCH_GOP == 0;
+  }
+  return 0;
+}
+
+static int bench_buffer_list_pollfd(buffer_list_t *buf_list, struct pollfd *pollfd, bool can_dequeue)
+{
+  bench_device_t *bench = (bench_device_t*)buf_list->dev;
+
+  pollfd->fd = buf_list->do_capture ? bench->capture_fds[0] : bench->output_fds[0];
+  pollfd->events = POLLHUP;
+  if (can_dequeue && buffer_list_count_enqueued(buf_list) > 0) {
+    pollfd->events |= POLLIN;
+  }
+  pollfd->revents = 0;
+  return 0;
+}
+
+static int bench_buffer_list_set_stream(buffer_list_t *buf_list, bool do_on)
+{
+  return 0;
+}
+
+static device_hw_t bench_hw = {
+  .buffer_enqueue = bench_buffer_enqueue,
+  .buffer_list_dequeue = bench_buffer_list_dequeue,
+  .buffer_list_pollfd = bench_buffer_list_pollfd,
+  .buffer_list_set_stream = bench_buffer_list_set_stream
+};
+
+static void *bench_encoder_thread(bench_device_t *bench)
+{
+  while (1) {
+    pthread_mutex_lock(&bench->lock);
+    while (bench->running && (!bench->n_pending_outputs || !bench->n_pending_captures)) {
+      pthread_cond_wait(&bench->cond, &bench->lock);
+    }
+    if (!bench->running) {
+      pthread_mutex_unlock(&bench->lock);
+      break;
+    }
+
+    buffer_t *output = bench->pending_outputs[0];
+    buffer_t *capture = bench->pending_captures[0];
+    bench_pop(bench->pending_outputs, &bench->n_pending_outputs);
+    bench_pop(bench->pending_captures, &bench->n_pending_captures);
+    pthread_mutex_unlock(&bench->lock);
+
+    usleep(BENCH_ENCODE_US);
+
+    capture->captured_time_us = output->captured_time_us;
+    capture->used = output->used;
+
+    unsigned index = output->index;
+    if (write(bench->output_fds[1], &index, sizeof(index)) != sizeof(index)) {
+      break;
+    }
+    index = capture->index;
+    if (write(bench->capture_fds[1], &index, sizeof(index)) != sizeof(index)) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+static buffer_list_t *bench_open_buffer_list(bench_device_t *bench, const char *name, bool do_capture, bool do_mmap, int nbufs)
+{
+  buffer_list_t *buf_list = calloc(1, sizeof(buffer_list_t));
+  buf_list->name = strdup(name);
+  buf_list->dev = &bench->dev;
+  buf_list->do_capture = do_capture;
+  buf_list->do_mmap = do_mmap;
+  buf_list->queue_depth = MAX_BUFFER_QUEUE;
+  buf_list->nbufs = nbufs;
+  buf_list->bufs = calloc(nbufs, sizeof(buffer_t*));
+
+  for (int i = 0; i < nbufs; i++) {
+    buffer_t *buf = calloc(1, sizeof(buffer_t));
+    buf->name = buf_list->name;
+    buf->buf_list = buf_list;
+    buf->index = i;
+    buf->start = bench_data;
+    buf->used = buf->length = sizeof(bench_data);
+    buf->mmap_reflinks = 1;
+    buf_list->bufs[i] = buf;
+  }
+
+  return buf_list;
+}
+
+static bench_device_t *bench_open_device(const char *name, bool m2m)
+{
+  bench_device_t *bench = calloc(1, sizeof(bench_device_t));
+  bench->dev.name = strdup(name);
+  bench->dev.hw = &bench_hw;
+  bench->dev.capture_lists = calloc(1, sizeof(buffer_list_t*));
+  bench->dev.n_capture_list = 1;
+
+  if (pipe2(bench->capture_fds, O_CLOEXEC) < 0 || pipe2(bench->output_fds, O_CLOEXEC) < 0) {
+    LOG_PERROR(NULL, "Cannot open pipes");
+  }
+
+  if (!m2m) {
+    bench->dev.capture_lists[0] = bench_open_buffer_list(bench, name, true, true, BENCH_CAMERA_BUFFERS);
+    bench->dev.capture_lists[0]->fmt.format = V4L2_PIX_FMT_H264;
+    bench->dev.capture_lists[0]->fmt.interval_us = 1000 * 1000 / BENCH_FPS;
+    return bench;
+  }
+
+  bench->dev.output_list = bench_open_buffer_list(bench, name, false, false, BENCH_ENCODER_BUFFERS);
+  bench->dev.capture_lists[0] = bench_open_buffer_list(bench, name, true, true, BENCH_ENCODER_BUFFERS);
+
+  pthread_mutex_init(&bench->lock, NULL);
+  pthread_cond_init(&bench->cond, NULL);
+  bench->running = true;
+  pthread_create(&bench->worker, NULL, (void *(*)(void *))bench_encoder_thread, bench);
+  return bench;
+}
+
+static void bench_close_device(bench_device_t *bench)
+{
+  if (bench->dev.output_list) {
+    pthread_mutex_lock(&bench->lock);
+    bench->running = false;
+    pthread_cond_broadcast(&bench->cond);
+    pthread_mutex_unlock(&bench->lock);
+    pthread_join(bench->worker, NULL);
+  }
+}
+
+static bench_device_t *bench_devices[BENCH_ENCODERS + 1];
+
+static void bench_on_buffer(buffer_t *buf)
+{
+  bench_device_t *bench = (bench_device_t*)buf->buf_list->dev;
+
+  if (bench->frames < BENCH_MAX_FRAMES) {
+    bench->latency_us[bench->frames] = get_monotonic_time_us(NULL, NULL) - buf->captured_time_us;
+  }
+  bench->frames++;
+
+  if (bench->dev.output_list) {
+    usleep(BENCH_CALLBACK_US);
+  }
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static bool bench_running, bench_threaded;
+
+static void *bench_links_thread(link_t *links)
+{
+  return (void*)(intptr_t)links_loop(links, true, bench_threaded, &bench_running);
+}
+
+static void bench_run(bool threaded)
+{
+  link_t links[BENCH_ENCODERS + 2];
+  memset(links, 0, sizeof(links));
+
+  bench_devices[0] = bench_open_device("CAMERA", false);
+  links[0].capture_list = bench_devices[0]->dev.capture_lists[0];
+  links[0].callbacks[links[0].n_callbacks++] = (link_callbacks_t){ .name = "CAMERA-CALLBACK", .on_buffer = bench_on_buffer };
+
+  for (int i = 1; i <= BENCH_ENCODERS; i++) {
+    char name[32];
+    sprintf(name, "ENCODER%d", i);
+    bench_devices[i] = bench_open_device(name, true);
+
+    links[0].output_lists[links[0].n_output_lists++] = bench_devices[i]->dev.output_list;
+    links[i].capture_list = bench_devices[i]->dev.capture_lists[0];
+    links[i].callbacks[links[i].n_callbacks++] = (link_callbacks_t){ .name = "ENCODER-CALLBACK", .on_buffer = bench_on_buffer };
+  }
+
+  pthread_t thread;
+  void *ret = NULL;
+
+  bench_running = true;
+  bench_threaded = threaded;
+  pthread_create(&thread, NULL, (void *(*)(void *))bench_links_thread, links);
+  usleep(BENCH_DURATION_US);
+  bench_running = false;
+  pthread_join(thread, &ret);
+
+  int frames = 0;
+  uint64_t *all = calloc(BENCH_ENCODERS * BENCH_MAX_FRAMES, sizeof(uint64_t));
+
+  for (int i = 1; i <= BENCH_ENCODERS; i++) {
+    int n = MIN(bench_devices[i]->frames, BENCH_MAX_FRAMES);
+    memcpy(&all[frames], bench_devices[i]->latency_us, n * sizeof(uint64_t));
+    frames += n;
+    bench_close_device(bench_devices[i]);
+  }
+
+  qsort(all, frames, sizeof(uint64_t), bench_compare_u64);
+
+  printf("mode=%-6s ret=%d camera_fps=%.1f dropped=%d encoder_fps=%.1f latency_p50=%" PRIu64 "us latency_p99=%" PRIu64 "us\n",
+    threaded ? "thread" : "single", (int)(intptr_t)ret,
+    bench_devices[0]->frames * 1e6f / BENCH_DURATION_US,
+    bench_devices[0]->dev.capture_lists[0]->stats.dropped,
+    frames * 1e6f / BENCH_DURATION_US / BENCH_ENCODERS,
+    frames ? all[frames / 2] : 0,
+    frames ? all[frames * 99 / 100] : 0);
+
+  free(all);
+}
+
+int main(int argc, const char *argv[])
+{
+  bench_run(false);
+  bench_run(true);
+  return 0;
+}
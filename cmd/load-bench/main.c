@@ -0,0 +1,835 @@
+#include "util/opts/log.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// Starts camera-streamer with the dummy camera, and opens the clients
+// of `/stream`, `/snapshot`, `/video.h264` and `/video.mp4` over loopback.
+// After the warmup it measures for each client the delivered fps, and the
+// latency from the capture to the socket of the frames carrying
+// the `X-Timestamp`, and for the camera-streamer the CPU of each thread
+// and the RSS. The results are written as JSON.
+//
+// The snapshots are requested one after another, each waiting for a new frame.
+//
+// Usage: load-bench [options] [-- camera-streamer options]
+
+#define BENCH_MAX_CLIENTS 256
+#define BENCH_MAX_THREADS 128
+#define BENCH_MAX_HEADER 4096
+#define BENCH_READ_SIZE 65536
+#define BENCH_RECONNECT_US (100 * 1000)
+#define BENCH_STARTUP_US (10 * 1000 * 1000)
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+typedef enum {
+  BENCH_STREAM = 0,
+  BENCH_SNAPSHOT,
+  BENCH_H264,
+  BENCH_MP4,
+  BENCH_TYPES
+} bench_type_t;
+
+static const char *const bench_type_names[BENCH_TYPES] = { "stream", "snapshot", "video.h264", "video.mp4" };
+static const char *const bench_type_paths[BENCH_TYPES] = { "/stream", "/snapshot?max_delay=0", "/video.h264", "/video.mp4" };
+
+typedef enum {
+  BENCH_HEADER = 0,
+  BENCH_BODY,
+  BENCH_ANNEXB,
+  BENCH_BOXES
+} bench_state_t;
+
+typedef struct bench_client_s {
+  bench_type_t type;
+  int id;
+  int fd;
+  uint64_t reconnect_at_us;
+
+  bench_state_t state;
+  char header[BENCH_MAX_HEADER];
+  size_t header_len;
+  size_t remaining;
+  double timestamp;
+
+  // the Annex-B parser: the number of zeros, and the bytes after the start code
+  int zeros;
+  int nal_bytes;
+  int nal_type;
+
+  // the MP4 parser: the box header
+  uint8_t box[16];
+  int box_len;
+
+  // the measured values
+  int frames;
+  uint64_t bytes;
+  int errors;
+  int reconnects;
+  uint32_t *latency_us;
+  int n_latency, max_latency;
+} bench_client_t;
+
+typedef struct bench_thread_s {
+  int tid;
+  char name[32];
+  uint64_t ticks;
+} bench_thread_t;
+
+static struct {
+  const char *binary;
+  const char *log;
+  const char *output;
+  int port;
+  int duration;
+  int warmup;
+  int fps;
+  int clients[BENCH_TYPES];
+  char **extra_args;
+  int n_extra_args;
+} bench_options = {
+  .binary = "./camera-streamer",
+  .log = "/dev/null",
+  .output = NULL,
+  .port = 18090,
+  .duration = 10,
+  .warmup = 2,
+  .fps = 30,
+  .clients = { 4, 1, 1, 0 }
+};
+
+static bench_client_t bench_clients[BENCH_MAX_CLIENTS];
+static int bench_n_clients;
+static int bench_epoll_fd = -1;
+
+/* The clients */
+
+static void bench_client_close(bench_client_t *client, bool immediately)
+{
+  if (client->fd >= 0) {
+    epoll_ctl(bench_epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    client->fd = -1;
+  }
+
+  client->reconnect_at_us = get_monotonic_time_us(NULL, NULL) + (immediately ? 0 : BENCH_RECONNECT_US);
+}
+
+static int bench_client_connect(bench_client_t *client, const char *path)
+{
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = htons(bench_options.port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+  };
+  char request[256];
+
+  client->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (client->fd < 0) {
+    return -1;
+  }
+
+  if (connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    goto error;
+  }
+
+  int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", path);
+  if (write(client->fd, request, len) != len) {
+    goto error;
+  }
+
+  fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+
+  struct epoll_event event = { .events = EPOLLIN, .data.ptr = client };
+  if (epoll_ctl(bench_epoll_fd, EPOLL_CTL_ADD, client->fd, &event) < 0) {
+    goto error;
+  }
+
+  client->state = BENCH_HEADER;
+  client->header_len = 0;
+  client->zeros = 0;
+  client->nal_bytes = 0;
+  client->box_len = 0;
+  return 0;
+
+error:
+  close(client->fd);
+  client->fd = -1;
+  return -1;
+}
+
+static void bench_client_frame(bench_client_t *client, bool has_timestamp)
+{
+  client->frames++;
+
+  if (!has_timestamp || client->timestamp <= 0) {
+    return;
+  }
+
+  uint64_t now_us = get_monotonic_time_us(NULL, NULL);
+  uint64_t captured_us = client->timestamp * 1000.0 * 1000.0;
+
+  if (client->n_latency == client->max_latency) {
+    client->max_latency = MAX(client->max_latency * 2, 256);
+    client->latency_us = realloc(client->latency_us, client->max_latency * sizeof(uint32_t));
+  }
+  client->latency_us[client->n_latency++] = now_us > captured_us ? now_us - captured_us : 0;
+}
+
+// Returns false when the response is not accepted
+static bool bench_client_header(bench_client_t *client)
+{
+  char *header = client->header;
+  char *value;
+
+  header[client->header_len] = 0;
+  client->remaining = 0;
+  client->timestamp = 0;
+
+  if (!strncmp(header, "HTTP/", 5)) {
+    char *status = strchr(header, ' ');
+    if (!status || atoi(status + 1) != 200) {
+      return false;
+    }
+
+    if (client->type == BENCH_H264) {
+      client->state = BENCH_ANNEXB;
+      return true;
+    } else if (client->type == BENCH_MP4) {
+      client->state = BENCH_BOXES;
+      return true;
+    }
+  }
+
+  if ((value = strcasestr(header, "\r\nContent-Length:")) != NULL) {
+    client->remaining = strtoull(value + 17, NULL, 10);
+  }
+  if ((value = strcasestr(header, "\r\nX-Timestamp:")) != NULL) {
+    client->timestamp = strtod(value + 14, NULL);
+  }
+
+  if (client->remaining > 0) {
+    client->state = BENCH_BODY;
+  } else if (client->type == BENCH_SNAPSHOT) {
+    return false;
+  }
+  return true;
+}
+
+// Counts the first slices of the pictures
+static void bench_client_annexb(bench_client_t *client, const uint8_t *data, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    uint8_t byte = data[i];
+
+    if (client->nal_bytes == 1) {
+      client->nal_type = byte & 0x1F;
+      client->nal_bytes++;
+    } else if (client->nal_bytes == 2) {
+      if ((client->nal_type == 1 || client->nal_type == 5) && (byte & 0x80)) {
+        bench_client_frame(client, false);
+      }
+      client->nal_bytes = 0;
+    }
+
+    if (byte == 0) {
+      client->zeros++;
+    } else {
+      if (byte == 1 && client->zeros >= 2) {
+        client->nal_bytes = 1;
+      }
+      client->zeros = 0;
+    }
+  }
+}
+
+// Counts the `moof` boxes, the fragments
+static size_t bench_client_boxes(bench_client_t *client, const uint8_t *data, size_t n)
+{
+  size_t used = 0;
+
+  while (used < n) {
+    if (client->remaining > 0) {
+      size_t skip = MIN(client->remaining, n - used);
+      client->remaining -= skip;
+      used += skip;
+      continue;
+    }
+
+    client->box[client->box_len++] = data[used++];
+    if (client->box_len < 8) {
+      continue;
+    }
+
+    uint64_t size = (uint32_t)client->box[0] << 24 | client->box[1] << 16 | client->box[2] << 8 | client->box[3];
+    if (size == 1) {
+      // the 64-bit size follows the type
+      if (client->box_len < 16) {
+        continue;
+      }
+      size = 0;
+      for (int i = 8; i < 16; i++) {
+        size = size << 8 | client->box[i];
+      }
+    }
+
+    if (!memcmp(client->box + 4, "moof", 4)) {
+      bench_client_frame(client, false);
+    }
+
+    client->remaining = size > (uint64_t)client->box_len ? size - client->box_len : 0;
+    client->box_len = 0;
+  }
+
+  return used;
+}
+
+// Returns false when the connection has to be closed
+static bool bench_client_data(bench_client_t *client, const uint8_t *data, size_t n)
+{
+  client->bytes += n;
+
+  while (n > 0) {
+    size_t used = 0;
+
+    switch (client->state) {
+    case BENCH_HEADER:
+      while (used < n && client->header_len < BENCH_MAX_HEADER - 1) {
+        client->header[client->header_len++] = data[used++];
+
+        if (client->header_len >= 4 && !memcmp(client->header + client->header_len - 4, "\r\n\r\n", 4)) {
+          if (!bench_client_header(client)) {
+            return false;
+          }
+          client->header_len = 0;
+          break;
+        }
+      }
+
+      if (client->header_len >= BENCH_MAX_HEADER - 1) {
+        return false;
+      }
+      break;
+
+    case BENCH_BODY:
+      used = MIN(client->remaining, n);
+      client->remaining -= used;
+
+      if (!client->remaining) {
+        bench_client_frame(client, true);
+        client->state = BENCH_HEADER;
+
+        // a single snapshot per request
+        if (client->type == BENCH_SNAPSHOT) {
+          return false;
+        }
+      }
+      break;
+
+    case BENCH_ANNEXB:
+      bench_client_annexb(client, data, n);
+      used = n;
+      break;
+
+    case BENCH_BOXES:
+      used = bench_client_boxes(client, data, n);
+      break;
+    }
+
+    data += used;
+    n -= used;
+  }
+
+  return true;
+}
+
+static void bench_client_read(bench_client_t *client)
+{
+  static uint8_t data[BENCH_READ_SIZE];
+
+  while (client->fd >= 0) {
+    ssize_t n = read(client->fd, data, sizeof(data));
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+
+    if (n <= 0) {
+      client->reconnects++;
+      bench_client_close(client, false);
+      return;
+    }
+
+    int frames = client->frames;
+    if (!bench_client_data(client, data, n)) {
+      // the snapshots are requested again once received
+      bool complete = client->type == BENCH_SNAPSHOT && client->frames > frames;
+      if (!complete) {
+        client->errors++;
+      }
+      bench_client_close(client, complete);
+      return;
+    }
+  }
+}
+
+static void bench_clients_loop(uint64_t until_us)
+{
+  struct epoll_event events[64];
+
+  while (true) {
+    uint64_t now_us = get_monotonic_time_us(NULL, NULL);
+    if (now_us >= until_us) {
+      break;
+    }
+
+    for (int i = 0; i < bench_n_clients; i++) {
+      bench_client_t *client = &bench_clients[i];
+
+      if (client->fd < 0 && client->reconnect_at_us <= now_us && bench_client_connect(client, bench_type_paths[client->type]) < 0) {
+        client->errors++;
+        client->reconnect_at_us = now_us + BENCH_RECONNECT_US;
+      }
+    }
+
+    int n = epoll_wait(bench_epoll_fd, events, ARRAY_SIZE(events), 10);
+    for (int i = 0; i < n; i++) {
+      bench_client_read(events[i].data.ptr);
+    }
+  }
+}
+
+static void bench_clients_reset()
+{
+  for (int i = 0; i < bench_n_clients; i++) {
+    bench_clients[i].frames = 0;
+    bench_clients[i].bytes = 0;
+    bench_clients[i].errors = 0;
+    bench_clients[i].reconnects = 0;
+    bench_clients[i].n_latency = 0;
+  }
+}
+
+/* The camera-streamer process */
+
+static pid_t bench_start_server()
+{
+  char port[32], fps[32];
+  char *args[64];
+  int n = 0;
+
+  sprintf(port, "--http-port=%d", bench_options.port);
+  sprintf(fps, "--camera-fps=%d", bench_options.fps);
+
+  args[n++] = (char *)bench_options.binary;
+  args[n++] = "--camera-type=dummy";
+  args[n++] = "--camera-path=tests/capture.jpeg";
+  args[n++] = "--camera-format=JPEG";
+  args[n++] = "--camera-width=1920";
+  args[n++] = "--camera-height=1080";
+  args[n++] = fps;
+  args[n++] = port;
+
+  // the later options override the defaults
+  for (int i = 0; i < bench_options.n_extra_args && n < ARRAY_SIZE(args) - 1; i++) {
+    args[n++] = bench_options.extra_args[i];
+  }
+  args[n] = NULL;
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    int fd = open(bench_options.log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+    execv(args[0], args);
+    _exit(127);
+  }
+
+  return pid;
+}
+
+// Waits until the camera-streamer accepts the connections
+static int bench_wait_server(pid_t pid)
+{
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_port = htons(bench_options.port),
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+  };
+  uint64_t until_us = get_monotonic_time_us(NULL, NULL) + BENCH_STARTUP_US;
+
+  while (get_monotonic_time_us(NULL, NULL) < until_us) {
+    if (waitpid(pid, NULL, WNOHANG) == pid) {
+      return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int ret = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    close(fd);
+
+    if (ret == 0) {
+      return 0;
+    }
+    usleep(50 * 1000);
+  }
+
+  return -1;
+}
+
+// Reads the `utime` and `stime` of each thread
+static int bench_read_threads(pid_t pid, bench_thread_t *threads, int max_threads)
+{
+  char path[PATH_MAX];
+  int n = 0;
+
+  sprintf(path, "/proc/%d/task", pid);
+  DIR *dir = opendir(path);
+  if (!dir) {
+    return 0;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL && n < max_threads) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    char stat[512];
+    snprintf(path, sizeof(path), "/proc/%d/task/%s/stat", pid, entry->d_name);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+      continue;
+    }
+    size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[len] = 0;
+
+    // the name is in the parentheses, and can contain spaces
+    char *name = strchr(stat, '(');
+    char *end = strrchr(stat, ')');
+    if (!name || !end) {
+      continue;
+    }
+
+    bench_thread_t *thread = &threads[n++];
+    thread->tid = atoi(entry->d_name);
+    snprintf(thread->name, sizeof(thread->name), "%.*s", (int)(end - name - 1), name + 1);
+
+    // the `utime` and `stime` are the 12th and 13th after the name
+    unsigned long utime = 0, stime = 0;
+    sscanf(end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime);
+    thread->ticks = utime + stime;
+  }
+
+  closedir(dir);
+  return n;
+}
+
+static long bench_read_memory(pid_t pid, const char *key)
+{
+  char path[64], line[256];
+  long value = -1;
+
+  sprintf(path, "/proc/%d/status", pid);
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), f)) {
+    if (!strncmp(line, key, strlen(key))) {
+      value = atol(line + strlen(key) + 1);
+      break;
+    }
+  }
+
+  fclose(f);
+  return value;
+}
+
+// Returns the body of `/status`, or NULL
+static char *bench_read_status()
+{
+  bench_client_t client = { .fd = -1 };
+  char *body = NULL;
+  size_t len = 0;
+  uint8_t data[4096];
+
+  if (bench_client_connect(&client, "/status") < 0) {
+    return NULL;
+  }
+
+  epoll_ctl(bench_epoll_fd, EPOLL_CTL_DEL, client.fd, NULL);
+  fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL) & ~O_NONBLOCK);
+
+  ssize_t n;
+  while ((n = read(client.fd, data, sizeof(data))) > 0) {
+    body = realloc(body, len + n + 1);
+    memcpy(body + len, data, n);
+    len += n;
+    body[len] = 0;
+  }
+  close(client.fd);
+
+  char *start = body ? strstr(body, "\r\n\r\n") : NULL;
+  if (!start || start[4] != '{') {
+    free(body);
+    return NULL;
+  }
+
+  memmove(body, start + 4, strlen(start + 4) + 1);
+  return body;
+}
+
+/* The results */
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double bench_percentile_ms(uint32_t *values, int n, int percentile)
+{
+  return n ? values[MIN(n * percentile / 100, n - 1)] / 1000.0 : 0;
+}
+
+static void bench_write_latency(FILE *f, uint32_t *values, int n)
+{
+  qsort(values, n, sizeof(uint32_t), bench_compare_u32);
+  fprintf(f, "{\"samples\": %d, \"p50_ms\": %.2f, \"p95_ms\": %.2f, \"p99_ms\": %.2f, \"max_ms\": %.2f}",
+    n,
+    bench_percentile_ms(values, n, 50),
+    bench_percentile_ms(values, n, 95),
+    bench_percentile_ms(values, n, 99),
+    n ? values[n - 1] / 1000.0 : 0);
+}
+
+static void bench_write_results(FILE *f, pid_t pid, bench_thread_t *before, int n_before, bench_thread_t *after, int n_after, double seconds, char *status)
+{
+  long ticks_per_second = sysconf(_SC_CLK_TCK);
+  uint64_t total_ticks = 0;
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"duration_s\": %.2f,\n", seconds);
+  fprintf(f, "  \"camera_fps\": %d,\n", bench_options.fps);
+
+  fprintf(f, "  \"clients\": [\n");
+  for (int i = 0; i < bench_n_clients; i++) {
+    bench_client_t *client = &bench_clients[i];
+    int expected = bench_options.fps * seconds;
+
+    // the snapshots are requested one after another
+    int dropped = client->type == BENCH_SNAPSHOT ? 0 : MAX(expected - client->frames, 0);
+
+    fprintf(f, "    {\"type\": \"%s\", \"id\": %d, \"frames\": %d, \"fps\": %.2f, \"dropped\": %d, "
+      "\"bytes\": %" PRIu64 ", \"mbps\": %.2f, \"errors\": %d, \"reconnects\": %d, \"latency\": ",
+      bench_type_names[client->type], client->id, client->frames, client->frames / seconds, dropped,
+      client->bytes, client->bytes * 8 / seconds / 1e6, client->errors, client->reconnects);
+    bench_write_latency(f, client->latency_us, client->n_latency);
+    fprintf(f, "}%s\n", i + 1 < bench_n_clients ? "," : "");
+  }
+  fprintf(f, "  ],\n");
+
+  // all the latencies of each type of the clients
+  fprintf(f, "  \"summary\": {\n");
+  for (int type = 0; type < BENCH_TYPES; type++) {
+    uint32_t *values = NULL;
+    int n = 0, clients = 0, frames = 0;
+
+    for (int i = 0; i < bench_n_clients; i++) {
+      bench_client_t *client = &bench_clients[i];
+      if (client->type != type) {
+        continue;
+      }
+      values = realloc(values, (n + client->n_latency + 1) * sizeof(uint32_t));
+      memcpy(values + n, client->latency_us, client->n_latency * sizeof(uint32_t));
+      n += client->n_latency;
+      frames += client->frames;
+      clients++;
+    }
+
+    fprintf(f, "    \"%s\": {\"clients\": %d, \"fps_per_client\": %.2f, \"latency\": ",
+      bench_type_names[type], clients, clients ? frames / seconds / clients : 0);
+    bench_write_latency(f, values, n);
+    fprintf(f, "}%s\n", type + 1 < BENCH_TYPES ? "," : "");
+    free(values);
+  }
+  fprintf(f, "  },\n");
+
+  fprintf(f, "  \"process\": {\n");
+  fprintf(f, "    \"pid\": %d,\n", pid);
+  fprintf(f, "    \"rss_kb\": %ld,\n", bench_read_memory(pid, "VmRSS:"));
+  fprintf(f, "    \"rss_peak_kb\": %ld,\n", bench_read_memory(pid, "VmHWM:"));
+  fprintf(f, "    \"threads\": [\n");
+  for (int i = 0; i < n_after; i++) {
+    uint64_t ticks = after[i].ticks;
+
+    for (int j = 0; j < n_before; j++) {
+      if (before[j].tid == after[i].tid) {
+        ticks -= MIN(before[j].ticks, ticks);
+        break;
+      }
+    }
+
+    total_ticks += ticks;
+    fprintf(f, "      {\"tid\": %d, \"name\": \"%s\", \"cpu_percent\": %.1f}%s\n",
+      after[i].tid, after[i].name, ticks * 100.0 / ticks_per_second / seconds,
+      i + 1 < n_after ? "," : "");
+  }
+  fprintf(f, "    ],\n");
+  fprintf(f, "    \"cpu_percent\": %.1f\n", total_ticks * 100.0 / ticks_per_second / seconds);
+  fprintf(f, "  },\n");
+
+  fprintf(f, "  \"status\": %s\n", status ? status : "null");
+  fprintf(f, "}\n");
+}
+
+/* The options */
+
+static void bench_usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [options] [-- camera-streamer options]\n", name);
+  fprintf(stderr, "  --binary=PATH     the camera-streamer (default: %s)\n", bench_options.binary);
+  fprintf(stderr, "  --port=N          the HTTP port (default: %d)\n", bench_options.port);
+  fprintf(stderr, "  --fps=N           the frame rate of the dummy camera (default: %d)\n", bench_options.fps);
+  fprintf(stderr, "  --duration=S      the seconds measured (default: %d)\n", bench_options.duration);
+  fprintf(stderr, "  --warmup=S        the seconds before measuring (default: %d)\n", bench_options.warmup);
+  fprintf(stderr, "  --stream=N        the clients of /stream (default: %d)\n", bench_options.clients[BENCH_STREAM]);
+  fprintf(stderr, "  --snapshot=N      the clients of /snapshot (default: %d)\n", bench_options.clients[BENCH_SNAPSHOT]);
+  fprintf(stderr, "  --video=N         the clients of /video.h264 (default: %d)\n", bench_options.clients[BENCH_H264]);
+  fprintf(stderr, "  --mp4=N           the clients of /video.mp4 (default: %d)\n", bench_options.clients[BENCH_MP4]);
+  fprintf(stderr, "  --log=PATH        the output of camera-streamer (default: %s)\n", bench_options.log);
+  fprintf(stderr, "  --output=PATH     the JSON results (default: stdout)\n");
+}
+
+static int bench_parse_options(int argc, char *argv[])
+{
+  static struct option options[] = {
+    { "binary", required_argument, NULL, 'b' },
+    { "port", required_argument, NULL, 'p' },
+    { "fps", required_argument, NULL, 'f' },
+    { "duration", required_argument, NULL, 'd' },
+    { "warmup", required_argument, NULL, 'w' },
+    { "stream", required_argument, NULL, 's' },
+    { "snapshot", required_argument, NULL, 'S' },
+    { "video", required_argument, NULL, 'v' },
+    { "mp4", required_argument, NULL, 'm' },
+    { "log", required_argument, NULL, 'l' },
+    { "output", required_argument, NULL, 'o' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+    case 'b': bench_options.binary = optarg; break;
+    case 'p': bench_options.port = atoi(optarg); break;
+    case 'f': bench_options.fps = MAX(atoi(optarg), 1); break;
+    case 'd': bench_options.duration = MAX(atoi(optarg), 1); break;
+    case 'w': bench_options.warmup = MAX(atoi(optarg), 0); break;
+    case 's': bench_options.clients[BENCH_STREAM] = MAX(atoi(optarg), 0); break;
+    case 'S': bench_options.clients[BENCH_SNAPSHOT] = MAX(atoi(optarg), 0); break;
+    case 'v': bench_options.clients[BENCH_H264] = MAX(atoi(optarg), 0); break;
+    case 'm': bench_options.clients[BENCH_MP4] = MAX(atoi(optarg), 0); break;
+    case 'l': bench_options.log = optarg; break;
+    case 'o': bench_options.output = optarg; break;
+    default:
+      bench_usage(argv[0]);
+      return -1;
+    }
+  }
+
+  bench_options.extra_args = argv + optind;
+  bench_options.n_extra_args = argc - optind;
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  static bench_thread_t threads_before[BENCH_MAX_THREADS], threads_after[BENCH_MAX_THREADS];
+  FILE *f = stdout;
+  int ret = -1;
+
+  if (bench_parse_options(argc, argv) < 0) {
+    return -1;
+  }
+
+  for (int type = 0; type < BENCH_TYPES; type++) {
+    for (int i = 0; i < bench_options.clients[type] && bench_n_clients < BENCH_MAX_CLIENTS; i++) {
+      bench_client_t *client = &bench_clients[bench_n_clients++];
+      client->type = type;
+      client->id = i;
+      client->fd = -1;
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  bench_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  pid_t pid = bench_start_server();
+  if (pid < 0 || bench_wait_server(pid) < 0) {
+    fprintf(stderr, "Cannot start: %s (see %s)\n", bench_options.binary, bench_options.log);
+    goto error;
+  }
+
+  uint64_t start_us = get_monotonic_time_us(NULL, NULL);
+  bench_clients_loop(start_us + bench_options.warmup * 1000 * 1000);
+
+  bench_clients_reset();
+  int n_before = bench_read_threads(pid, threads_before, BENCH_MAX_THREADS);
+  start_us = get_monotonic_time_us(NULL, NULL);
+  bench_clients_loop(start_us + bench_options.duration * 1000 * 1000);
+  int n_after = bench_read_threads(pid, threads_after, BENCH_MAX_THREADS);
+  double seconds = (get_monotonic_time_us(NULL, NULL) - start_us) / 1e6;
+
+  char *status = bench_read_status();
+
+  if (bench_options.output) {
+    f = fopen(bench_options.output, "w");
+    if (!f) {
+      perror(bench_options.output);
+      f = stdout;
+    }
+  }
+
+  bench_write_results(f, pid, threads_before, n_before, threads_after, n_after, seconds, status);
+  if (f != stdout) {
+    fclose(f);
+  }
+  free(status);
+  ret = 0;
+
+error:
+  for (int i = 0; i < bench_n_clients; i++) {
+    bench_client_close(&bench_clients[i], false);
+    free(bench_clients[i].latency_us);
+  }
+
+  if (pid > 0) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+  }
+  return ret;
+}
@@ -0,0 +1,118 @@
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+#include "device/buffer_list.h"
+#include "device/software/software.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+// Scales a 1080p frame of each of the formats that the camera tries
+// to rescale to, with the scalar and each of the supported SIMD kernels,
+// on a single thread. The SIMD output has to be the same as the scalar one.
+
+#define BENCH_ITERATIONS 50
+
+log_options_t log_options = {
+  .debug = false,
+  .verbose = false
+};
+
+static buffer_format_t bench_format(unsigned format, unsigned width, unsigned height)
+{
+  buffer_format_t fmt = {
+    .width = width,
+    .height = height,
+    .format = format,
+    .bytesperline = format == V4L2_PIX_FMT_YUYV ? width * 2 : width
+  };
+  return fmt;
+}
+
+static void bench_fill_frame(uint8_t *data, size_t size)
+{
+  for (size_t i = 0; i < size; i++) {
+    data[i] = (i + i / 1920 + (i * 7) % 13) & 0xFF;
+  }
+}
+
+static double bench_scale(software_simd_t simd, const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt)
+{
+  software_rescaller_t *rescaller = software_rescaller_new(simd, 1);
+
+  // the first one builds the filters
+  software_rescaller_scale(rescaller, src, src_fmt, dst, dst_fmt);
+
+  uint64_t before = get_monotonic_time_us(NULL, NULL);
+  for (int i = 0; i < BENCH_ITERATIONS; i++) {
+    software_rescaller_scale(rescaller, src, src_fmt, dst, dst_fmt);
+  }
+  uint64_t after = get_monotonic_time_us(NULL, NULL);
+
+  software_rescaller_free(rescaller);
+  return (after - before) / 1000.0 / BENCH_ITERATIONS;
+}
+
+int main(int argc, const char *argv[])
+{
+  unsigned formats[] = {
+    V4L2_PIX_FMT_YUYV,
+    V4L2_PIX_FMT_YUV420,
+    V4L2_PIX_FMT_NV12,
+    V4L2_PIX_FMT_NV21,
+    V4L2_PIX_FMT_YVU420
+  };
+  struct {
+    unsigned width, height;
+  } sizes[] = {
+    { 960, 540 }, // 2:1 box
+    { 640, 360 }, // 3:1 box
+    { 1280, 720 } // 1.5:1 triangle
+  };
+  software_simd_t simds[] = {
+    SOFTWARE_SIMD_SSE2,
+    SOFTWARE_SIMD_AVX2,
+    SOFTWARE_SIMD_NEON
+  };
+  int failed = 0;
+
+  for (int i = 0; i < ARRAY_SIZE(formats); i++) {
+    buffer_format_t src_fmt = bench_format(formats[i], 1920, 1080);
+    size_t src_size = software_rescaller_frame_size(src_fmt);
+    uint8_t *src = malloc(src_size);
+    bench_fill_frame(src, src_size);
+
+    for (int j = 0; j < ARRAY_SIZE(sizes); j++) {
+      buffer_format_t dst_fmt = bench_format(formats[i], sizes[j].width, sizes[j].height);
+      size_t dst_size = software_rescaller_frame_size(dst_fmt);
+      uint8_t *expected = calloc(1, dst_size);
+      uint8_t *dst = calloc(1, dst_size);
+
+      double scalar_ms = bench_scale(SOFTWARE_SIMD_NONE, src, src_fmt, expected, dst_fmt);
+      printf("format=%s size=%ux%u => %ux%u simd=%-6s time=%.2fms\n",
+        fourcc_to_string(formats[i]).buf, src_fmt.width, src_fmt.height, dst_fmt.width, dst_fmt.height,
+        software_simd_name(SOFTWARE_SIMD_NONE), scalar_ms);
+
+      for (int k = 0; k < ARRAY_SIZE(simds); k++) {
+        if (!software_simd_supported(simds[k]))
+          continue;
+
+        memset(dst, 0, dst_size);
+        double simd_ms = bench_scale(simds[k], src, src_fmt, dst, dst_fmt);
+        bool same = !memcmp(dst, expected, dst_size);
+        failed += !same;
+
+        printf("format=%s size=%ux%u => %ux%u simd=%-6s time=%.2fms speedup=%.1fx %s\n",
+          fourcc_to_string(formats[i]).buf, src_fmt.width, src_fmt.height, dst_fmt.width, dst_fmt.height,
+          software_simd_name(simds[k]), simd_ms, scalar_ms / simd_ms, same ? "same" : "DIFFERENT");
+      }
+
+      free(dst);
+      free(expected);
+    }
+
+    free(src);
+  }
+
+  return failed ? -1 : 0;
+}
@@ -22,6 +22,7 @@ typedef struct buffer_s {
     bool is_keyed : 1;
     bool is_keyframe : 1;
     bool is_last : 1;
+    bool is_error : 1; // the software device failed the frame, it is dropped
   } flags;
 
   union {
@@ -35,10 +36,32 @@ typedef struct buffer_s {
   buffer_t *dma_source;
   bool enqueued;
   uint64_t enqueue_time_us, captured_time_us;
+  buffer_t *released_next;
 } buffer_t;
 
+typedef struct buffer_refs_stats_s {
+  uint64_t use_retries, use_failed;
+  uint64_t releases_inline, releases_deferred, owner_wakeups;
+} buffer_refs_stats_t;
+
+extern buffer_refs_stats_t buffer_refs_stats;
+
 buffer_t *buffer_open(const char *name, buffer_list_t *buf_list, int buffer);
 void buffer_close(buffer_t *buf);
 
 bool buffer_use(buffer_t *buf);
 bool buffer_consumed(buffer_t *buf, const char *who);
+void buffer_set_enqueued(buffer_t *buf, bool enqueued);
+
+// The owner thread of a device enqueues its buffers released by other threads,
+// waiting on `release_fd` and calling `buffer_queue_process_released`
+typedef struct buffer_queue_owner_s {
+  int release_fd;
+  buffer_t *released;
+} buffer_queue_owner_t;
+
+int buffer_queue_owner_open(buffer_queue_owner_t *owner);
+void buffer_queue_owner_close(buffer_queue_owner_t *owner);
+void buffer_queue_attach_owner(buffer_queue_owner_t *owner);
+void buffer_queue_detach_owner();
+void buffer_queue_process_released(buffer_queue_owner_t *owner);
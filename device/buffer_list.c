@@ -3,6 +3,7 @@
 #include "device/device.h"
 #include "util/opts/log.h"
 #include "util/opts/fourcc.h"
+#include "util/metrics/metrics.h"
 
 static int buffer_list_alloc_buffers2(buffer_list_t *buf_list, int got_bufs)
 {
@@ -10,6 +11,10 @@ static int buffer_list_alloc_buffers2(buffer_list_t *buf_list, int got_bufs)
     return -1;
   }
 
+  if (got_bufs > MAX_BUFFER_LIST_BUFS) {
+    LOG_ERROR(buf_list, "Too many buffers: %d, max %d", got_bufs, MAX_BUFFER_LIST_BUFS);
+  }
+
 	LOG_INFO(
     buf_list,
     "Using: %ux%u/%s, buffers=%d, bytesperline=%d, sizeimage=%.1fMiB",
@@ -24,6 +29,7 @@ static int buffer_list_alloc_buffers2(buffer_list_t *buf_list, int got_bufs)
   buf_list->bufs = calloc(got_bufs, sizeof(buffer_t*));
   buf_list->fmt.nbufs = got_bufs;
   buf_list->nbufs = got_bufs;
+  buf_list->enqueued_mask = 0;
 
   unsigned mem_used = 0;
 
@@ -64,6 +70,11 @@ buffer_list_t *buffer_list_open(const char *name, int index, struct device_s *de
   buf_list->do_mmap = do_mmap;
   buf_list->fmt = fmt;
   buf_list->index = index;
+  buf_list->queue_depth = MAX_BUFFER_QUEUE;
+  buf_list->dequeue_histogram = metrics_histogram("dequeue", name);
+  if (!do_capture) {
+    buf_list->enqueue_histogram = metrics_histogram("enqueue", name);
+  }
 
   int err = dev->hw->buffer_list_open(buf_list);
   if (err > 0) {
@@ -23,10 +23,12 @@ typedef struct buffer_format_s {
 } buffer_format_t;
 
 typedef struct buffer_stats_s {
-  int frames, dropped;
+  int frames, dropped, errors;
 } buffer_stats_t;
 
-#define MAX_BUFFER_QUEUE 4
+#define MAX_BUFFER_QUEUE 4 // default depth of `queued_bufs`
+#define MAX_BUFFER_QUEUE_DEPTH 32
+#define MAX_BUFFER_LIST_BUFS 64 // limited by `enqueued_mask`
 
 typedef struct buffer_list_s {
   char *name;
@@ -43,13 +45,22 @@ typedef struct buffer_list_s {
     struct buffer_list_v4l2_s *v4l2;
     struct buffer_list_dummy_s *dummy;
     struct buffer_list_libcamera_s *libcamera;
+    struct buffer_list_software_s *software;
   };
 
-  buffer_t *queued_bufs[MAX_BUFFER_QUEUE];
-  int n_queued_bufs;
+  // bit per `bufs[]` owned by the device
+  uint64_t enqueued_mask;
+
+  // single-producer single-consumer ring of buffers waiting to be enqueued
+  // into this (output) list: the buffers before `queued_keyframe` are obsolete
+  buffer_t *queued_bufs[MAX_BUFFER_QUEUE_DEPTH];
+  unsigned queued_head, queued_tail, queued_keyframe;
+  int queue_depth;
 
   uint64_t last_enqueued_us, last_dequeued_us;
   int last_capture_time_us, last_in_queue_time_us;
+  int last_process_time_us; // set by the devices processing in software
+  struct metrics_histogram_s *dequeue_histogram, *enqueue_histogram;
   bool streaming;
   buffer_stats_t stats, stats_last;
 } buffer_list_t;
@@ -66,6 +77,7 @@ buffer_t *buffer_list_find_slot(buffer_list_t *buf_list);
 buffer_t *buffer_list_dequeue(buffer_list_t *buf_list);
 int buffer_list_count_enqueued(buffer_list_t *buf_list);
 int buffer_list_enqueue(buffer_list_t *buf_list, buffer_t *dma_buf);
+int buffer_list_count_queued(buffer_list_t *buf_list);
 void buffer_list_clear_queue(buffer_list_t *buf_list);
 bool buffer_list_push_to_queue(buffer_list_t *buf_list, buffer_t *dma_buf, int max_bufs);
 buffer_t *buffer_list_pop_from_queue(buffer_list_t *buf_list);
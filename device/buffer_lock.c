@@ -1,24 +1,144 @@
 #include "device/buffer_lock.h"
 #include "device/buffer_list.h"
 #include "device/buffer.h"
+#include "device/device.h"
 #include "util/opts/log.h"
+#include "util/metrics/metrics.h"
+#include "util/trace/trace.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// The current buffer and the history are published with a seqlock:
+// the capture thread is the only writer (serialized by `lock`), readers
+// never take the `lock`, and instead retry if `seq` changed while reading.
 
 bool buffer_lock_is_used(buffer_lock_t *buf_lock)
 {
-  int refs = 0;
+  return __atomic_load_n(&buf_lock->refs, __ATOMIC_RELAXED) > 0;
+}
 
-  pthread_mutex_lock(&buf_lock->lock);
-  refs = buf_lock->refs;
-  pthread_mutex_unlock(&buf_lock->lock);
+void buffer_lock_use(buffer_lock_t *buf_lock, int ref)
+{
+  __atomic_add_fetch(&buf_lock->refs, ref, __ATOMIC_RELAXED);
+}
 
-  return refs;
+static void buffer_lock_write_begin(buffer_lock_t *buf_lock)
+{
+  __atomic_store_n(&buf_lock->seq, buf_lock->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
 }
 
-void buffer_lock_use(buffer_lock_t *buf_lock, int ref)
+static void buffer_lock_write_end(buffer_lock_t *buf_lock)
 {
-  pthread_mutex_lock(&buf_lock->lock);
-  buf_lock->refs += ref;
-  pthread_mutex_unlock(&buf_lock->lock);
+  __atomic_store_n(&buf_lock->seq, buf_lock->seq + 1, __ATOMIC_SEQ_CST);
+
+  // Only pay for the syscall if someone is blocked in `buffer_lock_get`
+  if (__atomic_load_n(&buf_lock->waiters, __ATOMIC_SEQ_CST) > 0) {
+    syscall(SYS_futex, &buf_lock->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  }
+}
+
+static int buffer_lock_history_size(buffer_lock_t *buf_lock)
+{
+  int size = MIN(buf_lock->history, BUFFER_LOCK_MAX_HISTORY);
+
+  // Always leave the device at least two buffers to capture into
+  if (buf_lock->buf_list) {
+    size = MIN(size, buf_lock->buf_list->nbufs - 2);
+  }
+
+  return MAX(size, 0);
+}
+
+static buffer_lock_entry_t *buffer_lock_entry_at(buffer_lock_t *buf_lock, int index)
+{
+  return &buf_lock->entries[(buf_lock->entries_head + index) % ARRAY_SIZE(buf_lock->entries)];
+}
+
+static void buffer_lock_push_entry(buffer_lock_t *buf_lock, buffer_t *buf)
+{
+  int size = buffer_lock_history_size(buf_lock) + 1;
+
+  buffer_use(buf);
+
+  buffer_lock_write_begin(buf_lock);
+  buf_lock->counter++;
+  *buffer_lock_entry_at(buf_lock, buf_lock->entries_len) = (buffer_lock_entry_t){
+    buf, buf_lock->counter, buf->captured_time_us
+  };
+  buf_lock->entries_len++;
+
+  while (buf_lock->entries_len > size) {
+    buffer_consumed(buffer_lock_entry_at(buf_lock, 0)->buf, buf_lock->name);
+    buf_lock->entries_head = (buf_lock->entries_head + 1) % ARRAY_SIZE(buf_lock->entries);
+    buf_lock->entries_len--;
+  }
+  buffer_lock_write_end(buf_lock);
+}
+
+static void buffer_lock_clear_entries(buffer_lock_t *buf_lock)
+{
+  if (!buf_lock->entries_len) {
+    return;
+  }
+
+  buffer_lock_write_begin(buf_lock);
+  for (int i = 0; i < buf_lock->entries_len; i++) {
+    buffer_consumed(buffer_lock_entry_at(buf_lock, i)->buf, buf_lock->name);
+  }
+  buf_lock->entries_head = 0;
+  buf_lock->entries_len = 0;
+  buffer_lock_write_end(buf_lock);
+}
+
+// Copies a consistent view of the entries, from the oldest to the current one
+static int buffer_lock_read_entries(buffer_lock_t *buf_lock, buffer_lock_entry_t *entries, unsigned *seqp)
+{
+  while (1) {
+    unsigned seq = __atomic_load_n(&buf_lock->seq, __ATOMIC_ACQUIRE);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+
+    int head = __atomic_load_n(&buf_lock->entries_head, __ATOMIC_RELAXED);
+    int len = __atomic_load_n(&buf_lock->entries_len, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < len && i < ARRAY_SIZE(buf_lock->entries); i++) {
+      buffer_lock_entry_t *entry = &buf_lock->entries[(head + i) % ARRAY_SIZE(buf_lock->entries)];
+      entries[i].buf = __atomic_load_n(&entry->buf, __ATOMIC_RELAXED);
+      entries[i].counter = __atomic_load_n(&entry->counter, __ATOMIC_RELAXED);
+      entries[i].captured_time_us = __atomic_load_n(&entry->captured_time_us, __ATOMIC_RELAXED);
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&buf_lock->seq, __ATOMIC_RELAXED) == seq) {
+      *seqp = seq;
+      return len;
+    }
+  }
+}
+
+// The buffer is held by the lock as long as `seq` did not change,
+// so the reference is only valid if taken before the next write
+static bool buffer_lock_use_entry(buffer_lock_t *buf_lock, buffer_lock_entry_t *entry, unsigned seq)
+{
+  if (!buffer_use(entry->buf)) {
+    return false;
+  }
+
+  if (__atomic_load_n(&buf_lock->seq, __ATOMIC_ACQUIRE) != seq) {
+    buffer_consumed(entry->buf, buf_lock->name);
+    return false;
+  }
+
+  return true;
 }
 
 bool buffer_lock_needs_buffer(buffer_lock_t *buf_lock)
@@ -28,10 +148,9 @@ bool buffer_lock_needs_buffer(buffer_lock_t *buf_lock)
 
   pthread_mutex_lock(&buf_lock->lock);
   if (buf_lock->timeout_us > 0 && now - buf_lock->buf_time_us > buf_lock->timeout_us) {
-    buffer_consumed(buf_lock->buf, buf_lock->name);
-    buf_lock->buf = NULL;
+    buffer_lock_clear_entries(buf_lock);
   }
-  if (buf_lock->refs > 0) {
+  if (buffer_lock_is_used(buf_lock)) {
     needs_buffer = true;
   }
   for (int i = 0; !needs_buffer && buf_lock->check_streaming[i] && i < BUFFER_LOCK_MAX_CALLBACKS; i++) {
@@ -42,31 +161,108 @@ bool buffer_lock_needs_buffer(buffer_lock_t *buf_lock)
   return needs_buffer;
 }
 
+static void buffer_lock_notify_push(buffer_lock_notify_t *notify, buffer_t *buf)
+{
+  unsigned head = __atomic_load_n(&notify->head, __ATOMIC_ACQUIRE);
+  unsigned tail = notify->tail;
+
+  // After dropping a keyed (H264) frame the following ones cannot be decoded,
+  // until the next key frame
+  bool skip = notify->wait_for_keyframe && buf->flags.is_keyed && !buf->flags.is_keyframe;
+
+  if (skip || tail - head >= BUFFER_LOCK_NOTIFY_QUEUE || !buffer_use(buf)) {
+    __atomic_add_fetch(&notify->dropped, 1, __ATOMIC_RELAXED);
+
+    if (!skip && buf->flags.is_keyed) {
+      LOG_DEBUG(notify->buf_lock, "Consumer fell behind. Requesting key frame.");
+      notify->wait_for_keyframe = true;
+      device_video_force_key(buf->buf_list->dev);
+    }
+    return;
+  }
+
+  notify->wait_for_keyframe = false;
+  notify->queue[tail % BUFFER_LOCK_NOTIFY_QUEUE] = buf;
+  __atomic_store_n(&notify->tail, tail + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&notify->waiting, __ATOMIC_SEQ_CST) > 0) {
+    syscall(SYS_futex, &notify->tail, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+static void *buffer_lock_notify_thread(buffer_lock_notify_t *notify)
+{
+  trace_thread_name(notify->buf_lock->name);
+
+  while (1) {
+    unsigned tail = __atomic_load_n(&notify->tail, __ATOMIC_ACQUIRE);
+
+    if (notify->head == tail) {
+      __atomic_add_fetch(&notify->waiting, 1, __ATOMIC_SEQ_CST);
+      syscall(SYS_futex, &notify->tail, FUTEX_WAIT_PRIVATE, tail, NULL, NULL, 0);
+      __atomic_sub_fetch(&notify->waiting, 1, __ATOMIC_SEQ_CST);
+      continue;
+    }
+
+    buffer_t *buf = notify->queue[notify->head % BUFFER_LOCK_NOTIFY_QUEUE];
+    uint64_t trace = trace_begin();
+    notify->notify_buffer(notify->buf_lock, buf);
+    trace_end(trace, "notify_buffer", notify->buf_lock->name);
+    buffer_consumed(buf, "notify");
+
+    // The slot is reused only once the buffer is released
+    __atomic_store_n(&notify->head, notify->head + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&notify->frames, 1, __ATOMIC_RELAXED);
+  }
+
+  return NULL;
+}
+
+int buffer_lock_notify_queued(buffer_lock_notify_t *notify)
+{
+  return __atomic_load_n(&notify->tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&notify->head, __ATOMIC_ACQUIRE);
+}
+
+static void buffer_lock_notify(buffer_lock_t *buf_lock, buffer_t *buf)
+{
+  uint64_t value = 1;
+
+  ARRAY_FOREACH(int, fd, buf_lock->notify_fds, buf_lock->n_notify_fds) {
+    if (write(*fd, &value, sizeof(value)) < 0) {
+      LOG_DEBUG(buf_lock, "Failed to notify fd=%d: errno=%d", *fd, errno);
+    }
+  }
+
+  ARRAY_FOREACH(buffer_lock_notify_t*, notify, buf_lock->notify, buf_lock->n_notify) {
+    buffer_lock_notify_push(*notify, buf);
+  }
+}
+
 static void buffer_lock_clear_buffers(buffer_lock_t *buf_lock, uint64_t now)
 {
-  buffer_consumed(buf_lock->buf, buf_lock->name);
-  buf_lock->buf = NULL;
+  buffer_lock_clear_entries(buf_lock);
   buf_lock->buf_time_us = now;
 }
 
 static void buffer_lock_set_buffer(buffer_lock_t *buf_lock, buffer_t *buf, uint64_t now)
 {
-  buffer_consumed(buf_lock->buf, buf_lock->name);
-  buffer_use(buf);
-  buf_lock->buf = buf;
+  uint64_t last_time_us = buf_lock->buf_time_us;
+
+  buffer_lock_push_entry(buf_lock, buf);
   buf_lock->buf_time_us = now;
-  buf_lock->counter++;
+
+  if (!buf_lock->publish_histogram) {
+    buf_lock->publish_histogram = metrics_histogram("publish", buf_lock->name);
+  }
+  metrics_histogram_record_us(buf_lock->publish_histogram, now - buf->captured_time_us);
 
   LOG_DEBUG(buf_lock, "Captured buffer %s (refs=%d), frame=%d/%d, processing_ms=%.1f, frame_ms=%.1f",
     dev_name(buf), buf ? buf->mmap_reflinks : 0,
     buf_lock->counter, buf_lock->dropped,
     (now - buf->captured_time_us) / 1000.0f,
-    (now - buf_lock->buf_time_us) / 1000.0f);
-  pthread_cond_broadcast(&buf_lock->cond_wait);
+    (now - last_time_us) / 1000.0f);
 
-  for (int i = 0; buf_lock->notify_buffer[i] && i < BUFFER_LOCK_MAX_CALLBACKS; i++) {
-    buf_lock->notify_buffer[i](buf_lock, buf);
-  }
+  buffer_lock_notify(buf_lock, buf);
 }
 
 void buffer_lock_capture(buffer_lock_t *buf_lock, buffer_t *buf)
@@ -93,33 +289,106 @@ void buffer_lock_capture(buffer_lock_t *buf_lock, buffer_t *buf)
   pthread_mutex_unlock(&buf_lock->lock);
 }
 
-buffer_t *buffer_lock_get(buffer_lock_t *buf_lock, int timeout_ms, int *counter)
+buffer_t *buffer_lock_get_next(buffer_lock_t *buf_lock, int *counter)
 {
-  buffer_t *buf = NULL;
-  struct timespec timeout;
+  buffer_lock_entry_t entries[BUFFER_LOCK_MAX_HISTORY + 1];
+  unsigned seq;
+
+  while (1) {
+    int n = buffer_lock_read_entries(buf_lock, entries, &seq);
+    if (!n || entries[n-1].counter == *counter) {
+      return NULL;
+    }
+
+    // Return the oldest retained buffer after `counter` to deliver them in order,
+    // or the latest one for new readers or if `counter` fell out of the history
+    buffer_lock_entry_t *entry = &entries[n-1];
+
+    for (int i = 0; *counter && i < n - 1; i++) {
+      if (entries[i].counter - *counter > 0) {
+        entry = &entries[i];
+        break;
+      }
+    }
+
+    if (buffer_lock_use_entry(buf_lock, entry, seq)) {
+      *counter = entry->counter;
+      return entry->buf;
+    }
+  }
+}
 
+buffer_t *buffer_lock_get(buffer_lock_t *buf_lock, int timeout_ms, int *counter)
+{
   if(!timeout_ms)
     timeout_ms = DEFAULT_BUFFER_LOCK_GET_TIMEOUT;
 
-  get_time_us(CLOCK_REALTIME, &timeout, NULL, timeout_ms * 1000LL);
+  uint64_t deadline_us = get_monotonic_time_us(NULL, NULL) + timeout_ms * 1000LL;
 
-  pthread_mutex_lock(&buf_lock->lock);
-  if (*counter == buf_lock->counter || !buf_lock->buf) {
-    int ret = pthread_cond_timedwait(&buf_lock->cond_wait, &buf_lock->lock, &timeout);
-    if (ret == ETIMEDOUT) {
-      goto ret;
-    } else if (ret < 0) {
-      goto ret;
+  while (1) {
+    unsigned seq = __atomic_load_n(&buf_lock->seq, __ATOMIC_ACQUIRE);
+
+    buffer_t *buf = buffer_lock_get_next(buf_lock, counter);
+    if (buf) {
+      return buf;
+    }
+
+    uint64_t now_us = get_monotonic_time_us(NULL, NULL);
+    if (now_us >= deadline_us) {
+      return NULL;
     }
+
+    struct timespec timeout = {
+      .tv_sec = (deadline_us - now_us) / (1000 * 1000),
+      .tv_nsec = (deadline_us - now_us) % (1000 * 1000) * 1000
+    };
+
+    // The futex returns immediately if `seq` was changed since it was read
+    __atomic_add_fetch(&buf_lock->waiters, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &buf_lock->seq, FUTEX_WAIT_PRIVATE, seq, &timeout, NULL, 0);
+    __atomic_sub_fetch(&buf_lock->waiters, 1, __ATOMIC_SEQ_CST);
   }
+}
 
-  buf = buf_lock->buf;
-  buffer_use(buf);
-  *counter = buf_lock->counter;
+buffer_t *buffer_lock_get_at(buffer_lock_t *buf_lock, uint64_t time_us, buffer_lock_lookup_t lookup, int *counter)
+{
+  buffer_lock_entry_t entries[BUFFER_LOCK_MAX_HISTORY + 1];
+  unsigned seq;
+
+  while (1) {
+    buffer_lock_entry_t *found = NULL;
+    uint64_t found_diff_us = UINT64_MAX;
+
+    int n = buffer_lock_read_entries(buf_lock, entries, &seq);
+
+    for (int i = 0; i < n; i++) {
+      uint64_t captured_time_us = entries[i].captured_time_us;
+
+      if (lookup == BUFFER_LOCK_AT_OR_AFTER) {
+        if (captured_time_us >= time_us) {
+          found = &entries[i];
+          break;
+        }
+      } else {
+        uint64_t diff_us = captured_time_us > time_us ? captured_time_us - time_us : time_us - captured_time_us;
+        if (diff_us < found_diff_us) {
+          found = &entries[i];
+          found_diff_us = diff_us;
+        }
+      }
+    }
 
-ret:
-  pthread_mutex_unlock(&buf_lock->lock);
-  return buf;
+    if (!found) {
+      return NULL;
+    }
+
+    if (buffer_lock_use_entry(buf_lock, found, seq)) {
+      if (counter) {
+        *counter = found->counter;
+      }
+      return found->buf;
+    }
+  }
 }
 
 int buffer_lock_write_loop(buffer_lock_t *buf_lock, int nframes, unsigned timeout_ms, buffer_write_fn fn, void *data)
@@ -181,17 +450,33 @@ bool buffer_lock_register_check_streaming(buffer_lock_t *buf_lock, buffer_lock_c
 
 bool buffer_lock_register_notify_buffer(buffer_lock_t *buf_lock, buffer_lock_notify_buffer notify_buffer)
 {
+  buffer_lock_notify_t *notify = calloc(1, sizeof(buffer_lock_notify_t));
   bool ret = false;
 
+  notify->buf_lock = buf_lock;
+  notify->notify_buffer = notify_buffer;
+
   pthread_mutex_lock(&buf_lock->lock);
-  for (int i = 0; i < BUFFER_LOCK_MAX_CALLBACKS; i++) {
-    if (!buf_lock->notify_buffer[i]) {
-      buf_lock->notify_buffer[i] = notify_buffer;
-      ret = true;
-      break;
-    }
+  ret = ARRAY_APPEND(buf_lock->notify, buf_lock->n_notify, notify);
+  if (ret && pthread_create(&notify->thread, NULL, (void *(*)(void*))buffer_lock_notify_thread, notify) != 0) {
+    buf_lock->n_notify--;
+    ret = false;
   }
   pthread_mutex_unlock(&buf_lock->lock);
 
+  if (!ret) {
+    free(notify);
+  }
+  return ret;
+}
+
+bool buffer_lock_register_notify_fd(buffer_lock_t *buf_lock, int fd)
+{
+  bool ret = false;
+
+  pthread_mutex_lock(&buf_lock->lock);
+  ret = ARRAY_APPEND(buf_lock->notify_fds, buf_lock->n_notify_fds, fd);
+  pthread_mutex_unlock(&buf_lock->lock);
+
   return ret;
 }
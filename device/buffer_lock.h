@@ -12,18 +12,52 @@ typedef bool (*buffer_lock_check_streaming)(buffer_lock_t *buf_lock);
 typedef void (*buffer_lock_notify_buffer)(buffer_lock_t *buf_lock, buffer_t *buf);
 
 #define BUFFER_LOCK_MAX_CALLBACKS 10
+#define BUFFER_LOCK_MAX_HISTORY 16
+#define BUFFER_LOCK_NOTIFY_QUEUE 2 // buffers referenced by each `notify_buffer`
+
+typedef enum {
+  BUFFER_LOCK_AT_OR_AFTER = 0,
+  BUFFER_LOCK_CLOSEST
+} buffer_lock_lookup_t;
+
+typedef struct buffer_lock_entry_s {
+  buffer_t *buf;
+  int counter;
+  uint64_t captured_time_us;
+} buffer_lock_entry_t;
+
+// Each `notify_buffer` runs on its own thread, fed by a bounded queue:
+// a consumer falling behind drops frames, instead of delaying the capture
+typedef struct buffer_lock_notify_s {
+  buffer_lock_t *buf_lock;
+  buffer_lock_notify_buffer notify_buffer;
+  pthread_t thread;
+
+  // private: single-producer (under `buf_lock->lock`), single-consumer ring
+  buffer_t *queue[BUFFER_LOCK_NOTIFY_QUEUE];
+  unsigned head, tail;
+  unsigned waiting;
+  bool wait_for_keyframe;
+
+  uint64_t frames, dropped;
+} buffer_lock_notify_t;
 
 typedef struct buffer_lock_s {
   const char *name;
   buffer_list_t *buf_list;
 
   buffer_lock_check_streaming check_streaming[BUFFER_LOCK_MAX_CALLBACKS];
-  buffer_lock_notify_buffer notify_buffer[BUFFER_LOCK_MAX_CALLBACKS];
+  buffer_lock_notify_t *notify[BUFFER_LOCK_MAX_CALLBACKS];
+  int n_notify;
+
+  // eventfds written on every new buffer, to be used with poll/epoll
+  int notify_fds[BUFFER_LOCK_MAX_CALLBACKS];
+  int n_notify_fds;
 
   // private
-  pthread_mutex_t lock;
-  pthread_cond_t cond_wait;
-  buffer_t *buf;
+  pthread_mutex_t lock; // serializes writers only, readers use `seq`
+  unsigned seq; // odd while `entries` are being updated, readers wait on it with futex
+  unsigned waiters;
   uint64_t buf_time_us;
   int counter;
   int refs;
@@ -31,6 +65,16 @@ typedef struct buffer_lock_s {
   uint64_t timeout_us;
 
   int frame_interval_ms;
+
+  // private: created on the first published buffer, as the lock is static
+  struct metrics_histogram_s *publish_histogram;
+
+  // number of previous buffers retained, limited by `buf_list->nbufs`
+  int history;
+
+  // private: the last entry is the current buffer, preceded by the history
+  buffer_lock_entry_t entries[BUFFER_LOCK_MAX_HISTORY + 1];
+  int entries_head, entries_len;
 } buffer_lock_t;
 
 #define DEFAULT_BUFFER_LOCK_TIMEOUT 16 // ~60fps
@@ -39,7 +83,6 @@ typedef struct buffer_lock_s {
 #define DEFINE_BUFFER_LOCK(_name, _timeout_ms) buffer_lock_t _name = { \
     .name = #_name, \
     .lock = PTHREAD_MUTEX_INITIALIZER, \
-    .cond_wait = PTHREAD_COND_INITIALIZER, \
     .timeout_us = (_timeout_ms > DEFAULT_BUFFER_LOCK_TIMEOUT ? _timeout_ms : DEFAULT_BUFFER_LOCK_TIMEOUT) * 1000LL, \
   };
 
@@ -49,9 +92,13 @@ typedef int (*buffer_write_fn)(buffer_lock_t *buf_lock, buffer_t *buf, int frame
 
 void buffer_lock_capture(buffer_lock_t *buf_lock, buffer_t *buf);
 buffer_t *buffer_lock_get(buffer_lock_t *buf_lock, int timeout_ms, int *counter);
+buffer_t *buffer_lock_get_next(buffer_lock_t *buf_lock, int *counter);
+buffer_t *buffer_lock_get_at(buffer_lock_t *buf_lock, uint64_t time_us, buffer_lock_lookup_t lookup, int *counter);
 bool buffer_lock_needs_buffer(buffer_lock_t *buf_lock);
 void buffer_lock_use(buffer_lock_t *buf_lock, int ref);
 bool buffer_lock_is_used(buffer_lock_t *buf_lock);
 int buffer_lock_write_loop(buffer_lock_t *buf_lock, int nframes, unsigned timeout_ms, buffer_write_fn fn, void *data);
 bool buffer_lock_register_check_streaming(buffer_lock_t *buf_lock, buffer_lock_check_streaming check_streaming);
 bool buffer_lock_register_notify_buffer(buffer_lock_t *buf_lock, buffer_lock_notify_buffer notify_buffer);
+int buffer_lock_notify_queued(buffer_lock_notify_t *notify);
+bool buffer_lock_register_notify_fd(buffer_lock_t *buf_lock, int fd);
@@ -3,11 +3,29 @@
 #include "device/device.h"
 #include "util/opts/log.h"
 #include "util/opts/fourcc.h"
+#include "util/metrics/metrics.h"
+#include "util/trace/trace.h"
 
-#include <pthread.h>
 #include <inttypes.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
-pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+// Reference counts are atomic. The thread dropping the last reference
+// enqueues the buffer back into the device: inline if this is the links
+// thread owning the device, otherwise it is handed off to the owner,
+// to keep the ioctl out of the HTTP/RTSP/WebRTC and other links threads.
+
+buffer_refs_stats_t buffer_refs_stats;
+
+static __thread buffer_queue_owner_t *buffer_queue_current_owner;
+
+static void buffer_queue_wake_owner(buffer_queue_owner_t *owner)
+{
+  uint64_t value = 1;
+  if (write(owner->release_fd, &value, sizeof(value)) < 0) {
+    LOG_DEBUG(NULL, "Failed to wake owner: errno=%d", errno);
+  }
+}
 
 bool buffer_use(buffer_t *buf)
 {
@@ -15,59 +33,69 @@ bool buffer_use(buffer_t *buf)
     return false;
   }
 
-  pthread_mutex_lock(&buffer_lock);
-  if (buf->enqueued) {
-    pthread_mutex_unlock(&buffer_lock);
-    return false;
-  }
+  // A buffer without references is enqueued, or being enqueued or dequeued,
+  // and cannot be used by the readers of the `buffer_lock_t` still seeing the old pointer
+  int refs = __atomic_load_n(&buf->mmap_reflinks, __ATOMIC_RELAXED);
 
-  buf->mmap_reflinks += 1;
-  pthread_mutex_unlock(&buffer_lock);
-  return true;
+  while (1) {
+    if (refs <= 0) {
+      __atomic_add_fetch(&buffer_refs_stats.use_failed, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+
+    if (__atomic_compare_exchange_n(&buf->mmap_reflinks, &refs, refs + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return true;
+    }
+
+    __atomic_add_fetch(&buffer_refs_stats.use_retries, 1, __ATOMIC_RELAXED);
+  }
 }
 
-bool buffer_consumed(buffer_t *buf, const char *who)
+void buffer_set_enqueued(buffer_t *buf, bool enqueued)
 {
-  if (!buf) {
-    return false;
-  }
+  uint64_t bit = 1ULL << buf->index;
 
-  pthread_mutex_lock(&buffer_lock);
-  if (buf->mmap_reflinks == 0) {
-    LOG_PERROR(buf, "Non symmetric reference counts");
+  __atomic_store_n(&buf->enqueued, enqueued, __ATOMIC_RELEASE);
+
+  if (enqueued) {
+    __atomic_or_fetch(&buf->buf_list->enqueued_mask, bit, __ATOMIC_RELEASE);
+  } else {
+    __atomic_and_fetch(&buf->buf_list->enqueued_mask, ~bit, __ATOMIC_RELEASE);
   }
+}
 
-  buf->mmap_reflinks--;
+static bool buffer_enqueue(buffer_t *buf, const char *who)
+{
+  LOG_DEBUG(buf, "Queuing buffer... used=%zu length=%zu (linked=%s) by %s",
+    buf->used,
+    buf->length,
+    buf->dma_source ? buf->dma_source->name : NULL,
+    who);
 
-  if (!buf->enqueued && buf->mmap_reflinks == 0) {
-    LOG_DEBUG(buf, "Queuing buffer... used=%zu length=%zu (linked=%s) by %s",
-      buf->used,
-      buf->length,
-      buf->dma_source ? buf->dma_source->name : NULL,
-      who);
+  // Assign or clone timestamp
+  if (buf->buf_list->do_timestamps) {
+    buf->captured_time_us = get_monotonic_time_us(NULL, NULL);
+  }
 
-    // Assign or clone timestamp
-    if (buf->buf_list->do_timestamps) {
-      buf->captured_time_us = get_monotonic_time_us(NULL, NULL);
-    }
+  buf->enqueue_time_us = buf->buf_list->last_enqueued_us = get_monotonic_time_us(NULL, NULL);
+  buffer_set_enqueued(buf, true);
 
-    if (buf->buf_list->dev->hw->buffer_enqueue(buf, who) < 0) {
-      goto error;
-    }
+  uint64_t trace = trace_begin();
+  int ret = buf->buf_list->dev->hw->buffer_enqueue(buf, who);
+  trace_end(trace, "enqueue", buf->buf_list->name);
 
-    buf->enqueued = true;
-    buf->enqueue_time_us = buf->buf_list->last_enqueued_us = get_monotonic_time_us(NULL, NULL);
+  if (ret < 0) {
+    goto error;
   }
 
-  pthread_mutex_unlock(&buffer_lock);
   return true;
 
 error:
   {
     buffer_t *dma_source = buf->dma_source;
     buf->dma_source = NULL;
-    buf->mmap_reflinks++;
-    pthread_mutex_unlock(&buffer_lock);
+    buffer_set_enqueued(buf, false);
+    __atomic_add_fetch(&buf->mmap_reflinks, 1, __ATOMIC_RELEASE);
 
     if (dma_source) {
       buffer_consumed(dma_source, who);
@@ -77,31 +105,111 @@ error:
   return false;
 }
 
-buffer_t *buffer_list_find_slot(buffer_list_t *buf_list)
+bool buffer_consumed(buffer_t *buf, const char *who)
 {
-  buffer_t *buf = NULL;
+  if (!buf) {
+    return false;
+  }
+
+  int refs = __atomic_sub_fetch(&buf->mmap_reflinks, 1, __ATOMIC_ACQ_REL);
+  if (refs < 0) {
+    LOG_PERROR(buf, "Non symmetric reference counts");
+  }
+
+  buffer_queue_owner_t *owner = __atomic_load_n(&buf->buf_list->dev->owner, __ATOMIC_ACQUIRE);
+  bool is_owner = !owner || owner == buffer_queue_current_owner;
 
-  for (int i = 0; i < buf_list->nbufs; i++) {
-    if (!buf_list->bufs[i]->enqueued && buf_list->bufs[i]->mmap_reflinks == 1) {
-      buf = buf_list->bufs[i];
-      break;
+  if (refs == 0 && is_owner) {
+    __atomic_add_fetch(&buffer_refs_stats.releases_inline, 1, __ATOMIC_RELAXED);
+    return buffer_enqueue(buf, who);
+  } else if (refs == 0) {
+    // Push onto the lock-free list of released buffers, and wake the owner
+    buf->released_next = __atomic_load_n(&owner->released, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&owner->released, &buf->released_next, buf, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
     }
+
+    __atomic_add_fetch(&buffer_refs_stats.releases_deferred, 1, __ATOMIC_RELAXED);
+    buffer_queue_wake_owner(owner);
+  } else if (refs == 1 && !is_owner) {
+    // Only the reference taken on dequeue is left: the owner can reuse the buffer now,
+    // instead of on its next timeout
+    __atomic_add_fetch(&buffer_refs_stats.owner_wakeups, 1, __ATOMIC_RELAXED);
+    buffer_queue_wake_owner(owner);
   }
 
-  return buf;
+  return true;
 }
 
-int buffer_list_count_enqueued(buffer_list_t *buf_list)
+int buffer_queue_owner_open(buffer_queue_owner_t *owner)
+{
+  owner->released = NULL;
+  owner->release_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return owner->release_fd;
+}
+
+void buffer_queue_owner_close(buffer_queue_owner_t *owner)
+{
+  if (owner->release_fd < 0) {
+    return;
+  }
+
+  buffer_queue_process_released(owner);
+  close(owner->release_fd);
+  owner->release_fd = -1;
+}
+
+void buffer_queue_attach_owner(buffer_queue_owner_t *owner)
 {
-  int n = 0;
+  buffer_queue_current_owner = owner;
+}
+
+void buffer_queue_detach_owner()
+{
+  buffer_queue_current_owner = NULL;
+}
+
+void buffer_queue_process_released(buffer_queue_owner_t *owner)
+{
+  uint64_t value;
+  if (read(owner->release_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+    LOG_DEBUG(NULL, "Failed to read released: errno=%d", errno);
+  }
+
+  buffer_t *released = __atomic_exchange_n(&owner->released, NULL, __ATOMIC_ACQUIRE);
+
+  while (released) {
+    buffer_t *buf = released;
+    released = buf->released_next;
+    buf->released_next = NULL;
+    buffer_enqueue(buf, "released");
+  }
+}
 
-  for (int i = 0; i < buf_list->nbufs; i++) {
-    if (buf_list->bufs[i]->enqueued) {
-      n++;
+static uint64_t buffer_list_all_mask(buffer_list_t *buf_list)
+{
+  return buf_list->nbufs >= 64 ? ~0ULL : (1ULL << buf_list->nbufs) - 1;
+}
+
+buffer_t *buffer_list_find_slot(buffer_list_t *buf_list)
+{
+  // Only visit the buffers not owned by the device
+  uint64_t mask = ~__atomic_load_n(&buf_list->enqueued_mask, __ATOMIC_ACQUIRE) & buffer_list_all_mask(buf_list);
+
+  while (mask) {
+    buffer_t *buf = buf_list->bufs[__builtin_ctzll(mask)];
+    mask &= mask - 1;
+
+    if (!buf->enqueued && __atomic_load_n(&buf->mmap_reflinks, __ATOMIC_ACQUIRE) == 1) {
+      return buf;
     }
   }
 
-  return n;
+  return NULL;
+}
+
+int buffer_list_count_enqueued(buffer_list_t *buf_list)
+{
+  return __builtin_popcountll(__atomic_load_n(&buf_list->enqueued_mask, __ATOMIC_ACQUIRE));
 }
 
 int buffer_list_enqueue(buffer_list_t *buf_list, buffer_t *dma_buf)
@@ -125,9 +233,11 @@ int buffer_list_enqueue(buffer_list_t *buf_list, buffer_t *dma_buf)
       dma_buf->used = buf->length;
     }
 
+    uint64_t trace = trace_begin();
     uint64_t before = get_monotonic_time_us(NULL, NULL);
     memcpy(buf->start, dma_buf->start, dma_buf->used);
     uint64_t after = get_monotonic_time_us(NULL, NULL);
+    trace_end(trace, "memcpy", buf_list->name);
 
     LOG_DEBUG(buf, "mmap copy: dest=%p, src=%p (%s), size=%zu, space=%zu, time=%" PRIu64 "us",
       buf->start, dma_buf->start, dma_buf->name, dma_buf->used, buf->length, after-before);
@@ -137,10 +247,16 @@ int buffer_list_enqueue(buffer_list_t *buf_list, buffer_t *dma_buf)
 
     buf->dma_source = dma_buf;
     buf->length = dma_buf->length;
-    dma_buf->mmap_reflinks++;
+    __atomic_add_fetch(&dma_buf->mmap_reflinks, 1, __ATOMIC_RELAXED);
   }
 
   buf->used = dma_buf->used;
+
+  // After the copy, when handed to the device
+  if (buf->captured_time_us) {
+    metrics_histogram_record_us(buf_list->enqueue_histogram, get_monotonic_time_us(NULL, NULL) - buf->captured_time_us);
+  }
+
   buffer_consumed(buf, "copy-data");
   return 1;
 }
@@ -149,16 +265,12 @@ static void buffer_update_h264_key_frame(buffer_t *buf)
 {
   unsigned char *data = buf->start;
 
-  static const int N = 8;
-  char buffer [3*N+1];
-  buffer[sizeof(buffer)-1] = 0;
-  for(int j = 0; j < N; j++)
-    sprintf(&buffer[sizeof(buffer)/N*j], "%02X ", data[j]);
-
   if (buf->flags.is_keyframe) {
-    LOG_DEBUG(buf, "Got key frame (from V4L2)!: %s", buffer);
+    LOG_DEBUG(buf, "Got key frame (from V4L2)!: %02X %02X %02X %02X %02X %02X %02X %02X",
+      data[0], data[1], data[2], data[3], data[4], data[5], data[6], data[7]);
   } else if (buf->used >= 5 && (data[4] & 0x1F) == 0x07) {
-    LOG_DEBUG(buf, "Got key frame (from buffer)!: %s", buffer);
+    LOG_DEBUG(buf, "Got key frame (from buffer)!: %02X %02X %02X %02X %02X %02X %02X %02X",
+      data[0], data[1], data[2], data[3], data[4], data[5], data[6], data[7]);
     buf->flags.is_keyframe = true;
   }
 }
@@ -167,20 +279,28 @@ buffer_t *buffer_list_dequeue(buffer_list_t *buf_list)
 {
   buffer_t *buf = NULL;
 
-  if (buf_list->dev->hw->buffer_list_dequeue(buf_list, &buf) < 0) {
+  uint64_t trace = trace_begin();
+  int ret = buf_list->dev->hw->buffer_list_dequeue(buf_list, &buf);
+  trace_end(trace, "dequeue", buf_list->name);
+
+  if (ret < 0) {
     goto error;
   }
 
   buf_list->last_dequeued_us = get_monotonic_time_us(NULL, NULL);
   buf_list->last_capture_time_us = buf_list->last_dequeued_us - buf->captured_time_us;
   buf_list->last_in_queue_time_us = buf_list->last_dequeued_us - buf->enqueue_time_us;
+  if (buf->captured_time_us) {
+    metrics_histogram_record_us(buf_list->dequeue_histogram, buf_list->last_dequeued_us - buf->captured_time_us);
+  }
 
   if (buf->mmap_reflinks > 0) {
     LOG_PERROR(buf, "Buffer appears to be enqueued? (links=%d)", buf->mmap_reflinks);
   }
 
-  buf->enqueued = false;
-  buf->mmap_reflinks = 1;
+  // Mark as dequeued before taking the reference, so `buffer_use` cannot see it enqueued
+  buffer_set_enqueued(buf, false);
+  __atomic_store_n(&buf->mmap_reflinks, 1, __ATOMIC_RELEASE);
 
 	LOG_DEBUG(buf_list, "Grabbed mmap buffer=%u, bytes=%zu, used=%zu, frame=%d, linked=%s",
     buf->index,
@@ -214,40 +334,81 @@ int buffer_list_pollfd(buffer_list_t *buf_list, struct pollfd *pollfd, bool can_
   return buf_list->dev->hw->buffer_list_pollfd(buf_list, pollfd, can_dequeue);
 }
 
+// The queue is filled by the thread dequeuing the source buffers, and drained
+// by the thread owning this list. A key frame makes the buffers queued before
+// obsolete: the producer only moves `queued_keyframe`, the consumer drops them.
+
+int buffer_list_count_queued(buffer_list_t *buf_list)
+{
+  unsigned head = __atomic_load_n(&buf_list->queued_head, __ATOMIC_ACQUIRE);
+  unsigned keyframe = __atomic_load_n(&buf_list->queued_keyframe, __ATOMIC_ACQUIRE);
+  unsigned tail = __atomic_load_n(&buf_list->queued_tail, __ATOMIC_ACQUIRE);
+
+  if ((int)(keyframe - head) > 0)
+    head = keyframe;
+  return MAX((int)(tail - head), 0);
+}
+
 void buffer_list_clear_queue(buffer_list_t *buf_list)
 {
-  ARRAY_FOREACH(buffer_t*, queued_buf, buf_list->queued_bufs, buf_list->n_queued_bufs) {
-    buffer_consumed(*queued_buf, "clear queue");
-    *queued_buf = NULL;
+  buffer_t *buf;
+
+  while ((buf = buffer_list_pop_from_queue(buf_list)) != NULL) {
+    buffer_consumed(buf, "clear queue");
   }
-  buf_list->n_queued_bufs = 0;
 }
 
 bool buffer_list_push_to_queue(buffer_list_t *buf_list, buffer_t *dma_buf, int max_bufs)
 {
-  max_bufs = MIN(max_bufs ? max_bufs : MAX_BUFFER_QUEUE, MAX_BUFFER_QUEUE);
+  int depth = MIN(buf_list->queue_depth, MAX_BUFFER_QUEUE_DEPTH);
+  max_bufs = MIN(max_bufs ? max_bufs : depth, depth);
 
-  if (buf_list->dev->paused)
+  if (__atomic_load_n(&buf_list->dev->paused, __ATOMIC_RELAXED))
     return true;
-  if (buf_list->n_queued_bufs >= max_bufs)
+
+  unsigned head = __atomic_load_n(&buf_list->queued_head, __ATOMIC_ACQUIRE);
+  unsigned tail = buf_list->queued_tail;
+  unsigned keyframe = buf_list->queued_keyframe;
+
+  if (dma_buf->flags.is_keyframe)
+    keyframe = tail;
+
+  unsigned first = (int)(keyframe - head) > 0 ? keyframe : head;
+
+  if ((int)(tail - first) >= max_bufs || tail - head >= MAX_BUFFER_QUEUE_DEPTH)
+    return false;
+  if (!buffer_use(dma_buf))
     return false;
 
-  buffer_use(dma_buf);
-  buf_list->queued_bufs[buf_list->n_queued_bufs++] = dma_buf;
+  buf_list->queued_bufs[tail % MAX_BUFFER_QUEUE_DEPTH] = dma_buf;
+  __atomic_store_n(&buf_list->queued_keyframe, keyframe, __ATOMIC_RELEASE);
+  __atomic_store_n(&buf_list->queued_tail, tail + 1, __ATOMIC_RELEASE);
+
+  // The consumer might be another thread, waiting for its devices
+  buffer_queue_owner_t *owner = __atomic_load_n(&buf_list->dev->owner, __ATOMIC_ACQUIRE);
+  if (owner && owner != buffer_queue_current_owner) {
+    buffer_queue_wake_owner(owner);
+  }
   return true;
 }
 
 buffer_t *buffer_list_pop_from_queue(buffer_list_t *buf_list)
 {
-  if (buf_list->n_queued_bufs <= 0)
-    return NULL;
-
-  buffer_t *buf = buf_list->queued_bufs[0];
-  buf_list->n_queued_bufs--;
-
-  for (int i = 0; i < buf_list->n_queued_bufs; i++) {
-    buf_list->queued_bufs[i] = buf_list->queued_bufs[i+1];
+  unsigned head = buf_list->queued_head;
+  unsigned tail = __atomic_load_n(&buf_list->queued_tail, __ATOMIC_ACQUIRE);
+  unsigned keyframe = __atomic_load_n(&buf_list->queued_keyframe, __ATOMIC_ACQUIRE);
+
+  // drop buffers superseded by a key frame
+  while ((int)(keyframe - head) > 0) {
+    buffer_t *buf = buf_list->queued_bufs[head % MAX_BUFFER_QUEUE_DEPTH];
+    __atomic_store_n(&buf_list->queued_head, ++head, __ATOMIC_RELEASE);
+    buffer_consumed(buf, "clear queue");
   }
 
+  if ((int)(tail - head) <= 0)
+    return NULL;
+
+  buffer_t *buf = buf_list->queued_bufs[head % MAX_BUFFER_QUEUE_DEPTH];
+  __atomic_store_n(&buf_list->queued_head, head + 1, __ATOMIC_RELEASE);
   return buf;
 }
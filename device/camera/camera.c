@@ -13,7 +13,7 @@ camera_t *camera_open(camera_options_t *options)
   camera_t *camera = calloc(1, sizeof(camera_t));
   camera->name = "CAMERA";
   camera->options = *options;
-  camera->device_list = device_list_v4l2();
+  camera->device_list = device_list_software(device_list_v4l2());
 
   if (camera_configure_input(camera) < 0) {
     goto error;
@@ -83,6 +83,10 @@ void camera_capture_add_output(camera_t *camera, buffer_list_t *capture, buffer_
 {
   link_t *link = camera_ensure_capture(camera, capture);
   ARRAY_APPEND(link->output_lists, link->n_output_lists, output);
+
+  if (camera->options.queue_depth > 0) {
+    output->queue_depth = MIN(camera->options.queue_depth, MAX_BUFFER_QUEUE_DEPTH);
+  }
 }
 
 void camera_capture_add_callbacks(camera_t *camera, buffer_list_t *capture, link_callbacks_t callbacks)
@@ -101,6 +105,7 @@ int camera_set_params(camera_t *camera)
   device_set_fps(camera->camera, camera->options.fps);
   device_set_option_list(camera->camera, camera->options.options);
   device_set_option_list(camera->isp, camera->options.isp.options);
+  device_set_option_list(camera->decoder, camera->options.decoder.options);
 
   if (camera->options.auto_focus) {
     device_set_option_string(camera->camera, "AfTrigger", "1");
@@ -117,5 +122,5 @@ int camera_set_params(camera_t *camera)
 int camera_run(camera_t *camera)
 {
   bool running = false;
-  return links_loop(camera->links, camera->options.force_active, &running);
+  return links_loop(camera->links, camera->options.force_active, camera->options.threaded, &running);
 }
@@ -3,6 +3,8 @@
 #include "device/links.h"
 #include "device/device.h"
 
+typedef struct device_info_s device_info_t;
+
 #define MAX_DEVICES 20
 #define MAX_RESCALLERS 4
 #define MAX_HTTP_METHODS 20
@@ -22,6 +24,7 @@ typedef enum {
 typedef struct camera_output_options_s {
   bool disabled;
   unsigned height;
+  unsigned history;
   char options[CAMERA_OPTIONS_LENGTH];
 } camera_output_options_t;
 
@@ -29,6 +32,7 @@ typedef struct camera_options_s {
   char path[256];
   unsigned width, height, format;
   unsigned nbufs, fps;
+  unsigned queue_depth;
   camera_type_t type;
   bool allow_dma;
   float high_res_factor;
@@ -36,6 +40,7 @@ typedef struct camera_options_s {
   bool auto_focus;
   unsigned auto_reconnect;
   bool force_active;
+  bool threaded;
   union {
     bool vflip;
     unsigned vflip_align;
@@ -52,6 +57,10 @@ typedef struct camera_options_s {
     char options[CAMERA_OPTIONS_LENGTH];
   } isp;
 
+  struct {
+    char options[CAMERA_OPTIONS_LENGTH];
+  } decoder;
+
   camera_output_options_t snapshot;
   camera_output_options_t stream;
   camera_output_options_t video;
@@ -100,4 +109,5 @@ buffer_list_t *camera_configure_isp(camera_t *camera, buffer_list_t *src_capture
 buffer_list_t *camera_configure_decoder(camera_t *camera, buffer_list_t *src_capture);
 buffer_list_t *camera_configure_rescaller(camera_t *camera, buffer_list_t *src_capture, const char *name, unsigned target_height, unsigned formats[]);
 int camera_configure_output(camera_t *camera, buffer_list_t *camera_capture, const char *name, camera_output_options_t *options, unsigned formats[], link_callbacks_t callbacks, device_t **device);
-bool camera_get_scaled_resolution(buffer_format_t capture_format, camera_output_options_t *options, buffer_format_t *format, int align_size);
+unsigned camera_rescaller_max_size(device_info_t *device_info);
+bool camera_get_scaled_resolution(buffer_format_t capture_format, camera_output_options_t *options, buffer_format_t *format, int align_size, unsigned max_size);
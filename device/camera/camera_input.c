@@ -68,11 +68,11 @@ static int camera_configure_input_libcamera(camera_t *camera)
 
   bool found = false;
 
-  found = camera_get_scaled_resolution(capture_fmt, &camera->options.snapshot, &capture_fmt, 1);
+  found = camera_get_scaled_resolution(capture_fmt, &camera->options.snapshot, &capture_fmt, 1, MAX_RESCALLER_SIZE);
   if (!found)
-    found = camera_get_scaled_resolution(capture_fmt, &camera->options.stream, &capture_fmt, 1);
+    found = camera_get_scaled_resolution(capture_fmt, &camera->options.stream, &capture_fmt, 1, MAX_RESCALLER_SIZE);
   if (!found)
-    found = camera_get_scaled_resolution(capture_fmt, &camera->options.video, &capture_fmt, 1);
+    found = camera_get_scaled_resolution(capture_fmt, &camera->options.video, &capture_fmt, 1, MAX_RESCALLER_SIZE);
 
   buffer_list_t *camera_capture = device_open_buffer_list(camera->camera, true, capture_fmt, true);
   if (!camera_capture) {
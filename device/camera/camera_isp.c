@@ -10,16 +10,60 @@
 #include "device/buffer_list.h"
 #include "util/http/http.h"
 
-buffer_list_t *camera_configure_isp(camera_t *camera, buffer_list_t *src_capture)
+#define CAMERA_ISP_OUTPUT_PATH "/dev/video13"
+#define CAMERA_ISP_CAPTURE_PATH "/dev/video14"
+
+static unsigned isp_formats[] =
+{
+  V4L2_PIX_FMT_YUYV,
+  V4L2_PIX_FMT_NV12,
+  V4L2_PIX_FMT_YUV420,
+  0
+};
+
+// The bcm2835 ISP of the Raspberry Pi
+static buffer_list_t *camera_configure_hw_isp(camera_t *camera, buffer_list_t *src_capture)
+{
+  camera->isp = device_v4l2_open("ISP", CAMERA_ISP_OUTPUT_PATH);
+
+  buffer_list_t *isp_output = device_open_buffer_list_output(
+    camera->isp, src_capture);
+  buffer_list_t *isp_capture = device_open_buffer_list_capture2(
+    camera->isp, CAMERA_ISP_CAPTURE_PATH, isp_output, V4L2_PIX_FMT_YUYV, true);
+
+  camera_capture_add_output(camera, src_capture, isp_output);
+
+  return isp_capture;
+}
+
+static buffer_list_t *camera_configure_m2m_isp(camera_t *camera, buffer_list_t *src_capture)
 {
-  camera->isp = device_v4l2_open("ISP", "/dev/video13");
+  unsigned chosen_format = 0;
+  device_info_t *device = device_list_find_m2m_formats(camera->device_list, src_capture->fmt.format, isp_formats, &chosen_format);
+
+  if (!device) {
+    LOG_INFO(camera, "Cannot find ISP for '%s'", fourcc_to_string(src_capture->fmt.format).buf);
+    return NULL;
+  }
+
+  camera->isp = device_info_open(device, "ISP");
 
   buffer_list_t *isp_output = device_open_buffer_list_output(
     camera->isp, src_capture);
   buffer_list_t *isp_capture = device_open_buffer_list_capture2(
-    camera->isp, "/dev/video14", isp_output, V4L2_PIX_FMT_YUYV, true);
+    camera->isp, NULL, isp_output, chosen_format, true);
 
+  camera_debug_capture(camera, isp_capture);
   camera_capture_add_output(camera, src_capture, isp_output);
 
   return isp_capture;
 }
+
+buffer_list_t *camera_configure_isp(camera_t *camera, buffer_list_t *src_capture)
+{
+  if (access(CAMERA_ISP_OUTPUT_PATH, F_OK) == 0) {
+    return camera_configure_hw_isp(camera, src_capture);
+  }
+
+  return camera_configure_m2m_isp(camera, src_capture);
+}
@@ -76,16 +76,36 @@ static unsigned rescalled_formats[] =
 
 #define OUTPUT_RESCALLER_SIZE 32
 
+// The size is limited, unless both the encoder and the rescaller are software
+static unsigned camera_output_max_size(camera_t *camera, unsigned formats[])
+{
+  for (int i = 0; rescalled_formats[i]; i++) {
+    device_info_t *encoder = device_list_find_m2m_formats(camera->device_list, rescalled_formats[i], formats, NULL);
+    if (!encoder) {
+      continue;
+    }
+
+    device_info_t *rescaller = device_list_find_m2m_formats(camera->device_list, rescalled_formats[i], rescalled_formats, NULL);
+    if (camera_rescaller_max_size(encoder) || (rescaller && camera_rescaller_max_size(rescaller))) {
+      return MAX_RESCALLER_SIZE;
+    }
+    return 0;
+  }
+
+  return MAX_RESCALLER_SIZE;
+}
+
 int camera_configure_output(camera_t *camera, buffer_list_t *camera_capture, const char *name, camera_output_options_t *options, unsigned formats[], link_callbacks_t callbacks, device_t **device)
 {
   buffer_format_t selected_format = {0};
   buffer_format_t rescalled_format = {0};
+  unsigned max_size = camera_output_max_size(camera, formats);
 
-  if (!camera_get_scaled_resolution(camera_capture->fmt, options, &selected_format, 1)) {
+  if (!camera_get_scaled_resolution(camera_capture->fmt, options, &selected_format, 1, max_size)) {
     return 0;
   }
 
-  if (!camera_get_scaled_resolution(camera_capture->fmt, options, &rescalled_format, RESCALLER_BLOCK_SIZE)) {
+  if (!camera_get_scaled_resolution(camera_capture->fmt, options, &rescalled_format, RESCALLER_BLOCK_SIZE, max_size)) {
     return 0;
   }
 
@@ -115,9 +135,12 @@ int camera_configure_output(camera_t *camera, buffer_list_t *camera_capture, con
     switch (camera_capture->fmt.format) {
     case V4L2_PIX_FMT_SRGGB10P:
     case V4L2_PIX_FMT_SGRBG10P:
+    case V4L2_PIX_FMT_SGBRG10P:
     case V4L2_PIX_FMT_SBGGR10P:
     case V4L2_PIX_FMT_SRGGB10:
     case V4L2_PIX_FMT_SGRBG10:
+    case V4L2_PIX_FMT_SGBRG10:
+    case V4L2_PIX_FMT_SBGGR10:
       decoded_capture = camera_configure_isp(camera, camera_capture);
       break;
 
@@ -153,10 +176,17 @@ int camera_configure_output(camera_t *camera, buffer_list_t *camera_capture, con
     return -1;
   }
 
-  *device = device_v4l2_open(name, device_info->path);
+  *device = device_info_open(device_info, name);
 
   buffer_list_t *output = device_open_buffer_list_output(*device, src_capture);
-  buffer_list_t *capture = device_open_buffer_list_capture2(*device, NULL, output, chosen_format, true);
+
+  // Extra buffers are retained by the output history
+  buffer_format_t capture_format = {
+    .format = chosen_format,
+    .nbufs = output->fmt.nbufs + options->history
+  };
+
+  buffer_list_t *capture = device_open_buffer_list_capture(*device, NULL, output, capture_format, true);
 
   if (!capture) {
     return -1;
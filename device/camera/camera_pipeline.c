@@ -2,6 +2,7 @@
 
 #include "device/buffer.h"
 #include "device/buffer_list.h"
+#include "device/buffer_lock.h"
 #include "device/device.h"
 #include "device/device_list.h"
 #include "device/links.h"
@@ -48,6 +49,10 @@ int camera_configure_pipeline(camera_t *camera, buffer_list_t *camera_capture)
 
   camera_debug_capture(camera, camera_capture);
 
+  snapshot_lock.history = camera->options.snapshot.history;
+  stream_lock.history = camera->options.stream.history;
+  video_lock.history = camera->options.video.history;
+
   if (camera_configure_output(camera, camera_capture, "SNAPSHOT", &camera->options.snapshot,
     snapshot_formats, snapshot_callbacks, &camera->codec_snapshot) < 0) {
     return -1;
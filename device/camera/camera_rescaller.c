@@ -20,24 +20,31 @@ static unsigned camera_rescaller_align_size(unsigned size, int align_size)
     return size;
 }
 
-void camera_get_scaled_resolution2(unsigned in_width, unsigned in_height, unsigned proposed_height, unsigned *target_width, unsigned *target_height, int align_size)
+// The hardware rescallers are limited, the software one is not
+unsigned camera_rescaller_max_size(device_info_t *device_info)
+{
+  return device_info->open == device_software_open ? 0 : MAX_RESCALLER_SIZE;
+}
+
+void camera_get_scaled_resolution2(unsigned in_width, unsigned in_height, unsigned proposed_height, unsigned *target_width, unsigned *target_height, int align_size, unsigned max_size)
 {
   proposed_height = MIN(proposed_height, in_height);
 
   *target_height = camera_rescaller_align_size(proposed_height, align_size);
-  *target_height = MIN(*target_height, MAX_RESCALLER_SIZE);
+  if (max_size)
+    *target_height = MIN(*target_height, max_size);
 
   // maintain aspect ratio on target width
   *target_width = camera_rescaller_align_size(*target_height * in_width / in_height, align_size);
 
   // if width is larger then rescaller, try to maintain scale down height
-  if (*target_width > MAX_RESCALLER_SIZE) {
-    *target_width = MAX_RESCALLER_SIZE;
+  if (max_size && *target_width > max_size) {
+    *target_width = max_size;
     *target_height = camera_rescaller_align_size(*target_width * in_height / in_width, align_size);
   }
 }
 
-bool camera_get_scaled_resolution(buffer_format_t capture_format, camera_output_options_t *options, buffer_format_t *format, int align_size)
+bool camera_get_scaled_resolution(buffer_format_t capture_format, camera_output_options_t *options, buffer_format_t *format, int align_size, unsigned max_size)
 {
   if (options->disabled)
     return false;
@@ -48,7 +55,8 @@ bool camera_get_scaled_resolution(buffer_format_t capture_format, camera_output_
     options->height,
     &format->width,
     &format->height,
-    align_size
+    align_size,
+    max_size
   );
   return format->height > 0;
 }
@@ -69,7 +77,7 @@ buffer_list_t *camera_try_rescaller(camera_t *camera, buffer_list_t *src_capture
   char name2[256];
   sprintf(name2, "RESCALLER:%s", name);
 
-  device_t *device = device_v4l2_open(name2, device_info->path);
+  device_t *device = device_info_open(device_info, name2);
 
   buffer_list_t *rescaller_output = device_open_buffer_list_output(
     device, src_capture);
@@ -82,7 +90,8 @@ buffer_list_t *camera_try_rescaller(camera_t *camera, buffer_list_t *src_capture
     src_capture->fmt.width, src_capture->fmt.height,
     target_height,
     &target_fmt.width, &target_fmt.height,
-    RESCALLER_BLOCK_SIZE
+    RESCALLER_BLOCK_SIZE,
+    camera_rescaller_max_size(device_info)
   );
 
   buffer_list_t *rescaller_capture = device_open_buffer_list_capture(
@@ -8,6 +8,7 @@ typedef struct buffer_s buffer_t;
 typedef struct buffer_list_s buffer_list_t;
 typedef struct buffer_format_s buffer_format_t;
 typedef struct device_s device_t;
+typedef struct buffer_queue_owner_s buffer_queue_owner_t;
 struct pollfd;
 
 typedef struct device_hw_s {
@@ -50,9 +51,11 @@ typedef struct device_s {
     struct device_v4l2_s *v4l2;
     struct device_dummy_s *dummy;
     struct device_libcamera_s *libcamera;
+    struct device_software_s *software;
   };
 
-  bool paused;
+  bool paused; // written by the thread of the capture, accessed with __atomic
+  buffer_queue_owner_t *owner; // the thread enqueuing the buffers
 } device_t;
 
 device_t *device_open(const char *name, const char *path, device_hw_t *hw);
@@ -79,3 +82,4 @@ int device_capture_enqueued(device_t *dev, int *max);
 device_t *device_v4l2_open(const char *name, const char *path);
 device_t *device_libcamera_open(const char *name, const char *path);
 device_t *device_dummy_open(const char *name, const char *path);
+device_t *device_software_open(const char *name, const char *path);
@@ -1,4 +1,5 @@
 #include "device/device_list.h"
+#include "device/device.h"
 
 #include <stddef.h>
 #include <stdlib.h>
@@ -20,6 +21,15 @@ bool device_info_has_format(device_info_t *info, bool capture, unsigned format)
   return false;
 }
 
+device_t *device_info_open(device_info_t *info, const char *name)
+{
+  if (!info || !info->open) {
+    return NULL;
+  }
+
+  return info->open(name, info->path);
+}
+
 device_info_t *device_list_find_m2m_format(device_list_t *list, unsigned output, unsigned capture)
 {
   if (!list)
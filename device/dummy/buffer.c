@@ -1,18 +1,91 @@
 #include "dummy.h"
 #include "device/buffer.h"
 #include "device/buffer_list.h"
+#include "device/device.h"
 #include "util/opts/log.h"
 
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <linux/videodev2.h>
+
+// The frames are captured every `interval_us` into the enqueued buffers,
+// like a sensor does: the frames are dropped when no buffer is enqueued
+// at their time. The `timer_fd` is armed at the time of the next frame.
+// Without the `interval_us` the frame is captured once a buffer is enqueued.
+
+static void dummy_buffer_arm_timer(buffer_list_dummy_t *dummy, uint64_t time_us)
+{
+  struct itimerspec spec = {
+    .it_value = {
+      .tv_sec = time_us / (1000LL * 1000LL),
+      .tv_nsec = time_us % (1000LL * 1000LL) * 1000LL
+    }
+  };
+
+  // the zero disarms it, and the past fires immediately
+  if (!time_us) {
+    spec.it_value.tv_nsec = 1;
+  }
+
+  timerfd_settime(dummy->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+// Schedules the frame after `tick_us`, with the `lock` held
+static void dummy_buffer_schedule_frame(buffer_list_t *buf_list, unsigned interval_us)
+{
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  unsigned jitter_us = buf_list->dev->dummy->jitter_us;
+
+  dummy->tick_us += interval_us;
+  dummy->next_frame_us = dummy->tick_us;
+
+  // the frames can only be late
+  if (jitter_us > 0) {
+    dummy->next_frame_us += rand_r(&dummy->seed) % (jitter_us + 1);
+  }
+
+  dummy_buffer_arm_timer(dummy, dummy->next_frame_us);
+}
+
+// Drops the frames captured while no buffer was enqueued, with the `lock` held.
+// The H264 access units reference the previous ones, so they are only delayed.
+static void dummy_buffer_drop_frames(buffer_list_t *buf_list, unsigned interval_us, uint64_t now_us)
+{
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  bool keep_order = buf_list->fmt.format == V4L2_PIX_FMT_H264;
+  int dropped = 0;
+
+  if (!dummy->tick_us) {
+    dummy->tick_us = now_us;
+    dummy_buffer_schedule_frame(buf_list, interval_us);
+    return;
+  }
+
+  while (dummy->next_frame_us <= now_us) {
+    if (!keep_order) {
+      dummy->frame = (dummy->frame + 1) % dummy->nframes;
+    }
+    dummy_buffer_schedule_frame(buf_list, interval_us);
+    dropped++;
+  }
+
+  buf_list->stats.dropped += dropped;
+}
 
 int dummy_buffer_open(buffer_t *buf)
 {
+  buffer_list_dummy_t *dummy = buf->buf_list->dummy;
+
   buf->dummy = calloc(1, sizeof(buffer_dummy_t));
-  buf->start = buf->buf_list->dummy->data;
-  buf->used = buf->buf_list->dummy->length;
-  buf->length = buf->buf_list->dummy->length;
+  buf->start = dummy->data;
+  buf->used = dummy->frames[0].length;
+  buf->length = 0;
+
+  for (int i = 0; i < dummy->nframes; i++) {
+    buf->length = MAX(buf->length, dummy->frames[i].length);
+  }
   return 0;
 }
 
@@ -23,17 +96,38 @@ void dummy_buffer_close(buffer_t *buf)
 
 int dummy_buffer_enqueue(buffer_t *buf, const char *who)
 {
+  buffer_list_t *buf_list = buf->buf_list;
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  unsigned interval_us = buf_list->dev->dummy->interval_us;
   unsigned index = buf->index;
-  if (write(buf->buf_list->dummy->fds[1], &index, sizeof(index)) != sizeof(index)) {
-    return -1;
+  int ret = 0;
+
+  pthread_mutex_lock(&dummy->lock);
+  if (write(dummy->fds[1], &index, sizeof(index)) != sizeof(index)) {
+    ret = -1;
+  } else if (dummy->enqueued++ > 0) {
+    // the timer is already armed
+  } else if (interval_us > 0) {
+    dummy_buffer_drop_frames(buf_list, interval_us, get_monotonic_time_us(NULL, NULL));
+  } else {
+    dummy_buffer_arm_timer(dummy, 0);
   }
-  return 0;
+  pthread_mutex_unlock(&dummy->lock);
+  return ret;
 }
 
 int dummy_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp)
 {
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  unsigned interval_us = buf_list->dev->dummy->interval_us;
+  uint64_t expirations = 0;
   unsigned index = 0;
-  int n = read(buf_list->dummy->fds[0], &index, sizeof(index));
+
+  if (read(dummy->timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+    LOG_INFO(buf_list, "Received invalid result from timer `read`: %d", errno);
+  }
+
+  int n = read(dummy->fds[0], &index, sizeof(index));
   if (n != sizeof(index)) {
     LOG_INFO(buf_list, "Received invalid result from `read`: %d", n);
     return -1;
@@ -44,14 +138,36 @@ int dummy_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp)
     return -1;
   }
 
-  *bufp = buf_list->bufs[index];
+  buffer_t *buf = buf_list->bufs[index];
+
+  pthread_mutex_lock(&dummy->lock);
+  dummy_frame_t *frame = &dummy->frames[dummy->frame];
+  dummy->frame = (dummy->frame + 1) % dummy->nframes;
+  dummy->enqueued--;
+
+  buf->start = (uint8_t *)dummy->data + frame->offset;
+  buf->used = frame->length;
+  buf->flags.is_keyframe = frame->is_keyframe;
+
+  if (interval_us > 0 && dummy->tick_us) {
+    buf->captured_time_us = dummy->next_frame_us;
+    dummy_buffer_schedule_frame(buf_list, interval_us);
+  } else {
+    buf->captured_time_us = get_monotonic_time_us(NULL, NULL);
+    if (dummy->enqueued > 0) {
+      dummy_buffer_arm_timer(dummy, 0);
+    }
+  }
+  pthread_mutex_unlock(&dummy->lock);
+
+  *bufp = buf;
   return 0;
 }
 
 int dummy_buffer_list_pollfd(buffer_list_t *buf_list, struct pollfd *pollfd, bool can_dequeue)
 {
   int count_enqueued = buffer_list_count_enqueued(buf_list);
-  pollfd->fd = buf_list->dummy->fds[0]; // write end
+  pollfd->fd = buf_list->dummy->timer_fd;
   pollfd->events = POLLHUP;
   if (can_dequeue && count_enqueued > 0) {
     pollfd->events |= POLLIN;
@@ -6,49 +6,39 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 
 int dummy_buffer_list_open(buffer_list_t *buf_list)
 {
-  int fd = -1;
-
   buf_list->dummy = calloc(1, sizeof(buffer_list_dummy_t));
   buf_list->dummy->fds[0] = -1;
   buf_list->dummy->fds[1] = -1;
+  buf_list->dummy->timer_fd = -1;
+  buf_list->dummy->seed = 1; // the same jitter on each run
+  pthread_mutex_init(&buf_list->dummy->lock, NULL);
 
   if (!buf_list->do_capture) {
     LOG_ERROR(buf_list, "Only capture mode supported");
   }
 
+  // the indexes of the enqueued buffers
   if (pipe2(buf_list->dummy->fds, O_DIRECT|O_CLOEXEC) < 0) {
-    LOG_INFO(buf_list, "Cannot open `pipe2`.");
-    return -1;
-  }
-
-  fd = open(buf_list->dev->path, O_RDWR|O_NONBLOCK);
-  if (fd < 0) {
-		LOG_ERROR(buf_list, "Can't open device: %s", buf_list->dev->path);
-  }
-
-  struct stat st;
-  if (fstat(fd, &st) < 0) {
-		LOG_ERROR(buf_list, "Can't get fstat: %s", buf_list->dev->path);
+    LOG_ERROR(buf_list, "Cannot open `pipe2`.");
   }
 
-  buf_list->dummy->data = malloc(st.st_size);
-  if (!buf_list->dummy->data) {
-		LOG_ERROR(buf_list, "Can't allocate %ld bytes for %s", st.st_size, buf_list->dev->path);
+  // fires when the next frame is captured
+  buf_list->dummy->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+  if (buf_list->dummy->timer_fd < 0) {
+    LOG_ERROR(buf_list, "Cannot open `timerfd_create`.");
   }
 
-  buf_list->dummy->length = read(fd, buf_list->dummy->data, st.st_size);
-  if (!buf_list->dummy->data) {
-		LOG_ERROR(buf_list, "Can't read %ld bytes for %s. Only read %zu.", st.st_size, buf_list->dev->path, buf_list->dummy->length);
+  if (dummy_frames_load(buf_list) < 0) {
+    goto error;
   }
 
-  close(fd);
   return buf_list->fmt.nbufs;
 
 error:
-  close(fd);
   return -1;
 }
 
@@ -57,6 +47,9 @@ void dummy_buffer_list_close(buffer_list_t *buf_list)
   if (buf_list->dummy) {
     close(buf_list->dummy->fds[0]);
     close(buf_list->dummy->fds[1]);
+    close(buf_list->dummy->timer_fd);
+    pthread_mutex_destroy(&buf_list->dummy->lock);
+    free(buf_list->dummy->frames);
     free(buf_list->dummy->data);
   }
 
@@ -65,5 +58,9 @@ void dummy_buffer_list_close(buffer_list_t *buf_list)
 
 int dummy_buffer_list_set_stream(buffer_list_t *buf_list, bool do_on)
 {
+  // the frames are scheduled again from the first enqueued buffer
+  pthread_mutex_lock(&buf_list->dummy->lock);
+  buf_list->dummy->tick_us = 0;
+  pthread_mutex_unlock(&buf_list->dummy->lock);
   return 0;
 }
@@ -1,7 +1,10 @@
 #include "dummy.h"
 #include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/control.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 int dummy_device_open(device_t *dev)
 {
@@ -22,10 +25,32 @@ int dummy_device_video_force_key(device_t *dev)
 
 int dummy_device_set_fps(device_t *dev, int desired_fps)
 {
-  return -1;
+  if (desired_fps <= 0) {
+    return -1;
+  }
+
+  dev->dummy->interval_us = 1000 * 1000 / desired_fps;
+  return 0;
 }
 
 int dummy_device_set_option(device_t *dev, const char *key, const char *value)
 {
-  return -1;
+  char *keyp = strdup(key);
+  int ret = -1;
+
+  device_option_normalize_name(keyp, keyp);
+
+  if (!strcmp(keyp, "jitterus")) {
+    dev->dummy->jitter_us = MAX(atoi(value), 0);
+    ret = 0;
+  }
+
+  if (ret < 0) {
+    LOG_INFO(dev, "The '%s=%s' was failed to find.", key, value);
+  } else {
+    LOG_INFO(dev, "Configuring option %s = %s", keyp, value);
+  }
+
+  free(keyp);
+  return ret;
 }
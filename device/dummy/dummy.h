@@ -3,6 +3,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <pthread.h>
 
 typedef struct buffer_s buffer_t;
 typedef struct buffer_list_s buffer_list_t;
@@ -10,12 +11,32 @@ typedef struct device_s device_t;
 struct pollfd;
 
 typedef struct device_dummy_s {
+  unsigned interval_us; // 0 = as fast as the buffers are enqueued
+  unsigned jitter_us;
 } device_dummy_t;
 
+typedef struct dummy_frame_s {
+  size_t offset;
+  size_t length;
+  bool is_keyframe;
+} dummy_frame_t;
+
 typedef struct buffer_list_dummy_s {
   int fds[2];
+  int timer_fd;
   void *data;
   size_t length;
+
+  dummy_frame_t *frames;
+  int nframes;
+  int frame;
+
+  // the capture schedule, with the `lock` held
+  pthread_mutex_t lock;
+  uint64_t tick_us; // the time of the next frame without the jitter
+  uint64_t next_frame_us;
+  unsigned seed;
+  int enqueued;
 } buffer_list_dummy_t;
 
 typedef struct buffer_dummy_s {
@@ -36,3 +57,5 @@ int dummy_buffer_list_pollfd(buffer_list_t *buf_list, struct pollfd *pollfd, boo
 int dummy_buffer_list_open(buffer_list_t *buf_list);
 void dummy_buffer_list_close(buffer_list_t *buf_list);
 int dummy_buffer_list_set_stream(buffer_list_t *buf_list, bool do_on);
+
+int dummy_frames_load(buffer_list_t *buf_list);
@@ -0,0 +1,215 @@
+#include "dummy.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+#include "util/convert/convert.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+// The source is replayed frame by frame in a loop:
+// - a directory of `*.jpg` or `*.jpeg` files, in the order of their names,
+// - an Annex-B H264 stream, split into access units,
+// - a raw file, split into frames of `sizeimage` bytes,
+// - or any other file as a single frame.
+
+static bool dummy_frames_add(buffer_list_dummy_t *dummy, size_t offset, size_t length, bool is_keyframe)
+{
+  dummy_frame_t frame = { offset, length, is_keyframe };
+
+  dummy_frame_t *frames = realloc(dummy->frames, (dummy->nframes + 1) * sizeof(dummy_frame_t));
+  if (!frames) {
+    return false;
+  }
+
+  dummy->frames = frames;
+  dummy->frames[dummy->nframes++] = frame;
+  return true;
+}
+
+static ssize_t dummy_frames_read_file(buffer_list_dummy_t *dummy, const char *path)
+{
+  int fd = open(path, O_RDONLY|O_CLOEXEC);
+  struct stat st;
+  ssize_t total = 0;
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    goto error;
+  }
+
+  void *data = realloc(dummy->data, dummy->length + st.st_size);
+  if (!data) {
+    goto error;
+  }
+  dummy->data = data;
+
+  while (total < st.st_size) {
+    ssize_t n = read(fd, (uint8_t *)dummy->data + dummy->length + total, st.st_size - total);
+    if (n <= 0) {
+      goto error;
+    }
+    total += n;
+  }
+
+  dummy->length += total;
+  close(fd);
+  return total;
+
+error:
+  if (fd >= 0)
+    close(fd);
+  return -1;
+}
+
+static int dummy_frames_is_jpeg(const struct dirent *entry)
+{
+  const char *ext = strrchr(entry->d_name, '.');
+  return ext && (!strcasecmp(ext, ".jpg") || !strcasecmp(ext, ".jpeg"));
+}
+
+static int dummy_frames_load_directory(buffer_list_t *buf_list)
+{
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  struct dirent **entries = NULL;
+  char path[PATH_MAX];
+
+  int n = scandir(buf_list->dev->path, &entries, dummy_frames_is_jpeg, alphasort);
+  if (n < 0) {
+    LOG_ERROR(buf_list, "Can't list directory: %s", buf_list->dev->path);
+  }
+
+  for (int i = 0; i < n; i++) {
+    snprintf(path, sizeof(path), "%s/%s", buf_list->dev->path, entries[i]->d_name);
+
+    size_t offset = dummy->length;
+    ssize_t length = dummy_frames_read_file(dummy, path);
+    if (length < 0) {
+      LOG_INFO(buf_list, "Can't read: %s", path);
+    } else if (length > 0) {
+      dummy_frames_add(dummy, offset, length, true);
+    }
+    free(entries[i]);
+  }
+
+  free(entries);
+  return 0;
+
+error:
+  return -1;
+}
+
+// The offset of the next `00 00 01`, or `length`
+static size_t dummy_frames_find_start_code(const uint8_t *data, size_t length, size_t offset)
+{
+  for (; offset + 3 <= length; offset++) {
+    if (data[offset] == 0 && data[offset + 1] == 0 && data[offset + 2] == 1) {
+      return offset;
+    }
+  }
+  return length;
+}
+
+// A new access unit starts at the AUD, SPS, PPS or SEI, or at the first
+// slice of a picture, that follows the slices of the previous picture
+static void dummy_frames_split_h264(buffer_list_dummy_t *dummy)
+{
+  const uint8_t *data = dummy->data;
+  size_t length = dummy->length;
+  size_t au_start = 0;
+  bool has_slice = false, is_keyframe = false;
+
+  for (size_t offset = dummy_frames_find_start_code(data, length, 0); offset < length; ) {
+    size_t nal = offset + 3;
+    size_t next = dummy_frames_find_start_code(data, length, nal);
+    if (nal >= length) {
+      break;
+    }
+
+    // the 4 bytes start code
+    size_t nal_start = offset > au_start && data[offset - 1] == 0 ? offset - 1 : offset;
+    int type = data[nal] & 0x1F;
+    bool is_slice = type == 1 || type == 5;
+    bool first_slice = is_slice && nal + 1 < length && (data[nal + 1] & 0x80);
+
+    if (has_slice && (type == 9 || type == 7 || type == 8 || type == 6 || first_slice)) {
+      dummy_frames_add(dummy, au_start, nal_start - au_start, is_keyframe);
+      au_start = nal_start;
+      has_slice = false;
+      is_keyframe = false;
+    }
+
+    has_slice |= is_slice;
+    is_keyframe |= type == 5;
+    offset = next;
+  }
+
+  if (au_start < length) {
+    dummy_frames_add(dummy, au_start, length - au_start, is_keyframe);
+  }
+}
+
+static void dummy_frames_split_raw(buffer_list_t *buf_list)
+{
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  size_t frame_size = buf_list->fmt.sizeimage;
+
+  if (!frame_size) {
+    frame_size = convert_frame_size(buf_list->fmt);
+  }
+
+  if (!frame_size || dummy->length < frame_size) {
+    dummy_frames_add(dummy, 0, dummy->length, true);
+    return;
+  }
+
+  for (size_t offset = 0; offset + frame_size <= dummy->length; offset += frame_size) {
+    dummy_frames_add(dummy, offset, frame_size, true);
+  }
+}
+
+int dummy_frames_load(buffer_list_t *buf_list)
+{
+  buffer_list_dummy_t *dummy = buf_list->dummy;
+  struct stat st;
+
+  if (stat(buf_list->dev->path, &st) < 0) {
+    LOG_ERROR(buf_list, "Can't get stat: %s", buf_list->dev->path);
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    if (dummy_frames_load_directory(buf_list) < 0) {
+      goto error;
+    }
+  } else if (dummy_frames_read_file(dummy, buf_list->dev->path) < 0) {
+    LOG_ERROR(buf_list, "Can't read: %s", buf_list->dev->path);
+  } else if (buf_list->fmt.format == V4L2_PIX_FMT_H264) {
+    dummy_frames_split_h264(dummy);
+  } else if (buf_list->fmt.format == V4L2_PIX_FMT_JPEG || buf_list->fmt.format == V4L2_PIX_FMT_MJPEG) {
+    dummy_frames_add(dummy, 0, dummy->length, true);
+  } else {
+    dummy_frames_split_raw(buf_list);
+  }
+
+  if (!dummy->nframes) {
+    LOG_ERROR(buf_list, "No frames found in: %s", buf_list->dev->path);
+  }
+
+  int keyframes = 0;
+  for (int i = 0; i < dummy->nframes; i++) {
+    keyframes += dummy->frames[i].is_keyframe;
+  }
+
+  LOG_INFO(buf_list, "Loaded %d frames (%d key frames, %zu bytes) from %s",
+    dummy->nframes, keyframes, dummy->length, buf_list->dev->path);
+  return 0;
+
+error:
+  return -1;
+}
@@ -5,24 +5,50 @@
 #include "device/buffer_lock.h"
 #include "util/opts/log.h"
 #include "util/opts/fourcc.h"
+#include "util/trace/trace.h"
 
 #include <inttypes.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 
 #define CAPTURE_TIMEOUT_US (1000*1000)
 #define STALE_TIMEOUT_US (1000*1000*1000)
-#define N_FDS 50
 
-#define MAX_QUEUED_ON_KEYED MAX_BUFFER_QUEUE
+#define MAX_QUEUED_ON_KEYED 0 // up to `queue_depth` of output
 #define MAX_QUEUED_ON_NON_KEYED 1
 #define MAX_CAPTURED_ON_CAMERA 2
 #define MAX_CAPTURED_ON_M2M 2
 
+typedef struct link_pool_entry_s
+{
+  link_t *link; // set for capture lists
+  buffer_list_t *buf_list;
+  int fd; // dup of the device fd, as M2M lists share it
+  bool registered;
+  uint32_t events;
+} link_pool_entry_t;
+
+// The links serviced by a single thread, owning the devices
+// of their capture lists and enqueuing all their buffers
 typedef struct link_pool_s
 {
-  struct pollfd fds[N_FDS];
-  link_t *links[N_FDS];
-  buffer_list_t *capture_lists[N_FDS];
-  buffer_list_t *output_lists[N_FDS];
+  buffer_queue_owner_t owner;
+  int epoll_fd;
+  int timer_fd;
+  uint64_t timer_deadline_us;
+
+  link_t **links;
+  int n_links;
+
+  link_pool_entry_t *entries;
+  int n_entries;
+  struct epoll_event *events;
+
+  pthread_t thread;
+  bool force_active;
+  bool *running;
+  int ret;
 } link_pool_t;
 
 static bool link_needs_buffer_by_callbacks(link_t *link)
@@ -49,7 +75,7 @@ static bool link_needs_buffer_by_sinks(link_t *link)
   for (int j = 0; j < link->n_output_lists; j++) {
     buffer_list_t *output_list = link->output_lists[j];
 
-    if (!output_list->dev->paused) {
+    if (!__atomic_load_n(&output_list->dev->paused, __ATOMIC_RELAXED)) {
       needs = true;
     }
   }
@@ -64,18 +90,18 @@ static int links_count(link_t *all_links)
   return n;
 }
 
-static void links_process_paused(link_t *all_links, bool force_active)
+static void links_process_paused(link_pool_t *pool)
 {
   // This traverses in reverse order as it requires to first fix outputs
   // and go back into captures
 
-  for (int i = links_count(all_links); i-- > 0; ) {
-    link_t *link = &all_links[i];
+  for (int i = pool->n_links; i-- > 0; ) {
+    link_t *link = pool->links[i];
     buffer_list_t *capture_list = link->capture_list;
 
     bool paused = true;
 
-    if (force_active) {
+    if (pool->force_active) {
       paused = false;
     }
 
@@ -87,11 +113,11 @@ static void links_process_paused(link_t *all_links, bool force_active)
       paused = false;
     }
 
-    capture_list->dev->paused = paused;
+    __atomic_store_n(&capture_list->dev->paused, paused, __ATOMIC_RELAXED);
   }
 }
 
-static bool links_enqueue_capture_buffers(buffer_list_t *capture_list, int *timeout_next_ms)
+static bool links_enqueue_capture_buffers(buffer_list_t *capture_list, uint64_t *wakeup_us)
 {
   buffer_t *capture_buf = NULL;
   uint64_t now_us = get_monotonic_time_us(NULL, NULL);
@@ -109,7 +135,7 @@ static bool links_enqueue_capture_buffers(buffer_list_t *capture_list, int *time
 
   // skip if trying to enqueue to fast
   if (capture_list->fmt.interval_us > 0 && now_us - capture_list->last_enqueued_us < capture_list->fmt.interval_us) {
-    *timeout_next_ms = MIN(*timeout_next_ms, (capture_list->last_enqueued_us + capture_list->fmt.interval_us - now_us) / 1000);
+    *wakeup_us = MIN(*wakeup_us, capture_list->last_enqueued_us + capture_list->fmt.interval_us);
 
     LOG_DEBUG(capture_list, "skipping dequeue: %.1f / %.1f. enqueued=%d",
       (now_us - capture_list->last_enqueued_us) / 1000.0f,
@@ -172,65 +198,274 @@ static bool links_enqueue_capture_buffers(buffer_list_t *capture_list, int *time
   return can_enqueue;
 }
 
-static void links_process_capture_buffers(link_t *all_links, int *timeout_next_ms)
+static void links_process_capture_buffers(link_pool_t *pool, uint64_t *wakeup_us)
 {
-  for (int i = 0; all_links[i].capture_list; i++) {
-    link_t *link = &all_links[i];
+  for (int i = 0; i < pool->n_links; i++) {
+    link_t *link = pool->links[i];
     buffer_list_t *capture_list = link->capture_list;
 
-    if (capture_list->dev->paused)
+    if (__atomic_load_n(&capture_list->dev->paused, __ATOMIC_RELAXED))
       continue;
 
-    while (links_enqueue_capture_buffers(capture_list, timeout_next_ms)) {
+    while (links_enqueue_capture_buffers(capture_list, wakeup_us)) {
     }
   }
 }
 
-static int links_build_fds(link_t *all_links, link_pool_t *link_pool)
+static void link_pool_close(link_pool_t *pool)
 {
-  int n = 0;
+  for (int i = 0; i < pool->n_entries; i++) {
+    __atomic_store_n(&pool->entries[i].buf_list->dev->owner, NULL, __ATOMIC_RELEASE);
 
-  for (int i = 0; all_links[i].capture_list; i++) {
+    if (pool->entries[i].fd >= 0) {
+      close(pool->entries[i].fd);
+    }
+  }
+
+  buffer_queue_owner_close(&pool->owner);
+
+  if (pool->timer_fd >= 0) {
+    close(pool->timer_fd);
+  }
+  if (pool->epoll_fd >= 0) {
+    close(pool->epoll_fd);
+  }
+
+  free(pool->links);
+  free(pool->entries);
+  free(pool->events);
+  pool->links = NULL;
+  pool->entries = NULL;
+  pool->events = NULL;
+  pool->n_links = pool->n_entries = 0;
+  pool->epoll_fd = pool->timer_fd = pool->owner.release_fd = -1;
+}
+
+static int link_pool_add_entry(link_pool_t *pool, link_t *link, buffer_list_t *buf_list)
+{
+  link_pool_entry_t *entry = &pool->entries[pool->n_entries++];
+  struct pollfd pollfd = {0};
+
+  entry->link = link;
+  entry->buf_list = buf_list;
+  entry->fd = -1;
+
+  __atomic_store_n(&buf_list->dev->owner, &pool->owner, __ATOMIC_RELEASE);
+
+  if (buffer_list_pollfd(buf_list, &pollfd, false) < 0) {
+    LOG_ERROR(buf_list, "Cannot get pollfd");
+  }
+
+  entry->fd = dup(pollfd.fd);
+  if (entry->fd < 0) {
+    LOG_ERROR(buf_list, "Cannot dup fd=%d", pollfd.fd);
+  }
+
+  return 0;
+
+error:
+  return -1;
+}
+
+static int link_pool_open(link_pool_t *pool, int max_links, int max_entries)
+{
+  struct epoll_event ev = { .events = EPOLLIN };
+
+  pool->epoll_fd = pool->timer_fd = pool->owner.release_fd = -1;
+  pool->links = calloc(max_links, sizeof(link_t*));
+  pool->entries = calloc(max_entries, sizeof(link_pool_entry_t));
+  pool->events = calloc(max_entries + 2, sizeof(struct epoll_event));
+
+  if (buffer_queue_owner_open(&pool->owner) < 0) {
+    LOG_ERROR(NULL, "Cannot create release_fd");
+  }
+
+  pool->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (pool->epoll_fd < 0) {
+    LOG_ERROR(NULL, "Cannot create epoll");
+  }
+
+  pool->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (pool->timer_fd < 0) {
+    LOG_ERROR(NULL, "Cannot create timerfd");
+  }
+
+  // Buffers released by other threads are enqueued back by this thread
+  ev.data.ptr = &pool->owner;
+  if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, pool->owner.release_fd, &ev) < 0) {
+    LOG_ERROR(NULL, "Cannot add release_fd to epoll");
+  }
+
+  ev.data.ptr = &pool->timer_fd;
+  if (epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, pool->timer_fd, &ev) < 0) {
+    LOG_ERROR(NULL, "Cannot add timer_fd to epoll");
+  }
+
+  return 0;
+
+error:
+  return -1;
+}
+
+static link_pool_t *links_find_pool(link_pool_t *pools, int n_pools, device_t *dev)
+{
+  for (int i = 0; i < n_pools; i++) {
+    if (dev->owner == &pools[i].owner) {
+      return &pools[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Assigns all links to a single pool, or each device with its links to a separate pool
+static int links_open_pools(link_t *all_links, bool threaded, link_pool_t *pools)
+{
+  int n_links = links_count(all_links);
+  int max_entries = 0;
+  int n_pools = 0;
+
+  for (int i = 0; i < n_links; i++) {
+    max_entries += 1 + all_links[i].n_output_lists;
+  }
+
+  for (int i = 0; i < n_links; i++) {
     link_t *link = &all_links[i];
-    buffer_list_t *capture_list = link->capture_list;
+    link_pool_t *pool = links_find_pool(pools, n_pools, link->capture_list->dev);
 
-    if (n >= N_FDS) {
-      return -EINVAL;
+    if (!pool && (threaded || n_pools == 0)) {
+      pool = &pools[n_pools++];
+      if (link_pool_open(pool, n_links, max_entries) < 0) {
+        goto error;
+      }
+    } else if (!pool) {
+      pool = &pools[0];
     }
 
-    int count_enqueued = buffer_list_count_enqueued(capture_list);
-    bool can_dequeue = count_enqueued > 0;
+    pool->links[pool->n_links++] = link;
 
-    if (buffer_list_pollfd(capture_list, &link_pool->fds[n], can_dequeue) == 0) {
-      link_pool->capture_lists[n] = capture_list;
-      link_pool->links[n] = link;
-      n++;
+    if (link_pool_add_entry(pool, link, link->capture_list) < 0) {
+      goto error;
     }
+  }
+
+  // Output lists are dequeued by the pool owning their device,
+  // or, if the device has no capture link, by the pool feeding them
+  for (int i = 0; i < n_links; i++) {
+    link_t *link = &all_links[i];
 
     for (int j = 0; j < link->n_output_lists; j++) {
       buffer_list_t *output_list = link->output_lists[j];
+      link_pool_t *pool = links_find_pool(pools, n_pools, output_list->dev);
 
-      int count_output_enqueued = buffer_list_count_enqueued(output_list);
-      if (count_output_enqueued == 0) {
-        continue;
+      if (!pool) {
+        pool = links_find_pool(pools, n_pools, link->capture_list->dev);
       }
 
-      if (n >= N_FDS) {
-        return -EINVAL;
+      if (link_pool_add_entry(pool, NULL, output_list) < 0) {
+        goto error;
       }
+    }
+  }
 
-      int count_capture_enqueued = buffer_list_count_enqueued(output_list->dev->capture_lists[0]);
+  return n_pools;
 
-      // Can something be dequeued?
-      if (buffer_list_pollfd(output_list, &link_pool->fds[n], count_output_enqueued > count_capture_enqueued) == 0) {
-        link_pool->output_lists[n] = output_list;
-        link_pool->links[n] = NULL;
-        n++;
-      }
+error:
+  for (int i = 0; i < n_pools; i++) {
+    link_pool_close(&pools[i]);
+  }
+  return -1;
+}
+
+static int link_pool_update_entry(link_pool_t *pool, link_pool_entry_t *entry)
+{
+  buffer_list_t *buf_list = entry->buf_list;
+  struct pollfd pollfd = {0};
+  bool active = true;
+  bool can_dequeue;
+
+  if (entry->link) {
+    can_dequeue = buffer_list_count_enqueued(buf_list) > 0;
+  } else {
+    int count_output_enqueued = buffer_list_count_enqueued(buf_list);
+    int count_capture_enqueued = buffer_list_count_enqueued(buf_list->dev->capture_lists[0]);
+
+    // Can something be dequeued?
+    active = count_output_enqueued > 0;
+    can_dequeue = count_output_enqueued > count_capture_enqueued;
+  }
+
+  if (active && buffer_list_pollfd(buf_list, &pollfd, can_dequeue) < 0) {
+    active = false;
+  }
+
+  // poll() and epoll() share the values of the event bits
+  uint32_t events = active ? pollfd.events : 0;
+
+  if (entry->registered == active && entry->events == events) {
+    return 0;
+  }
+
+  struct epoll_event ev = { .events = events, .data.ptr = entry };
+  int op = !active ? EPOLL_CTL_DEL : entry->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+  if (epoll_ctl(pool->epoll_fd, op, entry->fd, &ev) < 0) {
+    LOG_ERROR(buf_list, "Cannot update epoll: op=%d, events=%08x", op, events);
+  }
+
+  entry->registered = active;
+  entry->events = events;
+  return 0;
+
+error:
+  return -1;
+}
+
+static int link_pool_update(link_pool_t *pool)
+{
+  for (int i = 0; i < pool->n_entries; i++) {
+    if (link_pool_update_entry(pool, &pool->entries[i]) < 0) {
+      return -1;
     }
   }
 
-  return n;
+  return 0;
+}
+
+static int link_pool_arm_timer(link_pool_t *pool, uint64_t wakeup_us)
+{
+  // The armed timer fires early enough
+  if (pool->timer_deadline_us && pool->timer_deadline_us <= wakeup_us) {
+    return 0;
+  }
+
+  struct itimerspec its = {
+    .it_value = {
+      .tv_sec = wakeup_us / (1000*1000),
+      .tv_nsec = wakeup_us % (1000*1000) * 1000
+    }
+  };
+
+  if (timerfd_settime(pool->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+    LOG_ERROR(NULL, "Cannot arm timer_fd");
+  }
+
+  pool->timer_deadline_us = wakeup_us;
+  return 0;
+
+error:
+  return -1;
+}
+
+static void link_pool_read_timer(link_pool_t *pool)
+{
+  uint64_t expirations;
+
+  if (read(pool->timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+    LOG_INFO(NULL, "Cannot read timer_fd: %s", strerror(errno));
+  }
+
+  pool->timer_deadline_us = 0;
 }
 
 static int links_enqueue_from_capture_list(buffer_list_t *capture_list, link_t *link)
@@ -251,6 +486,12 @@ static int links_enqueue_from_capture_list(buffer_list_t *capture_list, link_t *
     return 0;
   }
 
+  if (buf->flags.is_error) {
+    LOG_DEBUG(buf, "Capture image is corrupt. Skipped.");
+    capture_list->stats.errors++;
+    return 0;
+  }
+
   uint64_t now_us = get_monotonic_time_us(NULL, NULL);
   if ((now_us - buf->captured_time_us) > CAPTURE_TIMEOUT_US) {
     LOG_INFO(buf, "Capture image is outdated. Skipped. Now: %" PRIu64 ", vs %" PRIu64 ".",
@@ -263,12 +504,9 @@ static int links_enqueue_from_capture_list(buffer_list_t *capture_list, link_t *
   int max_bufs_queued = buf->flags.is_keyed ? MAX_QUEUED_ON_KEYED : MAX_QUEUED_ON_NON_KEYED;
 
   for (int j = 0; j < link->n_output_lists; j++) {
-    if (link->output_lists[j]->dev->paused) {
+    if (__atomic_load_n(&link->output_lists[j]->dev->paused, __ATOMIC_RELAXED)) {
       continue;
     }
-    if (buf->flags.is_keyframe) {
-      buffer_list_clear_queue(link->output_lists[j]);
-    }
     if (!buffer_list_push_to_queue(link->output_lists[j], buf, max_bufs_queued)) {
       dropped = true;
     }
@@ -280,11 +518,15 @@ static int links_enqueue_from_capture_list(buffer_list_t *capture_list, link_t *
 
   for (int j = 0; j < link->n_callbacks; j++) {
     if (link->callbacks[j].on_buffer) {
+      uint64_t trace = trace_begin();
       link->callbacks[j].on_buffer(buf);
+      trace_end(trace, "on_buffer", capture_list->name);
     }
 
     if (link->callbacks[j].buf_lock) {
+      uint64_t trace = trace_begin();
       buffer_lock_capture(link->callbacks[j].buf_lock, buf);
+      trace_end(trace, "buffer_lock_capture", link->callbacks[j].buf_lock->name);
     }
   }
 
@@ -307,77 +549,91 @@ error:
   return -1;
 }
 
-static void print_pollfds(struct pollfd *fds, int n)
+static void print_epoll_events(link_pool_t *pool, struct epoll_event *events, int n)
 {
   if (!getenv("DEBUG_FDS")) {
     return;
   }
 
+  for (int i = 0; i < pool->n_entries; i++) {
+    link_pool_entry_t *entry = &pool->entries[i];
+    printf("epoll(i=%i, fd=%d, registered=%d, events=%08x)\n", i, entry->fd, entry->registered, entry->events);
+  }
+
   for (int i = 0; i < n; i++) {
-    printf("poll(i=%i, fd=%d, events=%08x, revents=%08x)\n", i, fds[i].fd, fds[i].events, fds[i].revents);
+    printf("epoll(ready=%i, revents=%08x)\n", i, events[i].events);
   }
-  printf("pollfds = %d\n", n);
+  printf("epoll events = %d\n", n);
 }
 
-static int links_step(link_t *all_links, bool force_active, int timeout_now_ms, int *timeout_next_ms)
+static int links_step(link_pool_t *pool)
 {
-  link_pool_t pool = {
-    .fds = {{0}},
-    .links = {0},
-    .capture_lists = {0},
-    .output_lists = {0}
-  };
+  uint64_t wakeup_us = get_monotonic_time_us(NULL, NULL) + LINKS_LOOP_INTERVAL * 1000;
 
-  links_process_paused(all_links, force_active);
-  links_process_capture_buffers(all_links, timeout_next_ms);
+  links_process_paused(pool);
+  links_process_capture_buffers(pool, &wakeup_us);
 
-  int n = links_build_fds(all_links, &pool);
-  print_pollfds(pool.fds, n);
-  int ret = poll(pool.fds, n, timeout_now_ms);
-  print_pollfds(pool.fds, n);
+  if (link_pool_update(pool) < 0 || link_pool_arm_timer(pool, wakeup_us) < 0) {
+    return -1;
+  }
+
+  uint64_t trace = trace_begin();
+  int n = epoll_wait(pool->epoll_fd, pool->events, pool->n_entries + 2, -1);
+  trace_end(trace, "poll", NULL);
+  print_epoll_events(pool, pool->events, n);
 
-  if (ret < 0 && errno != EINTR) {
-    return errno;
+  if (n < 0) {
+    return errno == EINTR ? 0 : errno;
   }
 
   for (int i = 0; i < n; i++) {
-    buffer_list_t *capture_list = pool.capture_lists[i];
-    buffer_list_t *output_list = pool.output_lists[i];
-    buffer_list_t *buf_list = capture_list ? capture_list : output_list;
-    link_t *link = pool.links[i];
-
-    LOG_DEBUG(buf_list, "pool event=%08x revent=%s%s%s%s%s%08x streaming=%d enqueued=%d/%d paused=%d",
-      pool.fds[i].events,
-      !pool.fds[i].revents ? "NONE/" : "",
-      pool.fds[i].revents & POLLIN ? "IN/" : "",
-      pool.fds[i].revents & POLLOUT ? "OUT/" : "",
-      pool.fds[i].revents & POLLHUP ? "HUP/" : "",
-      pool.fds[i].revents & POLLERR ? "ERR/" : "",
-      pool.fds[i].revents,
-      buf_list->streaming,
-      buffer_list_count_enqueued(buf_list),
-      buf_list->nbufs,
-      buf_list->dev->paused);
+    struct epoll_event *ev = &pool->events[i];
 
-    if (pool.fds[i].revents & POLLIN) {
-      if (links_enqueue_from_capture_list(capture_list, link) < 0) {
-        return -1;
-      }
+    if (ev->data.ptr == &pool->owner) {
+      buffer_queue_process_released(&pool->owner);
+      continue;
+    }
+
+    if (ev->data.ptr == &pool->timer_fd) {
+      link_pool_read_timer(pool);
+      continue;
     }
 
-    // Dequeue buffers that were processed
-    if (pool.fds[i].revents & POLLOUT) {
-      if (links_dequeue_from_output_list(output_list) < 0) {
-        return -1;
+    link_pool_entry_t *entry = ev->data.ptr;
+    buffer_list_t *buf_list = entry->buf_list;
+    uint32_t revents = ev->events;
+
+    LOG_DEBUG(buf_list, "pool event=%08x revent=%s%s%s%s%08x streaming=%d enqueued=%d/%d paused=%d",
+      entry->events,
+      revents & EPOLLIN ? "IN/" : "",
+      revents & EPOLLOUT ? "OUT/" : "",
+      revents & EPOLLHUP ? "HUP/" : "",
+      revents & EPOLLERR ? "ERR/" : "",
+      revents,
+      buf_list->streaming,
+      buffer_list_count_enqueued(buf_list),
+      buf_list->nbufs,
+      __atomic_load_n(&buf_list->dev->paused, __ATOMIC_RELAXED));
+
+    if (revents & (EPOLLIN | EPOLLOUT)) {
+      if (buf_list->do_capture) {
+        if (links_enqueue_from_capture_list(buf_list, entry->link) < 0) {
+          return -1;
+        }
+      } else {
+        // Dequeue buffers that were processed
+        if (links_dequeue_from_output_list(buf_list) < 0) {
+          return -1;
+        }
       }
     }
 
-    if (pool.fds[i].revents & POLLHUP) {
+    if (revents & EPOLLHUP) {
       LOG_INFO(buf_list, "Device disconnected.");
       return -1;
     }
 
-    if (pool.fds[i].revents & POLLERR) {
+    if (revents & EPOLLERR) {
       LOG_INFO(buf_list, "Got an error");
       return -1;
     }
@@ -431,8 +687,8 @@ static void links_refresh_stats(link_t *all_links, uint64_t *last_refresh_us)
         (now->dropped - prev->dropped) / log_options.stats,
         capture_list->last_capture_time_us > 0 ? capture_list->last_capture_time_us / 1000 : -1,
         capture_list->last_in_queue_time_us > 0 ? capture_list->last_in_queue_time_us / 1000 : -1,
-        capture_list->streaming ? (capture_list->dev->paused ? 'P' : 'S') : 'X',
-        capture_list->dev->output_list ? capture_list->dev->output_list->n_queued_bufs : 0,
+        capture_list->streaming ? (__atomic_load_n(&capture_list->dev->paused, __ATOMIC_RELAXED) ? 'P' : 'S') : 'X',
+        capture_list->dev->output_list ? buffer_list_count_queued(capture_list->dev->output_list) : 0,
         capture_list->dev->output_list ? buffer_list_count_enqueued(capture_list->dev->output_list) : 0,
         buffer_list_count_enqueued(capture_list)
       );
@@ -453,27 +709,77 @@ static void links_refresh_stats(link_t *all_links, uint64_t *last_refresh_us)
   }
 }
 
-int links_loop(link_t *all_links, bool force_active, bool *running)
+static void *links_pool_thread(link_pool_t *pool)
+{
+  trace_thread_name("links");
+  buffer_queue_attach_owner(&pool->owner);
+
+  while(__atomic_load_n(pool->running, __ATOMIC_RELAXED) && pool->ret == 0) {
+    pool->ret = links_step(pool);
+  }
+
+  // Stop all other pools
+  __atomic_store_n(pool->running, false, __ATOMIC_RELAXED);
+  buffer_queue_detach_owner();
+  return NULL;
+}
+
+int links_loop(link_t *all_links, bool force_active, bool threaded, bool *running)
 {
+  link_pool_t pools[links_count(all_links) + 1];
+  int ret = 0;
+
+  memset(pools, 0, sizeof(pools));
   *running = true;
 
-  if (links_stream(all_links, true) < 0) {
+  int n_pools = links_open_pools(all_links, threaded, pools);
+  if (n_pools < 0) {
     return -1;
   }
 
-  int timeout_ms = LINKS_LOOP_INTERVAL;
-  uint64_t last_refresh_us = get_monotonic_time_us(NULL, NULL);
-  int ret = 0;
+  for (int i = 0; i < n_pools; i++) {
+    pools[i].force_active = force_active;
+    pools[i].running = running;
+  }
+
+  LOG_INFO(NULL, "Running %d links on %d threads", links_count(all_links), n_pools);
+
+  buffer_queue_attach_owner(&pools[0].owner);
+  trace_thread_name("links");
+
+  if (links_stream(all_links, true) < 0) {
+    ret = -1;
+    goto error;
+  }
 
-  while(*running && ret == 0) {
-    int timeout_now_ms = timeout_ms;
-    timeout_ms = LINKS_LOOP_INTERVAL;
+  for (int i = 1; i < n_pools; i++) {
+    pthread_create(&pools[i].thread, NULL, (void *(*)(void *))links_pool_thread, &pools[i]);
+  }
+
+  uint64_t last_refresh_us = get_monotonic_time_us(NULL, NULL);
 
-    ret = links_step(all_links, force_active, timeout_now_ms, &timeout_ms);
+  while(__atomic_load_n(running, __ATOMIC_RELAXED) && pools[0].ret == 0) {
+    pools[0].ret = links_step(&pools[0]);
     links_refresh_stats(all_links, &last_refresh_us);
   }
 
+  __atomic_store_n(running, false, __ATOMIC_RELAXED);
+  ret = pools[0].ret;
+
+  for (int i = 1; i < n_pools; i++) {
+    pthread_join(pools[i].thread, NULL);
+    if (!ret) {
+      ret = pools[i].ret;
+    }
+  }
+
   links_stream(all_links, false);
+
+error:
+  for (int i = 0; i < n_pools; i++) {
+    link_pool_close(&pools[i]);
+  }
+  buffer_queue_detach_owner();
   return ret;
 }
 
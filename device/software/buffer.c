@@ -0,0 +1,82 @@
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+
+int software_buffer_open(buffer_t *buf)
+{
+  buffer_list_t *buf_list = buf->buf_list;
+
+  // The non-mmap output buffers use the `dma_source` memory
+  if (!buf_list->do_mmap) {
+    return 0;
+  }
+
+  buf->start = malloc(buf_list->fmt.sizeimage);
+  if (!buf->start) {
+    LOG_ERROR(buf, "Can't allocate %u bytes", buf_list->fmt.sizeimage);
+  }
+
+  buf->length = buf_list->fmt.sizeimage;
+  return 0;
+
+error:
+  return -1;
+}
+
+void software_buffer_close(buffer_t *buf)
+{
+  if (buf->buf_list->do_mmap) {
+    free(buf->start);
+  }
+  buf->start = NULL;
+}
+
+int software_buffer_enqueue(buffer_t *buf, const char *who)
+{
+  device_software_t *software = buf->buf_list->dev->software;
+
+  pthread_mutex_lock(&software->lock);
+  if (buf->buf_list->do_capture) {
+    software->pending_captures[software->n_pending_captures++] = buf;
+  } else {
+    software->pending_outputs[software->n_pending_outputs++] = buf;
+  }
+  pthread_cond_broadcast(&software->cond);
+  pthread_mutex_unlock(&software->lock);
+  return 0;
+}
+
+int software_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp)
+{
+  unsigned index = 0;
+  int n = read(buf_list->software->fds[0], &index, sizeof(index));
+  if (n != sizeof(index)) {
+    LOG_INFO(buf_list, "Received invalid result from `read`: %d", n);
+    return -1;
+  }
+
+  if (index >= (unsigned)buf_list->nbufs) {
+    LOG_INFO(buf_list, "Received invalid index from `read`: %d >= %d", index, buf_list->nbufs);
+    return -1;
+  }
+
+  *bufp = buf_list->bufs[index];
+  return 0;
+}
+
+int software_buffer_list_pollfd(buffer_list_t *buf_list, struct pollfd *pollfd, bool can_dequeue)
+{
+  int count_enqueued = buffer_list_count_enqueued(buf_list);
+  pollfd->fd = buf_list->software->fds[0]; // read end, written by the device thread
+  pollfd->events = POLLHUP;
+
+  // The pipe is readable only once the device is done with the buffer,
+  // so the processed output buffers are dequeued as soon as possible
+  if ((can_dequeue || !buf_list->do_capture) && count_enqueued > 0) {
+    pollfd->events |= POLLIN;
+  }
+  pollfd->revents = 0;
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+
+#include <linux/videodev2.h>
+
+static bool software_has_format(const unsigned *formats, unsigned format)
+{
+  for (int i = 0; formats[i]; i++) {
+    if (formats[i] == format) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int software_buffer_list_open(buffer_list_t *buf_list)
+{
+  const software_codec_t *codec = buf_list->dev->software->codec;
+  buffer_format_t *fmt = &buf_list->fmt;
+
+  buf_list->software = calloc(1, sizeof(buffer_list_software_t));
+  buf_list->software->fds[0] = -1;
+  buf_list->software->fds[1] = -1;
+
+  if (!software_has_format(buf_list->do_capture ? codec->capture_formats : codec->output_formats, fmt->format)) {
+    LOG_ERROR(buf_list, "The format '%s' is not supported by '%s'",
+      fourcc_to_string(fmt->format).buf, codec->name);
+  }
+
+  if (!fmt->width || !fmt->height || !fmt->nbufs) {
+    LOG_ERROR(buf_list, "Invalid format: %ux%u, buffers=%u", fmt->width, fmt->height, fmt->nbufs);
+  }
+
+  if (pipe2(buf_list->software->fds, O_DIRECT|O_CLOEXEC|O_NONBLOCK) < 0) {
+    LOG_ERROR(buf_list, "Cannot open `pipe2`.");
+  }
+
+  switch (fmt->format) {
+  case V4L2_PIX_FMT_YUYV:
+    fmt->bytesperline = MAX(fmt->bytesperline, fmt->width * 2);
+    fmt->sizeimage = MAX(fmt->sizeimage, fmt->bytesperline * fmt->height);
+    break;
+
+  case V4L2_PIX_FMT_YUV420:
+  case V4L2_PIX_FMT_YVU420:
+  case V4L2_PIX_FMT_NV12:
+  case V4L2_PIX_FMT_NV21:
+    fmt->bytesperline = MAX(fmt->bytesperline, fmt->width);
+    fmt->sizeimage = MAX(fmt->sizeimage, fmt->bytesperline * (fmt->height + (fmt->height + 1) / 2));
+    break;
+
+  case V4L2_PIX_FMT_SRGGB10P:
+  case V4L2_PIX_FMT_SGRBG10P:
+  case V4L2_PIX_FMT_SGBRG10P:
+  case V4L2_PIX_FMT_SBGGR10P:
+    fmt->bytesperline = MAX(fmt->bytesperline, fmt->width * 5 / 4);
+    fmt->sizeimage = MAX(fmt->sizeimage, fmt->bytesperline * fmt->height);
+    break;
+
+  case V4L2_PIX_FMT_SRGGB10:
+  case V4L2_PIX_FMT_SGRBG10:
+  case V4L2_PIX_FMT_SGBRG10:
+  case V4L2_PIX_FMT_SBGGR10:
+    fmt->bytesperline = MAX(fmt->bytesperline, fmt->width * 2);
+    fmt->sizeimage = MAX(fmt->sizeimage, fmt->bytesperline * fmt->height);
+    break;
+
+  default:
+    // compressed: enough for 16 bits per pixel
+    fmt->bytesperline = 0;
+    if (!fmt->sizeimage) {
+      fmt->sizeimage = fmt->width * fmt->height * 2;
+    }
+    break;
+  }
+
+  return fmt->nbufs;
+
+error:
+  return -1;
+}
+
+void software_buffer_list_close(buffer_list_t *buf_list)
+{
+  if (buf_list->software) {
+    if (buf_list->software->fds[0] >= 0)
+      close(buf_list->software->fds[0]);
+    if (buf_list->software->fds[1] >= 0)
+      close(buf_list->software->fds[1]);
+  }
+
+  free(buf_list->software);
+  buf_list->software = NULL;
+}
+
+int software_buffer_list_set_stream(buffer_list_t *buf_list, bool do_on)
+{
+  device_software_t *software = buf_list->dev->software;
+
+  if (do_on) {
+    return 0;
+  }
+
+  // Wait for the frame being processed, and take back the pending buffers
+  pthread_mutex_lock(&software->lock);
+  while (software->processing) {
+    pthread_cond_wait(&software->cond, &software->lock);
+  }
+  if (buf_list->do_capture) {
+    software->n_pending_captures = 0;
+  } else {
+    software->n_pending_outputs = 0;
+  }
+  pthread_mutex_unlock(&software->lock);
+
+  unsigned index;
+  while (read(buf_list->software->fds[0], &index, sizeof(index)) > 0) {
+  }
+
+  // forcefully dequeue all buffers
+  for (int i = 0; i < buf_list->nbufs; i++) {
+    buffer_t *buf = buf_list->bufs[i];
+    if (!buf->enqueued)
+      continue;
+
+    if (buf->dma_source) {
+      buf->dma_source->used = 0;
+      buffer_consumed(buf->dma_source, "stream-off");
+      buf->dma_source = NULL;
+    }
+
+    buffer_set_enqueued(buf, false);
+    buf->mmap_reflinks = 1;
+  }
+
+  return 0;
+}
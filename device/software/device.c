@@ -0,0 +1,223 @@
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/control.h"
+#include "util/trace/trace.h"
+
+#include <inttypes.h>
+
+static void software_device_pop(buffer_t **bufs, int *n)
+{
+  memmove(&bufs[0], &bufs[1], --(*n) * sizeof(buffer_t*));
+}
+
+static int software_device_complete(buffer_t *buf)
+{
+  unsigned index = buf->index;
+  if (write(buf->buf_list->software->fds[1], &index, sizeof(index)) != sizeof(index)) {
+    LOG_INFO(buf, "Cannot complete buffer: %s", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void software_device_process(device_t *dev, buffer_t *output, buffer_t *capture, unsigned seq)
+{
+  device_software_t *software = dev->software;
+
+  uint64_t trace = trace_begin();
+  uint64_t before = get_monotonic_time_us(NULL, NULL);
+  int ret = software->codec->process(dev, output, capture);
+  uint64_t after = get_monotonic_time_us(NULL, NULL);
+  trace_end(trace, "process", dev->name);
+
+  capture->buf_list->last_process_time_us = after - before;
+
+  LOG_DEBUG(capture, "Processed %s: used=%zu => %zu, time=%" PRIu64 "us, ret=%d",
+    output->name, output->used, capture->used, after - before, ret);
+
+  // The frames processed at once are completed in order
+  pthread_mutex_lock(&software->lock);
+  while (software->completed_seq != seq) {
+    pthread_cond_wait(&software->cond, &software->lock);
+  }
+
+  // The failed frame is returned too, to be dropped by the links
+  capture->captured_time_us = output->captured_time_us;
+  capture->flags.is_error = ret < 0;
+  software_device_complete(output);
+  software_device_complete(capture);
+
+  software->completed_seq++;
+  pthread_cond_broadcast(&software->cond);
+  pthread_mutex_unlock(&software->lock);
+}
+
+static void *software_device_thread(device_t *dev)
+{
+  device_software_t *software = dev->software;
+
+  trace_thread_name(dev->name);
+
+  pthread_mutex_lock(&software->lock);
+  int index = software->n_thread_indexes++;
+
+  while (1) {
+    while (software->running && (index >= software->n_threads ||
+      !software->n_pending_outputs || !software->n_pending_captures)) {
+      pthread_cond_wait(&software->cond, &software->lock);
+    }
+    if (!software->running) {
+      break;
+    }
+
+    buffer_t *output = software->pending_outputs[0];
+    buffer_t *capture = software->pending_captures[0];
+    software_device_pop(software->pending_outputs, &software->n_pending_outputs);
+    software_device_pop(software->pending_captures, &software->n_pending_captures);
+    unsigned seq = software->next_seq++;
+    software->processing++;
+    pthread_mutex_unlock(&software->lock);
+
+    software_device_process(dev, output, capture, seq);
+
+    pthread_mutex_lock(&software->lock);
+    software->processing--;
+    pthread_cond_broadcast(&software->cond);
+  }
+  pthread_mutex_unlock(&software->lock);
+  return NULL;
+}
+
+int software_device_set_threads(device_t *dev, int n_threads)
+{
+  device_software_t *software = dev->software;
+
+  n_threads = MAX(MIN(MIN(n_threads, software->codec->max_threads), SOFTWARE_MAX_THREADS), 1);
+
+  // The threads above `n_threads` stay idle
+  pthread_mutex_lock(&software->lock);
+  software->n_threads = n_threads;
+  pthread_cond_broadcast(&software->cond);
+  pthread_mutex_unlock(&software->lock);
+
+  while (software->n_started < n_threads) {
+    if (pthread_create(&software->threads[software->n_started], NULL, (void *(*)(void *))software_device_thread, dev) != 0) {
+      LOG_ERROR(dev, "Cannot start thread: %s", strerror(errno));
+    }
+    software->n_started++;
+  }
+
+  return n_threads;
+
+error:
+  return -1;
+}
+
+int software_device_open(device_t *dev)
+{
+  dev->software = calloc(1, sizeof(device_software_t));
+
+  for (int i = 0; software_codecs[i]; i++) {
+    if (!strncmp(dev->path, "software:", 9) && !strcmp(dev->path + 9, software_codecs[i]->name)) {
+      dev->software->codec = software_codecs[i];
+      break;
+    }
+  }
+
+  if (!dev->software->codec) {
+    LOG_ERROR(dev, "Unknown software codec: %s", dev->path);
+  }
+
+  if (dev->software->codec->open && dev->software->codec->open(dev) < 0) {
+    LOG_ERROR(dev, "Cannot open software codec: %s", dev->software->codec->name);
+  }
+
+  pthread_mutex_init(&dev->software->lock, NULL);
+  pthread_cond_init(&dev->software->cond, NULL);
+  dev->software->running = true;
+
+  // One frame per CPU processed at once, if supported by the codec
+  if (software_device_set_threads(dev, sysconf(_SC_NPROCESSORS_ONLN)) < 0) {
+    goto error;
+  }
+
+	LOG_INFO(dev, "Device path=%s opened", dev->path);
+  return 0;
+
+error:
+  return -1;
+}
+
+void software_device_close(device_t *dev)
+{
+  if (!dev->software) {
+    return;
+  }
+
+  if (dev->software->running) {
+    pthread_mutex_lock(&dev->software->lock);
+    dev->software->running = false;
+    pthread_cond_broadcast(&dev->software->cond);
+    pthread_mutex_unlock(&dev->software->lock);
+  }
+
+  for (int i = 0; i < dev->software->n_started; i++) {
+    pthread_join(dev->software->threads[i], NULL);
+  }
+
+  if (dev->software->codec && dev->software->codec->close) {
+    dev->software->codec->close(dev);
+  }
+
+  free(dev->software);
+  dev->software = NULL;
+}
+
+int software_device_video_force_key(device_t *dev)
+{
+  if (!dev->software->codec->force_key) {
+    return -1;
+  }
+
+  return dev->software->codec->force_key(dev);
+}
+
+void software_device_dump_options(device_t *dev, FILE *stream)
+{
+  fprintf(stream, "%s Options:\n", dev->name);
+
+  if (dev->software->codec->max_threads > 1) {
+    fprintf(stream, "- available option: frame_threads [1..%d], current=%d\n",
+      dev->software->codec->max_threads, dev->software->n_threads);
+  }
+
+  if (dev->software->codec->dump_options) {
+    dev->software->codec->dump_options(dev, stream);
+  }
+}
+
+int software_device_set_option(device_t *dev, const char *key, const char *value)
+{
+  char *keyp = strdup(key);
+  int ret = -1;
+
+  device_option_normalize_name(keyp, keyp);
+
+  if (!strcmp(keyp, "framethreads") && dev->software->codec->max_threads > 1) {
+    ret = software_device_set_threads(dev, atoi(value));
+  } else if (dev->software->codec->set_option) {
+    ret = dev->software->codec->set_option(dev, keyp, value);
+  }
+
+  if (ret < 0) {
+    LOG_INFO(dev, "The '%s=%s' was failed to find.", key, value);
+  } else {
+    LOG_INFO(dev, "Configuring option %s = %s", keyp, value);
+  }
+
+  free(keyp);
+  return ret;
+}
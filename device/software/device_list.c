@@ -0,0 +1,41 @@
+#include "software.h"
+#include "device/device.h"
+#include "device/device_list.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+static void device_list_copy_formats(device_info_formats_t *formats, const unsigned *codec_formats)
+{
+  for (int i = 0; codec_formats[i]; i++) {
+    formats->n++;
+    formats->formats = realloc(formats->formats, sizeof(formats->formats[0]) * formats->n);
+    formats->formats[formats->n - 1] = codec_formats[i];
+  }
+}
+
+device_list_t *device_list_software(device_list_t *list)
+{
+  if (!list) {
+    list = calloc(1, sizeof(device_list_t));
+  }
+
+  // Appended after the hardware devices, which are found first
+  for (int i = 0; software_codecs[i]; i++) {
+    const software_codec_t *codec = software_codecs[i];
+
+    device_info_t info = {NULL};
+    asprintf(&info.name, "Software %s", codec->name);
+    asprintf(&info.path, "software:%s", codec->name);
+    info.m2m = true;
+    info.open = device_software_open;
+    device_list_copy_formats(&info.output_formats, codec->output_formats);
+    device_list_copy_formats(&info.capture_formats, codec->capture_formats);
+
+    list->ndevices++;
+    list->devices = realloc(list->devices, sizeof(info) * list->ndevices);
+    list->devices[list->ndevices-1] = info;
+  }
+
+  return list;
+}
@@ -0,0 +1,362 @@
+#ifdef USE_FFMPEG
+
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+#include <linux/videodev2.h>
+
+// Encodes with the libx264 of libavcodec, tuned for the lowest latency:
+// a frame in, the access unit out, with SPS/PPS repeated before each IDR.
+// The options use the names of the V4L2 controls of the hardware encoder.
+
+#define SOFTWARE_H264_DEFAULT_BITRATE 2000000
+#define SOFTWARE_H264_DEFAULT_I_FRAME_PERIOD 30
+
+typedef struct software_h264_s {
+  int bitrate_mode; // 0 = VBR, 1 = CBR
+  int bitrate;
+  int i_frame_period;
+  int profile, level; // V4L2_MPEG_VIDEO_H264_PROFILE_*, V4L2_MPEG_VIDEO_H264_LEVEL_*
+  int min_qp, max_qp;
+  int threads;
+  bool reopen, force_key;
+
+  AVCodecContext *context;
+  AVFrame *frame;
+  AVPacket *packet;
+  unsigned format, width, height;
+  int64_t last_pts;
+} software_h264_t;
+
+static const char *software_h264_profiles[] = {
+  [V4L2_MPEG_VIDEO_H264_PROFILE_BASELINE] = "baseline",
+  [V4L2_MPEG_VIDEO_H264_PROFILE_CONSTRAINED_BASELINE] = "baseline",
+  [V4L2_MPEG_VIDEO_H264_PROFILE_MAIN] = "main",
+  [V4L2_MPEG_VIDEO_H264_PROFILE_EXTENDED] = "main",
+  [V4L2_MPEG_VIDEO_H264_PROFILE_HIGH] = "high"
+};
+
+static const int software_h264_levels[] = {
+  [V4L2_MPEG_VIDEO_H264_LEVEL_1_0] = 10,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_1B] = 9,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_1_1] = 11,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_1_2] = 12,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_1_3] = 13,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_2_0] = 20,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_2_1] = 21,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_2_2] = 22,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_3_0] = 30,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_3_1] = 31,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_3_2] = 32,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_4_0] = 40,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_4_1] = 41,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_4_2] = 42,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_5_0] = 50,
+  [V4L2_MPEG_VIDEO_H264_LEVEL_5_1] = 51
+};
+
+static void software_h264_close_context(software_h264_t *h264)
+{
+  av_packet_free(&h264->packet);
+  av_frame_free(&h264->frame);
+  avcodec_free_context(&h264->context);
+}
+
+static int software_h264_open_context(device_t *dev, software_h264_t *h264, buffer_list_t *output_list)
+{
+  const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+  if (!codec) {
+    LOG_ERROR(dev, "Cannot find the 'libx264' encoder");
+  }
+
+  software_h264_close_context(h264);
+
+  h264->format = output_list->fmt.format;
+  h264->width = output_list->fmt.width;
+  h264->height = output_list->fmt.height;
+  h264->context = avcodec_alloc_context3(codec);
+  h264->frame = av_frame_alloc();
+  h264->packet = av_packet_alloc();
+  if (!h264->context || !h264->frame || !h264->packet) {
+    LOG_ERROR(dev, "Cannot allocate H264 encoder");
+  }
+
+  AVCodecContext *context = h264->context;
+  context->width = h264->width;
+  context->height = h264->height;
+  context->pix_fmt = h264->format == V4L2_PIX_FMT_NV12 ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+  context->time_base = (AVRational){ 1, 1000 * 1000 }; // the `captured_time_us`
+  context->framerate = (AVRational){ 30, 1 };
+  context->gop_size = h264->i_frame_period;
+  context->max_b_frames = 0;
+  context->bit_rate = h264->bitrate;
+  context->thread_count = h264->threads;
+
+  if (h264->bitrate_mode == V4L2_MPEG_VIDEO_BITRATE_MODE_CBR) {
+    context->rc_max_rate = h264->bitrate;
+    context->rc_buffer_size = h264->bitrate;
+  }
+  if (h264->min_qp > 0) {
+    context->qmin = h264->min_qp;
+  }
+  if (h264->max_qp > 0) {
+    context->qmax = h264->max_qp;
+  }
+  if (h264->level >= 0 && h264->level < (int)ARRAY_SIZE(software_h264_levels)) {
+    context->level = software_h264_levels[h264->level];
+  }
+
+  av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+  av_opt_set(context->priv_data, "tune", "zerolatency", 0);
+  av_opt_set(context->priv_data, "forced-idr", "1", 0);
+  if (h264->profile >= 0 && h264->profile < (int)ARRAY_SIZE(software_h264_profiles) && software_h264_profiles[h264->profile]) {
+    av_opt_set(context->priv_data, "profile", software_h264_profiles[h264->profile], 0);
+  }
+
+  int ret = avcodec_open2(context, codec, NULL);
+  if (ret < 0) {
+    LOG_ERROR(dev, "Cannot open '%s' encoder: %s", codec->name, av_err2str(ret));
+  }
+
+  h264->frame->format = context->pix_fmt;
+  h264->frame->width = context->width;
+  h264->frame->height = context->height;
+  if (av_frame_get_buffer(h264->frame, 0) < 0) {
+    LOG_ERROR(dev, "Cannot allocate H264 frame");
+  }
+
+  LOG_INFO(dev, "Opened '%s' encoder: %ux%u/%s, bitrate=%d, gop=%d",
+    codec->name, h264->width, h264->height, fourcc_to_string(h264->format).buf,
+    h264->bitrate, h264->i_frame_period);
+  h264->reopen = false;
+  return 0;
+
+error:
+  software_h264_close_context(h264);
+  return -1;
+}
+
+static void software_h264_copy_plane(uint8_t *dst, int dst_stride, const uint8_t *src, int src_stride, int width, int height)
+{
+  for (int y = 0; y < height; y++) {
+    memcpy(dst + y * dst_stride, src + y * src_stride, width);
+  }
+}
+
+static void software_h264_fill_frame(software_h264_t *h264, const uint8_t *src, unsigned stride)
+{
+  AVFrame *frame = h264->frame;
+  unsigned width = h264->width, height = h264->height;
+  unsigned chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+
+  switch (h264->format) {
+  case V4L2_PIX_FMT_YUV420:
+    software_h264_copy_plane(frame->data[0], frame->linesize[0], src, stride, width, height);
+    src += stride * height;
+    software_h264_copy_plane(frame->data[1], frame->linesize[1], src, stride / 2, chroma_width, chroma_height);
+    src += stride / 2 * chroma_height;
+    software_h264_copy_plane(frame->data[2], frame->linesize[2], src, stride / 2, chroma_width, chroma_height);
+    break;
+
+  case V4L2_PIX_FMT_NV12:
+    software_h264_copy_plane(frame->data[0], frame->linesize[0], src, stride, width, height);
+    software_h264_copy_plane(frame->data[1], frame->linesize[1], src + stride * height, stride, chroma_width * 2, chroma_height);
+    break;
+
+  case V4L2_PIX_FMT_YUYV:
+    // 4:2:2 => 4:2:0, averaging the chroma of the row pairs
+    for (unsigned y = 0; y < height; y += 2) {
+      const uint8_t *line0 = src + y * stride;
+      const uint8_t *line1 = y + 1 < height ? line0 + stride : line0;
+      uint8_t *y0 = frame->data[0] + y * frame->linesize[0];
+      uint8_t *y1 = y + 1 < height ? y0 + frame->linesize[0] : y0;
+      uint8_t *u = frame->data[1] + y / 2 * frame->linesize[1];
+      uint8_t *v = frame->data[2] + y / 2 * frame->linesize[2];
+
+      for (unsigned x = 0; x < width; x++) {
+        y0[x] = line0[x * 2];
+        y1[x] = line1[x * 2];
+      }
+      for (unsigned x = 0; x < width / 2; x++) {
+        u[x] = (line0[x * 4 + 1] + line1[x * 4 + 1] + 1) / 2;
+        v[x] = (line0[x * 4 + 3] + line1[x * 4 + 3] + 1) / 2;
+      }
+    }
+    break;
+  }
+}
+
+static int software_h264_open(device_t *dev)
+{
+  // The other H264 encoders might buffer frames, and hold back their packets
+  if (!avcodec_find_encoder_by_name("libx264")) {
+    LOG_ERROR(dev, "Cannot find the 'libx264' encoder, the only zero-delay H264 encoder supported");
+  }
+
+  software_h264_t *h264 = calloc(1, sizeof(software_h264_t));
+  h264->bitrate = SOFTWARE_H264_DEFAULT_BITRATE;
+  h264->i_frame_period = SOFTWARE_H264_DEFAULT_I_FRAME_PERIOD;
+  h264->profile = V4L2_MPEG_VIDEO_H264_PROFILE_HIGH;
+  h264->level = -1;
+  dev->software->codec_data = h264;
+  return 0;
+
+error:
+  return -1;
+}
+
+static void software_h264_close(device_t *dev)
+{
+  software_h264_t *h264 = dev->software->codec_data;
+  if (!h264) {
+    return;
+  }
+
+  software_h264_close_context(h264);
+  free(h264);
+  dev->software->codec_data = NULL;
+}
+
+static void software_h264_dump_options(device_t *dev, FILE *stream)
+{
+  software_h264_t *h264 = dev->software->codec_data;
+
+  fprintf(stream, "- available option: video_bitrate_mode [0..1], current=%d\n", h264->bitrate_mode);
+  fprintf(stream, "- available option: video_bitrate [1..], current=%d\n", h264->bitrate);
+  fprintf(stream, "- available option: h264_i_frame_period [0..], current=%d\n", h264->i_frame_period);
+  fprintf(stream, "- available option: h264_profile [0..4], current=%d\n", h264->profile);
+  fprintf(stream, "- available option: h264_level [0..%zu], current=%d\n", ARRAY_SIZE(software_h264_levels) - 1, h264->level);
+  fprintf(stream, "- available option: h264_minimum_qp_value [0..51], current=%d\n", h264->min_qp);
+  fprintf(stream, "- available option: h264_maximum_qp_value [0..51], current=%d\n", h264->max_qp);
+  fprintf(stream, "- available option: threads [0..], current=%d (0 = auto)\n", h264->threads);
+}
+
+static int software_h264_set_option(device_t *dev, const char *key, const char *value)
+{
+  software_h264_t *h264 = dev->software->codec_data;
+  int *option = NULL;
+
+  if (!strcmp(key, "videobitratemode")) {
+    option = &h264->bitrate_mode;
+  } else if (!strcmp(key, "videobitrate")) {
+    option = &h264->bitrate;
+  } else if (!strcmp(key, "h264iframeperiod")) {
+    option = &h264->i_frame_period;
+  } else if (!strcmp(key, "h264profile")) {
+    option = &h264->profile;
+  } else if (!strcmp(key, "h264level")) {
+    option = &h264->level;
+  } else if (!strcmp(key, "h264minimumqpvalue")) {
+    option = &h264->min_qp;
+  } else if (!strcmp(key, "h264maximumqpvalue")) {
+    option = &h264->max_qp;
+  } else if (!strcmp(key, "threads")) {
+    option = &h264->threads;
+  } else if (!strcmp(key, "repeatsequenceheader")) {
+    // SPS/PPS are always sent with each IDR
+    return 1;
+  } else {
+    return -1;
+  }
+
+  *option = MAX(atoi(value), 0);
+
+  // applied on the next frame
+  __atomic_store_n(&h264->reopen, true, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static int software_h264_force_key(device_t *dev)
+{
+  software_h264_t *h264 = dev->software->codec_data;
+
+  __atomic_store_n(&h264->force_key, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static int software_h264_process(device_t *dev, buffer_t *output, buffer_t *capture)
+{
+  software_h264_t *h264 = dev->software->codec_data;
+  buffer_list_t *output_list = output->buf_list;
+  buffer_t *source = output->dma_source ? output->dma_source : output;
+  int ret;
+
+  size_t expected = output_list->fmt.bytesperline * output_list->fmt.height;
+  if (output_list->fmt.format != V4L2_PIX_FMT_YUYV) {
+    expected = expected * 3 / 2;
+  }
+
+  if (!source->start || output->used < expected) {
+    LOG_ERROR(output, "The buffer is too short: used=%zu, expected=%zu", output->used, expected);
+  }
+
+  if (!h264->context || __atomic_load_n(&h264->reopen, __ATOMIC_ACQUIRE) ||
+    h264->format != output_list->fmt.format || h264->width != output_list->fmt.width || h264->height != output_list->fmt.height) {
+    if (software_h264_open_context(dev, h264, output_list) < 0) {
+      goto error;
+    }
+  }
+
+  // the encoder might still reference the previous frame
+  if (av_frame_make_writable(h264->frame) < 0) {
+    LOG_ERROR(dev, "Cannot make the frame writable");
+  }
+
+  software_h264_fill_frame(h264, source->start, output_list->fmt.bytesperline);
+
+  h264->frame->pts = MAX((int64_t)output->captured_time_us, h264->last_pts + 1);
+  h264->frame->pict_type = AV_PICTURE_TYPE_NONE;
+  h264->last_pts = h264->frame->pts;
+
+  if (__atomic_exchange_n(&h264->force_key, false, __ATOMIC_ACQ_REL)) {
+    LOG_DEBUG(dev, "Forcing keyframe ...");
+    h264->frame->pict_type = AV_PICTURE_TYPE_I;
+  }
+
+  ret = avcodec_send_frame(h264->context, h264->frame);
+  if (ret < 0) {
+    LOG_ERROR(dev, "Cannot send frame: %s", av_err2str(ret));
+  }
+
+  // The `zerolatency` libx264 outputs each frame right away
+  ret = avcodec_receive_packet(h264->context, h264->packet);
+  if (ret < 0) {
+    LOG_ERROR(dev, "Cannot receive packet: %s", av_err2str(ret));
+  }
+
+  if (h264->packet->size > capture->length) {
+    int size = h264->packet->size;
+    av_packet_unref(h264->packet);
+    LOG_ERROR(capture, "The packet does not fit: %d vs space=%zu", size, capture->length);
+  }
+
+  memcpy(capture->start, h264->packet->data, h264->packet->size);
+  capture->used = h264->packet->size;
+  capture->flags.is_keyframe = (h264->packet->flags & AV_PKT_FLAG_KEY) != 0;
+  av_packet_unref(h264->packet);
+  return 0;
+
+error:
+  return -1;
+}
+
+const software_codec_t software_h264_codec = {
+  .name = "h264",
+  .output_formats = { V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUYV },
+  .capture_formats = { V4L2_PIX_FMT_H264 },
+
+  .open = software_h264_open,
+  .close = software_h264_close,
+  .dump_options = software_h264_dump_options,
+  .set_option = software_h264_set_option,
+  .force_key = software_h264_force_key,
+  .process = software_h264_process
+};
+
+#endif // USE_FFMPEG
@@ -0,0 +1,623 @@
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+#include "util/convert/convert_kernels.h"
+
+#include <math.h>
+#include <linux/videodev2.h>
+
+// The raw Bayer frame is split into bands of rows, each processed
+// by a worker one row at a time: the rows are unpacked into 16 bits and
+// the black level is subtracted, the missing colors are interpolated,
+// and the white balance gains and the gamma are applied. The RGB row
+// is then converted into the capture format.
+//
+// The green is interpolated from its 4 neighbours, or only from the two
+// along the edge with `demosaic=edge`. The grey-world white balance
+// takes the average of each color of a frame for the gains of the next ones.
+
+#define SOFTWARE_ISP_MAX_BANDS SOFTWARE_MAX_WORKERS
+#define SOFTWARE_ISP_MAX_VALUE 1023
+#define SOFTWARE_ISP_GAIN_BITS 8
+#define SOFTWARE_ISP_PADDING 2 // the pixels mirrored at each side of the rows
+#define SOFTWARE_ISP_STATS_STEP 4 // a pair of rows of each 4 is sampled
+#define SOFTWARE_ISP_AWB_SPEED 0.25f
+
+typedef enum software_isp_demosaic_e {
+  SOFTWARE_ISP_BILINEAR = 0,
+  SOFTWARE_ISP_EDGE_AWARE
+} software_isp_demosaic_t;
+
+typedef struct software_isp_format_s {
+  unsigned format;
+  bool packed;
+  unsigned red_x, red_y; // in the 2x2 pattern
+} software_isp_format_t;
+
+static const software_isp_format_t software_isp_formats[] = {
+  { V4L2_PIX_FMT_SRGGB10P, true, 0, 0 },
+  { V4L2_PIX_FMT_SGRBG10P, true, 1, 0 },
+  { V4L2_PIX_FMT_SGBRG10P, true, 0, 1 },
+  { V4L2_PIX_FMT_SBGGR10P, true, 1, 1 },
+  { V4L2_PIX_FMT_SRGGB10, false, 0, 0 },
+  { V4L2_PIX_FMT_SGRBG10, false, 1, 0 },
+  { V4L2_PIX_FMT_SGBRG10, false, 0, 1 },
+  { V4L2_PIX_FMT_SBGGR10, false, 1, 1 },
+};
+
+// The settings of a frame
+typedef struct software_isp_params_s {
+  unsigned black_level;
+  software_isp_demosaic_t demosaic;
+  unsigned red_gain, blue_gain; // fixed point
+  uint8_t gamma[SOFTWARE_ISP_MAX_VALUE + 1];
+} software_isp_params_t;
+
+typedef struct software_isp_band_s {
+  unsigned first_row, rows;
+
+  uint16_t *raw[3]; // the rows above, at and below, within `scratch`
+  uint8_t *rgb, *y, *u[2], *v[2];
+  uint8_t *scratch;
+  size_t scratch_size;
+
+  // the sums of each color of the sampled rows, and the number of the 2x2 groups
+  uint64_t sums[3];
+  uint64_t groups;
+} software_isp_band_t;
+
+// A frame being processed
+typedef struct software_isp_context_s {
+  bool busy;
+
+  software_workers_t workers;
+  software_isp_band_t band[SOFTWARE_ISP_MAX_BANDS];
+  int n_bands;
+
+  const convert_kernels_t *kernels;
+  const software_isp_format_t *format;
+  software_isp_params_t params;
+
+  const uint8_t *src;
+  buffer_format_t src_fmt;
+  uint8_t *dst;
+  buffer_format_t dst_fmt;
+} software_isp_context_t;
+
+typedef struct software_isp_s {
+  int bands; // 0 = one per CPU
+  software_isp_demosaic_t demosaic;
+  unsigned black_level;
+  float gamma;
+  bool awb;
+  float red_gain, blue_gain;
+
+  pthread_mutex_t lock;
+  uint8_t gamma_table[SOFTWARE_ISP_MAX_VALUE + 1];
+  bool gamma_dirty;
+  software_isp_context_t *contexts[SOFTWARE_MAX_THREADS];
+} software_isp_t;
+
+static const software_isp_format_t *software_isp_find_format(unsigned format)
+{
+  for (int i = 0; i < ARRAY_SIZE(software_isp_formats); i++) {
+    if (software_isp_formats[i].format == format) {
+      return &software_isp_formats[i];
+    }
+  }
+  return NULL;
+}
+
+// Maps the values above the black level into 8 bits, with the `lock` held
+static void software_isp_update_gamma(software_isp_t *isp)
+{
+  float white = MAX(SOFTWARE_ISP_MAX_VALUE - (int)isp->black_level, 1);
+
+  for (int i = 0; i <= SOFTWARE_ISP_MAX_VALUE; i++) {
+    float value = MIN(i / white, 1.0f);
+    isp->gamma_table[i] = (uint8_t)(powf(value, 1.0f / isp->gamma) * 255.0f + 0.5f);
+  }
+
+  isp->gamma_dirty = false;
+}
+
+/* The processing of a band */
+
+// Unpacks the row `y`, mirrored at the edges of the frame, and subtracts the black level
+static void software_isp_unpack_row(software_isp_context_t *context, int y, uint16_t *row)
+{
+  const buffer_format_t *fmt = &context->src_fmt;
+  int width = fmt->width, height = fmt->height;
+  unsigned black_level = context->params.black_level;
+
+  if (y < 0) {
+    y = -y;
+  } else if (y >= height) {
+    y = 2 * height - 2 - y;
+  }
+  y = MAX(MIN(y, height - 1), 0);
+
+  const uint8_t *src = context->src + (size_t)y * fmt->bytesperline;
+  uint16_t *out = row + SOFTWARE_ISP_PADDING;
+
+  if (context->format->packed) {
+    context->kernels->unpack10p16(src, out, width);
+  } else {
+    memcpy(out, src, width * sizeof(uint16_t));
+  }
+
+  for (int x = 0; x < width; x++) {
+    unsigned value = out[x] & SOFTWARE_ISP_MAX_VALUE;
+    out[x] = value > black_level ? value - black_level : 0;
+  }
+
+  // the pixels 2 apart have the same color
+  for (int x = 1; x <= SOFTWARE_ISP_PADDING; x++) {
+    out[-x] = out[MIN(x, width - 1)];
+    out[width - 1 + x] = out[MAX(width - 1 - x, 0)];
+  }
+}
+
+static void software_isp_collect_stats(software_isp_context_t *context, software_isp_band_t *band, const uint16_t *row, int y)
+{
+  int width = context->src_fmt.width;
+  bool red_row = (y & 1) == context->format->red_y;
+  uint64_t sums[2] = { 0, 0 };
+
+  for (int x = 0; x < width; x += 2) {
+    sums[0] += row[x];
+    sums[1] += row[x + 1];
+  }
+
+  // the pixels at `red_x` are red or green
+  unsigned red_x = context->format->red_x;
+  if (red_row) {
+    band->sums[0] += sums[red_x];
+    band->sums[1] += sums[!red_x];
+    band->groups += width / 2;
+  } else {
+    band->sums[1] += sums[red_x];
+    band->sums[2] += sums[!red_x];
+  }
+}
+
+static void software_isp_demosaic_row(software_isp_context_t *context, const uint16_t *above, const uint16_t *row, const uint16_t *below, uint8_t *rgb, int y)
+{
+  const software_isp_params_t *params = &context->params;
+  int width = context->src_fmt.width;
+  bool red_row = (y & 1) == context->format->red_y;
+  unsigned red_x = context->format->red_x;
+  bool edge_aware = params->demosaic == SOFTWARE_ISP_EDGE_AWARE;
+
+  for (int x = 0; x < width; x++, rgb += 3) {
+    int center = row[x], left = row[x - 1], right = row[x + 1];
+    int up = above[x], down = below[x];
+    int red, green, blue;
+
+    if (((x & 1) == red_x) != red_row) {
+      int horizontal = (left + right + 1) >> 1;
+      int vertical = (up + down + 1) >> 1;
+
+      green = center;
+      red = red_row ? horizontal : vertical;
+      blue = red_row ? vertical : horizontal;
+    } else {
+      int diagonal = (above[x - 1] + above[x + 1] + below[x - 1] + below[x + 1] + 2) >> 2;
+      int dh = abs(left - right), dv = abs(up - down);
+
+      if (edge_aware && dh < dv) {
+        green = (left + right + 1) >> 1;
+      } else if (edge_aware && dv < dh) {
+        green = (up + down + 1) >> 1;
+      } else {
+        green = (left + right + up + down + 2) >> 2;
+      }
+
+      red = red_row ? center : diagonal;
+      blue = red_row ? diagonal : center;
+    }
+
+    red = (red * params->red_gain) >> SOFTWARE_ISP_GAIN_BITS;
+    blue = (blue * params->blue_gain) >> SOFTWARE_ISP_GAIN_BITS;
+
+    rgb[0] = params->gamma[MIN(red, SOFTWARE_ISP_MAX_VALUE)];
+    rgb[1] = params->gamma[green];
+    rgb[2] = params->gamma[MIN(blue, SOFTWARE_ISP_MAX_VALUE)];
+  }
+}
+
+// Converts the 4:2:2 row `y` of the band into the capture format
+static void software_isp_write_row(software_isp_context_t *context, software_isp_band_t *band, int y)
+{
+  const convert_kernels_t *kernels = context->kernels;
+  const buffer_format_t *fmt = &context->dst_fmt;
+  int width = fmt->width, chroma_width = width / 2;
+  uint8_t *plane = context->dst + (size_t)fmt->bytesperline * fmt->height;
+  int pair = y & 1;
+
+  if (fmt->format == V4L2_PIX_FMT_YUYV) {
+    kernels->rgb_to_yuv(band->rgb, band->y, band->u[0], band->v[0], width, false);
+    kernels->yuyv_join(band->y, band->u[0], band->v[0], context->dst + (size_t)y * fmt->bytesperline, width);
+    return;
+  }
+
+  kernels->rgb_to_yuv(band->rgb, context->dst + (size_t)y * fmt->bytesperline, band->u[pair], band->v[pair], width, false);
+
+  // the chroma of each pair of rows, or of the last odd row
+  if (!pair && y + 1 < (int)fmt->height) {
+    return;
+  }
+
+  uint8_t *u = band->u[0], *v = band->v[0];
+  int row = y / 2;
+
+  if (pair) {
+    kernels->average(band->u[0], band->u[1], u, chroma_width);
+    kernels->average(band->v[0], band->v[1], v, chroma_width);
+  }
+
+  if (fmt->format == V4L2_PIX_FMT_YUV420) {
+    unsigned stride = fmt->bytesperline / 2;
+    memcpy(plane + (size_t)row * stride, u, chroma_width);
+    memcpy(plane + (size_t)stride * ((fmt->height + 1) / 2) + (size_t)row * stride, v, chroma_width);
+  } else {
+    kernels->interleave(u, v, plane + (size_t)row * fmt->bytesperline, chroma_width);
+  }
+}
+
+static void software_isp_process_band(software_isp_context_t *context, software_isp_band_t *band)
+{
+  int first_row = band->first_row, last_row = band->first_row + band->rows;
+
+  memset(band->sums, 0, sizeof(band->sums));
+  band->groups = 0;
+
+  software_isp_unpack_row(context, first_row - 1, band->raw[0]);
+  software_isp_unpack_row(context, first_row, band->raw[1]);
+
+  for (int y = first_row; y < last_row; y++) {
+    software_isp_unpack_row(context, y + 1, band->raw[2]);
+
+    const uint16_t *above = band->raw[0] + SOFTWARE_ISP_PADDING;
+    const uint16_t *row = band->raw[1] + SOFTWARE_ISP_PADDING;
+    const uint16_t *below = band->raw[2] + SOFTWARE_ISP_PADDING;
+
+    if ((y / 2) % SOFTWARE_ISP_STATS_STEP == 0) {
+      software_isp_collect_stats(context, band, row, y);
+    }
+
+    software_isp_demosaic_row(context, above, row, below, band->rgb, y);
+    software_isp_write_row(context, band, y);
+
+    // the rows move up
+    uint16_t *tmp = band->raw[0];
+    band->raw[0] = band->raw[1];
+    band->raw[1] = band->raw[2];
+    band->raw[2] = tmp;
+  }
+}
+
+static void software_isp_band_job(void *opaque, int index)
+{
+  software_isp_context_t *context = opaque;
+
+  software_isp_process_band(context, &context->band[index]);
+}
+
+static void software_isp_setup_band(software_isp_context_t *context, software_isp_band_t *band)
+{
+  int width = context->src_fmt.width;
+  size_t raw_size = (width + 2 * SOFTWARE_ISP_PADDING) * sizeof(uint16_t);
+  size_t size = 3 * raw_size + width * 3 + width + 2 * width;
+
+  if (band->scratch_size < size) {
+    band->scratch_size = size;
+    band->scratch = realloc(band->scratch, size);
+  }
+
+  uint8_t *scratch = band->scratch;
+  for (int i = 0; i < 3; i++) {
+    band->raw[i] = (uint16_t *)scratch;
+    scratch += raw_size;
+  }
+  band->rgb = scratch;
+  scratch += width * 3;
+  band->y = scratch;
+  scratch += width;
+  for (int i = 0; i < 2; i++) {
+    band->u[i] = scratch;
+    band->v[i] = scratch + width / 2;
+    scratch += width;
+  }
+}
+
+// Splits the frame into bands of whole pairs of rows
+static void software_isp_setup_bands(software_isp_context_t *context, int n_bands)
+{
+  unsigned pairs = (context->src_fmt.height + 1) / 2;
+
+  n_bands = MAX(MIN(n_bands, SOFTWARE_ISP_MAX_BANDS), 1);
+  n_bands = MIN(n_bands, (int)pairs);
+
+  for (int i = 0; i < n_bands; i++) {
+    software_isp_band_t *band = &context->band[i];
+
+    band->first_row = pairs * i / n_bands * 2;
+    band->rows = MIN(pairs * (i + 1) / n_bands * 2, context->src_fmt.height) - band->first_row;
+    software_isp_setup_band(context, band);
+  }
+
+  // the calling thread processes one of the bands
+  if (context->workers.n_threads < n_bands - 1) {
+    software_workers_stop(&context->workers);
+    software_workers_start(&context->workers, n_bands - 1);
+  }
+
+  context->n_bands = n_bands;
+}
+
+/* The white balance */
+
+static void software_isp_update_awb(software_isp_t *isp, software_isp_context_t *context)
+{
+  uint64_t sums[3] = { 0, 0, 0 }, groups = 0;
+
+  for (int i = 0; i < context->n_bands; i++) {
+    for (int j = 0; j < 3; j++) {
+      sums[j] += context->band[i].sums[j];
+    }
+    groups += context->band[i].groups;
+  }
+
+  // too dark to tell
+  if (!groups || sums[0] < groups || sums[2] < groups) {
+    return;
+  }
+
+  // each group has two greens
+  float red_gain = sums[1] / 2.0f / sums[0];
+  float blue_gain = sums[1] / 2.0f / sums[2];
+
+  red_gain = MAX(MIN(red_gain, 8.0f), 0.25f);
+  blue_gain = MAX(MIN(blue_gain, 8.0f), 0.25f);
+
+  pthread_mutex_lock(&isp->lock);
+  isp->red_gain += (red_gain - isp->red_gain) * SOFTWARE_ISP_AWB_SPEED;
+  isp->blue_gain += (blue_gain - isp->blue_gain) * SOFTWARE_ISP_AWB_SPEED;
+  LOG_DEBUG(NULL, "ISP: AWB red_gain=%.3f, blue_gain=%.3f", isp->red_gain, isp->blue_gain);
+  pthread_mutex_unlock(&isp->lock);
+}
+
+/* The contexts */
+
+static void software_isp_free_context(software_isp_context_t *context)
+{
+  if (!context) {
+    return;
+  }
+
+  software_workers_stop(&context->workers);
+
+  for (int i = 0; i < SOFTWARE_ISP_MAX_BANDS; i++) {
+    free(context->band[i].scratch);
+  }
+
+  free(context);
+}
+
+static software_isp_context_t *software_isp_get_context(software_isp_t *isp)
+{
+  software_isp_context_t *context = NULL;
+
+  pthread_mutex_lock(&isp->lock);
+  for (int i = 0; i < SOFTWARE_MAX_THREADS; i++) {
+    if (!isp->contexts[i]) {
+      isp->contexts[i] = calloc(1, sizeof(software_isp_context_t));
+    }
+    if (!isp->contexts[i]->busy) {
+      context = isp->contexts[i];
+      context->busy = true;
+      break;
+    }
+  }
+
+  // the settings of this frame
+  if (context) {
+    if (isp->gamma_dirty) {
+      software_isp_update_gamma(isp);
+    }
+
+    context->params.black_level = isp->black_level;
+    context->params.demosaic = isp->demosaic;
+    context->params.red_gain = isp->red_gain * (1 << SOFTWARE_ISP_GAIN_BITS) + 0.5f;
+    context->params.blue_gain = isp->blue_gain * (1 << SOFTWARE_ISP_GAIN_BITS) + 0.5f;
+    memcpy(context->params.gamma, isp->gamma_table, sizeof(isp->gamma_table));
+  }
+  pthread_mutex_unlock(&isp->lock);
+
+  return context;
+}
+
+static void software_isp_put_context(software_isp_t *isp, software_isp_context_t *context)
+{
+  pthread_mutex_lock(&isp->lock);
+  context->busy = false;
+  pthread_mutex_unlock(&isp->lock);
+}
+
+static int software_isp_process_frame(software_isp_t *isp, software_isp_context_t *context, int n_bands, buffer_t *output, buffer_t *capture)
+{
+  buffer_t *source = output->dma_source ? output->dma_source : output;
+  buffer_format_t src_fmt = output->buf_list->fmt;
+  buffer_format_t dst_fmt = capture->buf_list->fmt;
+
+  context->format = software_isp_find_format(src_fmt.format);
+  if (!context->format) {
+    LOG_ERROR(output, "Unsupported format: %s", fourcc_to_string(src_fmt.format).buf);
+  }
+
+  if (src_fmt.width != dst_fmt.width || src_fmt.height != dst_fmt.height) {
+    LOG_ERROR(capture, "Cannot scale %ux%u into %ux%u", src_fmt.width, src_fmt.height, dst_fmt.width, dst_fmt.height);
+  }
+
+  if (src_fmt.width % 4 || src_fmt.width < 4 || src_fmt.height < 2) {
+    LOG_ERROR(output, "The width has to be a multiple of 4: %ux%u", src_fmt.width, src_fmt.height);
+  }
+
+  if (!src_fmt.bytesperline) {
+    src_fmt.bytesperline = context->format->packed ? src_fmt.width * 5 / 4 : src_fmt.width * 2;
+  }
+
+  if (!source->start || output->used < (size_t)src_fmt.bytesperline * (src_fmt.height - 1)) {
+    LOG_ERROR(output, "The frame is too short: used=%zu", output->used);
+  }
+
+  if (capture->length < software_rescaller_frame_size(dst_fmt)) {
+    LOG_ERROR(capture, "The buffer is too short: length=%zu", capture->length);
+  }
+
+  context->kernels = convert_get_kernels(convert_simd_detect());
+  context->src = source->start;
+  context->src_fmt = src_fmt;
+  context->dst = capture->start;
+  context->dst_fmt = dst_fmt;
+
+  software_isp_setup_bands(context, n_bands);
+  software_workers_run(&context->workers, software_isp_band_job, context, context->n_bands);
+
+  if (isp->awb) {
+    software_isp_update_awb(isp, context);
+  }
+
+  capture->used = software_rescaller_frame_size(dst_fmt);
+  return 0;
+
+error:
+  return -1;
+}
+
+/* The codec */
+
+static int software_isp_open(device_t *dev)
+{
+  software_isp_t *isp = calloc(1, sizeof(software_isp_t));
+
+  isp->black_level = 64;
+  isp->gamma = 2.2f;
+  isp->awb = true;
+  isp->red_gain = 1.0f;
+  isp->blue_gain = 1.0f;
+  isp->gamma_dirty = true;
+  pthread_mutex_init(&isp->lock, NULL);
+
+  dev->software->codec_data = isp;
+  return 0;
+}
+
+static void software_isp_close(device_t *dev)
+{
+  software_isp_t *isp = dev->software->codec_data;
+  if (!isp) {
+    return;
+  }
+
+  for (int i = 0; i < SOFTWARE_MAX_THREADS; i++) {
+    software_isp_free_context(isp->contexts[i]);
+  }
+
+  pthread_mutex_destroy(&isp->lock);
+  free(isp);
+  dev->software->codec_data = NULL;
+}
+
+static void software_isp_dump_options(device_t *dev, FILE *stream)
+{
+  software_isp_t *isp = dev->software->codec_data;
+
+  fprintf(stream, "- available option: bands [0..%d], current=%d (0 = the CPUs per frame being processed)\n", SOFTWARE_ISP_MAX_BANDS, isp->bands);
+  fprintf(stream, "- available option: demosaic [bilinear, edge], current=%s\n", isp->demosaic == SOFTWARE_ISP_EDGE_AWARE ? "edge" : "bilinear");
+  fprintf(stream, "- available option: black_level [0..%d], current=%u\n", SOFTWARE_ISP_MAX_VALUE, isp->black_level);
+  fprintf(stream, "- available option: gamma [0.1..10], current=%.2f\n", isp->gamma);
+  fprintf(stream, "- available option: awb [0..1], current=%d\n", isp->awb);
+  fprintf(stream, "- available option: red_gain [0.25..8], current=%.3f\n", isp->red_gain);
+  fprintf(stream, "- available option: blue_gain [0.25..8], current=%.3f\n", isp->blue_gain);
+}
+
+static int software_isp_set_option(device_t *dev, const char *key, const char *value)
+{
+  software_isp_t *isp = dev->software->codec_data;
+  int ret = 1;
+
+  pthread_mutex_lock(&isp->lock);
+
+  if (!strcmp(key, "bands")) {
+    isp->bands = MAX(MIN(atoi(value), SOFTWARE_ISP_MAX_BANDS), 0);
+  } else if (!strcmp(key, "demosaic")) {
+    if (!strcmp(value, "bilinear")) {
+      isp->demosaic = SOFTWARE_ISP_BILINEAR;
+    } else if (!strcmp(value, "edge")) {
+      isp->demosaic = SOFTWARE_ISP_EDGE_AWARE;
+    } else {
+      ret = -1;
+    }
+  } else if (!strcmp(key, "blacklevel")) {
+    isp->black_level = MAX(MIN(atoi(value), SOFTWARE_ISP_MAX_VALUE - 1), 0);
+    isp->gamma_dirty = true;
+  } else if (!strcmp(key, "gamma")) {
+    isp->gamma = MAX(MIN(atof(value), 10.0f), 0.1f);
+    isp->gamma_dirty = true;
+  } else if (!strcmp(key, "awb")) {
+    isp->awb = atoi(value) != 0;
+  } else if (!strcmp(key, "redgain")) {
+    isp->red_gain = MAX(MIN(atof(value), 8.0f), 0.25f);
+  } else if (!strcmp(key, "bluegain")) {
+    isp->blue_gain = MAX(MIN(atof(value), 8.0f), 0.25f);
+  } else {
+    ret = -1;
+  }
+
+  pthread_mutex_unlock(&isp->lock);
+  return ret;
+}
+
+static int software_isp_process(device_t *dev, buffer_t *output, buffer_t *capture)
+{
+  software_isp_t *isp = dev->software->codec_data;
+  software_isp_context_t *context = software_isp_get_context(isp);
+  int n_bands = isp->bands;
+
+  if (!context) {
+    LOG_ERROR(dev, "No free ISP context");
+  }
+
+  if (n_bands <= 0) {
+    int processing = MAX(__atomic_load_n(&dev->software->processing, __ATOMIC_RELAXED), 1);
+    n_bands = MAX(sysconf(_SC_NPROCESSORS_ONLN) / processing, 1);
+  }
+
+  int ret = software_isp_process_frame(isp, context, n_bands, output, capture);
+  software_isp_put_context(isp, context);
+  return ret;
+
+error:
+  return -1;
+}
+
+const software_codec_t software_isp_codec = {
+  .name = "isp",
+  .output_formats = {
+    V4L2_PIX_FMT_SRGGB10P, V4L2_PIX_FMT_SGRBG10P, V4L2_PIX_FMT_SGBRG10P, V4L2_PIX_FMT_SBGGR10P,
+    V4L2_PIX_FMT_SRGGB10, V4L2_PIX_FMT_SGRBG10, V4L2_PIX_FMT_SGBRG10, V4L2_PIX_FMT_SBGGR10
+  },
+  .capture_formats = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420 },
+  .max_threads = SOFTWARE_MAX_THREADS,
+
+  .open = software_isp_open,
+  .close = software_isp_close,
+  .dump_options = software_isp_dump_options,
+  .set_option = software_isp_set_option,
+  .process = software_isp_process
+};
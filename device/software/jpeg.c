@@ -0,0 +1,460 @@
+#ifdef USE_LIBJPEG
+
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <linux/videodev2.h>
+
+// The frame is split into horizontal slices of whole MCU rows, each encoded
+// as a separate image by a worker. As all slices use the same tables,
+// the entropy-coded data of each is a valid restart interval of the full image:
+// the header of the first slice (with the full height), and the scans joined
+// with the RSTn markers form the final JPEG.
+
+#define SOFTWARE_JPEG_MAX_SLICES SOFTWARE_MAX_WORKERS
+#define SOFTWARE_JPEG_DEFAULT_QUALITY 80
+#define SOFTWARE_JPEG_MAX_RESTART_INTERVAL 65535
+
+typedef struct software_jpeg_slice_s {
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  jmp_buf jump;
+  bool created;
+
+  // reused between frames, grown by `jpeg_mem_dest` if needed
+  unsigned char *out;
+  unsigned long out_length, out_used;
+
+  // padded rows of a single MCU row
+  JSAMPLE *scratch;
+  size_t scratch_size;
+
+  unsigned first_row, rows;
+  int ret;
+} software_jpeg_slice_t;
+
+typedef struct software_jpeg_s {
+  int quality;
+  int slices; // 0 = one per CPU
+
+  software_workers_t workers;
+  software_jpeg_slice_t slice[SOFTWARE_JPEG_MAX_SLICES];
+
+  // the frame being encoded
+  const uint8_t *src;
+  unsigned format, width, height, stride;
+  unsigned mcu_width, mcu_height, slice_rows;
+  int n_slices;
+} software_jpeg_t;
+
+static void software_jpeg_error_exit(j_common_ptr cinfo)
+{
+  software_jpeg_slice_t *slice = cinfo->client_data;
+  char message[JMSG_LENGTH_MAX];
+
+  cinfo->err->format_message(cinfo, message);
+  LOG_INFO(NULL, "libjpeg: %s", message);
+  longjmp(slice->jump, 1);
+}
+
+static JSAMPROW software_jpeg_pad_row(JSAMPROW row, unsigned width, unsigned padded_width)
+{
+  for (unsigned x = width; x < padded_width; x++) {
+    row[x] = row[width - 1];
+  }
+  return row;
+}
+
+// Points `rows` at the MCU row starting at `y`, copying it to `scratch`
+// if the source needs to be deinterleaved or padded
+static void software_jpeg_fill_rows(software_jpeg_t *jpeg, software_jpeg_slice_t *slice, unsigned y, JSAMPROW rows[3][16])
+{
+  unsigned padded_width = (jpeg->width + jpeg->mcu_width - 1) / jpeg->mcu_width * jpeg->mcu_width;
+  unsigned chroma_width = (jpeg->width + 1) / 2;
+  unsigned chroma_height = jpeg->format == V4L2_PIX_FMT_YUYV ? jpeg->height : (jpeg->height + 1) / 2;
+  unsigned chroma_y = jpeg->format == V4L2_PIX_FMT_YUYV ? y : y / 2;
+  bool aligned = padded_width == jpeg->width;
+  JSAMPLE *scratch = slice->scratch;
+
+  const uint8_t *src = jpeg->src;
+  const uint8_t *src_u = src + jpeg->stride * jpeg->height;
+  const uint8_t *src_v = src_u + jpeg->stride / 2 * chroma_height;
+
+  for (unsigned i = 0; i < jpeg->mcu_height; i++) {
+    unsigned row = MIN(y + i, jpeg->height - 1);
+    const uint8_t *line = src + row * jpeg->stride;
+
+    if (jpeg->format == V4L2_PIX_FMT_YUYV) {
+      JSAMPROW dst = scratch;
+      for (unsigned x = 0; x < jpeg->width; x++) {
+        dst[x] = line[x * 2];
+      }
+      rows[0][i] = software_jpeg_pad_row(dst, jpeg->width, padded_width);
+      scratch += padded_width;
+    } else if (aligned) {
+      rows[0][i] = (JSAMPROW)line;
+    } else {
+      memcpy(scratch, line, jpeg->width);
+      rows[0][i] = software_jpeg_pad_row(scratch, jpeg->width, padded_width);
+      scratch += padded_width;
+    }
+  }
+
+  for (unsigned i = 0; i < DCTSIZE; i++) {
+    unsigned row = MIN(chroma_y + i, chroma_height - 1);
+
+    switch (jpeg->format) {
+    case V4L2_PIX_FMT_YUYV:
+      {
+        const uint8_t *line = src + row * jpeg->stride;
+        JSAMPROW u = scratch, v = scratch + padded_width / 2;
+        for (unsigned x = 0; x < chroma_width; x++) {
+          u[x] = line[x * 4 + 1];
+          v[x] = line[x * 4 + 3];
+        }
+        rows[1][i] = software_jpeg_pad_row(u, chroma_width, padded_width / 2);
+        rows[2][i] = software_jpeg_pad_row(v, chroma_width, padded_width / 2);
+        scratch += padded_width;
+      }
+      break;
+
+    case V4L2_PIX_FMT_NV12:
+      {
+        const uint8_t *line = src_u + row * jpeg->stride;
+        JSAMPROW u = scratch, v = scratch + padded_width / 2;
+        for (unsigned x = 0; x < chroma_width; x++) {
+          u[x] = line[x * 2];
+          v[x] = line[x * 2 + 1];
+        }
+        rows[1][i] = software_jpeg_pad_row(u, chroma_width, padded_width / 2);
+        rows[2][i] = software_jpeg_pad_row(v, chroma_width, padded_width / 2);
+        scratch += padded_width;
+      }
+      break;
+
+    case V4L2_PIX_FMT_YUV420:
+      if (aligned) {
+        rows[1][i] = (JSAMPROW)(src_u + row * jpeg->stride / 2);
+        rows[2][i] = (JSAMPROW)(src_v + row * jpeg->stride / 2);
+      } else {
+        JSAMPROW u = scratch, v = scratch + padded_width / 2;
+        memcpy(u, src_u + row * jpeg->stride / 2, chroma_width);
+        memcpy(v, src_v + row * jpeg->stride / 2, chroma_width);
+        rows[1][i] = software_jpeg_pad_row(u, chroma_width, padded_width / 2);
+        rows[2][i] = software_jpeg_pad_row(v, chroma_width, padded_width / 2);
+        scratch += padded_width;
+      }
+      break;
+    }
+  }
+}
+
+static void software_jpeg_encode_slice(software_jpeg_t *jpeg, int index)
+{
+  software_jpeg_slice_t *slice = &jpeg->slice[index];
+  struct jpeg_compress_struct *cinfo = &slice->cinfo;
+  unsigned padded_width = (jpeg->width + jpeg->mcu_width - 1) / jpeg->mcu_width * jpeg->mcu_width;
+
+  slice->ret = -1;
+
+  if (!slice->created) {
+    cinfo->err = jpeg_std_error(&slice->jerr);
+    slice->jerr.error_exit = software_jpeg_error_exit;
+    jpeg_create_compress(cinfo);
+    cinfo->client_data = slice;
+    slice->created = true;
+  }
+
+  // at most: the luma and both chroma rows of the MCU row
+  size_t scratch_size = padded_width * (jpeg->mcu_height + DCTSIZE);
+  if (slice->scratch_size < scratch_size) {
+    free(slice->scratch);
+    slice->scratch = malloc(scratch_size);
+    slice->scratch_size = slice->scratch ? scratch_size : 0;
+    if (!slice->scratch) {
+      return;
+    }
+  }
+
+  // the uncompressed size, to avoid growing the buffer
+  unsigned long out_length = padded_width * slice->rows * 2 + 1024;
+  if (slice->out_length < out_length) {
+    free(slice->out);
+    slice->out = malloc(out_length);
+    slice->out_length = slice->out ? out_length : 0;
+    if (!slice->out) {
+      return;
+    }
+  }
+
+  if (setjmp(slice->jump)) {
+    jpeg_abort_compress(cinfo);
+    return;
+  }
+
+  cinfo->image_width = jpeg->width;
+  cinfo->image_height = slice->rows;
+  cinfo->input_components = 3;
+  cinfo->in_color_space = JCS_YCbCr;
+  jpeg_set_defaults(cinfo);
+  jpeg_set_quality(cinfo, jpeg->quality, TRUE);
+
+  cinfo->raw_data_in = TRUE;
+  cinfo->dct_method = JDCT_IFAST;
+  cinfo->comp_info[0].h_samp_factor = 2;
+  cinfo->comp_info[0].v_samp_factor = jpeg->mcu_height / DCTSIZE;
+  cinfo->comp_info[1].h_samp_factor = 1;
+  cinfo->comp_info[1].v_samp_factor = 1;
+  cinfo->comp_info[2].h_samp_factor = 1;
+  cinfo->comp_info[2].v_samp_factor = 1;
+
+  if (jpeg->n_slices > 1) {
+    cinfo->restart_interval = padded_width / jpeg->mcu_width * (jpeg->slice_rows / jpeg->mcu_height);
+  }
+
+  unsigned char *out = slice->out;
+  unsigned long out_used = slice->out_length;
+  jpeg_mem_dest(cinfo, &out, &out_used);
+  jpeg_start_compress(cinfo, TRUE);
+
+  JSAMPROW rows[3][16];
+  JSAMPARRAY planes[3] = { rows[0], rows[1], rows[2] };
+
+  for (unsigned y = 0; y < slice->rows; y += jpeg->mcu_height) {
+    software_jpeg_fill_rows(jpeg, slice, slice->first_row + y, rows);
+    jpeg_write_raw_data(cinfo, planes, jpeg->mcu_height);
+  }
+
+  jpeg_finish_compress(cinfo);
+
+  if (out != slice->out) {
+    free(slice->out);
+    slice->out = out;
+    slice->out_length = out_used;
+  }
+  slice->out_used = out_used;
+  slice->ret = 0;
+}
+
+static void software_jpeg_encode_job(void *opaque, int job)
+{
+  software_jpeg_encode_slice(opaque, job);
+}
+
+// Returns the offset of the entropy-coded data, following the SOS segment
+static int software_jpeg_find_scan(const uint8_t *data, size_t size, int *sof)
+{
+  size_t pos = 2; // SOI
+
+  while (pos + 4 <= size && data[pos] == 0xFF) {
+    uint8_t marker = data[pos + 1];
+    size_t length = (data[pos + 2] << 8) | data[pos + 3];
+
+    if (marker == 0xC0 && sof) {
+      *sof = pos;
+    }
+
+    pos += 2 + length;
+
+    if (marker == 0xDA) {
+      return pos <= size ? pos : -1;
+    }
+  }
+
+  return -1;
+}
+
+static int software_jpeg_join_slices(software_jpeg_t *jpeg, buffer_t *capture)
+{
+  uint8_t *dst = capture->start;
+  size_t used = 0;
+  int sof = -1;
+
+  for (int i = 0; i < jpeg->n_slices; i++) {
+    software_jpeg_slice_t *slice = &jpeg->slice[i];
+    int scan = software_jpeg_find_scan(slice->out, slice->out_used, i == 0 ? &sof : NULL);
+
+    if (scan < 0 || slice->out_used < scan + 2 || (i == 0 && sof < 0)) {
+      LOG_ERROR(capture, "Cannot find the scan of slice %d", i);
+    }
+
+    size_t length = slice->out_used - 2 - scan; // without EOI
+    size_t needed = (i == 0 ? scan : 2) + length + 2;
+
+    if (used + needed > capture->length) {
+      LOG_ERROR(capture, "The JPEG does not fit: %zu vs space=%zu", used + needed, capture->length);
+    }
+
+    if (i == 0) {
+      memcpy(dst, slice->out, scan);
+      dst[sof + 5] = jpeg->height >> 8;
+      dst[sof + 6] = jpeg->height & 0xFF;
+      used = scan;
+    } else {
+      dst[used++] = 0xFF;
+      dst[used++] = JPEG_RST0 + (i - 1) % 8;
+    }
+
+    memcpy(dst + used, slice->out + scan, length);
+    used += length;
+  }
+
+  dst[used++] = 0xFF;
+  dst[used++] = JPEG_EOI;
+  capture->used = used;
+  return 0;
+
+error:
+  return -1;
+}
+
+static int software_jpeg_setup_slices(software_jpeg_t *jpeg)
+{
+  unsigned padded_width = (jpeg->width + jpeg->mcu_width - 1) / jpeg->mcu_width * jpeg->mcu_width;
+  unsigned mcu_rows = (jpeg->height + jpeg->mcu_height - 1) / jpeg->mcu_height;
+  int n_slices = jpeg->slices > 0 ? jpeg->slices : sysconf(_SC_NPROCESSORS_ONLN);
+
+  n_slices = MAX(MIN(n_slices, SOFTWARE_JPEG_MAX_SLICES), 1);
+  n_slices = MIN(n_slices, (int)mcu_rows);
+
+  // the restart interval counts the MCUs of a slice
+  while (n_slices < (int)mcu_rows && n_slices < SOFTWARE_JPEG_MAX_SLICES &&
+    padded_width / jpeg->mcu_width * ((mcu_rows + n_slices - 1) / n_slices) > SOFTWARE_JPEG_MAX_RESTART_INTERVAL) {
+    n_slices++;
+  }
+
+  jpeg->slice_rows = (mcu_rows + n_slices - 1) / n_slices * jpeg->mcu_height;
+  n_slices = (jpeg->height + jpeg->slice_rows - 1) / jpeg->slice_rows;
+
+  for (int i = 0; i < n_slices; i++) {
+    jpeg->slice[i].first_row = i * jpeg->slice_rows;
+    jpeg->slice[i].rows = MIN(jpeg->slice_rows, jpeg->height - jpeg->slice[i].first_row);
+  }
+
+  // the calling thread encodes one of the slices
+  if (jpeg->workers.n_threads != n_slices - 1) {
+    software_workers_stop(&jpeg->workers);
+    if (n_slices > 1) {
+      software_workers_start(&jpeg->workers, n_slices - 1);
+    }
+  }
+
+  jpeg->n_slices = n_slices;
+  return 0;
+}
+
+static int software_jpeg_open(device_t *dev)
+{
+  software_jpeg_t *jpeg = calloc(1, sizeof(software_jpeg_t));
+  jpeg->quality = SOFTWARE_JPEG_DEFAULT_QUALITY;
+  dev->software->codec_data = jpeg;
+  return 0;
+}
+
+static void software_jpeg_close(device_t *dev)
+{
+  software_jpeg_t *jpeg = dev->software->codec_data;
+  if (!jpeg) {
+    return;
+  }
+
+  software_workers_stop(&jpeg->workers);
+
+  for (int i = 0; i < SOFTWARE_JPEG_MAX_SLICES; i++) {
+    software_jpeg_slice_t *slice = &jpeg->slice[i];
+    if (slice->created) {
+      jpeg_destroy_compress(&slice->cinfo);
+    }
+    free(slice->out);
+    free(slice->scratch);
+  }
+
+  free(jpeg);
+  dev->software->codec_data = NULL;
+}
+
+static void software_jpeg_dump_options(device_t *dev, FILE *stream)
+{
+  software_jpeg_t *jpeg = dev->software->codec_data;
+
+  fprintf(stream, "- available option: compression_quality [1..100], current=%d\n", jpeg->quality);
+  fprintf(stream, "- available option: slices [0..%d], current=%d (0 = one per CPU)\n", SOFTWARE_JPEG_MAX_SLICES, jpeg->slices);
+}
+
+static int software_jpeg_set_option(device_t *dev, const char *key, const char *value)
+{
+  software_jpeg_t *jpeg = dev->software->codec_data;
+
+  if (!strcmp(key, "compressionquality") || !strcmp(key, "quality")) {
+    jpeg->quality = MAX(MIN(atoi(value), 100), 1);
+    return 1;
+  }
+
+  if (!strcmp(key, "slices")) {
+    jpeg->slices = MAX(MIN(atoi(value), SOFTWARE_JPEG_MAX_SLICES), 0);
+    return 1;
+  }
+
+  return -1;
+}
+
+static int software_jpeg_process(device_t *dev, buffer_t *output, buffer_t *capture)
+{
+  software_jpeg_t *jpeg = dev->software->codec_data;
+  buffer_list_t *output_list = output->buf_list;
+  buffer_t *source = output->dma_source ? output->dma_source : output;
+
+  jpeg->src = source->start;
+  jpeg->format = output_list->fmt.format;
+  jpeg->width = output_list->fmt.width;
+  jpeg->height = output_list->fmt.height;
+  jpeg->stride = output_list->fmt.bytesperline;
+  jpeg->mcu_width = 16;
+  jpeg->mcu_height = jpeg->format == V4L2_PIX_FMT_YUYV ? 8 : 16;
+
+  size_t expected = jpeg->stride * jpeg->height;
+  if (jpeg->format != V4L2_PIX_FMT_YUYV) {
+    expected = expected * 3 / 2;
+  }
+
+  if (!jpeg->src || output->used < expected) {
+    LOG_ERROR(output, "The buffer is too short: used=%zu, expected=%zu", output->used, expected);
+  }
+
+  if (software_jpeg_setup_slices(jpeg) < 0) {
+    goto error;
+  }
+
+  software_workers_run(&jpeg->workers, software_jpeg_encode_job, jpeg, jpeg->n_slices);
+
+  for (int i = 0; i < jpeg->n_slices; i++) {
+    if (jpeg->slice[i].ret < 0) {
+      LOG_ERROR(capture, "Cannot encode slice %d of %d", i, jpeg->n_slices);
+    }
+  }
+
+  return software_jpeg_join_slices(jpeg, capture);
+
+error:
+  return -1;
+}
+
+const software_codec_t software_jpeg_codec = {
+  .name = "jpeg",
+  .output_formats = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12 },
+  .capture_formats = { V4L2_PIX_FMT_JPEG, V4L2_PIX_FMT_MJPEG },
+
+  .open = software_jpeg_open,
+  .close = software_jpeg_close,
+  .dump_options = software_jpeg_dump_options,
+  .set_option = software_jpeg_set_option,
+  .process = software_jpeg_process
+};
+
+#endif // USE_LIBJPEG
@@ -0,0 +1,646 @@
+#ifdef USE_LIBJPEG
+
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <linux/videodev2.h>
+
+// A JPEG with the restart markers at the boundaries of the MCU rows
+// is split into slices of whole rows, each decoded by a worker as a separate
+// image: the header of the frame (with the height of the slice) followed
+// by the entropy-coded data of the slice, with the RSTn renumbered from 0.
+// Any other JPEG is decoded by a single worker, and the frames are decoded
+// in parallel instead (`frame_threads`). By default, the CPUs are split
+// between the frames being decoded at once.
+//
+// The 4:2:2 and 4:2:0 images are decoded as raw YUV planes, the other ones
+// into YUV 4:4:4, and then converted into the capture format.
+
+#define SOFTWARE_JPEG_DECODER_MAX_SLICES SOFTWARE_MAX_WORKERS
+#define SOFTWARE_JPEG_DECODER_MAX_COMPONENTS 3
+
+typedef struct software_jpeg_decoder_slice_s {
+  struct jpeg_decompress_struct dinfo;
+  struct jpeg_error_mgr jerr;
+  jmp_buf jump;
+  bool created;
+  int warnings;
+
+  // the image of the slice, when built from the frame
+  const uint8_t *data;
+  size_t length;
+  uint8_t *image;
+  size_t image_size;
+
+  // where the rows past the end of the planes go
+  uint8_t *scratch;
+  size_t scratch_size;
+
+  unsigned first_row, rows;
+  int ret;
+} software_jpeg_decoder_slice_t;
+
+typedef struct software_jpeg_decoder_frame_s {
+  const uint8_t *data;
+  size_t length;
+
+  // the parsed markers
+  size_t sof, sos_data, eoi;
+  bool baseline;
+  unsigned width, height, restart_interval;
+  int n_components;
+  int h_samp[SOFTWARE_JPEG_DECODER_MAX_COMPONENTS], v_samp[SOFTWARE_JPEG_DECODER_MAX_COMPONENTS];
+  size_t *rst; // the offsets of the RSTn markers
+  int n_rst, max_rst;
+
+  unsigned mcu_width, mcu_height, mcus_per_row, mcu_rows;
+} software_jpeg_decoder_frame_t;
+
+// A frame being decoded
+typedef struct software_jpeg_decoder_context_s {
+  bool busy;
+  software_jpeg_decoder_frame_t frame;
+
+  software_workers_t workers;
+  software_jpeg_decoder_slice_t slice[SOFTWARE_JPEG_DECODER_MAX_SLICES];
+  int n_slices;
+
+  // the decoded image
+  buffer_format_t fmt;
+  uint8_t *planes;
+  size_t planes_size;
+  software_rescaller_t *rescaller;
+} software_jpeg_decoder_context_t;
+
+typedef struct software_jpeg_decoder_s {
+  int slices; // 0 = one per CPU
+  bool drop_corrupt;
+
+  pthread_mutex_t lock;
+  software_jpeg_decoder_context_t *contexts[SOFTWARE_MAX_THREADS];
+} software_jpeg_decoder_t;
+
+static void software_jpeg_decoder_error_exit(j_common_ptr cinfo)
+{
+  software_jpeg_decoder_slice_t *slice = cinfo->client_data;
+  char message[JMSG_LENGTH_MAX];
+
+  cinfo->err->format_message(cinfo, message);
+  LOG_DEBUG(NULL, "libjpeg: %s", message);
+  longjmp(slice->jump, 1);
+}
+
+static void software_jpeg_decoder_emit_message(j_common_ptr cinfo, int msg_level)
+{
+  software_jpeg_decoder_slice_t *slice = cinfo->client_data;
+  char message[JMSG_LENGTH_MAX];
+
+  // only the warnings: the corrupt data
+  if (msg_level >= 0) {
+    return;
+  }
+
+  if (!slice->warnings++) {
+    cinfo->err->format_message(cinfo, message);
+    LOG_DEBUG(NULL, "libjpeg: %s", message);
+  }
+}
+
+static unsigned software_jpeg_decoder_get16(const uint8_t *data)
+{
+  return data[0] << 8 | data[1];
+}
+
+// Finds the frame header, the start of the scan, and the RSTn and EOI in it
+static int software_jpeg_decoder_parse(software_jpeg_decoder_frame_t *frame)
+{
+  const uint8_t *data = frame->data;
+  size_t length = frame->length, pos = 2;
+
+  frame->sof = frame->sos_data = frame->eoi = 0;
+  frame->restart_interval = 0;
+  frame->n_components = 0;
+  frame->n_rst = 0;
+
+  if (length < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+    return -1;
+  }
+
+  while (pos + 4 <= length) {
+    if (data[pos] != 0xFF) {
+      return -1;
+    }
+
+    unsigned marker = data[pos + 1];
+    if (marker == 0xFF) {
+      pos++;
+      continue;
+    } else if (marker == JPEG_EOI) {
+      return -1;
+    }
+
+    unsigned marker_length = software_jpeg_decoder_get16(data + pos + 2);
+    if (marker_length < 2 || pos + 2 + marker_length > length) {
+      return -1;
+    }
+
+    const uint8_t *payload = data + pos + 4;
+
+    switch (marker) {
+    case 0xC0: // SOF0, SOF1 and SOF2
+    case 0xC1:
+    case 0xC2:
+      if (marker_length < 8 || marker_length < 8 + 3 * payload[5] || payload[5] > SOFTWARE_JPEG_DECODER_MAX_COMPONENTS) {
+        return -1;
+      }
+      frame->sof = pos;
+      frame->baseline = marker != 0xC2;
+      frame->height = software_jpeg_decoder_get16(payload + 1);
+      frame->width = software_jpeg_decoder_get16(payload + 3);
+      frame->n_components = payload[5];
+      for (int i = 0; i < frame->n_components; i++) {
+        frame->h_samp[i] = payload[6 + i * 3 + 1] >> 4;
+        frame->v_samp[i] = payload[6 + i * 3 + 1] & 0xF;
+      }
+      break;
+
+    case 0xDD: // DRI
+      if (marker_length >= 4) {
+        frame->restart_interval = software_jpeg_decoder_get16(payload);
+      }
+      break;
+
+    case 0xDA: // SOS
+      frame->sos_data = pos + 2 + marker_length;
+      break;
+    }
+
+    pos += 2 + marker_length;
+    if (frame->sos_data) {
+      break;
+    }
+  }
+
+  if (!frame->sof || !frame->sos_data || !frame->width || !frame->height) {
+    return -1;
+  }
+
+  int h_max = 1, v_max = 1;
+  for (int i = 0; i < frame->n_components; i++) {
+    h_max = MAX(h_max, frame->h_samp[i]);
+    v_max = MAX(v_max, frame->v_samp[i]);
+  }
+  frame->mcu_width = h_max * DCTSIZE;
+  frame->mcu_height = v_max * DCTSIZE;
+  frame->mcus_per_row = (frame->width + frame->mcu_width - 1) / frame->mcu_width;
+  frame->mcu_rows = (frame->height + frame->mcu_height - 1) / frame->mcu_height;
+
+  // The RSTn are only needed to split the frame
+  for (pos = frame->sos_data; pos + 1 < length; ) {
+    const uint8_t *next = memchr(data + pos, 0xFF, length - pos - 1);
+    if (!next) {
+      break;
+    }
+
+    pos = next - data;
+    unsigned marker = data[pos + 1];
+
+    if (marker == 0x00 || marker == 0xFF) {
+      pos += marker ? 1 : 2;
+    } else if (marker >= JPEG_RST0 && marker <= JPEG_RST0 + 7) {
+      if (frame->restart_interval) {
+        if (frame->n_rst == frame->max_rst) {
+          frame->max_rst = MAX(frame->max_rst * 2, 256);
+          frame->rst = realloc(frame->rst, frame->max_rst * sizeof(size_t));
+        }
+        frame->rst[frame->n_rst++] = pos;
+      }
+      pos += 2;
+    } else {
+      // EOI, or the next scan
+      if (marker == JPEG_EOI) {
+        frame->eoi = pos;
+      }
+      break;
+    }
+  }
+
+  if (!frame->eoi) {
+    frame->eoi = length;
+  }
+
+  return 0;
+}
+
+// Sets the rows of each slice, and builds their images
+static int software_jpeg_decoder_setup_slices(software_jpeg_decoder_context_t *context, int n_slices)
+{
+  software_jpeg_decoder_frame_t *frame = &context->frame;
+  unsigned intervals_per_group = 0, rows_per_group = 0;
+
+  // The slices start at the restart markers found at the beginning of a MCU row
+  if (frame->baseline && frame->restart_interval) {
+    unsigned n_intervals = (frame->mcus_per_row * frame->mcu_rows + frame->restart_interval - 1) / frame->restart_interval;
+
+    if (frame->n_rst + 1 != n_intervals) {
+      LOG_DEBUG(NULL, "Found %d RSTn markers instead of %u", frame->n_rst, n_intervals - 1);
+    } else if (frame->restart_interval % frame->mcus_per_row == 0) {
+      intervals_per_group = 1;
+      rows_per_group = frame->restart_interval / frame->mcus_per_row;
+    } else if (frame->mcus_per_row % frame->restart_interval == 0) {
+      intervals_per_group = frame->mcus_per_row / frame->restart_interval;
+      rows_per_group = 1;
+    }
+  }
+
+  if (!rows_per_group) {
+    n_slices = 1;
+  }
+
+  unsigned n_groups = rows_per_group ? (frame->mcu_rows + rows_per_group - 1) / rows_per_group : 1;
+  n_slices = MAX(MIN(n_slices, SOFTWARE_JPEG_DECODER_MAX_SLICES), 1);
+  n_slices = MIN(n_slices, (int)n_groups);
+
+  for (int i = 0; i < n_slices; i++) {
+    software_jpeg_decoder_slice_t *slice = &context->slice[i];
+
+    if (n_slices == 1) {
+      slice->data = frame->data;
+      slice->length = frame->length;
+      slice->first_row = 0;
+      slice->rows = frame->height;
+      continue;
+    }
+
+    unsigned first_group = n_groups * i / n_slices;
+    unsigned last_group = n_groups * (i + 1) / n_slices;
+    unsigned first_interval = first_group * intervals_per_group;
+    unsigned last_interval = last_group * intervals_per_group; // exclusive
+
+    slice->first_row = first_group * rows_per_group * frame->mcu_height;
+    slice->rows = MIN(last_group * rows_per_group * frame->mcu_height, frame->height) - slice->first_row;
+
+    size_t start = first_interval ? frame->rst[first_interval - 1] + 2 : frame->sos_data;
+    size_t end = last_interval <= (unsigned)frame->n_rst ? frame->rst[last_interval - 1] : frame->eoi;
+    size_t size = frame->sos_data + (end - start) + 2;
+
+    if (slice->image_size < size) {
+      slice->image_size = size;
+      slice->image = realloc(slice->image, size);
+    }
+
+    uint8_t *image = slice->image;
+    memcpy(image, frame->data, frame->sos_data);
+    image[frame->sof + 5] = slice->rows >> 8;
+    image[frame->sof + 6] = slice->rows & 0xFF;
+    memcpy(image + frame->sos_data, frame->data + start, end - start);
+    image[size - 2] = 0xFF;
+    image[size - 1] = JPEG_EOI;
+
+    // the RSTn of the slice have to start from RST0
+    for (int j = first_interval, n = 0; j < (int)last_interval - 1; j++, n++) {
+      image[frame->sos_data + frame->rst[j] - start + 1] = JPEG_RST0 + n % 8;
+    }
+
+    slice->data = image;
+    slice->length = size;
+  }
+
+  // the calling thread decodes one of the slices
+  if (context->workers.n_threads < n_slices - 1) {
+    software_workers_stop(&context->workers);
+    software_workers_start(&context->workers, n_slices - 1);
+  }
+
+  context->n_slices = n_slices;
+  return 0;
+}
+
+// The decoded planes: as decoded by libjpeg, padded to whole MCUs
+static int software_jpeg_decoder_setup_planes(software_jpeg_decoder_context_t *context)
+{
+  software_jpeg_decoder_frame_t *frame = &context->frame;
+  buffer_format_t fmt = {
+    .width = frame->width,
+    .height = frame->height
+  };
+
+  if (frame->n_components != 3) {
+    LOG_INFO(NULL, "Unsupported JPEG with %d components", frame->n_components);
+    return -1;
+  }
+
+  bool chroma_subsampled = frame->h_samp[1] == 1 && frame->v_samp[1] == 1 &&
+    frame->h_samp[2] == 1 && frame->v_samp[2] == 1;
+
+  if (chroma_subsampled && frame->h_samp[0] == 2 && frame->v_samp[0] == 1) {
+    fmt.format = V4L2_PIX_FMT_YUV422P;
+    fmt.bytesperline = frame->mcus_per_row * frame->mcu_width;
+  } else if (chroma_subsampled && frame->h_samp[0] == 2 && frame->v_samp[0] == 2) {
+    fmt.format = V4L2_PIX_FMT_YUV420;
+    fmt.bytesperline = frame->mcus_per_row * frame->mcu_width;
+  } else {
+    fmt.format = V4L2_PIX_FMT_YUV24;
+    fmt.bytesperline = frame->width * 3;
+  }
+
+  size_t size = software_rescaller_frame_size(fmt);
+  if (context->planes_size < size) {
+    context->planes_size = size;
+    context->planes = realloc(context->planes, size);
+  }
+
+  context->fmt = fmt;
+  return 0;
+}
+
+// Points the rows of the `component` at `plane_row`, or at the scratch past the plane
+static void software_jpeg_decoder_plane_rows(software_jpeg_decoder_context_t *context, software_jpeg_decoder_slice_t *slice,
+  int component, unsigned plane_row, unsigned n_rows, JSAMPROW *rows)
+{
+  buffer_format_t *fmt = &context->fmt;
+  unsigned stride = component ? fmt->bytesperline / 2 : fmt->bytesperline;
+  unsigned height = fmt->height;
+  uint8_t *plane = context->planes;
+
+  if (component) {
+    if (fmt->format == V4L2_PIX_FMT_YUV420) {
+      height = (height + 1) / 2;
+    }
+    plane += fmt->bytesperline * fmt->height + (component - 1) * stride * height;
+  }
+
+  for (unsigned i = 0; i < n_rows; i++) {
+    rows[i] = plane_row + i < height ? plane + (plane_row + i) * stride : slice->scratch;
+  }
+}
+
+static int software_jpeg_decoder_decode_slice(software_jpeg_decoder_context_t *context, software_jpeg_decoder_slice_t *slice)
+{
+  software_jpeg_decoder_frame_t *frame = &context->frame;
+  struct jpeg_decompress_struct *dinfo = &slice->dinfo;
+  bool raw = context->fmt.format != V4L2_PIX_FMT_YUV24;
+
+  if (!slice->created) {
+    dinfo->err = jpeg_std_error(&slice->jerr);
+    slice->jerr.error_exit = software_jpeg_decoder_error_exit;
+    slice->jerr.emit_message = software_jpeg_decoder_emit_message;
+    jpeg_create_decompress(dinfo);
+    dinfo->client_data = slice;
+    slice->created = true;
+  }
+
+  if (slice->scratch_size < context->fmt.bytesperline) {
+    slice->scratch_size = context->fmt.bytesperline;
+    slice->scratch = realloc(slice->scratch, slice->scratch_size);
+  }
+
+  slice->warnings = 0;
+
+  if (setjmp(slice->jump)) {
+    jpeg_abort_decompress(dinfo);
+    return -1;
+  }
+
+  jpeg_mem_src(dinfo, slice->data, slice->length);
+  jpeg_read_header(dinfo, TRUE);
+
+  if (dinfo->image_width != frame->width || dinfo->image_height != slice->rows) {
+    LOG_DEBUG(NULL, "The slice is %ux%u instead of %ux%u", dinfo->image_width, dinfo->image_height, frame->width, slice->rows);
+    jpeg_abort_decompress(dinfo);
+    return -1;
+  }
+
+  dinfo->dct_method = JDCT_IFAST;
+  dinfo->out_color_space = JCS_YCbCr;
+  dinfo->raw_data_out = raw;
+  dinfo->do_fancy_upsampling = FALSE;
+  jpeg_start_decompress(dinfo);
+
+  while (dinfo->output_scanline < dinfo->output_height) {
+    unsigned row = slice->first_row + dinfo->output_scanline;
+
+    if (raw) {
+      JSAMPROW rows[SOFTWARE_JPEG_DECODER_MAX_COMPONENTS][4 * DCTSIZE];
+      JSAMPARRAY planes[SOFTWARE_JPEG_DECODER_MAX_COMPONENTS];
+
+      for (int i = 0; i < SOFTWARE_JPEG_DECODER_MAX_COMPONENTS; i++) {
+        unsigned n_rows = frame->v_samp[i] * DCTSIZE;
+        software_jpeg_decoder_plane_rows(context, slice, i, row * frame->v_samp[i] / frame->v_samp[0], n_rows, rows[i]);
+        planes[i] = rows[i];
+      }
+
+      jpeg_read_raw_data(dinfo, planes, frame->mcu_height);
+    } else {
+      JSAMPROW line = context->planes + row * context->fmt.bytesperline;
+      jpeg_read_scanlines(dinfo, &line, 1);
+    }
+  }
+
+  jpeg_finish_decompress(dinfo);
+  return 0;
+}
+
+static void software_jpeg_decoder_slice_job(void *opaque, int index)
+{
+  software_jpeg_decoder_context_t *context = opaque;
+  software_jpeg_decoder_slice_t *slice = &context->slice[index];
+
+  slice->ret = software_jpeg_decoder_decode_slice(context, slice);
+}
+
+static void software_jpeg_decoder_free_context(software_jpeg_decoder_context_t *context)
+{
+  if (!context) {
+    return;
+  }
+
+  software_workers_stop(&context->workers);
+
+  for (int i = 0; i < SOFTWARE_JPEG_DECODER_MAX_SLICES; i++) {
+    software_jpeg_decoder_slice_t *slice = &context->slice[i];
+    if (slice->created) {
+      jpeg_destroy_decompress(&slice->dinfo);
+    }
+    free(slice->image);
+    free(slice->scratch);
+  }
+
+  software_rescaller_free(context->rescaller);
+  free(context->frame.rst);
+  free(context->planes);
+  free(context);
+}
+
+static software_jpeg_decoder_context_t *software_jpeg_decoder_get_context(software_jpeg_decoder_t *decoder)
+{
+  software_jpeg_decoder_context_t *context = NULL;
+
+  pthread_mutex_lock(&decoder->lock);
+  for (int i = 0; i < SOFTWARE_MAX_THREADS; i++) {
+    if (!decoder->contexts[i]) {
+      decoder->contexts[i] = calloc(1, sizeof(software_jpeg_decoder_context_t));
+    }
+    if (!decoder->contexts[i]->busy) {
+      context = decoder->contexts[i];
+      context->busy = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&decoder->lock);
+
+  return context;
+}
+
+static void software_jpeg_decoder_put_context(software_jpeg_decoder_t *decoder, software_jpeg_decoder_context_t *context)
+{
+  pthread_mutex_lock(&decoder->lock);
+  context->busy = false;
+  pthread_mutex_unlock(&decoder->lock);
+}
+
+static int software_jpeg_decoder_decode(software_jpeg_decoder_t *decoder, software_jpeg_decoder_context_t *context, int n_slices, buffer_t *output, buffer_t *capture)
+{
+  buffer_t *source = output->dma_source ? output->dma_source : output;
+  buffer_format_t capture_fmt = capture->buf_list->fmt;
+  int warnings = 0;
+
+  context->frame.data = source->start;
+  context->frame.length = output->used;
+
+  if (!source->start || software_jpeg_decoder_parse(&context->frame) < 0) {
+    LOG_ERROR(output, "Not a JPEG: used=%zu", output->used);
+  }
+
+  if (software_jpeg_decoder_setup_planes(context) < 0 ||
+    software_jpeg_decoder_setup_slices(context, n_slices) < 0) {
+    goto error;
+  }
+
+  software_workers_run(&context->workers, software_jpeg_decoder_slice_job, context, context->n_slices);
+
+  for (int i = 0; i < context->n_slices; i++) {
+    if (context->slice[i].ret < 0) {
+      LOG_ERROR(output, "Cannot decode slice %d of %d", i, context->n_slices);
+    }
+    warnings += context->slice[i].warnings;
+  }
+
+  if (warnings) {
+    LOG_DEBUG(output, "The JPEG is corrupt: %d warnings", warnings);
+    if (decoder->drop_corrupt) {
+      goto error;
+    }
+  }
+
+  if (!context->rescaller) {
+    context->rescaller = software_rescaller_new(software_simd_detect(), 1);
+  }
+
+  if (capture->length < software_rescaller_frame_size(capture_fmt)) {
+    LOG_ERROR(capture, "The buffer is too short: length=%zu", capture->length);
+  }
+
+  if (software_rescaller_scale(context->rescaller, context->planes, context->fmt, capture->start, capture_fmt) < 0) {
+    LOG_ERROR(capture, "Cannot convert from '%s'", fourcc_to_string(context->fmt.format).buf);
+  }
+
+  capture->used = software_rescaller_frame_size(capture_fmt);
+  return 0;
+
+error:
+  return -1;
+}
+
+static int software_jpeg_decoder_open(device_t *dev)
+{
+  software_jpeg_decoder_t *decoder = calloc(1, sizeof(software_jpeg_decoder_t));
+  pthread_mutex_init(&decoder->lock, NULL);
+  dev->software->codec_data = decoder;
+  return 0;
+}
+
+static void software_jpeg_decoder_close(device_t *dev)
+{
+  software_jpeg_decoder_t *decoder = dev->software->codec_data;
+  if (!decoder) {
+    return;
+  }
+
+  for (int i = 0; i < SOFTWARE_MAX_THREADS; i++) {
+    software_jpeg_decoder_free_context(decoder->contexts[i]);
+  }
+
+  pthread_mutex_destroy(&decoder->lock);
+  free(decoder);
+  dev->software->codec_data = NULL;
+}
+
+static void software_jpeg_decoder_dump_options(device_t *dev, FILE *stream)
+{
+  software_jpeg_decoder_t *decoder = dev->software->codec_data;
+
+  fprintf(stream, "- available option: slices [0..%d], current=%d (0 = the CPUs per frame being decoded)\n", SOFTWARE_JPEG_DECODER_MAX_SLICES, decoder->slices);
+  fprintf(stream, "- available option: drop_corrupt [0..1], current=%d\n", decoder->drop_corrupt);
+}
+
+static int software_jpeg_decoder_set_option(device_t *dev, const char *key, const char *value)
+{
+  software_jpeg_decoder_t *decoder = dev->software->codec_data;
+
+  if (!strcmp(key, "slices")) {
+    decoder->slices = MAX(MIN(atoi(value), SOFTWARE_JPEG_DECODER_MAX_SLICES), 0);
+    return 1;
+  }
+
+  if (!strcmp(key, "dropcorrupt")) {
+    decoder->drop_corrupt = atoi(value) != 0;
+    return 1;
+  }
+
+  return -1;
+}
+
+static int software_jpeg_decoder_process(device_t *dev, buffer_t *output, buffer_t *capture)
+{
+  software_jpeg_decoder_t *decoder = dev->software->codec_data;
+  software_jpeg_decoder_context_t *context = software_jpeg_decoder_get_context(decoder);
+  int n_slices = decoder->slices;
+
+  if (!context) {
+    LOG_ERROR(dev, "No free decoder");
+  }
+
+  if (n_slices <= 0) {
+    int processing = MAX(__atomic_load_n(&dev->software->processing, __ATOMIC_RELAXED), 1);
+    n_slices = MAX(sysconf(_SC_NPROCESSORS_ONLN) / processing, 1);
+  }
+
+  int ret = software_jpeg_decoder_decode(decoder, context, n_slices, output, capture);
+  software_jpeg_decoder_put_context(decoder, context);
+  return ret;
+
+error:
+  return -1;
+}
+
+const software_codec_t software_jpeg_decoder_codec = {
+  .name = "jpeg-decoder",
+  .output_formats = { V4L2_PIX_FMT_JPEG, V4L2_PIX_FMT_MJPEG },
+  .capture_formats = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YVU420 },
+  .max_threads = SOFTWARE_MAX_THREADS,
+
+  .open = software_jpeg_decoder_open,
+  .close = software_jpeg_decoder_close,
+  .dump_options = software_jpeg_decoder_dump_options,
+  .set_option = software_jpeg_decoder_set_option,
+  .process = software_jpeg_decoder_process
+};
+
+#endif // USE_LIBJPEG
@@ -0,0 +1,1009 @@
+#include "software.h"
+#include "device/buffer.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+
+#include <math.h>
+#include <linux/videodev2.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Each plane is scaled separately, so converting between the formats
+// (ex. the 4:2:2 chroma of YUYV into the 4:2:0 of NV12) is just a different
+// vertical scale of the chroma planes. The vertical filter runs first,
+// on the full width of the source rows, and then the horizontal one:
+// the vertical pass touches `ratio` times more pixels, and is the one
+// vectorized across the pixels, the horizontal one is a dot product per pixel.
+//
+// The integer ratios use a box filter, the other ones a triangle filter
+// with the support scaled by the ratio (bilinear when upscaling),
+// with the coefficients precomputed for each output row and column.
+
+#define SOFTWARE_RESCALLER_SHIFT 14
+#define SOFTWARE_RESCALLER_ONE (1 << SOFTWARE_RESCALLER_SHIFT)
+#define SOFTWARE_RESCALLER_MAX_TAPS 64
+#define SOFTWARE_RESCALLER_MAX_BANDS SOFTWARE_MAX_WORKERS
+#define SOFTWARE_RESCALLER_MAX_PLANES 3
+
+typedef struct software_rescaller_plane_s {
+  uint8_t *data;
+  int step, stride; // in bytes
+  int width, height;
+} software_rescaller_plane_t;
+
+typedef struct software_rescaller_filter_s {
+  int in_size, size, n_taps;
+  int stride; // `n_taps` rounded up to 8, the padding coefficients are zero
+  int *offsets; // the first input of each output
+  int16_t *coeffs; // `stride` of each output, summing to SOFTWARE_RESCALLER_ONE
+  bool box2;
+} software_rescaller_filter_t;
+
+typedef struct software_rescaller_kernels_s {
+  software_simd_t simd;
+  void (*vfilter)(uint8_t *dst, const uint8_t **rows, const int16_t *coeffs, int n_taps, int width);
+  void (*hfilter)(uint8_t *dst, const uint8_t *src, const software_rescaller_filter_t *filter);
+  void (*hbox2)(uint8_t *dst, const uint8_t *src, int dst_width);
+  void (*unpack2)(uint8_t *dst, const uint8_t *src, int width);
+  void (*unpack4)(uint8_t *dst, const uint8_t *src, int width);
+} software_rescaller_kernels_t;
+
+struct software_rescaller_s {
+  const software_rescaller_kernels_t *kernels;
+  int threads; // 0 = one per CPU
+
+  software_workers_t workers;
+  int n_bands;
+  uint8_t *scratch[SOFTWARE_RESCALLER_MAX_BANDS];
+  size_t scratch_size, band_size;
+
+  // the filters are rebuilt when any of the formats changes
+  buffer_format_t src_fmt, dst_fmt;
+  int n_planes;
+  software_rescaller_plane_t src[SOFTWARE_RESCALLER_MAX_PLANES];
+  software_rescaller_plane_t dst[SOFTWARE_RESCALLER_MAX_PLANES];
+  software_rescaller_filter_t hfilter[SOFTWARE_RESCALLER_MAX_PLANES];
+  software_rescaller_filter_t vfilter[SOFTWARE_RESCALLER_MAX_PLANES];
+};
+
+/* Scalar kernels */
+
+static uint8_t software_rescaller_clamp(int value)
+{
+  value >>= SOFTWARE_RESCALLER_SHIFT;
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static void software_rescaller_vfilter_scalar(uint8_t *dst, const uint8_t **rows, const int16_t *coeffs, int n_taps, int width)
+{
+  for (int x = 0; x < width; x++) {
+    int acc = SOFTWARE_RESCALLER_ONE / 2;
+    for (int t = 0; t < n_taps; t++) {
+      acc += rows[t][x] * coeffs[t];
+    }
+    dst[x] = software_rescaller_clamp(acc);
+  }
+}
+
+static void software_rescaller_hbox2_scalar(uint8_t *dst, const uint8_t *src, int dst_width)
+{
+  for (int x = 0; x < dst_width; x++) {
+    dst[x] = (src[x * 2] + src[x * 2 + 1] + 1) >> 1;
+  }
+}
+
+static void software_rescaller_unpack2_scalar(uint8_t *dst, const uint8_t *src, int width)
+{
+  for (int x = 0; x < width; x++) {
+    dst[x] = src[x * 2];
+  }
+}
+
+static void software_rescaller_unpack4_scalar(uint8_t *dst, const uint8_t *src, int width)
+{
+  for (int x = 0; x < width; x++) {
+    dst[x] = src[x * 4];
+  }
+}
+
+// The outputs from `first`
+static void software_rescaller_hfilter_tail(uint8_t *dst, const uint8_t *src, const software_rescaller_filter_t *filter, int first)
+{
+  for (int x = first; x < filter->size; x++) {
+    const uint8_t *in = src + filter->offsets[x];
+    const int16_t *coeffs = filter->coeffs + x * filter->stride;
+    int acc = SOFTWARE_RESCALLER_ONE / 2;
+    for (int t = 0; t < filter->n_taps; t++) {
+      acc += in[t] * coeffs[t];
+    }
+    dst[x] = software_rescaller_clamp(acc);
+  }
+}
+
+static void software_rescaller_hfilter_scalar(uint8_t *dst, const uint8_t *src, const software_rescaller_filter_t *filter)
+{
+  software_rescaller_hfilter_tail(dst, src, filter, 0);
+}
+
+static const software_rescaller_kernels_t software_rescaller_scalar = {
+  .simd = SOFTWARE_SIMD_NONE,
+  .vfilter = software_rescaller_vfilter_scalar,
+  .hfilter = software_rescaller_hfilter_scalar,
+  .hbox2 = software_rescaller_hbox2_scalar,
+  .unpack2 = software_rescaller_unpack2_scalar,
+  .unpack4 = software_rescaller_unpack4_scalar
+};
+
+/* SSE2 kernels */
+
+#if defined(__SSE2__)
+
+static void software_rescaller_vfilter_sse2(uint8_t *dst, const uint8_t **rows, const int16_t *coeffs, int n_taps, int width)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(SOFTWARE_RESCALLER_ONE / 2);
+  int x = 0;
+
+  // the 2:1 box is an average
+  if (n_taps == 2 && coeffs[0] == SOFTWARE_RESCALLER_ONE / 2 && coeffs[1] == SOFTWARE_RESCALLER_ONE / 2) {
+    for ( ; x + 16 <= width; x += 16) {
+      __m128i a = _mm_loadu_si128((const __m128i*)(rows[0] + x));
+      __m128i b = _mm_loadu_si128((const __m128i*)(rows[1] + x));
+      _mm_storeu_si128((__m128i*)(dst + x), _mm_avg_epu8(a, b));
+    }
+  }
+
+  for ( ; x + 16 <= width; x += 16) {
+    __m128i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+    // pairs of rows: (a0 * c0 + b0 * c1), (a1 * c0 + b1 * c1), ...
+    for (int t = 0; t < n_taps; t += 2) {
+      bool pair = t + 1 < n_taps;
+      __m128i a = _mm_loadu_si128((const __m128i*)(rows[t] + x));
+      __m128i b = pair ? _mm_loadu_si128((const __m128i*)(rows[t + 1] + x)) : zero;
+      __m128i c = _mm_set1_epi32((uint16_t)coeffs[t] | (pair ? (uint32_t)(uint16_t)coeffs[t + 1] << 16 : 0));
+      __m128i lo = _mm_unpacklo_epi8(a, b);
+      __m128i hi = _mm_unpackhi_epi8(a, b);
+
+      acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), c));
+      acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), c));
+      acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), c));
+      acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), c));
+    }
+
+    acc0 = _mm_srai_epi32(acc0, SOFTWARE_RESCALLER_SHIFT);
+    acc1 = _mm_srai_epi32(acc1, SOFTWARE_RESCALLER_SHIFT);
+    acc2 = _mm_srai_epi32(acc2, SOFTWARE_RESCALLER_SHIFT);
+    acc3 = _mm_srai_epi32(acc3, SOFTWARE_RESCALLER_SHIFT);
+
+    __m128i out = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3));
+    _mm_storeu_si128((__m128i*)(dst + x), out);
+  }
+
+  const uint8_t *tail_rows[SOFTWARE_RESCALLER_MAX_TAPS];
+  for (int t = 0; t < n_taps; t++) {
+    tail_rows[t] = rows[t] + x;
+  }
+  software_rescaller_vfilter_scalar(dst + x, tail_rows, coeffs, n_taps, width - x);
+}
+
+static void software_rescaller_hbox2_sse2(uint8_t *dst, const uint8_t *src, int dst_width)
+{
+  const __m128i mask = _mm_set1_epi16(0xFF);
+  const __m128i one = _mm_set1_epi16(1);
+  int x = 0;
+
+  for ( ; x + 16 <= dst_width; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src + x * 2));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + x * 2 + 16));
+    a = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, mask), _mm_srli_epi16(a, 8)), one);
+    b = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(b, mask), _mm_srli_epi16(b, 8)), one);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(_mm_srli_epi16(a, 1), _mm_srli_epi16(b, 1)));
+  }
+
+  software_rescaller_hbox2_scalar(dst + x, src + x * 2, dst_width - x);
+}
+
+static void software_rescaller_unpack2_sse2(uint8_t *dst, const uint8_t *src, int width)
+{
+  const __m128i mask = _mm_set1_epi16(0xFF);
+  int x = 0;
+
+  // the last byte of the source might be the last one of the buffer
+  for ( ; x + 16 < width; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(src + x * 2));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + x * 2 + 16));
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+  }
+
+  software_rescaller_unpack2_scalar(dst + x, src + x * 2, width - x);
+}
+
+static void software_rescaller_unpack4_sse2(uint8_t *dst, const uint8_t *src, int width)
+{
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  int x = 0;
+
+  for ( ; x + 16 < width; x += 16) {
+    __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x * 4)), mask);
+    __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x * 4 + 16)), mask);
+    __m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x * 4 + 32)), mask);
+    __m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + x * 4 + 48)), mask);
+    _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  }
+
+  software_rescaller_unpack4_scalar(dst + x, src + x * 4, width - x);
+}
+
+// Four outputs at a time, each a dot product of 8 inputs and coefficients
+// at a time, as long as the inputs are within the line
+static void software_rescaller_hfilter_sse2(uint8_t *dst, const uint8_t *src, const software_rescaller_filter_t *filter)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i round = _mm_set1_epi32(SOFTWARE_RESCALLER_ONE / 2);
+  int x = 0;
+
+  for ( ; x + 4 <= filter->size && filter->offsets[x + 3] + filter->stride <= filter->in_size; x += 4) {
+    __m128i acc[4];
+
+    for (int i = 0; i < 4; i++) {
+      const uint8_t *in = src + filter->offsets[x + i];
+      const int16_t *coeffs = filter->coeffs + (x + i) * filter->stride;
+
+      acc[i] = zero;
+      for (int t = 0; t < filter->stride; t += 8) {
+        __m128i pixels = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(in + t)), zero);
+        acc[i] = _mm_add_epi32(acc[i], _mm_madd_epi16(pixels, _mm_loadu_si128((const __m128i*)(coeffs + t))));
+      }
+    }
+
+    // transpose, to sum each of the accumulators
+    __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(acc[0], acc[1]), _mm_unpackhi_epi32(acc[0], acc[1]));
+    __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(acc[2], acc[3]), _mm_unpackhi_epi32(acc[2], acc[3]));
+    __m128i sum = _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+
+    sum = _mm_srai_epi32(_mm_add_epi32(sum, round), SOFTWARE_RESCALLER_SHIFT);
+    sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), zero);
+
+    uint32_t out = _mm_cvtsi128_si32(sum);
+    memcpy(dst + x, &out, sizeof(out));
+  }
+
+  software_rescaller_hfilter_tail(dst, src, filter, x);
+}
+
+static const software_rescaller_kernels_t software_rescaller_sse2 = {
+  .simd = SOFTWARE_SIMD_SSE2,
+  .vfilter = software_rescaller_vfilter_sse2,
+  .hfilter = software_rescaller_hfilter_sse2,
+  .hbox2 = software_rescaller_hbox2_sse2,
+  .unpack2 = software_rescaller_unpack2_sse2,
+  .unpack4 = software_rescaller_unpack4_sse2
+};
+
+/* AVX2 kernels: the pack/unpack work within the 128-bit lanes */
+
+__attribute__((target("avx2")))
+static void software_rescaller_vfilter_avx2(uint8_t *dst, const uint8_t **rows, const int16_t *coeffs, int n_taps, int width)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i round = _mm256_set1_epi32(SOFTWARE_RESCALLER_ONE / 2);
+  int x = 0;
+
+  if (n_taps == 2 && coeffs[0] == SOFTWARE_RESCALLER_ONE / 2 && coeffs[1] == SOFTWARE_RESCALLER_ONE / 2) {
+    for ( ; x + 32 <= width; x += 32) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(rows[0] + x));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(rows[1] + x));
+      _mm256_storeu_si256((__m256i*)(dst + x), _mm256_avg_epu8(a, b));
+    }
+  }
+
+  for ( ; x + 32 <= width; x += 32) {
+    __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+
+    for (int t = 0; t < n_taps; t += 2) {
+      bool pair = t + 1 < n_taps;
+      __m256i a = _mm256_loadu_si256((const __m256i*)(rows[t] + x));
+      __m256i b = pair ? _mm256_loadu_si256((const __m256i*)(rows[t + 1] + x)) : zero;
+      __m256i c = _mm256_set1_epi32((uint16_t)coeffs[t] | (pair ? (uint32_t)(uint16_t)coeffs[t + 1] << 16 : 0));
+      __m256i lo = _mm256_unpacklo_epi8(a, b);
+      __m256i hi = _mm256_unpackhi_epi8(a, b);
+
+      acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), c));
+      acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), c));
+      acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), c));
+      acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), c));
+    }
+
+    acc0 = _mm256_srai_epi32(acc0, SOFTWARE_RESCALLER_SHIFT);
+    acc1 = _mm256_srai_epi32(acc1, SOFTWARE_RESCALLER_SHIFT);
+    acc2 = _mm256_srai_epi32(acc2, SOFTWARE_RESCALLER_SHIFT);
+    acc3 = _mm256_srai_epi32(acc3, SOFTWARE_RESCALLER_SHIFT);
+
+    // the lanes were split and packed the same way: the order is restored
+    __m256i out = _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1), _mm256_packs_epi32(acc2, acc3));
+    _mm256_storeu_si256((__m256i*)(dst + x), out);
+  }
+
+  const uint8_t *tail_rows[SOFTWARE_RESCALLER_MAX_TAPS];
+  for (int t = 0; t < n_taps; t++) {
+    tail_rows[t] = rows[t] + x;
+  }
+  software_rescaller_vfilter_scalar(dst + x, tail_rows, coeffs, n_taps, width - x);
+}
+
+__attribute__((target("avx2")))
+static void software_rescaller_hbox2_avx2(uint8_t *dst, const uint8_t *src, int dst_width)
+{
+  const __m256i mask = _mm256_set1_epi16(0xFF);
+  const __m256i one = _mm256_set1_epi16(1);
+  int x = 0;
+
+  for ( ; x + 32 <= dst_width; x += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src + x * 2));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + x * 2 + 32));
+    a = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(a, mask), _mm256_srli_epi16(a, 8)), one);
+    b = _mm256_add_epi16(_mm256_add_epi16(_mm256_and_si256(b, mask), _mm256_srli_epi16(b, 8)), one);
+    __m256i out = _mm256_packus_epi16(_mm256_srli_epi16(a, 1), _mm256_srli_epi16(b, 1));
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(out, 0xD8));
+  }
+
+  software_rescaller_hbox2_scalar(dst + x, src + x * 2, dst_width - x);
+}
+
+__attribute__((target("avx2")))
+static void software_rescaller_unpack2_avx2(uint8_t *dst, const uint8_t *src, int width)
+{
+  const __m256i mask = _mm256_set1_epi16(0xFF);
+  int x = 0;
+
+  for ( ; x + 32 < width; x += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(src + x * 2));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(src + x * 2 + 32));
+    __m256i out = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+    _mm256_storeu_si256((__m256i*)(dst + x), _mm256_permute4x64_epi64(out, 0xD8));
+  }
+
+  software_rescaller_unpack2_scalar(dst + x, src + x * 2, width - x);
+}
+
+// The SSE2 ones are as good for the dot products of the horizontal filter
+static const software_rescaller_kernels_t software_rescaller_avx2 = {
+  .simd = SOFTWARE_SIMD_AVX2,
+  .vfilter = software_rescaller_vfilter_avx2,
+  .hfilter = software_rescaller_hfilter_sse2,
+  .hbox2 = software_rescaller_hbox2_avx2,
+  .unpack2 = software_rescaller_unpack2_avx2,
+  .unpack4 = software_rescaller_unpack4_sse2
+};
+
+#endif // __SSE2__
+
+/* NEON kernels */
+
+#if defined(__ARM_NEON)
+
+static void software_rescaller_vfilter_neon(uint8_t *dst, const uint8_t **rows, const int16_t *coeffs, int n_taps, int width)
+{
+  int x = 0;
+
+  if (n_taps == 2 && coeffs[0] == SOFTWARE_RESCALLER_ONE / 2 && coeffs[1] == SOFTWARE_RESCALLER_ONE / 2) {
+    for ( ; x + 16 <= width; x += 16) {
+      vst1q_u8(dst + x, vrhaddq_u8(vld1q_u8(rows[0] + x), vld1q_u8(rows[1] + x)));
+    }
+  }
+
+  for ( ; x + 16 <= width; x += 16) {
+    int32x4_t acc0 = vdupq_n_s32(0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+
+    for (int t = 0; t < n_taps; t++) {
+      uint8x16_t in = vld1q_u8(rows[t] + x);
+      int16x8_t lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(in)));
+      int16x8_t hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(in)));
+
+      acc0 = vmlal_n_s16(acc0, vget_low_s16(lo), coeffs[t]);
+      acc1 = vmlal_n_s16(acc1, vget_high_s16(lo), coeffs[t]);
+      acc2 = vmlal_n_s16(acc2, vget_low_s16(hi), coeffs[t]);
+      acc3 = vmlal_n_s16(acc3, vget_high_s16(hi), coeffs[t]);
+    }
+
+    // rounding shift, saturated to 16 and then 8 bits
+    uint16x8_t lo = vcombine_u16(vqrshrun_n_s32(acc0, SOFTWARE_RESCALLER_SHIFT), vqrshrun_n_s32(acc1, SOFTWARE_RESCALLER_SHIFT));
+    uint16x8_t hi = vcombine_u16(vqrshrun_n_s32(acc2, SOFTWARE_RESCALLER_SHIFT), vqrshrun_n_s32(acc3, SOFTWARE_RESCALLER_SHIFT));
+    vst1q_u8(dst + x, vcombine_u8(vqmovn_u16(lo), vqmovn_u16(hi)));
+  }
+
+  const uint8_t *tail_rows[SOFTWARE_RESCALLER_MAX_TAPS];
+  for (int t = 0; t < n_taps; t++) {
+    tail_rows[t] = rows[t] + x;
+  }
+  software_rescaller_vfilter_scalar(dst + x, tail_rows, coeffs, n_taps, width - x);
+}
+
+static void software_rescaller_hbox2_neon(uint8_t *dst, const uint8_t *src, int dst_width)
+{
+  int x = 0;
+
+  for ( ; x + 16 <= dst_width; x += 16) {
+    uint8x16x2_t in = vld2q_u8(src + x * 2);
+    vst1q_u8(dst + x, vrhaddq_u8(in.val[0], in.val[1]));
+  }
+
+  software_rescaller_hbox2_scalar(dst + x, src + x * 2, dst_width - x);
+}
+
+static void software_rescaller_unpack2_neon(uint8_t *dst, const uint8_t *src, int width)
+{
+  int x = 0;
+
+  for ( ; x + 16 < width; x += 16) {
+    uint8x16x2_t in = vld2q_u8(src + x * 2);
+    vst1q_u8(dst + x, in.val[0]);
+  }
+
+  software_rescaller_unpack2_scalar(dst + x, src + x * 2, width - x);
+}
+
+static void software_rescaller_unpack4_neon(uint8_t *dst, const uint8_t *src, int width)
+{
+  int x = 0;
+
+  for ( ; x + 16 < width; x += 16) {
+    uint8x16x4_t in = vld4q_u8(src + x * 4);
+    vst1q_u8(dst + x, in.val[0]);
+  }
+
+  software_rescaller_unpack4_scalar(dst + x, src + x * 4, width - x);
+}
+
+static void software_rescaller_hfilter_neon(uint8_t *dst, const uint8_t *src, const software_rescaller_filter_t *filter)
+{
+  int x = 0;
+
+  for ( ; x < filter->size && filter->offsets[x] + filter->stride <= filter->in_size; x++) {
+    const uint8_t *in = src + filter->offsets[x];
+    const int16_t *coeffs = filter->coeffs + x * filter->stride;
+    int32x4_t acc = vdupq_n_s32(0);
+
+    for (int t = 0; t < filter->stride; t += 8) {
+      int16x8_t pixels = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(in + t)));
+      int16x8_t c = vld1q_s16(coeffs + t);
+      acc = vmlal_s16(acc, vget_low_s16(pixels), vget_low_s16(c));
+      acc = vmlal_s16(acc, vget_high_s16(pixels), vget_high_s16(c));
+    }
+
+    int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    sum = vpadd_s32(sum, sum);
+    dst[x] = software_rescaller_clamp(vget_lane_s32(sum, 0) + SOFTWARE_RESCALLER_ONE / 2);
+  }
+
+  software_rescaller_hfilter_tail(dst, src, filter, x);
+}
+
+static const software_rescaller_kernels_t software_rescaller_neon = {
+  .simd = SOFTWARE_SIMD_NEON,
+  .vfilter = software_rescaller_vfilter_neon,
+  .hfilter = software_rescaller_hfilter_neon,
+  .hbox2 = software_rescaller_hbox2_neon,
+  .unpack2 = software_rescaller_unpack2_neon,
+  .unpack4 = software_rescaller_unpack4_neon
+};
+
+#endif // __ARM_NEON
+
+static const software_rescaller_kernels_t *software_rescaller_get_kernels(software_simd_t simd)
+{
+  if (!software_simd_supported(simd)) {
+    return NULL;
+  }
+
+  switch (simd) {
+  case SOFTWARE_SIMD_NONE:
+    return &software_rescaller_scalar;
+#if defined(__SSE2__)
+  case SOFTWARE_SIMD_SSE2:
+    return &software_rescaller_sse2;
+  case SOFTWARE_SIMD_AVX2:
+    return &software_rescaller_avx2;
+#endif
+#if defined(__ARM_NEON)
+  case SOFTWARE_SIMD_NEON:
+    return &software_rescaller_neon;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+/* Frame geometry */
+
+size_t software_rescaller_frame_size(buffer_format_t fmt)
+{
+  switch (fmt.format) {
+  case V4L2_PIX_FMT_YUYV:
+  case V4L2_PIX_FMT_YUV24:
+    return fmt.bytesperline * fmt.height;
+
+  case V4L2_PIX_FMT_YUV422P:
+    return fmt.bytesperline * fmt.height * 2;
+
+  case V4L2_PIX_FMT_YUV420:
+  case V4L2_PIX_FMT_YVU420:
+  case V4L2_PIX_FMT_NV12:
+  case V4L2_PIX_FMT_NV21:
+    return fmt.bytesperline * (fmt.height + (fmt.height + 1) / 2);
+
+  default:
+    return 0;
+  }
+}
+
+// The planes of Y, U and V
+static int software_rescaller_get_planes(buffer_format_t fmt, uint8_t *data, software_rescaller_plane_t planes[SOFTWARE_RESCALLER_MAX_PLANES])
+{
+  int stride = fmt.bytesperline;
+  int width = fmt.width, height = fmt.height;
+  int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+  uint8_t *chroma = data + stride * height;
+
+  planes[0] = (software_rescaller_plane_t){ data, 1, stride, width, height };
+
+  switch (fmt.format) {
+  case V4L2_PIX_FMT_YUYV:
+    planes[0].step = 2;
+    planes[1] = (software_rescaller_plane_t){ data + 1, 4, stride, chroma_width, height };
+    planes[2] = (software_rescaller_plane_t){ data + 3, 4, stride, chroma_width, height };
+    return 3;
+
+  case V4L2_PIX_FMT_YUV24:
+    planes[0].step = 3;
+    planes[1] = (software_rescaller_plane_t){ data + 1, 3, stride, width, height };
+    planes[2] = (software_rescaller_plane_t){ data + 2, 3, stride, width, height };
+    return 3;
+
+  case V4L2_PIX_FMT_YUV422P:
+    planes[1] = (software_rescaller_plane_t){ chroma, 1, stride / 2, chroma_width, height };
+    planes[2] = (software_rescaller_plane_t){ chroma + stride / 2 * height, 1, stride / 2, chroma_width, height };
+    return 3;
+
+  case V4L2_PIX_FMT_YUV420:
+  case V4L2_PIX_FMT_YVU420:
+    planes[1] = (software_rescaller_plane_t){ chroma, 1, stride / 2, chroma_width, chroma_height };
+    planes[2] = (software_rescaller_plane_t){ chroma + stride / 2 * chroma_height, 1, stride / 2, chroma_width, chroma_height };
+    break;
+
+  case V4L2_PIX_FMT_NV12:
+  case V4L2_PIX_FMT_NV21:
+    planes[1] = (software_rescaller_plane_t){ chroma, 2, stride, chroma_width, chroma_height };
+    planes[2] = (software_rescaller_plane_t){ chroma + 1, 2, stride, chroma_width, chroma_height };
+    break;
+
+  default:
+    return -1;
+  }
+
+  if (fmt.format == V4L2_PIX_FMT_YVU420 || fmt.format == V4L2_PIX_FMT_NV21) {
+    software_rescaller_plane_t u = planes[2];
+    planes[2] = planes[1];
+    planes[1] = u;
+  }
+  return 3;
+}
+
+static void software_rescaller_filter_free(software_rescaller_filter_t *filter)
+{
+  free(filter->offsets);
+  free(filter->coeffs);
+  memset(filter, 0, sizeof(*filter));
+}
+
+static int software_rescaller_filter_init(software_rescaller_filter_t *filter, int in_size, int out_size)
+{
+  software_rescaller_filter_free(filter);
+
+  int ratio = in_size % out_size ? 0 : in_size / out_size;
+  double scale = (double)in_size / out_size;
+  double support = MAX(scale, 1.0);
+
+  filter->in_size = in_size;
+  filter->size = out_size;
+  filter->n_taps = ratio ? ratio : MIN((int)ceil(support * 2) + 1, in_size);
+  filter->stride = (filter->n_taps + 7) / 8 * 8;
+  filter->box2 = ratio == 2;
+
+  if (filter->n_taps > SOFTWARE_RESCALLER_MAX_TAPS) {
+    LOG_INFO(NULL, "Cannot scale from %d to %d: too many taps %d", in_size, out_size, filter->n_taps);
+    return -1;
+  }
+
+  filter->offsets = calloc(out_size, sizeof(int));
+  filter->coeffs = calloc(out_size * filter->stride, sizeof(int16_t));
+
+  for (int i = 0; i < out_size; i++) {
+    int16_t *coeffs = filter->coeffs + i * filter->stride;
+    double weights[SOFTWARE_RESCALLER_MAX_TAPS] = {0};
+    double sum = 0;
+
+    if (ratio) {
+      filter->offsets[i] = i * ratio;
+      for (int t = 0; t < ratio; t++) {
+        weights[t] = 1;
+      }
+      sum = ratio;
+    } else {
+      double center = (i + 0.5) * scale - 0.5;
+      int start = (int)floor(center - support) + 1;
+      int first = MAX(MIN(start, in_size - filter->n_taps), 0);
+
+      // the inputs past the edges are the edge ones
+      for (int t = 0; t < filter->n_taps; t++) {
+        double weight = 1 - fabs(start + t - center) / support;
+        if (weight <= 0)
+          continue;
+
+        int input = MAX(MIN(start + t, in_size - 1), 0);
+        weights[input - first] += weight;
+        sum += weight;
+      }
+      filter->offsets[i] = first;
+    }
+
+    // the rounding error goes to the biggest coefficient
+    int total = 0, biggest = 0;
+    for (int t = 0; t < filter->n_taps; t++) {
+      coeffs[t] = lround(weights[t] / sum * SOFTWARE_RESCALLER_ONE);
+      total += coeffs[t];
+      if (coeffs[t] > coeffs[biggest])
+        biggest = t;
+    }
+    coeffs[biggest] += SOFTWARE_RESCALLER_ONE - total;
+  }
+
+  return 0;
+}
+
+static int software_rescaller_setup(software_rescaller_t *rescaller, buffer_format_t src_fmt, buffer_format_t dst_fmt)
+{
+  software_rescaller_plane_t src[SOFTWARE_RESCALLER_MAX_PLANES];
+  software_rescaller_plane_t dst[SOFTWARE_RESCALLER_MAX_PLANES];
+  int n_planes = software_rescaller_get_planes(src_fmt, NULL, src);
+
+  if (n_planes < 0 || software_rescaller_get_planes(dst_fmt, NULL, dst) != n_planes) {
+    LOG_INFO(NULL, "Cannot scale from '%s' to '%s'",
+      fourcc_to_string(src_fmt.format).buf, fourcc_to_string(dst_fmt.format).buf);
+    return -1;
+  }
+
+  size_t band_size = 0;
+
+  for (int i = 0; i < n_planes; i++) {
+    if (software_rescaller_filter_init(&rescaller->vfilter[i], src[i].height, dst[i].height) < 0 ||
+      software_rescaller_filter_init(&rescaller->hfilter[i], src[i].width, dst[i].width) < 0) {
+      goto error;
+    }
+
+    // the unpacked rows, the vertically and then the horizontally filtered one
+    size_t size = (rescaller->vfilter[i].n_taps + 1) * src[i].width + dst[i].width;
+    band_size = MAX(band_size, size);
+  }
+
+  rescaller->src_fmt = src_fmt;
+  rescaller->dst_fmt = dst_fmt;
+  rescaller->n_planes = n_planes;
+  rescaller->band_size = (band_size + 63) / 64 * 64;
+  return 0;
+
+error:
+  rescaller->src_fmt.format = 0;
+  return -1;
+}
+
+static int software_rescaller_setup_bands(software_rescaller_t *rescaller)
+{
+  int n_bands = rescaller->threads > 0 ? rescaller->threads : sysconf(_SC_NPROCESSORS_ONLN);
+  n_bands = MAX(MIN(n_bands, SOFTWARE_RESCALLER_MAX_BANDS), 1);
+  n_bands = MIN(n_bands, (int)rescaller->dst_fmt.height / 2);
+  n_bands = MAX(n_bands, 1);
+
+  if (rescaller->scratch_size < rescaller->band_size) {
+    for (int i = 0; i < SOFTWARE_RESCALLER_MAX_BANDS; i++) {
+      free(rescaller->scratch[i]);
+      rescaller->scratch[i] = NULL;
+    }
+    rescaller->scratch_size = rescaller->band_size;
+  }
+
+  for (int i = 0; i < n_bands; i++) {
+    if (!rescaller->scratch[i]) {
+      rescaller->scratch[i] = malloc(rescaller->scratch_size);
+    }
+  }
+
+  // the calling thread scales one of the bands
+  if (rescaller->workers.n_threads != n_bands - 1) {
+    software_workers_stop(&rescaller->workers);
+    if (n_bands > 1) {
+      software_workers_start(&rescaller->workers, n_bands - 1);
+    }
+  }
+
+  rescaller->n_bands = n_bands;
+  return 0;
+}
+
+static void software_rescaller_unpack(software_rescaller_t *rescaller, uint8_t *dst, const uint8_t *src, int step, int width)
+{
+  if (step == 2) {
+    rescaller->kernels->unpack2(dst, src, width);
+    return;
+  } else if (step == 4) {
+    rescaller->kernels->unpack4(dst, src, width);
+    return;
+  }
+
+  for (int x = 0; x < width; x++) {
+    dst[x] = src[x * step];
+  }
+}
+
+static void software_rescaller_scale_row(software_rescaller_t *rescaller, int plane, int y, uint8_t *scratch)
+{
+  const software_rescaller_plane_t *src = &rescaller->src[plane];
+  const software_rescaller_plane_t *dst = &rescaller->dst[plane];
+  const software_rescaller_filter_t *vfilter = &rescaller->vfilter[plane];
+  const software_rescaller_filter_t *hfilter = &rescaller->hfilter[plane];
+  const uint8_t *rows[SOFTWARE_RESCALLER_MAX_TAPS] = {NULL};
+  uint8_t *vline = scratch + vfilter->n_taps * src->width;
+  uint8_t *hline = vline + src->width;
+  uint8_t *out = dst->data + y * dst->stride;
+
+  for (int t = 0; t < vfilter->n_taps; t++) {
+    const uint8_t *row = src->data + (vfilter->offsets[y] + t) * src->stride;
+    if (src->step == 1) {
+      rows[t] = row;
+    } else {
+      software_rescaller_unpack(rescaller, scratch + t * src->width, row, src->step, src->width);
+      rows[t] = scratch + t * src->width;
+    }
+  }
+
+  const uint8_t *line = rows[0];
+  if (vfilter->n_taps > 1) {
+    rescaller->kernels->vfilter(vline, rows, vfilter->coeffs + y * vfilter->stride, vfilter->n_taps, src->width);
+    line = vline;
+  }
+
+  uint8_t *hout = dst->step == 1 ? out : hline;
+  if (hfilter->n_taps == 1) {
+    // the same width
+    if (dst->step == 1) {
+      memcpy(out, line, dst->width);
+      return;
+    }
+    hout = (uint8_t*)line;
+  } else if (hfilter->box2) {
+    rescaller->kernels->hbox2(hout, line, dst->width);
+  } else {
+    rescaller->kernels->hfilter(hout, line, hfilter);
+  }
+
+  if (dst->step != 1) {
+    for (int x = 0; x < dst->width; x++) {
+      out[x * dst->step] = hout[x];
+    }
+  }
+}
+
+static void software_rescaller_band_job(void *opaque, int band)
+{
+  software_rescaller_t *rescaller = opaque;
+
+  for (int i = 0; i < rescaller->n_planes; i++) {
+    int height = rescaller->dst[i].height;
+    int first = height * band / rescaller->n_bands;
+    int last = height * (band + 1) / rescaller->n_bands;
+
+    for (int y = first; y < last; y++) {
+      software_rescaller_scale_row(rescaller, i, y, rescaller->scratch[band]);
+    }
+  }
+}
+
+/* Public interface */
+
+bool software_simd_supported(software_simd_t simd)
+{
+  switch (simd) {
+  case SOFTWARE_SIMD_NONE:
+    return true;
+#if defined(__SSE2__)
+  case SOFTWARE_SIMD_SSE2:
+    return true;
+  case SOFTWARE_SIMD_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+  case SOFTWARE_SIMD_NEON:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+software_simd_t software_simd_detect()
+{
+  static const software_simd_t preferred[] = {
+    SOFTWARE_SIMD_AVX2,
+    SOFTWARE_SIMD_SSE2,
+    SOFTWARE_SIMD_NEON
+  };
+
+  for (int i = 0; i < ARRAY_SIZE(preferred); i++) {
+    if (software_simd_supported(preferred[i])) {
+      return preferred[i];
+    }
+  }
+  return SOFTWARE_SIMD_NONE;
+}
+
+const char *software_simd_name(software_simd_t simd)
+{
+  switch (simd) {
+  case SOFTWARE_SIMD_NONE: return "scalar";
+  case SOFTWARE_SIMD_SSE2: return "sse2";
+  case SOFTWARE_SIMD_AVX2: return "avx2";
+  case SOFTWARE_SIMD_NEON: return "neon";
+  default: return "unknown";
+  }
+}
+
+software_rescaller_t *software_rescaller_new(software_simd_t simd, int threads)
+{
+  const software_rescaller_kernels_t *kernels = software_rescaller_get_kernels(simd);
+  if (!kernels) {
+    return NULL;
+  }
+
+  software_rescaller_t *rescaller = calloc(1, sizeof(software_rescaller_t));
+  rescaller->kernels = kernels;
+  rescaller->threads = threads;
+  return rescaller;
+}
+
+void software_rescaller_free(software_rescaller_t *rescaller)
+{
+  if (!rescaller) {
+    return;
+  }
+
+  software_workers_stop(&rescaller->workers);
+
+  for (int i = 0; i < SOFTWARE_RESCALLER_MAX_PLANES; i++) {
+    software_rescaller_filter_free(&rescaller->vfilter[i]);
+    software_rescaller_filter_free(&rescaller->hfilter[i]);
+  }
+  for (int i = 0; i < SOFTWARE_RESCALLER_MAX_BANDS; i++) {
+    free(rescaller->scratch[i]);
+  }
+  free(rescaller);
+}
+
+static bool software_rescaller_same_format(buffer_format_t a, buffer_format_t b)
+{
+  return a.format == b.format && a.width == b.width && a.height == b.height && a.bytesperline == b.bytesperline;
+}
+
+int software_rescaller_scale(software_rescaller_t *rescaller, const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt)
+{
+  if (!software_rescaller_same_format(rescaller->src_fmt, src_fmt) || !software_rescaller_same_format(rescaller->dst_fmt, dst_fmt)) {
+    if (software_rescaller_setup(rescaller, src_fmt, dst_fmt) < 0) {
+      return -1;
+    }
+  }
+
+  software_rescaller_get_planes(src_fmt, (uint8_t*)src, rescaller->src);
+  software_rescaller_get_planes(dst_fmt, dst, rescaller->dst);
+
+  if (software_rescaller_setup_bands(rescaller) < 0) {
+    return -1;
+  }
+
+  software_workers_run(&rescaller->workers, software_rescaller_band_job, rescaller, rescaller->n_bands);
+  return 0;
+}
+
+/* Codec */
+
+static int software_rescaller_open(device_t *dev)
+{
+  dev->software->codec_data = software_rescaller_new(software_simd_detect(), 0);
+  return dev->software->codec_data ? 0 : -1;
+}
+
+static void software_rescaller_close(device_t *dev)
+{
+  software_rescaller_free(dev->software->codec_data);
+  dev->software->codec_data = NULL;
+}
+
+static void software_rescaller_dump_options(device_t *dev, FILE *stream)
+{
+  software_rescaller_t *rescaller = dev->software->codec_data;
+
+  fprintf(stream, "- available option: threads [0..%d], current=%d (0 = one per CPU)\n", SOFTWARE_RESCALLER_MAX_BANDS, rescaller->threads);
+  fprintf(stream, "- available option: simd [scalar, sse2, avx2, neon], current=%s\n", software_simd_name(rescaller->kernels->simd));
+}
+
+static int software_rescaller_set_option(device_t *dev, const char *key, const char *value)
+{
+  software_rescaller_t *rescaller = dev->software->codec_data;
+
+  if (!strcmp(key, "threads")) {
+    rescaller->threads = MAX(MIN(atoi(value), SOFTWARE_RESCALLER_MAX_BANDS), 0);
+    return 1;
+  }
+
+  if (!strcmp(key, "simd")) {
+    for (software_simd_t simd = SOFTWARE_SIMD_NONE; simd <= SOFTWARE_SIMD_NEON; simd++) {
+      if (!strcmp(value, software_simd_name(simd)) && software_rescaller_get_kernels(simd)) {
+        rescaller->kernels = software_rescaller_get_kernels(simd);
+        return 1;
+      }
+    }
+    LOG_INFO(dev, "The SIMD '%s' is not supported", value);
+    return -1;
+  }
+
+  return -1;
+}
+
+static int software_rescaller_process(device_t *dev, buffer_t *output, buffer_t *capture)
+{
+  software_rescaller_t *rescaller = dev->software->codec_data;
+  buffer_list_t *output_list = output->buf_list;
+  buffer_list_t *capture_list = capture->buf_list;
+  buffer_t *source = output->dma_source ? output->dma_source : output;
+
+  size_t expected = software_rescaller_frame_size(output_list->fmt);
+  size_t size = software_rescaller_frame_size(capture_list->fmt);
+
+  if (!source->start || output->used < expected) {
+    LOG_ERROR(output, "The buffer is too short: used=%zu, expected=%zu", output->used, expected);
+  }
+
+  if (capture->length < size) {
+    LOG_ERROR(capture, "The buffer is too short: length=%zu, expected=%zu", capture->length, size);
+  }
+
+  if (software_rescaller_scale(rescaller, source->start, output_list->fmt, capture->start, capture_list->fmt) < 0) {
+    LOG_ERROR(dev, "Cannot scale %ux%u/%s to %ux%u/%s",
+      output_list->fmt.width, output_list->fmt.height, fourcc_to_string(output_list->fmt.format).buf,
+      capture_list->fmt.width, capture_list->fmt.height, fourcc_to_string(capture_list->fmt.format).buf);
+  }
+
+  capture->used = size;
+  return 0;
+
+error:
+  return -1;
+}
+
+const software_codec_t software_rescaller_codec = {
+  .name = "rescaller",
+  .output_formats = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YVU420 },
+  .capture_formats = { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_YUV420, V4L2_PIX_FMT_NV12, V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YVU420 },
+
+  .open = software_rescaller_open,
+  .close = software_rescaller_close,
+  .dump_options = software_rescaller_dump_options,
+  .set_option = software_rescaller_set_option,
+  .process = software_rescaller_process
+};
@@ -0,0 +1,39 @@
+#include "software.h"
+
+#include "device/device.h"
+
+device_hw_t software_device_hw = {
+  .device_open = software_device_open,
+  .device_close = software_device_close,
+  .device_video_force_key = software_device_video_force_key,
+  .device_dump_options = software_device_dump_options,
+  .device_set_option = software_device_set_option,
+
+  .buffer_open = software_buffer_open,
+  .buffer_close = software_buffer_close,
+  .buffer_enqueue = software_buffer_enqueue,
+
+  .buffer_list_dequeue = software_buffer_list_dequeue,
+  .buffer_list_pollfd = software_buffer_list_pollfd,
+  .buffer_list_open = software_buffer_list_open,
+  .buffer_list_close = software_buffer_list_close,
+  .buffer_list_set_stream = software_buffer_list_set_stream
+};
+
+const software_codec_t *software_codecs[] = {
+  &software_rescaller_codec,
+  &software_isp_codec,
+#ifdef USE_LIBJPEG
+  &software_jpeg_codec,
+  &software_jpeg_decoder_codec,
+#endif
+#ifdef USE_FFMPEG
+  &software_h264_codec,
+#endif
+  NULL
+};
+
+device_t *device_software_open(const char *name, const char *path)
+{
+  return device_open(name, path, &software_device_hw);
+}
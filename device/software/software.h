@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "device/buffer_list.h"
+
+typedef struct buffer_s buffer_t;
+typedef struct buffer_list_s buffer_list_t;
+typedef struct device_s device_t;
+struct pollfd;
+
+#define SOFTWARE_MAX_FORMATS 12
+#define SOFTWARE_MAX_WORKERS 16
+#define SOFTWARE_MAX_THREADS 8
+
+// The codec converts the `output` buffer into the `capture` buffer,
+// on the thread of the device. With `max_threads > 1`, the `process`
+// of up to `frame_threads` frames runs at once, on different threads.
+typedef struct software_codec_s {
+  const char *name;
+  unsigned output_formats[SOFTWARE_MAX_FORMATS]; // zero terminated
+  unsigned capture_formats[SOFTWARE_MAX_FORMATS]; // zero terminated
+  int max_threads;
+
+  int (*open)(device_t *dev);
+  void (*close)(device_t *dev);
+  void (*dump_options)(device_t *dev, FILE *stream);
+  int (*set_option)(device_t *dev, const char *key, const char *value);
+  int (*force_key)(device_t *dev);
+  int (*process)(device_t *dev, buffer_t *output, buffer_t *capture);
+} software_codec_t;
+
+// Runs `n_jobs` calls of `fn` on the workers, and the calling thread
+typedef struct software_workers_s {
+  pthread_t threads[SOFTWARE_MAX_WORKERS];
+  int n_threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start_cond, done_cond;
+  bool running;
+  unsigned generation;
+
+  void (*fn)(void *opaque, int job);
+  void *opaque;
+  int n_jobs, next_job, done_jobs;
+} software_workers_t;
+
+typedef struct device_software_s {
+  const software_codec_t *codec;
+  void *codec_data;
+
+  pthread_t threads[SOFTWARE_MAX_THREADS];
+  int n_threads, n_started, n_thread_indexes;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  bool running;
+  int processing;
+
+  // the frames are completed in the order they were taken
+  unsigned next_seq, completed_seq;
+
+  buffer_t *pending_outputs[MAX_BUFFER_LIST_BUFS];
+  buffer_t *pending_captures[MAX_BUFFER_LIST_BUFS];
+  int n_pending_outputs, n_pending_captures;
+} device_software_t;
+
+typedef struct buffer_list_software_s {
+  int fds[2];
+} buffer_list_software_t;
+
+extern const software_codec_t *software_codecs[];
+
+int software_device_open(device_t *dev);
+void software_device_close(device_t *dev);
+int software_device_video_force_key(device_t *dev);
+int software_device_set_threads(device_t *dev, int n_threads);
+void software_device_dump_options(device_t *dev, FILE *stream);
+int software_device_set_option(device_t *dev, const char *key, const char *value);
+
+int software_buffer_open(buffer_t *buf);
+void software_buffer_close(buffer_t *buf);
+int software_buffer_enqueue(buffer_t *buf, const char *who);
+int software_buffer_list_dequeue(buffer_list_t *buf_list, buffer_t **bufp);
+int software_buffer_list_pollfd(buffer_list_t *buf_list, struct pollfd *pollfd, bool can_dequeue);
+
+int software_buffer_list_open(buffer_list_t *buf_list);
+void software_buffer_list_close(buffer_list_t *buf_list);
+int software_buffer_list_set_stream(buffer_list_t *buf_list, bool do_on);
+
+int software_workers_start(software_workers_t *workers, int n_threads);
+void software_workers_stop(software_workers_t *workers);
+void software_workers_run(software_workers_t *workers, void (*fn)(void *opaque, int job), void *opaque, int n_jobs);
+
+typedef enum software_simd_e {
+  SOFTWARE_SIMD_NONE = 0,
+  SOFTWARE_SIMD_SSE2,
+  SOFTWARE_SIMD_AVX2,
+  SOFTWARE_SIMD_NEON
+} software_simd_t;
+
+bool software_simd_supported(software_simd_t simd);
+software_simd_t software_simd_detect();
+const char *software_simd_name(software_simd_t simd);
+
+// Scales and converts between YUYV, YUV420, YVU420, NV12 and NV21
+// (and from YUV422P and YUV24), split into row bands between `threads`
+// (0 = one per CPU)
+typedef struct software_rescaller_s software_rescaller_t;
+
+software_rescaller_t *software_rescaller_new(software_simd_t simd, int threads);
+void software_rescaller_free(software_rescaller_t *rescaller);
+size_t software_rescaller_frame_size(buffer_format_t fmt);
+int software_rescaller_scale(software_rescaller_t *rescaller, const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt);
+
+extern const software_codec_t software_rescaller_codec;
+extern const software_codec_t software_isp_codec;
+#ifdef USE_LIBJPEG
+extern const software_codec_t software_jpeg_codec;
+extern const software_codec_t software_jpeg_decoder_codec;
+#endif
+#ifdef USE_FFMPEG
+extern const software_codec_t software_h264_codec;
+#endif
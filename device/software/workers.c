@@ -0,0 +1,104 @@
+#include "software.h"
+#include "util/opts/log.h"
+
+// Called with `workers->lock` held, releases it while running a job
+static void software_workers_do_jobs(software_workers_t *workers)
+{
+  while (workers->next_job < workers->n_jobs) {
+    int job = workers->next_job++;
+
+    pthread_mutex_unlock(&workers->lock);
+    workers->fn(workers->opaque, job);
+    pthread_mutex_lock(&workers->lock);
+
+    if (++workers->done_jobs == workers->n_jobs) {
+      pthread_cond_broadcast(&workers->done_cond);
+    }
+  }
+}
+
+static void *software_workers_thread(software_workers_t *workers)
+{
+  unsigned generation = 0;
+
+  pthread_mutex_lock(&workers->lock);
+  while (1) {
+    while (workers->running && workers->generation == generation) {
+      pthread_cond_wait(&workers->start_cond, &workers->lock);
+    }
+    if (!workers->running) {
+      break;
+    }
+
+    generation = workers->generation;
+    software_workers_do_jobs(workers);
+  }
+  pthread_mutex_unlock(&workers->lock);
+  return NULL;
+}
+
+int software_workers_start(software_workers_t *workers, int n_threads)
+{
+  memset(workers, 0, sizeof(*workers));
+  pthread_mutex_init(&workers->lock, NULL);
+  pthread_cond_init(&workers->start_cond, NULL);
+  pthread_cond_init(&workers->done_cond, NULL);
+  workers->running = true;
+
+  for (int i = 0; i < MIN(n_threads, SOFTWARE_MAX_WORKERS); i++) {
+    if (pthread_create(&workers->threads[i], NULL, (void *(*)(void *))software_workers_thread, workers) != 0) {
+      LOG_INFO(NULL, "Cannot start software worker %d: %s", i, strerror(errno));
+      break;
+    }
+    workers->n_threads++;
+  }
+
+  return workers->n_threads;
+}
+
+void software_workers_stop(software_workers_t *workers)
+{
+  if (!workers->running) {
+    return;
+  }
+
+  pthread_mutex_lock(&workers->lock);
+  workers->running = false;
+  pthread_cond_broadcast(&workers->start_cond);
+  pthread_mutex_unlock(&workers->lock);
+
+  for (int i = 0; i < workers->n_threads; i++) {
+    pthread_join(workers->threads[i], NULL);
+  }
+
+  workers->n_threads = 0;
+  pthread_cond_destroy(&workers->done_cond);
+  pthread_cond_destroy(&workers->start_cond);
+  pthread_mutex_destroy(&workers->lock);
+}
+
+void software_workers_run(software_workers_t *workers, void (*fn)(void *opaque, int job), void *opaque, int n_jobs)
+{
+  if (!workers->running || !workers->n_threads || n_jobs <= 1) {
+    for (int i = 0; i < n_jobs; i++) {
+      fn(opaque, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&workers->lock);
+  workers->fn = fn;
+  workers->opaque = opaque;
+  workers->n_jobs = n_jobs;
+  workers->next_job = 0;
+  workers->done_jobs = 0;
+  workers->generation++;
+  pthread_cond_broadcast(&workers->start_cond);
+
+  software_workers_do_jobs(workers);
+
+  while (workers->done_jobs < workers->n_jobs) {
+    pthread_cond_wait(&workers->done_cond, &workers->lock);
+  }
+  pthread_mutex_unlock(&workers->lock);
+}
@@ -194,7 +194,7 @@ int v4l2_buffer_list_set_stream(buffer_list_t *buf_list, bool do_on)
         buf->dma_source = NULL;
       }
 
-      buf->enqueued = false;
+      buffer_set_enqueued(buf, false);
       buf->mmap_reflinks = 1;
     }
   }
@@ -1,4 +1,5 @@
 #include "v4l2.h"
+#include "device/device.h"
 #include "device/device_list.h"
 #include "util/opts/log.h"
 
@@ -37,6 +38,7 @@ static bool device_list_read_dev(device_info_t *info, const char *name)
   struct v4l2_capability v4l2_cap;
   ERR_IOCTL(info, fd, VIDIOC_QUERYCAP, &v4l2_cap, "Can't query device capabilities");
   info->name = strdup((const char *)v4l2_cap.card);
+  info->open = device_v4l2_open;
 
   if (!(v4l2_cap.capabilities & V4L2_CAP_STREAMING)) {
     LOG_VERBOSE(info, "Device (%s) does not support streaming (skipping)", info->path);
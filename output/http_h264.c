@@ -17,14 +17,15 @@ static const char *const VIDEO_HEADER =
   "\r\n";
 
 typedef struct {
-  FILE *stream;
   bool wrote_header;
   bool had_key_frame;
   bool requested_key_frame;
 } http_video_status_t;
 
-int http_video_buf_part(buffer_lock_t *buf_lock, buffer_t *buf, int frame, http_video_status_t *status)
+static int http_video_buf_part(http_client_t *client, buffer_t *buf, int frame, void *opaque)
 {
+  http_video_status_t *status = opaque;
+
   if (!status->had_key_frame) {
     status->had_key_frame = buf->flags.is_keyframe;
   }
@@ -38,31 +39,29 @@ int http_video_buf_part(buffer_lock_t *buf_lock, buffer_t *buf, int frame, http_
   }
 
   if (!status->wrote_header) {
-    fputs(VIDEO_HEADER, status->stream);
+    if (http_client_write(client, VIDEO_HEADER, strlen(VIDEO_HEADER)) < 0) {
+      return -1;
+    }
     status->wrote_header = true;
   }
-  if (!fwrite(buf->start, buf->used, 1, status->stream)) {
+  if (http_client_write_buf(client, buf) < 0) {
     return -1;
   }
-  fflush(status->stream);
   return 1;
 }
 
-void http_h264_video(http_worker_t *worker, FILE *stream)
+static void http_video_close(http_client_t *client, void *opaque)
 {
-  http_video_status_t status = { stream };
-
-  int n = buffer_lock_write_loop(&video_lock, 0, 0, (buffer_write_fn)http_video_buf_part, &status);
-
-  if (status.wrote_header) {
-    return;
-  }
+  free(opaque);
+}
 
-  http_500(stream, NULL);
+void http_h264_video(http_worker_t *worker, FILE *stream)
+{
+  http_video_status_t *status = calloc(1, sizeof(http_video_status_t));
 
-  if (n == 0) {
-    fprintf(stream, "No frames.\n");
-  } else if (n < 0) {
-    fprintf(stream, "Interrupted. Received %d frames", -n);
+  if (http_client_attach(worker, stream, &video_lock, http_video_buf_part, http_video_close, status) < 0) {
+    free(status);
+    http_500(stream, NULL);
+    fprintf(stream, "Cannot stream.\n");
   }
 }
@@ -1,22 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "output.h"
 #include "util/opts/log.h"
 #include "util/http/http.h"
+#include "util/mux/mux.h"
 #include "device/buffer.h"
 #include "device/buffer_lock.h"
 #include "device/buffer_list.h"
 #include "device/device.h"
 
-static const char *const CONTENT_TYPE = "application/x-mpegURL";
+// Low-Latency HLS: the frames of `video_lock` are muxed on its notify thread
+// into CMAF segments starting at key frames, split into parts of `part_ms`.
+// The last segments are kept in memory, and served to all the viewers.
+// The requests of the playlist and parts not yet written are held by the
+// HTTP stream threads until they are (blocking playlist reload and preload hints).
+
+#define HTTP_HLS_MAX_SEGMENTS 16 // including the one being written
+#define HTTP_HLS_MAX_PARTS 64 // of each segment
+#define HTTP_HLS_IDLE_US (10 * 1000 * 1000LL) // stops muxing without requests
 
-static const char *const STREAM_M3U8 = 
-  "#EXTM3U\r\n" \
-  "#EXT-X-TARGETDURATION:1\r\n" \
-  "#EXT-X-VERSION:4\r\n" \
-  "#EXTINF:1.0,\r\n" \
-  "video.mp4?ts=%zu\r\n";
+static const char *const CONTENT_TYPE = "application/x-mpegURL";
 
 static const char *const LOCATION_REDIRECT =
   "HTTP/1.0 307 Temporary Redirect\r\n"
@@ -25,10 +30,559 @@ static const char *const LOCATION_REDIRECT =
   "Location: %s?%s\r\n"
   "\r\n";
 
+typedef struct http_hls_part_s {
+  int refs;
+  uint64_t duration_us;
+  bool independent;
+  size_t length;
+  uint8_t data[];
+} http_hls_part_t;
+
+typedef struct http_hls_segment_s {
+  unsigned msn;
+  uint64_t duration_us;
+  int nparts;
+  http_hls_part_t *parts[HTTP_HLS_MAX_PARTS];
+} http_hls_segment_t;
+
+typedef struct http_hls_s {
+  const char *name;
+  hls_options_t *options;
+  uint64_t last_request_us;
+
+  // written by the notify thread, with the `lock` held
+  pthread_mutex_t lock; // the held requests are woken on every part written
+  http_hls_part_t *init;
+  http_hls_segment_t segments[HTTP_HLS_MAX_SEGMENTS];
+  unsigned nsegments; // complete segments kept, ring of `options->segments + 1`
+  unsigned msn; // of the segment being written
+
+  // used only by the notify thread
+  mux_t mux;
+  bool requested_key_frame;
+  int part_frames, segment_frames;
+  uint64_t part_start_us, segment_start_us;
+  bool part_independent;
+} http_hls_t;
+
+static http_hls_t http_hls = {
+  .name = "HTTP-HLS",
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .mux = { .name = "HTTP-HLS", .format = MUX_FORMAT_MP4 }
+};
+
+static http_hls_t *hls = &http_hls;
+
+static void http_hls_part_release(http_hls_part_t *part)
+{
+  if (part && __atomic_sub_fetch(&part->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(part);
+  }
+}
+
+static http_hls_segment_t *http_hls_slot(unsigned msn)
+{
+  return &hls->segments[msn % (hls->options->segments + 1)];
+}
+
+// Returns the segment `msn`, if still kept
+static http_hls_segment_t *http_hls_find_segment(unsigned msn)
+{
+  if (msn > hls->msn || hls->msn - msn > hls->nsegments) {
+    return NULL;
+  }
+
+  return http_hls_slot(msn);
+}
+
+static void http_hls_clear_segment(http_hls_segment_t *segment)
+{
+  for (int i = 0; i < segment->nparts; i++) {
+    http_hls_part_release(segment->parts[i]);
+  }
+
+  memset(segment, 0, sizeof(*segment));
+}
+
+// Reuses the slot of the oldest segment
+static void http_hls_start_segment(unsigned msn)
+{
+  http_hls_segment_t *segment = http_hls_slot(msn);
+
+  http_hls_clear_segment(segment);
+  segment->msn = msn;
+  hls->msn = msn;
+}
+
+// Takes the output of the muxer
+static http_hls_part_t *http_hls_take_output(uint64_t duration_us, bool independent)
+{
+  mux_t *mux = &hls->mux;
+
+  http_hls_part_t *part = malloc(sizeof(http_hls_part_t) + mux->output_length);
+  if (!part) {
+    return NULL;
+  }
+
+  part->refs = 1;
+  part->duration_us = duration_us;
+  part->independent = independent;
+  part->length = mux->output_length;
+  memcpy(part->data, mux->output, mux->output_length);
+  mux->output_length = 0;
+  return part;
+}
+
+static void http_hls_write_part(uint64_t end_us)
+{
+  if (!hls->part_frames) {
+    return;
+  }
+
+  http_hls_part_t *part = http_hls_take_output(end_us - hls->part_start_us, hls->part_independent);
+  hls->part_frames = 0;
+  if (!part) {
+    return;
+  }
+
+  pthread_mutex_lock(&hls->lock);
+  http_hls_segment_t *segment = http_hls_slot(hls->msn);
+  if (segment->nparts < HTTP_HLS_MAX_PARTS) {
+    segment->parts[segment->nparts++] = part;
+    segment->duration_us += part->duration_us;
+    part = NULL;
+  }
+  pthread_mutex_unlock(&hls->lock);
+  http_client_wake();
+
+  http_hls_part_release(part);
+}
+
+static void http_hls_write_segment()
+{
+  pthread_mutex_lock(&hls->lock);
+  http_hls_start_segment(hls->msn + 1);
+  hls->nsegments = MIN(hls->nsegments + 1, hls->options->segments);
+  pthread_mutex_unlock(&hls->lock);
+  http_client_wake();
+
+  hls->segment_frames = 0;
+}
+
+// Drops all segments, the next ones are numbered after them
+static void http_hls_reset()
+{
+  pthread_mutex_lock(&hls->lock);
+  for (int i = 0; i <= hls->nsegments; i++) {
+    http_hls_clear_segment(http_hls_slot(hls->msn - i));
+  }
+  http_hls_start_segment(hls->msn + 1);
+  http_hls_part_release(hls->init);
+  hls->init = NULL;
+  hls->nsegments = 0;
+  pthread_mutex_unlock(&hls->lock);
+  http_client_wake();
+
+  mux_close(&hls->mux);
+  hls->requested_key_frame = false;
+  hls->part_frames = hls->segment_frames = 0;
+}
+
+static int http_hls_write_header(buffer_t *buf)
+{
+  hls->mux.width = buf->buf_list->fmt.width;
+  hls->mux.height = buf->buf_list->fmt.height;
+
+  if (mux_write_header(&hls->mux, buf->start, buf->used) < 0) {
+    return -1;
+  }
+
+  http_hls_part_t *init = http_hls_take_output(0, true);
+  if (!init) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&hls->lock);
+  hls->init = init;
+  pthread_mutex_unlock(&hls->lock);
+  http_client_wake();
+  return 0;
+}
+
+static void http_hls_capture(buffer_lock_t *buf_lock, buffer_t *buf)
+{
+  uint64_t now = get_monotonic_time_us(NULL, NULL);
+  uint64_t pts_us = buf->captured_time_us ? buf->captured_time_us : now;
+
+  if (now - __atomic_load_n(&hls->last_request_us, __ATOMIC_RELAXED) > HTTP_HLS_IDLE_US) {
+    if (hls->mux.has_header) {
+      LOG_INFO(hls, "No more requests, stopping.");
+      http_hls_reset();
+    }
+    return;
+  }
+
+  if (!hls->mux.has_header) {
+    if (!buf->flags.is_keyframe) {
+      if (!hls->requested_key_frame) {
+        device_video_force_key(buf->buf_list->dev);
+        hls->requested_key_frame = true;
+      }
+      return;
+    }
+
+    if (http_hls_write_header(buf) < 0) {
+      goto error;
+    }
+  }
+
+  // The capture times jitter, half of a frame is tolerated
+  http_hls_segment_t *segment = http_hls_slot(hls->msn);
+  uint64_t interval_us = hls->mux.last_duration_us;
+  bool long_segment = pts_us + interval_us / 2 - hls->segment_start_us >= hls->options->segment_ms * 1000LL;
+  bool full_segment = !hls->part_frames && segment->nparts >= HTTP_HLS_MAX_PARTS;
+
+  // The segments start with a key frame, unless too many parts
+  if (hls->segment_frames && ((buf->flags.is_keyframe && long_segment) || full_segment)) {
+    http_hls_write_part(pts_us);
+    http_hls_write_segment();
+  }
+
+  if (!hls->segment_frames) {
+    hls->segment_start_us = pts_us;
+  }
+  if (!hls->part_frames) {
+    hls->part_start_us = pts_us;
+    hls->part_independent = buf->flags.is_keyframe;
+  }
+
+  if (mux_write_frame(&hls->mux, buf->start, buf->used, pts_us, buf->flags.is_keyframe) < 0) {
+    goto error;
+  }
+
+  hls->part_frames++;
+  hls->segment_frames++;
+
+  // The part is written as soon as the next frame would not fit,
+  // assuming the same interval
+  interval_us = hls->mux.last_duration_us;
+  if (pts_us + 2 * interval_us - hls->part_start_us > hls->options->part_ms * 1000LL) {
+    http_hls_write_part(pts_us + interval_us);
+  }
+  return;
+
+error:
+  LOG_INFO(hls, "Cannot mux the frame, restarting.");
+  http_hls_reset();
+}
+
+static bool http_hls_needs_buffer(buffer_lock_t *buf_lock)
+{
+  uint64_t now = get_monotonic_time_us(NULL, NULL);
+  return now - __atomic_load_n(&hls->last_request_us, __ATOMIC_RELAXED) <= HTTP_HLS_IDLE_US;
+}
+
+// Longest segment kept, rounded to seconds
+static unsigned http_hls_target_duration()
+{
+  uint64_t duration_us = hls->options->segment_ms * 1000LL;
+
+  for (unsigned i = 0; i < hls->nsegments; i++) {
+    duration_us = MAX(duration_us, http_hls_slot(hls->msn - i - 1)->duration_us);
+  }
+
+  return MAX((duration_us + 500000) / 1000000, 1);
+}
+
+// Whether the part of the segment `msn` (or all of it, if `part` < 0) was written
+static bool http_hls_is_written(unsigned msn, int part)
+{
+  if (!hls->init) {
+    return false;
+  } else if (msn < hls->msn) {
+    return true;
+  }
+
+  return msn == hls->msn && part >= 0 && part < http_hls_slot(msn)->nparts;
+}
+
+// The part hinted after the last one of a segment is never written,
+// as the key frame starts the next segment: it is its first part instead
+static void http_hls_resolve_part(int *msn, int *part)
+{
+  http_hls_segment_t *segment = http_hls_find_segment(*msn);
+
+  if (segment && *msn < hls->msn && *part == segment->nparts) {
+    (*msn)++;
+    *part = 0;
+  }
+}
+
+static int http_hls_get_param(http_worker_t *worker, const char *key, int default_value)
+{
+  char *value = http_get_param(worker, key);
+  int ret = value && value[0] ? atoi(value) : default_value;
+  free(value);
+  return ret;
+}
+
+static void http_hls_requested()
+{
+  __atomic_store_n(&hls->last_request_us, get_monotonic_time_us(NULL, NULL), __ATOMIC_RELAXED);
+}
+
+static void http_hls_write_parts(http_hls_segment_t *segment, int part, FILE *stream)
+{
+  fprintf(stream, "#EXT-X-PART:DURATION=%.5f,URI=\"hls/part.m4s?msn=%u&part=%d\"%s\n",
+    segment->parts[part]->duration_us / 1e6, segment->msn, part,
+    segment->parts[part]->independent ? ",INDEPENDENT=YES" : "");
+}
+
+static void http_hls_write_playlist(FILE *stream)
+{
+  double part_target = hls->options->part_ms / 1e3;
+
+  fprintf(stream, "#EXTM3U\n");
+  fprintf(stream, "#EXT-X-VERSION:9\n");
+  fprintf(stream, "#EXT-X-TARGETDURATION:%u\n", http_hls_target_duration());
+  fprintf(stream, "#EXT-X-PART-INF:PART-TARGET=%.3f\n", part_target);
+  fprintf(stream, "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n", 3 * part_target);
+  fprintf(stream, "#EXT-X-MEDIA-SEQUENCE:%u\n", hls->msn - hls->nsegments);
+  fprintf(stream, "#EXT-X-MAP:URI=\"hls/init.mp4\"\n");
+
+  for (unsigned msn = hls->msn - hls->nsegments; msn <= hls->msn; msn++) {
+    http_hls_segment_t *segment = http_hls_slot(msn);
+
+    // The parts are listed only for the last segments
+    for (int part = 0; hls->msn - msn <= 2 && part < segment->nparts; part++) {
+      http_hls_write_parts(segment, part, stream);
+    }
+
+    if (msn < hls->msn) {
+      fprintf(stream, "#EXTINF:%.5f,\nhls/segment.m4s?msn=%u\n", segment->duration_us / 1e6, msn);
+    } else {
+      fprintf(stream, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"hls/part.m4s?msn=%u&part=%d\"\n",
+        msn, segment->nparts);
+    }
+  }
+}
+
+static void http_hls_part_unref(void *opaque)
+{
+  http_hls_part_release(opaque);
+}
+
+// Writes the parts, referenced with the `lock` held
+static void http_hls_write_response(http_client_t *client, http_hls_part_t **parts, int nparts)
+{
+  size_t length = 0;
+
+  for (int i = 0; i < nparts; i++) {
+    length += parts[i]->length;
+  }
+
+  http_client_write_response(client, "200 OK", "video/mp4", NULL, length);
+
+  for (int i = 0; i < nparts; i++) {
+    http_client_write_ref(client, parts[i]->data, parts[i]->length, http_hls_part_unref, parts[i]);
+  }
+}
+
+// The playlist, init and parts not yet written are held by the HTTP stream
+// threads, instead of the workers, up to three target durations as the spec requires
+typedef enum {
+  HTTP_HLS_PLAYLIST,
+  HTTP_HLS_INIT,
+  HTTP_HLS_SEGMENT,
+  HTTP_HLS_PART
+} http_hls_request_type_t;
+
+typedef struct http_hls_request_s {
+  http_hls_request_type_t type;
+  int msn;
+  int part;
+} http_hls_request_t;
+
+static int http_hls_playlist_ready(http_client_t *client, http_hls_request_t *request)
+{
+  char *body = NULL;
+  size_t length = 0;
+
+  if (!http_hls_is_written(request->msn, request->part)) {
+    pthread_mutex_unlock(&hls->lock);
+    http_client_write_response(client, "503 Service Unavailable", NULL, "No video.\n", 0);
+    return 1;
+  }
+
+  FILE *playlist = open_memstream(&body, &length);
+  if (playlist) {
+    http_hls_write_playlist(playlist);
+    fclose(playlist);
+  }
+
+  pthread_mutex_unlock(&hls->lock);
+
+  if (!playlist) {
+    return -1;
+  }
+
+  http_client_write_response(client, "200 OK", CONTENT_TYPE, body, length);
+  free(body);
+  return 1;
+}
+
+// Returns the init, the whole segment `msn`, or its `part`
+static int http_hls_parts_ready(http_client_t *client, http_hls_request_t *request)
+{
+  http_hls_part_t *parts[HTTP_HLS_MAX_PARTS];
+  int nparts = 0;
+
+  if (request->type == HTTP_HLS_INIT) {
+    if (http_hls_is_written(request->msn, request->part) && hls->init) {
+      parts[nparts++] = hls->init;
+    }
+  } else if (http_hls_is_written(request->msn, request->part)) {
+    http_hls_segment_t *segment = http_hls_find_segment(request->msn);
+
+    for (int i = 0; segment && i < segment->nparts; i++) {
+      if (request->part < 0 || i == request->part) {
+        parts[nparts++] = segment->parts[i];
+      }
+    }
+  }
+
+  for (int i = 0; i < nparts; i++) {
+    __atomic_add_fetch(&parts[i]->refs, 1, __ATOMIC_RELAXED);
+  }
+
+  pthread_mutex_unlock(&hls->lock);
+
+  if (!nparts) {
+    http_client_write_response(client, "404 Not Found", NULL, "Nothing here.\n", 0);
+    return 1;
+  }
+
+  http_hls_write_response(client, parts, nparts);
+  return 1;
+}
+
+static int http_hls_ready(http_client_t *client, bool timeout, void *opaque)
+{
+  http_hls_request_t *request = opaque;
+
+  pthread_mutex_lock(&hls->lock);
+
+  if (request->type == HTTP_HLS_PART) {
+    http_hls_resolve_part(&request->msn, &request->part);
+  }
+
+  if (!timeout && !http_hls_is_written(request->msn, request->part)) {
+    pthread_mutex_unlock(&hls->lock);
+    return 0;
+  }
+
+  if (request->type == HTTP_HLS_PLAYLIST) {
+    return http_hls_playlist_ready(client, request);
+  } else {
+    return http_hls_parts_ready(client, request);
+  }
+}
+
+static void http_hls_request_free(http_client_t *client, void *opaque)
+{
+  free(opaque);
+}
+
+// Takes the `lock`
+static void http_hls_hold(http_worker_t *worker, FILE *stream, http_hls_request_type_t type, int msn, int part)
+{
+  http_hls_request_t *request = calloc(1, sizeof(http_hls_request_t));
+  request->type = type;
+  request->msn = msn;
+  request->part = part;
+
+  uint64_t timeout_us = 3 * http_hls_target_duration() * 1000000LL;
+
+  pthread_mutex_unlock(&hls->lock);
+
+  if (http_client_hold(worker, stream, http_hls_ready, http_hls_request_free, request, timeout_us) < 0) {
+    free(request);
+    http_500(stream, NULL);
+  }
+}
+
 void http_m3u8_video(struct http_worker_s *worker, FILE *stream)
 {
-  uint64_t ts = get_monotonic_time_us(NULL, NULL) / 1000 / 1000;
-  http_write_responsef(stream, "200 OK", CONTENT_TYPE, STREAM_M3U8, ts);
+  int msn = http_hls_get_param(worker, "_HLS_msn", -1);
+  int part = http_hls_get_param(worker, "_HLS_part", -1);
+
+  http_hls_requested();
+
+  pthread_mutex_lock(&hls->lock);
+
+  if (msn < 0) {
+    // Anything to play
+    msn = hls->nsegments ? hls->msn - 1 : hls->msn;
+    part = hls->nsegments ? -1 : 0;
+  } else if (hls->init && msn > hls->msn + 2) {
+    pthread_mutex_unlock(&hls->lock);
+    http_400(stream, "The _HLS_msn is too far in the future.\n");
+    return;
+  }
+
+  http_hls_hold(worker, stream, HTTP_HLS_PLAYLIST, msn, part);
+}
+
+void http_hls_init(struct http_worker_s *worker, FILE *stream)
+{
+  http_hls_requested();
+
+  pthread_mutex_lock(&hls->lock);
+  http_hls_hold(worker, stream, HTTP_HLS_INIT, hls->msn, 0);
+}
+
+static void http_hls_segment_parts(struct http_worker_s *worker, FILE *stream, bool is_part)
+{
+  int msn = http_hls_get_param(worker, "msn", -1);
+  int part = is_part ? http_hls_get_param(worker, "part", -1) : -1;
+
+  if (msn < 0 || (is_part && part < 0)) {
+    http_400(stream, NULL);
+    return;
+  }
+
+  http_hls_requested();
+
+  pthread_mutex_lock(&hls->lock);
+
+  if (msn > hls->msn + 1) {
+    pthread_mutex_unlock(&hls->lock);
+    http_404(stream, NULL);
+    return;
+  }
+
+  http_hls_hold(worker, stream, is_part ? HTTP_HLS_PART : HTTP_HLS_SEGMENT, msn, part);
+}
+
+void http_hls_segment(struct http_worker_s *worker, FILE *stream)
+{
+  http_hls_segment_parts(worker, stream, false);
+}
+
+void http_hls_part(struct http_worker_s *worker, FILE *stream)
+{
+  http_hls_segment_parts(worker, stream, true);
+}
+
+int http_hls_start(hls_options_t *options)
+{
+  hls->options = options;
+  hls->options->segments = MAX(1, MIN(hls->options->segments, HTTP_HLS_MAX_SEGMENTS - 1));
+  hls->options->part_ms = MAX(hls->options->part_ms, 1);
+
+  buffer_lock_register_check_streaming(&video_lock, http_hls_needs_buffer);
+  buffer_lock_register_notify_buffer(&video_lock, http_hls_capture);
+  return 0;
 }
 
 void http_detect_video(struct http_worker_s *worker, FILE *stream)
@@ -20,7 +20,10 @@ static const char *const STREAM_HEADER = "HTTP/1.0 200 OK\r\n"
                                          "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
                                          "\r\n"
                                          "--" PART_BOUNDARY "\r\n";
-static const char *const STREAM_PART = "Content-Type: " CONTENT_TYPE "\r\n" CONTENT_LENGTH ": %u\r\n\r\n";
+static const char *const STREAM_PART = "Content-Type: " CONTENT_TYPE "\r\n"
+                                       CONTENT_LENGTH ": %zu\r\n"
+                                       "X-Timestamp: %.6f\r\n"
+                                       "\r\n";
 static const char *const STREAM_BOUNDARY = "\r\n"
                                            "--" PART_BOUNDARY "\r\n";
 
@@ -40,6 +43,7 @@ int http_snapshot_buf_part(buffer_lock_t *buf_lock, buffer_t *buf, int frame, ht
   fprintf(snapshot->stream, "HTTP/1.1 200 OK\r\n");
   fprintf(snapshot->stream, "Content-Type: image/jpeg\r\n");
   fprintf(snapshot->stream, "Content-Length: %zu\r\n", buf->used);
+  fprintf(snapshot->stream, "X-Timestamp: %.6f\r\n", buf->captured_time_us / 1000.0 / 1000.0);
   fprintf(snapshot->stream, "\r\n");
   fwrite(buf->start, buf->used, 1, snapshot->stream);
   return 1;
@@ -61,6 +65,14 @@ void http_snapshot(http_worker_t *worker, FILE *stream)
     .start_time_us = get_monotonic_time_us(NULL, NULL) - max_delay_value * 1000
   };
 
+  // Answer from the history if a frame was already captured after the requested time
+  buffer_t *buf = buffer_lock_get_at(&snapshot_lock, snapshot.start_time_us, BUFFER_LOCK_AT_OR_AFTER, NULL);
+  if (buf) {
+    http_snapshot_buf_part(&snapshot_lock, buf, 0, &snapshot);
+    buffer_consumed(buf, "http-snapshot");
+    return;
+  }
+
   int n = buffer_lock_write_loop(&snapshot_lock, 1, SNAPSHOT_TIMEOUT_MS,
     (buffer_write_fn)http_snapshot_buf_part, &snapshot);
 
@@ -70,18 +82,84 @@ void http_snapshot(http_worker_t *worker, FILE *stream)
   }
 }
 
-int http_stream_buf_part(buffer_lock_t *buf_lock, buffer_t *buf, int frame, FILE *stream)
+// The part headers are rendered once per captured frame and shared by all clients,
+// the frame keeps the buffer referenced until the last client has sent it
+typedef struct http_stream_frame_s {
+  int refs;
+  buffer_t *buf;
+  size_t header_length;
+  char header[BUFSIZE];
+} http_stream_frame_t;
+
+static pthread_mutex_t http_stream_frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static http_stream_frame_t *http_stream_frame;
+
+static void http_stream_frame_release(void *opaque)
 {
-  if (!frame && !fputs(STREAM_HEADER, stream)) {
+  http_stream_frame_t *frame = opaque;
+
+  pthread_mutex_lock(&http_stream_frame_lock);
+  bool last = --frame->refs == 0;
+  if (last && http_stream_frame == frame) {
+    http_stream_frame = NULL;
+  }
+  pthread_mutex_unlock(&http_stream_frame_lock);
+
+  if (last) {
+    buffer_consumed(frame->buf, "http-stream");
+    free(frame);
+  }
+}
+
+static http_stream_frame_t *http_stream_frame_get(buffer_t *buf, int refs)
+{
+  pthread_mutex_lock(&http_stream_frame_lock);
+
+  // The current frame holds `buf`, so it cannot be requeued and captured again
+  http_stream_frame_t *frame = http_stream_frame;
+  if (frame && frame->buf == buf) {
+    frame->refs += refs;
+    goto done;
+  }
+
+  frame = calloc(1, sizeof(http_stream_frame_t));
+  if (!frame || !buffer_use(buf)) {
+    free(frame);
+    frame = NULL;
+    goto done;
+  }
+
+  frame->refs = refs;
+  frame->buf = buf;
+  frame->header_length = snprintf(frame->header, sizeof(frame->header), STREAM_PART,
+    buf->used, buf->captured_time_us / 1000.0 / 1000.0);
+  http_stream_frame = frame;
+
+done:
+  pthread_mutex_unlock(&http_stream_frame_lock);
+  return frame;
+}
+
+static int http_stream_buf_part(http_client_t *client, buffer_t *buf, int frame, void *opaque)
+{
+  if (!frame && http_client_write_ref(client, STREAM_HEADER, strlen(STREAM_HEADER), NULL, NULL) < 0) {
+    return -1;
+  }
+
+  // One reference for the header and one for the payload
+  http_stream_frame_t *part = http_stream_frame_get(buf, 2);
+  if (!part) {
     return -1;
   }
-  if (!fprintf(stream, STREAM_PART, buf->used)) {
+
+  if (http_client_write_ref(client, part->header, part->header_length, http_stream_frame_release, part) < 0) {
+    http_stream_frame_release(part);
     return -1;
   }
-  if (!fwrite(buf->start, buf->used, 1, stream)) {
+  if (http_client_write_ref(client, buf->start, buf->used, http_stream_frame_release, part) < 0) {
     return -1;
   }
-  if (!fputs(STREAM_BOUNDARY, stream)) {
+  if (http_client_write_ref(client, STREAM_BOUNDARY, strlen(STREAM_BOUNDARY), NULL, NULL) < 0) {
     return -1;
   }
 
@@ -90,12 +168,8 @@ int http_stream_buf_part(buffer_lock_t *buf_lock, buffer_t *buf, int frame, FILE
 
 void http_stream(http_worker_t *worker, FILE *stream)
 {
-  int n = buffer_lock_write_loop(&stream_lock, 0, 0, (buffer_write_fn)http_stream_buf_part, stream);
-
-  if (n == 0) {
+  if (http_client_attach(worker, stream, &stream_lock, http_stream_buf_part, NULL, NULL) < 0) {
     http_500(stream, NULL);
-    fprintf(stream, "No frames.\n");
-  } else if (n < 0) {
-    fprintf(stream, "Interrupted. Received %d frames", -n);
+    fprintf(stream, "Cannot stream.\n");
   }
 }
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "output.h"
+#include "util/opts/log.h"
+#include "util/http/http.h"
+#include "device/buffer.h"
+#include "device/buffer_lock.h"
+#include "device/buffer_list.h"
+#include "device/device.h"
+#include "util/mux/mux.h"
+
+// A single muxer for each format is shared by all its clients: the first
+// client seeing a new buffer of `video_lock` muxes it into a segment, that is
+// written to every client without copying. The clients receive the cached
+// init segment, and join at the next segment starting with a key frame.
+// The frames are written directly by `util/mux`, timed by their capture.
+
+#define HTTP_MUX_MAX_SEGMENTS 16
+
+static const char *const VIDEO_HEADER =
+  "HTTP/1.0 200 OK\r\n"
+  "Access-Control-Allow-Origin: *\r\n"
+  "Connection: close\r\n"
+  "Content-Type: %s\r\n"
+  "\r\n";
+
+typedef struct http_mux_segment_s {
+  int refs;
+  unsigned seq;
+  bool is_keyframe;
+  size_t length;
+  uint8_t data[];
+} http_mux_segment_t;
+
+typedef struct http_mux_muxer_s {
+  const char *name;
+  const char *content_type;
+  mux_format_t format;
+
+  pthread_mutex_t lock;
+  int clients;
+  unsigned generation; // changed when restarted, the clients of the previous are closed
+
+  mux_t mux;
+  bool had_key_frame;
+  int counter; // of the last buffer of `video_lock` muxed
+
+  http_mux_segment_t *init;
+  http_mux_segment_t *segments[HTTP_MUX_MAX_SEGMENTS];
+  unsigned next_seq;
+} http_mux_muxer_t;
+
+typedef struct http_mux_client_s {
+  const char *name;
+  http_mux_muxer_t *muxer;
+  unsigned generation;
+  bool wrote_init;
+  bool requested_key_frame;
+  unsigned next_seq; // 0 if waiting for a key frame
+} http_mux_client_t;
+
+static http_mux_muxer_t http_mux_mkv = {
+  .name = "HTTP-MKV",
+  .content_type = "video/mp4",
+  .format = MUX_FORMAT_MKV,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .next_seq = 1
+};
+
+static http_mux_muxer_t http_mux_mp4 = {
+  .name = "HTTP-MP4",
+  .content_type = "video/mp4",
+  .format = MUX_FORMAT_MP4,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .next_seq = 1
+};
+
+static void http_mux_segment_release(void *opaque)
+{
+  http_mux_segment_t *segment = opaque;
+
+  if (segment && __atomic_sub_fetch(&segment->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+    free(segment);
+  }
+}
+
+static int http_mux_segment_write(http_client_t *client, http_mux_segment_t *segment)
+{
+  __atomic_add_fetch(&segment->refs, 1, __ATOMIC_RELAXED);
+  return http_client_write_ref(client, segment->data, segment->length, http_mux_segment_release, segment);
+}
+
+// Takes the output of the muxer
+static http_mux_segment_t *http_mux_muxer_take_output(http_mux_muxer_t *muxer, bool is_keyframe)
+{
+  mux_t *mux = &muxer->mux;
+
+  if (!mux->output_length) {
+    return NULL;
+  }
+
+  http_mux_segment_t *segment = malloc(sizeof(http_mux_segment_t) + mux->output_length);
+  if (!segment) {
+    return NULL;
+  }
+
+  segment->refs = 1;
+  segment->seq = 0;
+  segment->is_keyframe = is_keyframe;
+  segment->length = mux->output_length;
+  memcpy(segment->data, mux->output, mux->output_length);
+  mux->output_length = 0;
+  return segment;
+}
+
+static int http_mux_muxer_open(http_mux_muxer_t *muxer, buffer_t *buf)
+{
+  mux_t *mux = &muxer->mux;
+
+  mux->name = muxer->name;
+  mux->format = muxer->format;
+  mux->width = buf->buf_list->fmt.width;
+  mux->height = buf->buf_list->fmt.height;
+
+  if (mux_write_header(mux, buf->start, buf->used) < 0) {
+    return -1;
+  }
+
+  muxer->init = http_mux_muxer_take_output(muxer, false);
+  return muxer->init ? 0 : -1;
+}
+
+// Closes the muxer, and the clients of the previous one
+static void http_mux_muxer_reset(http_mux_muxer_t *muxer)
+{
+  mux_close(&muxer->mux);
+
+  http_mux_segment_release(muxer->init);
+  muxer->init = NULL;
+
+  for (int i = 0; i < HTTP_MUX_MAX_SEGMENTS; i++) {
+    http_mux_segment_release(muxer->segments[i]);
+    muxer->segments[i] = NULL;
+  }
+
+  muxer->had_key_frame = false;
+  muxer->counter = 0;
+  muxer->generation++;
+}
+
+static void http_mux_muxer_add_segment(http_mux_muxer_t *muxer, http_mux_segment_t *segment)
+{
+  http_mux_segment_t **slot = &muxer->segments[muxer->next_seq % HTTP_MUX_MAX_SEGMENTS];
+
+  http_mux_segment_release(*slot);
+  segment->seq = muxer->next_seq++;
+  *slot = segment;
+}
+
+// Muxes the `buf` once, with the `lock` held
+static int http_mux_muxer_process(http_mux_muxer_t *muxer, buffer_t *buf, int counter)
+{
+  if (muxer->counter && counter - muxer->counter <= 0) {
+    return 0;
+  }
+
+  // A frame was missed by all clients, the next can only follow a key frame
+  if (muxer->counter && counter - muxer->counter > 1) {
+    LOG_DEBUG(muxer, "Missed %d frames, waiting for a key frame.", counter - muxer->counter - 1);
+    muxer->had_key_frame = false;
+  }
+
+  muxer->counter = counter;
+
+  if (!muxer->had_key_frame) {
+    muxer->had_key_frame = buf->flags.is_keyframe;
+  }
+  if (!muxer->had_key_frame) {
+    return 0;
+  }
+
+  if (!muxer->mux.has_header && http_mux_muxer_open(muxer, buf) < 0) {
+    goto error;
+  }
+
+  uint64_t pts_us = buf->captured_time_us ? buf->captured_time_us : get_monotonic_time_us(NULL, NULL);
+
+  if (mux_write_frame(&muxer->mux, buf->start, buf->used, pts_us, buf->flags.is_keyframe) < 0) {
+    goto error;
+  }
+
+  http_mux_segment_t *segment = http_mux_muxer_take_output(muxer, buf->flags.is_keyframe);
+  if (segment) {
+    http_mux_muxer_add_segment(muxer, segment);
+  }
+  return 0;
+
+error:
+  LOG_INFO(muxer, "Cannot mux the frame, restarting.");
+  http_mux_muxer_reset(muxer);
+  return -1;
+}
+
+// Writes the segments not yet written to the client, with the `lock` held
+static int http_mux_client_write(http_mux_client_t *status, http_client_t *client)
+{
+  http_mux_muxer_t *muxer = status->muxer;
+  unsigned oldest = muxer->next_seq > HTTP_MUX_MAX_SEGMENTS ? muxer->next_seq - HTTP_MUX_MAX_SEGMENTS : 1;
+  int written = 0;
+
+  // The segments were dropped before being written: rejoin at a key frame
+  if (status->next_seq && status->next_seq < oldest) {
+    LOG_DEBUG(status, "Missed %d segments, waiting for a key frame.", oldest - status->next_seq);
+    status->next_seq = 0;
+  }
+
+  // Join at the latest segment, if it starts with a key frame
+  if (!status->next_seq) {
+    http_mux_segment_t *latest = muxer->next_seq > oldest ? muxer->segments[(muxer->next_seq - 1) % HTTP_MUX_MAX_SEGMENTS] : NULL;
+
+    if (!latest || !latest->is_keyframe) {
+      return 0;
+    }
+
+    status->next_seq = latest->seq;
+  }
+
+  if (!status->wrote_init) {
+    if (http_client_printf(client, VIDEO_HEADER, muxer->content_type) < 0)
+      return -1;
+    if (http_mux_segment_write(client, muxer->init) < 0)
+      return -1;
+    status->wrote_init = true;
+  }
+
+  for (; status->next_seq < muxer->next_seq; status->next_seq++) {
+    http_mux_segment_t *segment = muxer->segments[status->next_seq % HTTP_MUX_MAX_SEGMENTS];
+
+    if (http_mux_segment_write(client, segment) < 0)
+      return -1;
+    written++;
+  }
+
+  return written > 0 ? 1 : 0;
+}
+
+static int http_mux_video_buf_part(http_client_t *client, buffer_t *buf, int frame, void *opaque)
+{
+  http_mux_client_t *status = opaque;
+  http_mux_muxer_t *muxer = status->muxer;
+  int ret = -1;
+
+  pthread_mutex_lock(&muxer->lock);
+  if (status->generation != muxer->generation)
+    goto error;
+  if (http_mux_muxer_process(muxer, buf, client->counter) < 0)
+    goto error;
+
+  ret = http_mux_client_write(status, client);
+
+  if (ret == 0 && !status->requested_key_frame) {
+    device_video_force_key(buf->buf_list->dev);
+    status->requested_key_frame = true;
+  }
+
+error:
+  pthread_mutex_unlock(&muxer->lock);
+  return ret;
+}
+
+static void http_mux_video_close(http_client_t *client, void *opaque)
+{
+  http_mux_client_t *status = opaque;
+  http_mux_muxer_t *muxer = status->muxer;
+
+  pthread_mutex_lock(&muxer->lock);
+  if (--muxer->clients == 0) {
+    http_mux_muxer_reset(muxer);
+  }
+  pthread_mutex_unlock(&muxer->lock);
+
+  free(status);
+}
+
+static void http_mux_video(http_worker_t *worker, FILE *stream, http_mux_muxer_t *muxer)
+{
+  http_mux_client_t *status = calloc(1, sizeof(http_mux_client_t));
+  status->name = muxer->name;
+  status->muxer = muxer;
+
+  pthread_mutex_lock(&muxer->lock);
+  muxer->clients++;
+  status->generation = muxer->generation;
+  pthread_mutex_unlock(&muxer->lock);
+
+  if (http_client_attach(worker, stream, &video_lock, http_mux_video_buf_part, http_mux_video_close, status) < 0) {
+    http_mux_video_close(NULL, status);
+    http_500(stream, NULL);
+    fprintf(stream, "Cannot stream.\n");
+  }
+}
+
+void http_mkv_video(http_worker_t *worker, FILE *stream)
+{
+  http_mux_video(worker, stream, &http_mux_mkv);
+}
+
+void http_mp4_video(http_worker_t *worker, FILE *stream)
+{
+  http_mux_video(worker, stream, &http_mux_mp4);
+}
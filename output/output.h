@@ -21,7 +21,17 @@ void http_mp4_video(struct http_worker_s *worker, FILE *stream);
 void http_mov_video(struct http_worker_s *worker, FILE *stream);
 
 // HLS
+typedef struct hls_options_s {
+  unsigned segment_ms;
+  unsigned part_ms;
+  unsigned segments;
+} hls_options_t;
+
+int http_hls_start(hls_options_t *options);
 void http_m3u8_video(struct http_worker_s *worker, FILE *stream);
+void http_hls_init(struct http_worker_s *worker, FILE *stream);
+void http_hls_segment(struct http_worker_s *worker, FILE *stream);
+void http_hls_part(struct http_worker_s *worker, FILE *stream);
 void http_detect_video(struct http_worker_s *worker, FILE *stream);
 
 #define HTTP_LOW_RES_PARAM "res=low"
@@ -8,13 +8,22 @@ if [[ $# -lt 1 ]]; then
   echo "  $0 tests/capture.jpeg --video-height=720"
   echo "  $0 tests/capture.jpeg --snapshot-height=720 --video-height=480"
   echo "  $0 tests/capture.h264"
+  echo "  $0 tests/capture.jpeg --camera-fps=30 --camera-options=jitter_us=2000"
+  echo "  $0 path/to/jpegs/"
   exit 1
 fi
 
 INPUT=$(realpath "$1")
 shift
 
-case "$INPUT" in
+# a directory of JPEGs
+if [[ -d "$INPUT" ]]; then
+  INPUT_FORMAT="$INPUT.jpeg"
+else
+  INPUT_FORMAT="$INPUT"
+fi
+
+case "$INPUT_FORMAT" in
   *.jpeg)
     set -- --camera-format=JPEG --camera-width=1920 --camera-height=1080 "$@"
     ;;
@@ -0,0 +1,633 @@
+#include "convert_kernels.h"
+#include "util/opts/log.h"
+#include "util/opts/fourcc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <linux/videodev2.h>
+
+// The YUV and RGB formats are converted two rows at a time through
+// the YUV 4:2:2 rows: the source rows are split into the luma and
+// the chroma of each row (or the one chroma row of 4:2:0), and joined
+// into the destination ones. The rows of the destination planes are used
+// as the intermediate ones when possible, so the conversions between
+// the planar formats do not copy the planes twice.
+
+typedef enum convert_layout_e {
+  CONVERT_LAYOUT_YUYV,
+  CONVERT_LAYOUT_PLANAR, // YUV420 and YVU420
+  CONVERT_LAYOUT_SEMIPLANAR, // NV12 and NV21
+  CONVERT_LAYOUT_RGB24,
+  CONVERT_LAYOUT_RGB565,
+  CONVERT_LAYOUT_BAYER10P,
+  CONVERT_LAYOUT_BAYER8,
+  CONVERT_LAYOUT_BAYER16
+} convert_layout_t;
+
+typedef struct convert_format_s {
+  unsigned format;
+  convert_layout_t layout;
+  int bits_per_pixel; // of the first plane
+  bool swap; // V before U, or B before R
+  unsigned bayer; // the 10-bit packed format of the same order
+} convert_format_t;
+
+static const convert_format_t convert_formats[] = {
+  { V4L2_PIX_FMT_YUYV, CONVERT_LAYOUT_YUYV, 16 },
+  { V4L2_PIX_FMT_YUV420, CONVERT_LAYOUT_PLANAR, 8 },
+  { V4L2_PIX_FMT_YVU420, CONVERT_LAYOUT_PLANAR, 8, true },
+  { V4L2_PIX_FMT_NV12, CONVERT_LAYOUT_SEMIPLANAR, 8 },
+  { V4L2_PIX_FMT_NV21, CONVERT_LAYOUT_SEMIPLANAR, 8, true },
+  { V4L2_PIX_FMT_RGB24, CONVERT_LAYOUT_RGB24, 24 },
+  { V4L2_PIX_FMT_BGR24, CONVERT_LAYOUT_RGB24, 24, true },
+  { V4L2_PIX_FMT_RGB565, CONVERT_LAYOUT_RGB565, 16 },
+  { V4L2_PIX_FMT_SRGGB10P, CONVERT_LAYOUT_BAYER10P, 10, false, V4L2_PIX_FMT_SRGGB10P },
+  { V4L2_PIX_FMT_SGRBG10P, CONVERT_LAYOUT_BAYER10P, 10, false, V4L2_PIX_FMT_SGRBG10P },
+  { V4L2_PIX_FMT_SGBRG10P, CONVERT_LAYOUT_BAYER10P, 10, false, V4L2_PIX_FMT_SGBRG10P },
+  { V4L2_PIX_FMT_SBGGR10P, CONVERT_LAYOUT_BAYER10P, 10, false, V4L2_PIX_FMT_SBGGR10P },
+  { V4L2_PIX_FMT_SRGGB8, CONVERT_LAYOUT_BAYER8, 8, false, V4L2_PIX_FMT_SRGGB10P },
+  { V4L2_PIX_FMT_SGRBG8, CONVERT_LAYOUT_BAYER8, 8, false, V4L2_PIX_FMT_SGRBG10P },
+  { V4L2_PIX_FMT_SGBRG8, CONVERT_LAYOUT_BAYER8, 8, false, V4L2_PIX_FMT_SGBRG10P },
+  { V4L2_PIX_FMT_SBGGR8, CONVERT_LAYOUT_BAYER8, 8, false, V4L2_PIX_FMT_SBGGR10P },
+  { V4L2_PIX_FMT_SRGGB10, CONVERT_LAYOUT_BAYER16, 16, false, V4L2_PIX_FMT_SRGGB10P },
+  { V4L2_PIX_FMT_SGRBG10, CONVERT_LAYOUT_BAYER16, 16, false, V4L2_PIX_FMT_SGRBG10P },
+  { V4L2_PIX_FMT_SGBRG10, CONVERT_LAYOUT_BAYER16, 16, false, V4L2_PIX_FMT_SGBRG10P },
+  { V4L2_PIX_FMT_SBGGR10, CONVERT_LAYOUT_BAYER16, 16, false, V4L2_PIX_FMT_SBGGR10P },
+};
+
+typedef struct convert_planes_s {
+  uint8_t *data[3]; // Y, U (or UV) and V
+  unsigned stride[3];
+} convert_planes_t;
+
+typedef struct convert_rows_s {
+  const uint8_t *y[2], *u[2], *v[2];
+  int n; // 1 for the last odd row
+} convert_rows_t;
+
+typedef struct convert_context_s {
+  const convert_kernels_t *kernels;
+  const convert_format_t *src_desc, *dst_desc;
+  convert_planes_t src, dst;
+  int width, height;
+
+  uint8_t *scratch;
+  uint8_t *y_tmp[2], *u_tmp[2], *v_tmp[2], *u_avg, *v_avg, *rgb_tmp;
+} convert_context_t;
+
+/* Scalar kernels */
+
+static uint8_t convert_clamp(int value)
+{
+  return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+void convert_yuyv_split_scalar(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width)
+{
+  for (int x = 0; x < width / 2; x++) {
+    y[x * 2] = src[x * 4];
+    u[x] = src[x * 4 + 1];
+    y[x * 2 + 1] = src[x * 4 + 2];
+    v[x] = src[x * 4 + 3];
+  }
+}
+
+void convert_yuyv_join_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+  for (int x = 0; x < width / 2; x++) {
+    dst[x * 4] = y[x * 2];
+    dst[x * 4 + 1] = u[x];
+    dst[x * 4 + 2] = y[x * 2 + 1];
+    dst[x * 4 + 3] = v[x];
+  }
+}
+
+void convert_average_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+  for (int x = 0; x < n; x++) {
+    dst[x] = (a[x] + b[x] + 1) >> 1;
+  }
+}
+
+void convert_interleave_scalar(const uint8_t *u, const uint8_t *v, uint8_t *dst, int n)
+{
+  for (int x = 0; x < n; x++) {
+    dst[x * 2] = u[x];
+    dst[x * 2 + 1] = v[x];
+  }
+}
+
+void convert_deinterleave_scalar(const uint8_t *src, uint8_t *u, uint8_t *v, int n)
+{
+  for (int x = 0; x < n; x++) {
+    u[x] = src[x * 2];
+    v[x] = src[x * 2 + 1];
+  }
+}
+
+// The SIMD kernels compute it in 16 bits, saturating only where
+// the result is clamped to 255 anyway
+void convert_yuv_to_rgb_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool bgr)
+{
+  int r_offset = bgr ? 2 : 0, b_offset = bgr ? 0 : 2;
+
+  for (int x = 0; x < width; x++) {
+    int luma = (y[x] - 16) * 74;
+    int cb = u[x / 2] - 128, cr = v[x / 2] - 128;
+
+    dst[x * 3 + r_offset] = convert_clamp((luma + 102 * cr + 32) >> 6);
+    dst[x * 3 + 1] = convert_clamp((luma - 25 * cb - 52 * cr + 32) >> 6);
+    dst[x * 3 + b_offset] = convert_clamp((luma + 129 * cb + 32) >> 6);
+  }
+}
+
+void convert_rgb_to_yuv_scalar(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width, bool bgr)
+{
+  int r_offset = bgr ? 2 : 0, b_offset = bgr ? 0 : 2;
+
+  for (int x = 0; x < width; x++) {
+    const uint8_t *p = src + x * 3;
+    y[x] = ((66 * p[r_offset] + 129 * p[1] + 25 * p[b_offset] + 128) >> 8) + 16;
+  }
+
+  for (int x = 0; x < width / 2; x++) {
+    const uint8_t *p = src + x * 6;
+    int r = (p[r_offset] + p[r_offset + 3] + 1) >> 1;
+    int g = (p[1] + p[4] + 1) >> 1;
+    int b = (p[b_offset] + p[b_offset + 3] + 1) >> 1;
+
+    u[x] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    v[x] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+}
+
+void convert_rgb565_to_rgb_scalar(const uint8_t *src, uint8_t *dst, int width, bool bgr)
+{
+  int r_offset = bgr ? 2 : 0, b_offset = bgr ? 0 : 2;
+
+  for (int x = 0; x < width; x++) {
+    unsigned pixel = src[x * 2] | src[x * 2 + 1] << 8;
+    unsigned r = pixel >> 11, g = (pixel >> 5) & 0x3F, b = pixel & 0x1F;
+
+    dst[x * 3 + r_offset] = r << 3 | r >> 2;
+    dst[x * 3 + 1] = g << 2 | g >> 4;
+    dst[x * 3 + b_offset] = b << 3 | b >> 2;
+  }
+}
+
+void convert_swap_rb_scalar(const uint8_t *src, uint8_t *dst, int width)
+{
+  for (int x = 0; x < width; x++) {
+    uint8_t r = src[x * 3];
+    dst[x * 3 + 1] = src[x * 3 + 1];
+    dst[x * 3] = src[x * 3 + 2];
+    dst[x * 3 + 2] = r;
+  }
+}
+
+// Each 4 pixels take 5 bytes: the 8 high bits of each, and then
+// the 2 low bits of each
+void convert_unpack10p_scalar(const uint8_t *src, uint8_t *dst, int width)
+{
+  for (int x = 0; x < width / 4; x++) {
+    memcpy(dst + x * 4, src + x * 5, 4);
+  }
+}
+
+void convert_unpack10p16_scalar(const uint8_t *src, uint16_t *dst, int width)
+{
+  for (int x = 0; x < width / 4; x++) {
+    const uint8_t *group = src + x * 5;
+    for (int i = 0; i < 4; i++) {
+      dst[x * 4 + i] = group[i] << 2 | ((group[4] >> (i * 2)) & 3);
+    }
+  }
+}
+
+const convert_kernels_t convert_kernels_scalar = {
+  .simd = CONVERT_SIMD_NONE,
+  .yuyv_split = convert_yuyv_split_scalar,
+  .yuyv_join = convert_yuyv_join_scalar,
+  .average = convert_average_scalar,
+  .interleave = convert_interleave_scalar,
+  .deinterleave = convert_deinterleave_scalar,
+  .yuv_to_rgb = convert_yuv_to_rgb_scalar,
+  .rgb_to_yuv = convert_rgb_to_yuv_scalar,
+  .rgb565_to_rgb = convert_rgb565_to_rgb_scalar,
+  .swap_rb = convert_swap_rb_scalar,
+  .unpack10p = convert_unpack10p_scalar,
+  .unpack10p16 = convert_unpack10p16_scalar
+};
+
+const convert_kernels_t *convert_get_kernels(convert_simd_t simd)
+{
+  if (!convert_simd_supported(simd)) {
+    return NULL;
+  }
+
+  switch (simd) {
+  case CONVERT_SIMD_NONE:
+    return &convert_kernels_scalar;
+#if defined(__SSE2__)
+  case CONVERT_SIMD_SSE4:
+    return &convert_kernels_sse4;
+  case CONVERT_SIMD_AVX2:
+    return &convert_kernels_avx2;
+#endif
+#if defined(__ARM_NEON)
+  case CONVERT_SIMD_NEON:
+    return &convert_kernels_neon;
+#endif
+  default:
+    return NULL;
+  }
+}
+
+bool convert_simd_supported(convert_simd_t simd)
+{
+  switch (simd) {
+  case CONVERT_SIMD_NONE:
+    return true;
+#if defined(__SSE2__)
+  case CONVERT_SIMD_SSE4:
+    return __builtin_cpu_supports("sse4.1");
+  case CONVERT_SIMD_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#if defined(__ARM_NEON)
+  case CONVERT_SIMD_NEON:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+convert_simd_t convert_simd_detect()
+{
+  static const convert_simd_t preferred[] = {
+    CONVERT_SIMD_AVX2,
+    CONVERT_SIMD_SSE4,
+    CONVERT_SIMD_NEON
+  };
+
+  for (int i = 0; i < ARRAY_SIZE(preferred); i++) {
+    if (convert_simd_supported(preferred[i])) {
+      return preferred[i];
+    }
+  }
+  return CONVERT_SIMD_NONE;
+}
+
+const char *convert_simd_name(convert_simd_t simd)
+{
+  switch (simd) {
+  case CONVERT_SIMD_NONE: return "scalar";
+  case CONVERT_SIMD_SSE4: return "sse4";
+  case CONVERT_SIMD_AVX2: return "avx2";
+  case CONVERT_SIMD_NEON: return "neon";
+  default: return "unknown";
+  }
+}
+
+/* Frame geometry */
+
+static const convert_format_t *convert_find_format(unsigned format)
+{
+  for (int i = 0; i < ARRAY_SIZE(convert_formats); i++) {
+    if (convert_formats[i].format == format) {
+      return &convert_formats[i];
+    }
+  }
+  return NULL;
+}
+
+static bool convert_is_yuv_or_rgb(const convert_format_t *desc)
+{
+  return desc->layout <= CONVERT_LAYOUT_RGB565;
+}
+
+bool convert_supported(unsigned src_format, unsigned dst_format)
+{
+  const convert_format_t *src = convert_find_format(src_format);
+  const convert_format_t *dst = convert_find_format(dst_format);
+
+  if (!src || !dst) {
+    return false;
+  } else if (src->format == dst->format) {
+    return true;
+  } else if (src->layout == CONVERT_LAYOUT_BAYER10P) {
+    return dst->layout != CONVERT_LAYOUT_BAYER10P && dst->bayer == src->bayer;
+  } else {
+    return convert_is_yuv_or_rgb(src) && convert_is_yuv_or_rgb(dst) && dst->layout != CONVERT_LAYOUT_RGB565;
+  }
+}
+
+static unsigned convert_bytesperline(const convert_format_t *desc, buffer_format_t fmt)
+{
+  return fmt.bytesperline ? fmt.bytesperline : fmt.width * desc->bits_per_pixel / 8;
+}
+
+static void convert_get_planes(const convert_format_t *desc, buffer_format_t fmt, uint8_t *data, convert_planes_t *planes)
+{
+  unsigned bytesperline = convert_bytesperline(desc, fmt);
+  unsigned chroma_height = (fmt.height + 1) / 2;
+
+  memset(planes, 0, sizeof(*planes));
+  planes->data[0] = data;
+  planes->stride[0] = bytesperline;
+
+  switch (desc->layout) {
+  case CONVERT_LAYOUT_PLANAR:
+    planes->stride[1] = planes->stride[2] = bytesperline / 2;
+    planes->data[1] = data + bytesperline * fmt.height;
+    planes->data[2] = planes->data[1] + planes->stride[1] * chroma_height;
+    if (desc->swap) {
+      uint8_t *u = planes->data[2];
+      planes->data[2] = planes->data[1];
+      planes->data[1] = u;
+    }
+    break;
+
+  case CONVERT_LAYOUT_SEMIPLANAR:
+    planes->stride[1] = bytesperline;
+    planes->data[1] = data + bytesperline * fmt.height;
+    break;
+
+  default:
+    break;
+  }
+}
+
+size_t convert_frame_size(buffer_format_t fmt)
+{
+  const convert_format_t *desc = convert_find_format(fmt.format);
+  if (!desc) {
+    return 0;
+  }
+
+  unsigned bytesperline = convert_bytesperline(desc, fmt);
+  unsigned chroma_height = (fmt.height + 1) / 2;
+
+  switch (desc->layout) {
+  case CONVERT_LAYOUT_PLANAR:
+    return bytesperline * fmt.height + bytesperline / 2 * chroma_height * 2;
+  case CONVERT_LAYOUT_SEMIPLANAR:
+    return bytesperline * (fmt.height + chroma_height);
+  default:
+    return bytesperline * fmt.height;
+  }
+}
+
+/* Frame conversion */
+
+static void convert_copy(convert_context_t *ctx)
+{
+  int n_planes = ctx->src_desc->layout == CONVERT_LAYOUT_PLANAR ? 3 :
+    ctx->src_desc->layout == CONVERT_LAYOUT_SEMIPLANAR ? 2 : 1;
+
+  for (int plane = 0; plane < n_planes; plane++) {
+    int height = plane ? (ctx->height + 1) / 2 : ctx->height;
+    int size = (ctx->width * ctx->src_desc->bits_per_pixel + 7) / 8;
+    if (ctx->src_desc->layout == CONVERT_LAYOUT_PLANAR && plane) {
+      size /= 2;
+    }
+
+    for (int row = 0; row < height; row++) {
+      memcpy(ctx->dst.data[plane] + row * ctx->dst.stride[plane],
+        ctx->src.data[plane] + row * ctx->src.stride[plane], size);
+    }
+  }
+}
+
+static void convert_bayer(convert_context_t *ctx)
+{
+  for (int row = 0; row < ctx->height; row++) {
+    const uint8_t *src = ctx->src.data[0] + row * ctx->src.stride[0];
+    uint8_t *dst = ctx->dst.data[0] + row * ctx->dst.stride[0];
+
+    if (ctx->dst_desc->layout == CONVERT_LAYOUT_BAYER8) {
+      ctx->kernels->unpack10p(src, dst, ctx->width);
+    } else {
+      ctx->kernels->unpack10p16(src, (uint16_t *)dst, ctx->width);
+    }
+  }
+}
+
+static void convert_rgb(convert_context_t *ctx)
+{
+  for (int row = 0; row < ctx->height; row++) {
+    const uint8_t *src = ctx->src.data[0] + row * ctx->src.stride[0];
+    uint8_t *dst = ctx->dst.data[0] + row * ctx->dst.stride[0];
+
+    if (ctx->src_desc->layout == CONVERT_LAYOUT_RGB565) {
+      ctx->kernels->rgb565_to_rgb(src, dst, ctx->width, ctx->dst_desc->swap);
+    } else {
+      ctx->kernels->swap_rb(src, dst, ctx->width);
+    }
+  }
+}
+
+static bool convert_has_luma_plane(const convert_format_t *desc)
+{
+  return desc->layout == CONVERT_LAYOUT_PLANAR || desc->layout == CONVERT_LAYOUT_SEMIPLANAR;
+}
+
+static void convert_read_rows(convert_context_t *ctx, int row, convert_rows_t *rows)
+{
+  const convert_kernels_t *kernels = ctx->kernels;
+  const convert_format_t *desc = ctx->src_desc;
+  int width = ctx->width;
+
+  for (int i = 0; i < rows->n; i++) {
+    const uint8_t *src = ctx->src.data[0] + (row + i) * ctx->src.stride[0];
+
+    // the luma is written straight into the destination plane
+    uint8_t *y = convert_has_luma_plane(ctx->dst_desc) ?
+      ctx->dst.data[0] + (row + i) * ctx->dst.stride[0] : ctx->y_tmp[i];
+    uint8_t *u = ctx->u_tmp[i], *v = ctx->v_tmp[i];
+
+    // and the first chroma row, when it is not averaged with the second one
+    if (ctx->dst_desc->layout == CONVERT_LAYOUT_PLANAR && i == 0) {
+      u = ctx->dst.data[1] + row / 2 * ctx->dst.stride[1];
+      v = ctx->dst.data[2] + row / 2 * ctx->dst.stride[2];
+    }
+
+    switch (desc->layout) {
+    case CONVERT_LAYOUT_YUYV:
+      kernels->yuyv_split(src, y, u, v, width);
+      break;
+
+    case CONVERT_LAYOUT_RGB24:
+      kernels->rgb_to_yuv(src, y, u, v, width, desc->swap);
+      break;
+
+    case CONVERT_LAYOUT_RGB565:
+      kernels->rgb565_to_rgb(src, ctx->rgb_tmp, width, false);
+      kernels->rgb_to_yuv(ctx->rgb_tmp, y, u, v, width, false);
+      break;
+
+    case CONVERT_LAYOUT_PLANAR:
+      y = (uint8_t *)src;
+      u = ctx->src.data[1] + row / 2 * ctx->src.stride[1];
+      v = ctx->src.data[2] + row / 2 * ctx->src.stride[2];
+      break;
+
+    case CONVERT_LAYOUT_SEMIPLANAR:
+      y = (uint8_t *)src;
+      if (i == 0) {
+        const uint8_t *chroma = ctx->src.data[1] + row / 2 * ctx->src.stride[1];
+        kernels->deinterleave(chroma, desc->swap ? v : u, desc->swap ? u : v, width / 2);
+      } else {
+        u = (uint8_t *)rows->u[0];
+        v = (uint8_t *)rows->v[0];
+      }
+      break;
+
+    default:
+      break;
+    }
+
+    rows->y[i] = y;
+    rows->u[i] = u;
+    rows->v[i] = v;
+  }
+
+  if (rows->n == 1) {
+    rows->u[1] = rows->u[0];
+    rows->v[1] = rows->v[0];
+  }
+}
+
+static void convert_write_rows(convert_context_t *ctx, int row, convert_rows_t *rows)
+{
+  const convert_kernels_t *kernels = ctx->kernels;
+  const convert_format_t *desc = ctx->dst_desc;
+  int width = ctx->width;
+
+  for (int i = 0; i < rows->n; i++) {
+    uint8_t *dst = ctx->dst.data[0] + (row + i) * ctx->dst.stride[0];
+
+    switch (desc->layout) {
+    case CONVERT_LAYOUT_YUYV:
+      kernels->yuyv_join(rows->y[i], rows->u[i], rows->v[i], dst, width);
+      break;
+
+    case CONVERT_LAYOUT_RGB24:
+      kernels->yuv_to_rgb(rows->y[i], rows->u[i], rows->v[i], dst, width, desc->swap);
+      break;
+
+    default:
+      if (rows->y[i] != dst) {
+        memcpy(dst, rows->y[i], width);
+      }
+      break;
+    }
+  }
+
+  if (!convert_has_luma_plane(desc)) {
+    return;
+  }
+
+  // the 4:2:0 chroma is the average of the 4:2:2 of both rows
+  const uint8_t *u = rows->u[0], *v = rows->v[0];
+  uint8_t *u_dst = ctx->u_avg, *v_dst = ctx->v_avg;
+
+  if (desc->layout == CONVERT_LAYOUT_PLANAR) {
+    u_dst = ctx->dst.data[1] + row / 2 * ctx->dst.stride[1];
+    v_dst = ctx->dst.data[2] + row / 2 * ctx->dst.stride[2];
+  }
+
+  if (rows->u[1] != rows->u[0]) {
+    kernels->average(rows->u[0], rows->u[1], u_dst, width / 2);
+    kernels->average(rows->v[0], rows->v[1], v_dst, width / 2);
+    u = u_dst;
+    v = v_dst;
+  }
+
+  if (desc->layout == CONVERT_LAYOUT_PLANAR) {
+    if (u != u_dst) {
+      memcpy(u_dst, u, width / 2);
+      memcpy(v_dst, v, width / 2);
+    }
+  } else {
+    uint8_t *uv = ctx->dst.data[1] + row / 2 * ctx->dst.stride[1];
+    kernels->interleave(desc->swap ? v : u, desc->swap ? u : v, uv, width / 2);
+  }
+}
+
+static void convert_yuv(convert_context_t *ctx)
+{
+  for (int row = 0; row < ctx->height; row += 2) {
+    convert_rows_t rows = { .n = MIN(ctx->height - row, 2) };
+
+    convert_read_rows(ctx, row, &rows);
+    convert_write_rows(ctx, row, &rows);
+  }
+}
+
+int convert_frame_simd(convert_simd_t simd, const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt)
+{
+  convert_context_t ctx = {
+    .kernels = convert_get_kernels(simd),
+    .src_desc = convert_find_format(src_fmt.format),
+    .dst_desc = convert_find_format(dst_fmt.format),
+    .width = src_fmt.width,
+    .height = src_fmt.height
+  };
+
+  if (!ctx.kernels) {
+    LOG_ERROR(NULL, "The '%s' kernels are not supported", convert_simd_name(simd));
+  }
+
+  if (!convert_supported(src_fmt.format, dst_fmt.format)) {
+    LOG_ERROR(NULL, "Cannot convert from '%s' to '%s'",
+      fourcc_to_string(src_fmt.format).buf, fourcc_to_string(dst_fmt.format).buf);
+  }
+
+  if (src_fmt.width != dst_fmt.width || src_fmt.height != dst_fmt.height) {
+    LOG_ERROR(NULL, "Cannot convert between %ux%u and %ux%u",
+      src_fmt.width, src_fmt.height, dst_fmt.width, dst_fmt.height);
+  }
+
+  if (ctx.width % (ctx.src_desc->layout == CONVERT_LAYOUT_BAYER10P ? 4 : 2)) {
+    LOG_ERROR(NULL, "The width of '%s' cannot be %d", fourcc_to_string(src_fmt.format).buf, ctx.width);
+  }
+
+  convert_get_planes(ctx.src_desc, src_fmt, (uint8_t *)src, &ctx.src);
+  convert_get_planes(ctx.dst_desc, dst_fmt, dst, &ctx.dst);
+
+  if (ctx.src_desc->format == ctx.dst_desc->format) {
+    convert_copy(&ctx);
+  } else if (ctx.src_desc->layout == CONVERT_LAYOUT_BAYER10P) {
+    convert_bayer(&ctx);
+  } else if (ctx.dst_desc->layout == CONVERT_LAYOUT_RGB24 &&
+    (ctx.src_desc->layout == CONVERT_LAYOUT_RGB24 || ctx.src_desc->layout == CONVERT_LAYOUT_RGB565)) {
+    convert_rgb(&ctx);
+  } else {
+    // 2 rows of Y, 4:2:2 U and V and averaged U and V, and one of RGB24
+    ctx.scratch = malloc(ctx.width * 8);
+    ctx.y_tmp[0] = ctx.scratch;
+    ctx.y_tmp[1] = ctx.y_tmp[0] + ctx.width;
+    ctx.u_tmp[0] = ctx.y_tmp[1] + ctx.width;
+    ctx.u_tmp[1] = ctx.u_tmp[0] + ctx.width / 2;
+    ctx.v_tmp[0] = ctx.u_tmp[1] + ctx.width / 2;
+    ctx.v_tmp[1] = ctx.v_tmp[0] + ctx.width / 2;
+    ctx.u_avg = ctx.v_tmp[1] + ctx.width / 2;
+    ctx.v_avg = ctx.u_avg + ctx.width / 2;
+    ctx.rgb_tmp = ctx.v_avg + ctx.width / 2;
+
+    convert_yuv(&ctx);
+    free(ctx.scratch);
+  }
+
+  return 0;
+
+error:
+  return -1;
+}
+
+int convert_frame(const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt)
+{
+  return convert_frame_simd(convert_simd_detect(), src, src_fmt, dst, dst_fmt);
+}
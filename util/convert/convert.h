@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "device/buffer_list.h"
+
+// Converts the frames between the pixel formats of the same size:
+// - YUYV, YUV420, YVU420, NV12, NV21, RGB24 and BGR24 between each other,
+// - RGB565 into any of them,
+// - the packed 10-bit Bayer (SRGGB10P, ...) into the 8-bit (SRGGB8, ...)
+//   or the 16-bit (SRGGB10, ...) one of the same order.
+//
+// The `bytesperline` of the formats is used as the stride of the first
+// plane, and the default one when zero.
+
+typedef enum convert_simd_e {
+  CONVERT_SIMD_NONE = 0,
+  CONVERT_SIMD_SSE4,
+  CONVERT_SIMD_AVX2,
+  CONVERT_SIMD_NEON
+} convert_simd_t;
+
+bool convert_simd_supported(convert_simd_t simd);
+convert_simd_t convert_simd_detect();
+const char *convert_simd_name(convert_simd_t simd);
+
+bool convert_supported(unsigned src_format, unsigned dst_format);
+size_t convert_frame_size(buffer_format_t fmt);
+
+// With the best of the supported kernels
+int convert_frame(const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt);
+int convert_frame_simd(convert_simd_t simd, const uint8_t *src, buffer_format_t src_fmt, uint8_t *dst, buffer_format_t dst_fmt);
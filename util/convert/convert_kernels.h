@@ -0,0 +1,55 @@
+#pragma once
+
+#include "convert.h"
+
+// The kernels convert a single row, of `width` pixels, the 4:2:2 chroma
+// rows have `width / 2`. The SIMD kernels leave the pixels past the last
+// full vector to the scalar ones, and have to produce the same output.
+//
+// YUV is BT.601 limited range, as produced by the cameras and encoders.
+
+typedef struct convert_kernels_s {
+  convert_simd_t simd;
+
+  void (*yuyv_split)(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width);
+  void (*yuyv_join)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width);
+
+  // (a + b + 1) >> 1, of `n` bytes
+  void (*average)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n);
+  void (*interleave)(const uint8_t *u, const uint8_t *v, uint8_t *dst, int n);
+  void (*deinterleave)(const uint8_t *src, uint8_t *u, uint8_t *v, int n);
+
+  void (*yuv_to_rgb)(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool bgr);
+  // the chroma of each pair of pixels is taken from their average
+  void (*rgb_to_yuv)(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width, bool bgr);
+  void (*rgb565_to_rgb)(const uint8_t *src, uint8_t *dst, int width, bool bgr);
+  void (*swap_rb)(const uint8_t *src, uint8_t *dst, int width);
+
+  // `width` is a multiple of 4
+  void (*unpack10p)(const uint8_t *src, uint8_t *dst, int width);
+  void (*unpack10p16)(const uint8_t *src, uint16_t *dst, int width);
+} convert_kernels_t;
+
+extern const convert_kernels_t convert_kernels_scalar;
+#if defined(__SSE2__)
+extern const convert_kernels_t convert_kernels_sse4;
+extern const convert_kernels_t convert_kernels_avx2;
+#endif
+#if defined(__ARM_NEON)
+extern const convert_kernels_t convert_kernels_neon;
+#endif
+
+// NULL when not supported by the CPU
+const convert_kernels_t *convert_get_kernels(convert_simd_t simd);
+
+void convert_yuyv_split_scalar(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width);
+void convert_yuyv_join_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width);
+void convert_average_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n);
+void convert_interleave_scalar(const uint8_t *u, const uint8_t *v, uint8_t *dst, int n);
+void convert_deinterleave_scalar(const uint8_t *src, uint8_t *u, uint8_t *v, int n);
+void convert_yuv_to_rgb_scalar(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool bgr);
+void convert_rgb_to_yuv_scalar(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width, bool bgr);
+void convert_rgb565_to_rgb_scalar(const uint8_t *src, uint8_t *dst, int width, bool bgr);
+void convert_swap_rb_scalar(const uint8_t *src, uint8_t *dst, int width);
+void convert_unpack10p_scalar(const uint8_t *src, uint8_t *dst, int width);
+void convert_unpack10p16_scalar(const uint8_t *src, uint16_t *dst, int width);
@@ -0,0 +1,246 @@
+#include "convert_kernels.h"
+
+#if defined(__ARM_NEON)
+
+#include <arm_neon.h>
+
+static void convert_yuyv_split_neon(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width)
+{
+  int x = 0;
+
+  for (; x + 32 <= width; x += 32) {
+    uint8x16x4_t in = vld4q_u8(src + x * 2);
+    uint8x16x2_t luma = { { in.val[0], in.val[2] } };
+
+    vst2q_u8(y + x, luma);
+    vst1q_u8(u + x / 2, in.val[1]);
+    vst1q_u8(v + x / 2, in.val[3]);
+  }
+
+  convert_yuyv_split_scalar(src + x * 2, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+static void convert_yuyv_join_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+  int x = 0;
+
+  for (; x + 32 <= width; x += 32) {
+    uint8x16x2_t luma = vld2q_u8(y + x);
+    uint8x16x4_t out = { { luma.val[0], vld1q_u8(u + x / 2), luma.val[1], vld1q_u8(v + x / 2) } };
+
+    vst4q_u8(dst + x * 2, out);
+  }
+
+  convert_yuyv_join_scalar(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+static void convert_average_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+  int x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    vst1q_u8(dst + x, vrhaddq_u8(vld1q_u8(a + x), vld1q_u8(b + x)));
+  }
+
+  convert_average_scalar(a + x, b + x, dst + x, n - x);
+}
+
+static void convert_interleave_neon(const uint8_t *u, const uint8_t *v, uint8_t *dst, int n)
+{
+  int x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    uint8x16x2_t out = { { vld1q_u8(u + x), vld1q_u8(v + x) } };
+    vst2q_u8(dst + x * 2, out);
+  }
+
+  convert_interleave_scalar(u + x, v + x, dst + x * 2, n - x);
+}
+
+static void convert_deinterleave_neon(const uint8_t *src, uint8_t *u, uint8_t *v, int n)
+{
+  int x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    uint8x16x2_t in = vld2q_u8(src + x * 2);
+    vst1q_u8(u + x, in.val[0]);
+    vst1q_u8(v + x, in.val[1]);
+  }
+
+  convert_deinterleave_scalar(src + x * 2, u + x, v + x, n - x);
+}
+
+// 8 pixels into 8 bytes of each channel
+static inline void convert_yuv_to_rgb8_neon(uint8x8_t y, uint8x8_t u, uint8x8_t v, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b)
+{
+  int16x8_t luma = vmulq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(y)), vdupq_n_s16(16)), 74);
+  int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(u)), vdupq_n_s16(128));
+  int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(128));
+  int16x8_t round = vdupq_n_s16(32);
+
+  int16x8_t r16 = vqaddq_s16(vqaddq_s16(luma, vmulq_n_s16(cr, 102)), round);
+  int16x8_t g16 = vqaddq_s16(vsubq_s16(luma, vaddq_s16(vmulq_n_s16(cb, 25), vmulq_n_s16(cr, 52))), round);
+  int16x8_t b16 = vqaddq_s16(vqaddq_s16(luma, vmulq_n_s16(cb, 129)), round);
+
+  *r = vqshrun_n_s16(r16, 6);
+  *g = vqshrun_n_s16(g16, 6);
+  *b = vqshrun_n_s16(b16, 6);
+}
+
+static void convert_yuv_to_rgb_neon(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool bgr)
+{
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    uint8x16_t luma = vld1q_u8(y + x);
+    uint8x8x2_t cb = vzip_u8(vld1_u8(u + x / 2), vld1_u8(u + x / 2));
+    uint8x8x2_t cr = vzip_u8(vld1_u8(v + x / 2), vld1_u8(v + x / 2));
+    uint8x8_t r[2], g[2], b[2];
+
+    convert_yuv_to_rgb8_neon(vget_low_u8(luma), cb.val[0], cr.val[0], &r[0], &g[0], &b[0]);
+    convert_yuv_to_rgb8_neon(vget_high_u8(luma), cb.val[1], cr.val[1], &r[1], &g[1], &b[1]);
+
+    uint8x16x3_t out;
+    out.val[bgr ? 2 : 0] = vcombine_u8(r[0], r[1]);
+    out.val[1] = vcombine_u8(g[0], g[1]);
+    out.val[bgr ? 0 : 2] = vcombine_u8(b[0], b[1]);
+    vst3q_u8(dst + x * 3, out);
+  }
+
+  convert_yuv_to_rgb_scalar(y + x, u + x / 2, v + x / 2, dst + x * 3, width - x, bgr);
+}
+
+static void convert_rgb_to_yuv_neon(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width, bool bgr)
+{
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x3_t in = vld3q_u8(src + x * 3);
+    uint8x16_t r8 = in.val[bgr ? 2 : 0], g8 = in.val[1], b8 = in.val[bgr ? 0 : 2];
+    uint16x8_t luma[2];
+
+    for (int h = 0; h < 2; h++) {
+      uint8x8_t r = h ? vget_high_u8(r8) : vget_low_u8(r8);
+      uint8x8_t g = h ? vget_high_u8(g8) : vget_low_u8(g8);
+      uint8x8_t b = h ? vget_high_u8(b8) : vget_low_u8(b8);
+
+      luma[h] = vmull_u8(r, vdup_n_u8(66));
+      luma[h] = vmlal_u8(luma[h], g, vdup_n_u8(129));
+      luma[h] = vmlal_u8(luma[h], b, vdup_n_u8(25));
+      luma[h] = vaddq_u16(vshrq_n_u16(vaddq_u16(luma[h], vdupq_n_u16(128)), 8), vdupq_n_u16(16));
+    }
+
+    vst1q_u8(y + x, vcombine_u8(vmovn_u16(luma[0]), vmovn_u16(luma[1])));
+
+    // the rounded average of each pair of pixels
+    int16x8_t r = vreinterpretq_s16_u16(vrshrq_n_u16(vpaddlq_u8(r8), 1));
+    int16x8_t g = vreinterpretq_s16_u16(vrshrq_n_u16(vpaddlq_u8(g8), 1));
+    int16x8_t b = vreinterpretq_s16_u16(vrshrq_n_u16(vpaddlq_u8(b8), 1));
+
+    int16x8_t cb = vmulq_n_s16(r, -38);
+    cb = vmlaq_n_s16(cb, g, -74);
+    cb = vmlaq_n_s16(cb, b, 112);
+    int16x8_t cr = vmulq_n_s16(r, 112);
+    cr = vmlaq_n_s16(cr, g, -94);
+    cr = vmlaq_n_s16(cr, b, -18);
+
+    cb = vaddq_s16(vshrq_n_s16(vaddq_s16(cb, vdupq_n_s16(128)), 8), vdupq_n_s16(128));
+    cr = vaddq_s16(vshrq_n_s16(vaddq_s16(cr, vdupq_n_s16(128)), 8), vdupq_n_s16(128));
+
+    vst1_u8(u + x / 2, vqmovun_s16(cb));
+    vst1_u8(v + x / 2, vqmovun_s16(cr));
+  }
+
+  convert_rgb_to_yuv_scalar(src + x * 3, y + x, u + x / 2, v + x / 2, width - x, bgr);
+}
+
+static void convert_rgb565_to_rgb_neon(const uint8_t *src, uint8_t *dst, int width, bool bgr)
+{
+  int x = 0;
+
+  for (; x + 8 <= width; x += 8) {
+    uint16x8_t pixels = vld1q_u16((const uint16_t *)(src + x * 2));
+    uint8x8_t r5 = vmovn_u16(vshrq_n_u16(pixels, 11));
+    uint8x8_t g6 = vand_u8(vmovn_u16(vshrq_n_u16(pixels, 5)), vdup_n_u8(0x3F));
+    uint8x8_t b5 = vand_u8(vmovn_u16(pixels), vdup_n_u8(0x1F));
+    uint8x8x3_t out;
+
+    out.val[bgr ? 2 : 0] = vorr_u8(vshl_n_u8(r5, 3), vshr_n_u8(r5, 2));
+    out.val[1] = vorr_u8(vshl_n_u8(g6, 2), vshr_n_u8(g6, 4));
+    out.val[bgr ? 0 : 2] = vorr_u8(vshl_n_u8(b5, 3), vshr_n_u8(b5, 2));
+    vst3_u8(dst + x * 3, out);
+  }
+
+  convert_rgb565_to_rgb_scalar(src + x * 2, dst + x * 3, width - x, bgr);
+}
+
+static void convert_swap_rb_neon(const uint8_t *src, uint8_t *dst, int width)
+{
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    uint8x16x3_t in = vld3q_u8(src + x * 3);
+    uint8x16_t tmp = in.val[0];
+
+    in.val[0] = in.val[2];
+    in.val[2] = tmp;
+    vst3q_u8(dst + x * 3, in);
+  }
+
+  convert_swap_rb_scalar(src + x * 3, dst + x * 3, width - x);
+}
+
+// The 4 high bytes of two groups of 5 bytes, 13 bytes are read
+static inline uint8x8_t convert_unpack10p_neon_groups(const uint8_t *in)
+{
+  uint32x2_t a = vreinterpret_u32_u8(vld1_u8(in));
+  uint32x2_t b = vreinterpret_u32_u8(vld1_u8(in + 5));
+  return vreinterpret_u8_u32(vzip_u32(a, b).val[0]);
+}
+
+static void convert_unpack10p_neon(const uint8_t *src, uint8_t *dst, int width)
+{
+  int x = 0;
+
+  for (; x + 12 <= width; x += 8) {
+    vst1_u8(dst + x, convert_unpack10p_neon_groups(src + x / 4 * 5));
+  }
+
+  convert_unpack10p_scalar(src + x / 4 * 5, dst + x, width - x);
+}
+
+static const int16_t convert_unpack10p16_shifts[8] = { 0, -2, -4, -6, 0, -2, -4, -6 };
+
+static void convert_unpack10p16_neon(const uint8_t *src, uint16_t *dst, int width)
+{
+  const int16x8_t low_shift = vld1q_s16(convert_unpack10p16_shifts);
+  int x = 0;
+
+  for (; x + 12 <= width; x += 8) {
+    const uint8_t *in = src + x / 4 * 5;
+    uint16x8_t high = vmovl_u8(convert_unpack10p_neon_groups(in));
+    uint16x8_t low = vcombine_u16(vdup_n_u16(in[4]), vdup_n_u16(in[9]));
+
+    low = vandq_u16(vshlq_u16(low, low_shift), vdupq_n_u16(3));
+    vst1q_u16(dst + x, vorrq_u16(vshlq_n_u16(high, 2), low));
+  }
+
+  convert_unpack10p16_scalar(src + x / 4 * 5, dst + x, width - x);
+}
+
+const convert_kernels_t convert_kernels_neon = {
+  .simd = CONVERT_SIMD_NEON,
+  .yuyv_split = convert_yuyv_split_neon,
+  .yuyv_join = convert_yuyv_join_neon,
+  .average = convert_average_neon,
+  .interleave = convert_interleave_neon,
+  .deinterleave = convert_deinterleave_neon,
+  .yuv_to_rgb = convert_yuv_to_rgb_neon,
+  .rgb_to_yuv = convert_rgb_to_yuv_neon,
+  .rgb565_to_rgb = convert_rgb565_to_rgb_neon,
+  .swap_rb = convert_swap_rb_neon,
+  .unpack10p = convert_unpack10p_neon,
+  .unpack10p16 = convert_unpack10p16_neon
+};
+
+#endif // __ARM_NEON
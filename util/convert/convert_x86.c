@@ -0,0 +1,599 @@
+#include "convert_kernels.h"
+
+#if defined(__SSE2__)
+
+#include <immintrin.h>
+
+// The RGB24 is (de)interleaved with three shuffles of each register
+
+static const uint8_t convert_rgb_pack_masks[3][3][16] = {
+  { { 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80, 0x80, 5 },
+    { 0x80, 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80, 0x80 },
+    { 0x80, 0x80, 0, 0x80, 0x80, 1, 0x80, 0x80, 2, 0x80, 0x80, 3, 0x80, 0x80, 4, 0x80 } },
+  { { 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80, 10, 0x80 },
+    { 5, 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80, 10 },
+    { 0x80, 5, 0x80, 0x80, 6, 0x80, 0x80, 7, 0x80, 0x80, 8, 0x80, 0x80, 9, 0x80, 0x80 } },
+  { { 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15, 0x80, 0x80 },
+    { 0x80, 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15, 0x80 },
+    { 10, 0x80, 0x80, 11, 0x80, 0x80, 12, 0x80, 0x80, 13, 0x80, 0x80, 14, 0x80, 0x80, 15 } },
+};
+
+static const uint8_t convert_rgb_unpack_masks[3][3][16] = {
+  { { 0, 3, 6, 9, 12, 15, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 5, 8, 11, 14, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 1, 4, 7, 10, 13 } },
+  { { 1, 4, 7, 10, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0, 3, 6, 9, 12, 15, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 2, 5, 8, 11, 14 } },
+  { { 2, 5, 8, 11, 14, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 1, 4, 7, 10, 13, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+    { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0, 3, 6, 9, 12, 15 } },
+};
+
+// 5 pixels of each 16 bytes, the last byte is written again by the next ones
+static const uint8_t convert_swap_rb_mask[16] = {
+  2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15
+};
+
+// 3 groups of 5 bytes into 12 pixels
+static const uint8_t convert_unpack10p_mask[16] = {
+  0, 1, 2, 3, 5, 6, 7, 8, 10, 11, 12, 13, 0x80, 0x80, 0x80, 0x80
+};
+
+// 2 groups of 5 bytes into the high and the low bits of 8 pixels
+static const uint8_t convert_unpack10p16_masks[2][16] = {
+  { 0, 0x80, 1, 0x80, 2, 0x80, 3, 0x80, 5, 0x80, 6, 0x80, 7, 0x80, 8, 0x80 },
+  { 4, 0x80, 4, 0x80, 4, 0x80, 4, 0x80, 9, 0x80, 9, 0x80, 9, 0x80, 9, 0x80 }
+};
+
+#define CONVERT_LOAD_MASK(mask) _mm_loadu_si128((const __m128i *)(mask))
+
+/* SSE4.1 kernels */
+
+__attribute__((target("sse4.1")))
+static inline void convert_store_rgb_sse4(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+  for (int k = 0; k < 3; k++) {
+    __m128i out = _mm_or_si128(_mm_or_si128(
+      _mm_shuffle_epi8(r, CONVERT_LOAD_MASK(convert_rgb_pack_masks[k][0])),
+      _mm_shuffle_epi8(g, CONVERT_LOAD_MASK(convert_rgb_pack_masks[k][1]))),
+      _mm_shuffle_epi8(b, CONVERT_LOAD_MASK(convert_rgb_pack_masks[k][2])));
+    _mm_storeu_si128((__m128i *)(dst + k * 16), out);
+  }
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i convert_load_channel_sse4(const __m128i in[3], int channel)
+{
+  return _mm_or_si128(_mm_or_si128(
+    _mm_shuffle_epi8(in[0], CONVERT_LOAD_MASK(convert_rgb_unpack_masks[channel][0])),
+    _mm_shuffle_epi8(in[1], CONVERT_LOAD_MASK(convert_rgb_unpack_masks[channel][1]))),
+    _mm_shuffle_epi8(in[2], CONVERT_LOAD_MASK(convert_rgb_unpack_masks[channel][2])));
+}
+
+// 8 pixels of 16 bits
+__attribute__((target("sse4.1")))
+static inline void convert_yuv_to_rgb16_sse4(__m128i luma, __m128i cb, __m128i cr, __m128i *r, __m128i *g, __m128i *b)
+{
+  const __m128i round = _mm_set1_epi16(32);
+
+  luma = _mm_mullo_epi16(_mm_sub_epi16(luma, _mm_set1_epi16(16)), _mm_set1_epi16(74));
+  cb = _mm_sub_epi16(cb, _mm_set1_epi16(128));
+  cr = _mm_sub_epi16(cr, _mm_set1_epi16(128));
+
+  *r = _mm_adds_epi16(luma, _mm_mullo_epi16(cr, _mm_set1_epi16(102)));
+  *g = _mm_sub_epi16(luma, _mm_add_epi16(_mm_mullo_epi16(cb, _mm_set1_epi16(25)), _mm_mullo_epi16(cr, _mm_set1_epi16(52))));
+  *b = _mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(129)));
+
+  *r = _mm_srai_epi16(_mm_adds_epi16(*r, round), 6);
+  *g = _mm_srai_epi16(_mm_adds_epi16(*g, round), 6);
+  *b = _mm_srai_epi16(_mm_adds_epi16(*b, round), 6);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_yuyv_split_sse4(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width)
+{
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + x * 2));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + x * 2 + 16));
+    __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+
+    _mm_storeu_si128((__m128i *)(y + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+    _mm_storel_epi64((__m128i *)(u + x / 2), _mm_packus_epi16(_mm_and_si128(uv, mask), uv));
+    _mm_storel_epi64((__m128i *)(v + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), uv));
+  }
+
+  convert_yuyv_split_scalar(src + x * 2, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_yuyv_join_sse4(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i luma = _mm_loadu_si128((const __m128i *)(y + x));
+    __m128i uv = _mm_unpacklo_epi8(
+      _mm_loadl_epi64((const __m128i *)(u + x / 2)),
+      _mm_loadl_epi64((const __m128i *)(v + x / 2)));
+
+    _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_unpacklo_epi8(luma, uv));
+    _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), _mm_unpackhi_epi8(luma, uv));
+  }
+
+  convert_yuyv_join_scalar(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_average_sse4(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+  int x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_avg_epu8(
+      _mm_loadu_si128((const __m128i *)(a + x)),
+      _mm_loadu_si128((const __m128i *)(b + x))));
+  }
+
+  convert_average_scalar(a + x, b + x, dst + x, n - x);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_interleave_sse4(const uint8_t *u, const uint8_t *v, uint8_t *dst, int n)
+{
+  int x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(u + x));
+    __m128i b = _mm_loadu_si128((const __m128i *)(v + x));
+
+    _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_unpacklo_epi8(a, b));
+    _mm_storeu_si128((__m128i *)(dst + x * 2 + 16), _mm_unpackhi_epi8(a, b));
+  }
+
+  convert_interleave_scalar(u + x, v + x, dst + x * 2, n - x);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_deinterleave_sse4(const uint8_t *src, uint8_t *u, uint8_t *v, int n)
+{
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  int x = 0;
+
+  for (; x + 16 <= n; x += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(src + x * 2));
+    __m128i b = _mm_loadu_si128((const __m128i *)(src + x * 2 + 16));
+
+    _mm_storeu_si128((__m128i *)(u + x), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+    _mm_storeu_si128((__m128i *)(v + x), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+  }
+
+  convert_deinterleave_scalar(src + x * 2, u + x, v + x, n - x);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_yuv_to_rgb_sse4(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool bgr)
+{
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i luma = _mm_loadu_si128((const __m128i *)(y + x));
+    __m128i cb = _mm_loadl_epi64((const __m128i *)(u + x / 2));
+    __m128i cr = _mm_loadl_epi64((const __m128i *)(v + x / 2));
+    __m128i r[2], g[2], b[2];
+
+    // each chroma for two pixels
+    cb = _mm_unpacklo_epi8(cb, cb);
+    cr = _mm_unpacklo_epi8(cr, cr);
+
+    for (int h = 0; h < 2; h++) {
+      convert_yuv_to_rgb16_sse4(
+        _mm_cvtepu8_epi16(luma), _mm_cvtepu8_epi16(cb), _mm_cvtepu8_epi16(cr),
+        &r[h], &g[h], &b[h]);
+      luma = _mm_srli_si128(luma, 8);
+      cb = _mm_srli_si128(cb, 8);
+      cr = _mm_srli_si128(cr, 8);
+    }
+
+    __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+    __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+    __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+    convert_store_rgb_sse4(dst + x * 3, bgr ? b8 : r8, g8, bgr ? r8 : b8);
+  }
+
+  convert_yuv_to_rgb_scalar(y + x, u + x / 2, v + x / 2, dst + x * 3, width - x, bgr);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_rgb_to_yuv_sse4(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width, bool bgr)
+{
+  const __m128i mask = _mm_set1_epi16(0x00FF);
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i in[3] = {
+      _mm_loadu_si128((const __m128i *)(src + x * 3)),
+      _mm_loadu_si128((const __m128i *)(src + x * 3 + 16)),
+      _mm_loadu_si128((const __m128i *)(src + x * 3 + 32))
+    };
+    __m128i r8 = convert_load_channel_sse4(in, bgr ? 2 : 0);
+    __m128i g8 = convert_load_channel_sse4(in, 1);
+    __m128i b8 = convert_load_channel_sse4(in, bgr ? 0 : 2);
+    __m128i luma[2];
+
+    for (int h = 0; h < 2; h++) {
+      __m128i r = _mm_cvtepu8_epi16(h ? _mm_srli_si128(r8, 8) : r8);
+      __m128i g = _mm_cvtepu8_epi16(h ? _mm_srli_si128(g8, 8) : g8);
+      __m128i b = _mm_cvtepu8_epi16(h ? _mm_srli_si128(b8, 8) : b8);
+
+      // at most 56228, so it does not wrap around
+      luma[h] = _mm_add_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(r, _mm_set1_epi16(66)),
+        _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+        _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(25)), _mm_set1_epi16(128)));
+      luma[h] = _mm_add_epi16(_mm_srli_epi16(luma[h], 8), _mm_set1_epi16(16));
+    }
+
+    _mm_storeu_si128((__m128i *)(y + x), _mm_packus_epi16(luma[0], luma[1]));
+
+    // the average of each pair of pixels
+    __m128i r = _mm_avg_epu16(_mm_and_si128(r8, mask), _mm_srli_epi16(r8, 8));
+    __m128i g = _mm_avg_epu16(_mm_and_si128(g8, mask), _mm_srli_epi16(g8, 8));
+    __m128i b = _mm_avg_epu16(_mm_and_si128(b8, mask), _mm_srli_epi16(b8, 8));
+
+    __m128i cb = _mm_add_epi16(_mm_add_epi16(
+      _mm_mullo_epi16(r, _mm_set1_epi16(-38)),
+      _mm_mullo_epi16(g, _mm_set1_epi16(-74))),
+      _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(112)), _mm_set1_epi16(128)));
+    __m128i cr = _mm_add_epi16(_mm_add_epi16(
+      _mm_mullo_epi16(r, _mm_set1_epi16(112)),
+      _mm_mullo_epi16(g, _mm_set1_epi16(-94))),
+      _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(-18)), _mm_set1_epi16(128)));
+
+    cb = _mm_add_epi16(_mm_srai_epi16(cb, 8), _mm_set1_epi16(128));
+    cr = _mm_add_epi16(_mm_srai_epi16(cr, 8), _mm_set1_epi16(128));
+
+    _mm_storel_epi64((__m128i *)(u + x / 2), _mm_packus_epi16(cb, cb));
+    _mm_storel_epi64((__m128i *)(v + x / 2), _mm_packus_epi16(cr, cr));
+  }
+
+  convert_rgb_to_yuv_scalar(src + x * 3, y + x, u + x / 2, v + x / 2, width - x, bgr);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_rgb565_to_rgb_sse4(const uint8_t *src, uint8_t *dst, int width, bool bgr)
+{
+  int x = 0;
+
+  for (; x + 16 <= width; x += 16) {
+    __m128i r[2], g[2], b[2];
+
+    for (int h = 0; h < 2; h++) {
+      __m128i pixels = _mm_loadu_si128((const __m128i *)(src + x * 2 + h * 16));
+      __m128i r5 = _mm_srli_epi16(pixels, 11);
+      __m128i g6 = _mm_and_si128(_mm_srli_epi16(pixels, 5), _mm_set1_epi16(0x3F));
+      __m128i b5 = _mm_and_si128(pixels, _mm_set1_epi16(0x1F));
+
+      r[h] = _mm_or_si128(_mm_slli_epi16(r5, 3), _mm_srli_epi16(r5, 2));
+      g[h] = _mm_or_si128(_mm_slli_epi16(g6, 2), _mm_srli_epi16(g6, 4));
+      b[h] = _mm_or_si128(_mm_slli_epi16(b5, 3), _mm_srli_epi16(b5, 2));
+    }
+
+    __m128i r8 = _mm_packus_epi16(r[0], r[1]);
+    __m128i g8 = _mm_packus_epi16(g[0], g[1]);
+    __m128i b8 = _mm_packus_epi16(b[0], b[1]);
+    convert_store_rgb_sse4(dst + x * 3, bgr ? b8 : r8, g8, bgr ? r8 : b8);
+  }
+
+  convert_rgb565_to_rgb_scalar(src + x * 2, dst + x * 3, width - x, bgr);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_swap_rb_sse4(const uint8_t *src, uint8_t *dst, int width)
+{
+  const __m128i mask = CONVERT_LOAD_MASK(convert_swap_rb_mask);
+  int x = 0;
+
+  for (; x + 6 <= width; x += 5) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + x * 3));
+    _mm_storeu_si128((__m128i *)(dst + x * 3), _mm_shuffle_epi8(in, mask));
+  }
+
+  convert_swap_rb_scalar(src + x * 3, dst + x * 3, width - x);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_unpack10p_sse4(const uint8_t *src, uint8_t *dst, int width)
+{
+  const __m128i mask = CONVERT_LOAD_MASK(convert_unpack10p_mask);
+  int x = 0;
+
+  // 16 bytes are read and written for 12 pixels
+  for (; x + 16 <= width; x += 12) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + x / 4 * 5));
+    _mm_storeu_si128((__m128i *)(dst + x), _mm_shuffle_epi8(in, mask));
+  }
+
+  convert_unpack10p_scalar(src + x / 4 * 5, dst + x, width - x);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i convert_unpack10p16_sse4_lanes(__m128i in)
+{
+  __m128i high = _mm_shuffle_epi8(in, CONVERT_LOAD_MASK(convert_unpack10p16_masks[0]));
+  __m128i low = _mm_shuffle_epi8(in, CONVERT_LOAD_MASK(convert_unpack10p16_masks[1]));
+
+  // (low >> (2 * i)) & 3 of each of the 4 pixels
+  low = _mm_mullo_epi16(low, _mm_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1));
+  low = _mm_and_si128(_mm_srli_epi16(low, 6), _mm_set1_epi16(3));
+  return _mm_or_si128(_mm_slli_epi16(high, 2), low);
+}
+
+__attribute__((target("sse4.1")))
+static void convert_unpack10p16_sse4(const uint8_t *src, uint16_t *dst, int width)
+{
+  int x = 0;
+
+  // 16 bytes are read for 8 pixels
+  for (; x + 16 <= width; x += 8) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(src + x / 4 * 5));
+    _mm_storeu_si128((__m128i *)(dst + x), convert_unpack10p16_sse4_lanes(in));
+  }
+
+  convert_unpack10p16_scalar(src + x / 4 * 5, dst + x, width - x);
+}
+
+const convert_kernels_t convert_kernels_sse4 = {
+  .simd = CONVERT_SIMD_SSE4,
+  .yuyv_split = convert_yuyv_split_sse4,
+  .yuyv_join = convert_yuyv_join_sse4,
+  .average = convert_average_sse4,
+  .interleave = convert_interleave_sse4,
+  .deinterleave = convert_deinterleave_sse4,
+  .yuv_to_rgb = convert_yuv_to_rgb_sse4,
+  .rgb_to_yuv = convert_rgb_to_yuv_sse4,
+  .rgb565_to_rgb = convert_rgb565_to_rgb_sse4,
+  .swap_rb = convert_swap_rb_sse4,
+  .unpack10p = convert_unpack10p_sse4,
+  .unpack10p16 = convert_unpack10p16_sse4
+};
+
+/* AVX2 kernels */
+
+// The packs work on each 128-bit lane: reorder the 64-bit quarters
+#define CONVERT_AVX2_PACK_ORDER 0xD8
+
+__attribute__((target("avx2")))
+static void convert_yuyv_split_avx2(const uint8_t *src, uint8_t *y, uint8_t *u, uint8_t *v, int width)
+{
+  const __m256i mask = _mm256_set1_epi16(0x00FF);
+  int x = 0;
+
+  for (; x + 32 <= width; x += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src + x * 2));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + x * 2 + 32));
+    __m256i luma = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+    __m256i uv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+    uv = _mm256_permute4x64_epi64(uv, CONVERT_AVX2_PACK_ORDER);
+
+    __m256i cb = _mm256_packus_epi16(_mm256_and_si256(uv, mask), _mm256_and_si256(uv, mask));
+    __m256i cr = _mm256_packus_epi16(_mm256_srli_epi16(uv, 8), _mm256_srli_epi16(uv, 8));
+
+    _mm256_storeu_si256((__m256i *)(y + x), _mm256_permute4x64_epi64(luma, CONVERT_AVX2_PACK_ORDER));
+    _mm_storeu_si128((__m128i *)(u + x / 2), _mm256_castsi256_si128(_mm256_permute4x64_epi64(cb, CONVERT_AVX2_PACK_ORDER)));
+    _mm_storeu_si128((__m128i *)(v + x / 2), _mm256_castsi256_si128(_mm256_permute4x64_epi64(cr, CONVERT_AVX2_PACK_ORDER)));
+  }
+
+  convert_yuyv_split_scalar(src + x * 2, y + x, u + x / 2, v + x / 2, width - x);
+}
+
+__attribute__((target("avx2")))
+static void convert_yuyv_join_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width)
+{
+  int x = 0;
+
+  for (; x + 32 <= width; x += 32) {
+    __m256i luma = _mm256_loadu_si256((const __m256i *)(y + x));
+    __m128i cb = _mm_loadu_si128((const __m128i *)(u + x / 2));
+    __m128i cr = _mm_loadu_si128((const __m128i *)(v + x / 2));
+    __m256i uv = _mm256_set_m128i(_mm_unpackhi_epi8(cb, cr), _mm_unpacklo_epi8(cb, cr));
+
+    // the pixels 0-7 and 16-23, and 8-15 and 24-31
+    __m256i lo = _mm256_unpacklo_epi8(luma, uv);
+    __m256i hi = _mm256_unpackhi_epi8(luma, uv);
+
+    _mm256_storeu_si256((__m256i *)(dst + x * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + x * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+
+  convert_yuyv_join_scalar(y + x, u + x / 2, v + x / 2, dst + x * 2, width - x);
+}
+
+__attribute__((target("avx2")))
+static void convert_average_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n)
+{
+  int x = 0;
+
+  for (; x + 32 <= n; x += 32) {
+    _mm256_storeu_si256((__m256i *)(dst + x), _mm256_avg_epu8(
+      _mm256_loadu_si256((const __m256i *)(a + x)),
+      _mm256_loadu_si256((const __m256i *)(b + x))));
+  }
+
+  convert_average_scalar(a + x, b + x, dst + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static void convert_interleave_avx2(const uint8_t *u, const uint8_t *v, uint8_t *dst, int n)
+{
+  int x = 0;
+
+  for (; x + 32 <= n; x += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(u + x));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(v + x));
+    __m256i lo = _mm256_unpacklo_epi8(a, b);
+    __m256i hi = _mm256_unpackhi_epi8(a, b);
+
+    _mm256_storeu_si256((__m256i *)(dst + x * 2), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i *)(dst + x * 2 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+
+  convert_interleave_scalar(u + x, v + x, dst + x * 2, n - x);
+}
+
+__attribute__((target("avx2")))
+static void convert_deinterleave_avx2(const uint8_t *src, uint8_t *u, uint8_t *v, int n)
+{
+  const __m256i mask = _mm256_set1_epi16(0x00FF);
+  int x = 0;
+
+  for (; x + 32 <= n; x += 32) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(src + x * 2));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(src + x * 2 + 32));
+    __m256i cb = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+    __m256i cr = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+    _mm256_storeu_si256((__m256i *)(u + x), _mm256_permute4x64_epi64(cb, CONVERT_AVX2_PACK_ORDER));
+    _mm256_storeu_si256((__m256i *)(v + x), _mm256_permute4x64_epi64(cr, CONVERT_AVX2_PACK_ORDER));
+  }
+
+  convert_deinterleave_scalar(src + x * 2, u + x, v + x, n - x);
+}
+
+// As `convert_store_rgb_sse4`, but VEX encoded to not mix it with the AVX2 code
+__attribute__((target("avx2")))
+static inline void convert_store_rgb_avx2(uint8_t *dst, __m128i r, __m128i g, __m128i b)
+{
+  for (int k = 0; k < 3; k++) {
+    __m128i out = _mm_or_si128(_mm_or_si128(
+      _mm_shuffle_epi8(r, CONVERT_LOAD_MASK(convert_rgb_pack_masks[k][0])),
+      _mm_shuffle_epi8(g, CONVERT_LOAD_MASK(convert_rgb_pack_masks[k][1]))),
+      _mm_shuffle_epi8(b, CONVERT_LOAD_MASK(convert_rgb_pack_masks[k][2])));
+    _mm_storeu_si128((__m128i *)(dst + k * 16), out);
+  }
+}
+
+// 16 pixels of 16 bits, as `convert_yuv_to_rgb16_sse4`
+__attribute__((target("avx2")))
+static inline void convert_yuv_to_rgb16_avx2(__m256i luma, __m256i cb, __m256i cr, __m256i *r, __m256i *g, __m256i *b)
+{
+  const __m256i round = _mm256_set1_epi16(32);
+
+  luma = _mm256_mullo_epi16(_mm256_sub_epi16(luma, _mm256_set1_epi16(16)), _mm256_set1_epi16(74));
+  cb = _mm256_sub_epi16(cb, _mm256_set1_epi16(128));
+  cr = _mm256_sub_epi16(cr, _mm256_set1_epi16(128));
+
+  *r = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cr, _mm256_set1_epi16(102)));
+  *g = _mm256_sub_epi16(luma, _mm256_add_epi16(_mm256_mullo_epi16(cb, _mm256_set1_epi16(25)), _mm256_mullo_epi16(cr, _mm256_set1_epi16(52))));
+  *b = _mm256_adds_epi16(luma, _mm256_mullo_epi16(cb, _mm256_set1_epi16(129)));
+
+  *r = _mm256_srai_epi16(_mm256_adds_epi16(*r, round), 6);
+  *g = _mm256_srai_epi16(_mm256_adds_epi16(*g, round), 6);
+  *b = _mm256_srai_epi16(_mm256_adds_epi16(*b, round), 6);
+}
+
+__attribute__((target("avx2")))
+static void convert_yuv_to_rgb_avx2(const uint8_t *y, const uint8_t *u, const uint8_t *v, uint8_t *dst, int width, bool bgr)
+{
+  int x = 0;
+
+  for (; x + 32 <= width; x += 32) {
+    __m128i cb = _mm_loadu_si128((const __m128i *)(u + x / 2));
+    __m128i cr = _mm_loadu_si128((const __m128i *)(v + x / 2));
+    __m128i cbs[2] = { _mm_unpacklo_epi8(cb, cb), _mm_unpackhi_epi8(cb, cb) };
+    __m128i crs[2] = { _mm_unpacklo_epi8(cr, cr), _mm_unpackhi_epi8(cr, cr) };
+    __m256i r[2], g[2], b[2];
+
+    for (int h = 0; h < 2; h++) {
+      convert_yuv_to_rgb16_avx2(
+        _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(y + x + h * 16))),
+        _mm256_cvtepu8_epi16(cbs[h]), _mm256_cvtepu8_epi16(crs[h]),
+        &r[h], &g[h], &b[h]);
+    }
+
+    __m256i r8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(r[0], r[1]), CONVERT_AVX2_PACK_ORDER);
+    __m256i g8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(g[0], g[1]), CONVERT_AVX2_PACK_ORDER);
+    __m256i b8 = _mm256_permute4x64_epi64(_mm256_packus_epi16(b[0], b[1]), CONVERT_AVX2_PACK_ORDER);
+
+    if (bgr) {
+      __m256i tmp = r8;
+      r8 = b8;
+      b8 = tmp;
+    }
+
+    convert_store_rgb_avx2(dst + x * 3,
+      _mm256_castsi256_si128(r8), _mm256_castsi256_si128(g8), _mm256_castsi256_si128(b8));
+    convert_store_rgb_avx2(dst + x * 3 + 48,
+      _mm256_extracti128_si256(r8, 1), _mm256_extracti128_si256(g8, 1), _mm256_extracti128_si256(b8, 1));
+  }
+
+  convert_yuv_to_rgb_scalar(y + x, u + x / 2, v + x / 2, dst + x * 3, width - x, bgr);
+}
+
+__attribute__((target("avx2")))
+static void convert_unpack10p_avx2(const uint8_t *src, uint8_t *dst, int width)
+{
+  const __m256i mask = _mm256_broadcastsi128_si256(CONVERT_LOAD_MASK(convert_unpack10p_mask));
+  const __m256i order = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+  int x = 0;
+
+  // 12 pixels of each lane, 32 bytes are written for 24 pixels
+  for (; x + 32 <= width; x += 24) {
+    const uint8_t *in = src + x / 4 * 5;
+    __m256i pixels = _mm256_set_m128i(
+      _mm_loadu_si128((const __m128i *)(in + 15)),
+      _mm_loadu_si128((const __m128i *)in));
+
+    pixels = _mm256_shuffle_epi8(pixels, mask);
+    _mm256_storeu_si256((__m256i *)(dst + x), _mm256_permutevar8x32_epi32(pixels, order));
+  }
+
+  convert_unpack10p_scalar(src + x / 4 * 5, dst + x, width - x);
+}
+
+__attribute__((target("avx2")))
+static void convert_unpack10p16_avx2(const uint8_t *src, uint16_t *dst, int width)
+{
+  const __m256i high_mask = _mm256_broadcastsi128_si256(CONVERT_LOAD_MASK(convert_unpack10p16_masks[0]));
+  const __m256i low_mask = _mm256_broadcastsi128_si256(CONVERT_LOAD_MASK(convert_unpack10p16_masks[1]));
+  const __m256i low_shift = _mm256_setr_epi16(64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1, 64, 16, 4, 1);
+  int x = 0;
+
+  // 8 pixels of each lane, the second one is read up to 26 bytes
+  for (; x + 24 <= width; x += 16) {
+    const uint8_t *in = src + x / 4 * 5;
+    __m256i pixels = _mm256_set_m128i(
+      _mm_loadu_si128((const __m128i *)(in + 10)),
+      _mm_loadu_si128((const __m128i *)in));
+
+    __m256i high = _mm256_shuffle_epi8(pixels, high_mask);
+    __m256i low = _mm256_mullo_epi16(_mm256_shuffle_epi8(pixels, low_mask), low_shift);
+    low = _mm256_and_si256(_mm256_srli_epi16(low, 6), _mm256_set1_epi16(3));
+
+    _mm256_storeu_si256((__m256i *)(dst + x), _mm256_or_si256(_mm256_slli_epi16(high, 2), low));
+  }
+
+  convert_unpack10p16_scalar(src + x / 4 * 5, dst + x, width - x);
+}
+
+// The RGB24 kernels are bound by the shuffles, that do not cross
+// the 128-bit lanes: the AVX2 ones would be the SSE4 ones twice
+const convert_kernels_t convert_kernels_avx2 = {
+  .simd = CONVERT_SIMD_AVX2,
+  .yuyv_split = convert_yuyv_split_avx2,
+  .yuyv_join = convert_yuyv_join_avx2,
+  .average = convert_average_avx2,
+  .interleave = convert_interleave_avx2,
+  .deinterleave = convert_deinterleave_avx2,
+  .yuv_to_rgb = convert_yuv_to_rgb_avx2,
+  .rgb_to_yuv = convert_rgb_to_yuv_sse4,
+  .rgb565_to_rgb = convert_rgb565_to_rgb_sse4,
+  .swap_rb = convert_swap_rb_sse4,
+  .unpack10p = convert_unpack10p_avx2,
+  .unpack10p16 = convert_unpack10p16_avx2
+};
+
+#endif // __SSE2__
@@ -13,6 +13,7 @@
 
 #include "http.h"
 #include "util/opts/log.h"
+#include "util/trace/trace.h"
 
 #define HEADER_RANGE "Range:"
 #define HEADER_CONTENT_LENGTH "Content-Length:"
@@ -222,6 +223,8 @@ static void http_client(http_worker_t *worker)
 
 static int http_worker(http_worker_t *worker)
 {
+  trace_thread_name(worker->name);
+
   while (1) {
     unsigned addrlen = sizeof(worker->client_addr);
     worker->client_fd = accept(worker->listen_fd, (struct sockaddr *)&worker->client_addr, &addrlen);
@@ -247,6 +250,11 @@ int http_server(http_server_options_t *options, http_method_t *methods)
 
   sigaction(SIGPIPE, &(struct sigaction){{ SIG_IGN }}, NULL);
 
+  if (http_client_start(options) < 0) {
+    close(listen_fd);
+    return -1;
+  }
+
   for (int worker = 0; worker < options->maxcons; worker++) {
     char name[20];
     sprintf(name, "HTTP%d/%d", options->port, worker);
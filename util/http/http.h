@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,7 +9,9 @@
 #include <netinet/ip.h>
 
 typedef struct buffer_s buffer_t;
+typedef struct buffer_lock_s buffer_lock_t;
 typedef struct http_worker_s http_worker_t;
+typedef struct http_client_s http_client_t;
 
 typedef void (*http_method_fn)(struct http_worker_s *worker, FILE *stream);
 typedef void *(*http_param_fn)(struct http_worker_s *worker, FILE *stream, const char *key, const char *value, void *opaque);
@@ -25,9 +28,16 @@ typedef struct http_method_s {
   unsigned *content_lengthp;
 } http_method_t;
 
+typedef int (*http_client_frame_fn)(http_client_t *client, buffer_t *buf, int frame, void *opaque);
+typedef void (*http_client_close_fn)(http_client_t *client, void *opaque);
+typedef void (*http_client_release_fn)(void *opaque);
+typedef int (*http_client_ready_fn)(http_client_t *client, bool timeout, void *opaque);
+
 typedef struct http_server_options_s {
   unsigned port;
   unsigned maxcons;
+  unsigned stream_threads;
+  bool zerocopy;
 } http_server_options_t;
 
 typedef struct http_worker_s {
@@ -53,6 +63,45 @@ typedef struct http_worker_s {
   http_method_t *current_method;
 } http_worker_t;
 
+typedef struct http_client_s {
+  char *name;
+  int fd;
+  struct http_poller_s *poller;
+
+  buffer_lock_t *buf_lock;
+  http_client_frame_fn frame_fn;
+  http_client_close_fn close_fn;
+  void *opaque;
+
+  // Held requests, without `buf_lock`
+  http_client_ready_fn ready_fn;
+  uint64_t deadline_us;
+  bool responded;
+
+  int counter;
+  int frames;
+  bool wrote;
+  bool closed;
+  unsigned events;
+  uint64_t start_us, last_buf_us, last_write_us;
+
+  // capture time of the frame being written, until its first and last byte is sent
+  uint64_t frame_captured_us;
+  bool frame_first_sent;
+  struct metrics_histogram_s *first_byte_histogram, *last_byte_histogram;
+
+  struct http_chunk_s *chunks, **chunks_tail;
+
+  // Chunks sent with MSG_ZEROCOPY, kept until completed by the kernel
+  bool zerocopy;
+  uint32_t zerocopy_next;
+  unsigned inflight_frames;
+  void *inflight_opaque; // of the last in-flight frame
+  uint64_t orphan_deadline_us;
+  struct http_chunk_s *inflight, **inflight_tail;
+  struct http_client_s *next;
+} http_client_t;
+
 int http_server(http_server_options_t *options, http_method_t *methods);
 void http_content(http_worker_t *worker, FILE *stream);
 void http_write_response(FILE *stream, const char *status, const char *content_type, const char *body, unsigned content_length);
@@ -63,3 +112,23 @@ void http_404(FILE *stream, const char *data);
 void http_500(FILE *stream, const char *data);
 void *http_enum_params(http_worker_t *worker, FILE *stream, http_param_fn fn, void *opaque);
 char *http_get_param(http_worker_t *worker, const char *key);
+
+// Streaming clients are served by a small number of epoll threads,
+// being fed with every new frame of the `buf_lock`
+int http_client_start(http_server_options_t *options);
+int http_client_attach(http_worker_t *worker, FILE *stream, buffer_lock_t *buf_lock, http_client_frame_fn frame_fn, http_client_close_fn close_fn, void *opaque);
+
+// The requests waiting for a resource are held by the epoll threads too,
+// `ready_fn` is called on every wake up until it writes the response (returning 1),
+// with `timeout` set once `timeout_us` elapsed
+int http_client_hold(http_worker_t *worker, FILE *stream, http_client_ready_fn ready_fn, http_client_close_fn close_fn, void *opaque, uint64_t timeout_us);
+void http_client_wake();
+
+int http_client_write(http_client_t *client, const void *data, size_t length);
+int http_client_printf(http_client_t *client, const char *fmt, ...);
+int http_client_write_buf(http_client_t *client, buffer_t *buf);
+int http_client_write_response(http_client_t *client, const char *status, const char *content_type, const char *body, unsigned content_length);
+
+// Queue `data` without copying it, `release` is called once it is no longer needed,
+// also on failure
+int http_client_write_ref(http_client_t *client, const void *data, size_t length, http_client_release_fn release, void *opaque);
@@ -0,0 +1,867 @@
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+#include "http.h"
+#include "device/buffer.h"
+#include "device/buffer_lock.h"
+#include "util/opts/log.h"
+#include "util/metrics/metrics.h"
+#include "util/trace/trace.h"
+
+#define HTTP_CLIENT_MAX_EVENTS 64
+#define HTTP_CLIENT_MAX_IOVS 64
+#define HTTP_CLIENT_POLL_MS 100
+#define HTTP_CLIENT_WRITE_TIMEOUT_US (3*1000*1000)
+#define HTTP_CLIENT_FRAME_TIMEOUT_US (DEFAULT_BUFFER_LOCK_GET_TIMEOUT*1000LL)
+#define HTTP_CLIENT_MAX_LOCKS 10
+#define HTTP_CLIENT_ZEROCOPY_MIN_SIZE (16*1024)
+#define HTTP_CLIENT_MAX_INFLIGHT_FRAMES 2
+#define HTTP_CLIENT_ORPHAN_TIMEOUT_US (3*1000*1000)
+
+typedef struct http_chunk_s {
+  struct iovec iov;
+  http_client_release_fn release;
+  void *opaque;
+  bool zerocopy;
+  bool counted; // the first in-flight chunk of a frame
+  uint32_t zerocopy_id;
+  struct http_chunk_s *next;
+  char data[];
+} http_chunk_t;
+
+typedef struct http_poller_s {
+  char *name;
+  pthread_t thread;
+  int epoll_fd;
+  int wake_fd;
+
+  pthread_mutex_t lock;
+  http_client_t *pending;
+  http_client_t *clients;
+
+  // Closed clients, whose zerocopy chunks are still held by the kernel
+  http_client_t *orphans;
+} http_poller_t;
+
+static http_poller_t *http_pollers;
+static unsigned http_npollers;
+static unsigned http_next_poller;
+static bool http_zerocopy;
+
+static pthread_mutex_t http_locks_lock = PTHREAD_MUTEX_INITIALIZER;
+static buffer_lock_t *http_locks[HTTP_CLIENT_MAX_LOCKS];
+static int http_nlocks;
+
+static void http_poller_wake(http_poller_t *poller)
+{
+  uint64_t value = 1;
+  if (write(poller->wake_fd, &value, sizeof(value)) < 0) {
+    LOG_DEBUG(poller, "Failed to wake: errno=%d", errno);
+  }
+}
+
+static bool http_client_register_lock(buffer_lock_t *buf_lock)
+{
+  bool ret = true;
+
+  pthread_mutex_lock(&http_locks_lock);
+  for (int i = 0; i < http_nlocks; i++) {
+    if (http_locks[i] == buf_lock)
+      goto unlock;
+  }
+
+  // Every poller is woken by the lock directly through its eventfd
+  for (unsigned i = 0; ret && i < http_npollers; i++) {
+    ret = buffer_lock_register_notify_fd(buf_lock, http_pollers[i].wake_fd);
+  }
+
+  ret = ret && ARRAY_APPEND(http_locks, http_nlocks, buf_lock);
+
+unlock:
+  pthread_mutex_unlock(&http_locks_lock);
+  return ret;
+}
+
+static void http_client_set_events(http_client_t *client, unsigned events)
+{
+  if (client->events == events)
+    return;
+
+  struct epoll_event ev = {
+    .events = events,
+    .data.ptr = client
+  };
+
+  epoll_ctl(client->poller->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev);
+  client->events = events;
+}
+
+static void http_client_free_chunk(http_chunk_t *chunk)
+{
+  if (chunk->release) {
+    chunk->release(chunk->opaque);
+  }
+  free(chunk);
+}
+
+static void http_client_free_chunks(http_chunk_t **chunks)
+{
+  while (*chunks) {
+    http_chunk_t *chunk = *chunks;
+    *chunks = chunk->next;
+    http_client_free_chunk(chunk);
+  }
+}
+
+static void http_client_free(http_client_t *client)
+{
+  if (client->fd >= 0) {
+    if (client->orphan_deadline_us) {
+      epoll_ctl(client->poller->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+    }
+
+    // Reset the connection to drop the send queue still pointing to the chunks,
+    // otherwise the buffers could be re-filled with a newer frame while being sent
+    if (client->inflight) {
+      struct linger linger = { .l_onoff = 1, .l_linger = 0 };
+      setsockopt(client->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
+
+    close(client->fd);
+  }
+
+  http_client_free_chunks(&client->inflight);
+  free(client->name);
+  free(client);
+}
+
+static void http_client_orphan(http_client_t *client, uint64_t now_us)
+{
+  http_poller_t *poller = client->poller;
+
+  // The kernel still sends the queued data, and reports the completions
+  // on the error queue: edge-triggered, as the socket stays hung up
+  struct epoll_event ev = {
+    .events = EPOLLET,
+    .data.ptr = client
+  };
+
+  shutdown(client->fd, SHUT_WR);
+  client->orphan_deadline_us = now_us + HTTP_CLIENT_ORPHAN_TIMEOUT_US;
+
+  if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) < 0) {
+    http_client_free(client);
+    return;
+  }
+
+  client->events = ev.events;
+  client->next = poller->orphans;
+  poller->orphans = client;
+}
+
+static void http_client_close(http_client_t *client, uint64_t now_us)
+{
+  // The orphans stay registered, to receive the zerocopy completions
+  if (!client->inflight) {
+    epoll_ctl(client->poller->epoll_fd, EPOLL_CTL_DEL, client->fd, NULL);
+  }
+
+  http_client_free_chunks(&client->chunks);
+
+  if (client->close_fn) {
+    client->close_fn(client, client->opaque);
+  }
+
+  if (!client->wrote) {
+    FILE *stream = fdopen(client->fd, "w");
+    if (stream) {
+      client->fd = -1; // ownership taken by stream
+      http_500(stream, NULL);
+      fprintf(stream, "No frames.\n");
+      fclose(stream);
+    }
+  }
+
+  if (client->buf_lock) {
+    buffer_lock_use(client->buf_lock, -1);
+    LOG_INFO(client, "Client disconnected after %d frames.", client->frames);
+  }
+
+  if (client->inflight && client->fd >= 0) {
+    http_client_orphan(client, now_us);
+  } else {
+    http_client_free(client);
+  }
+}
+
+static void http_client_sent_chunk(http_client_t *client, http_chunk_t *chunk)
+{
+  if (!chunk->zerocopy) {
+    http_client_free_chunk(chunk);
+    return;
+  }
+
+  // The consecutive chunks of the same frame (like the part header and payload)
+  // share the `opaque`, and hold the buffer once
+  chunk->counted = chunk->release && chunk->opaque != client->inflight_opaque;
+  if (chunk->counted) {
+    client->inflight_frames++;
+    client->inflight_opaque = chunk->opaque;
+  }
+
+  chunk->next = NULL;
+  *client->inflight_tail = chunk;
+  client->inflight_tail = &chunk->next;
+}
+
+static int http_client_flush(http_client_t *client)
+{
+  uint64_t now_us = get_monotonic_time_us(NULL, NULL);
+
+  while (client->chunks) {
+    struct iovec iovs[HTTP_CLIENT_MAX_IOVS];
+    int n = 0;
+    int flags = MSG_NOSIGNAL;
+
+    for (http_chunk_t *chunk = client->chunks; chunk && n < HTTP_CLIENT_MAX_IOVS; chunk = chunk->next) {
+      if (client->zerocopy && chunk->iov.iov_base != chunk->data && chunk->iov.iov_len >= HTTP_CLIENT_ZEROCOPY_MIN_SIZE) {
+        flags |= MSG_ZEROCOPY;
+      }
+      iovs[n++] = chunk->iov;
+    }
+
+    struct msghdr msg = {
+      .msg_iov = iovs,
+      .msg_iovlen = n
+    };
+
+    uint64_t trace = trace_begin();
+    ssize_t ret = sendmsg(client->fd, &msg, flags);
+    trace_end(trace, "sendmsg", client->buf_lock ? client->buf_lock->name : NULL);
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)) {
+      http_client_set_events(client, EPOLLIN | EPOLLRDHUP | EPOLLOUT);
+      return 0;
+    } else if (ret < 0 && errno == EFAULT && (flags & MSG_ZEROCOPY)) {
+      // The pages cannot be pinned (like the V4L2 dma-contig mmaps), send them copied
+      LOG_INFO(client, "Cannot send with MSG_ZEROCOPY, disabling.");
+      client->zerocopy = false;
+      continue;
+    } else if (ret < 0) {
+      LOG_DEBUG(client, "Failed to write: errno=%d", errno);
+      return -1;
+    }
+
+    client->last_write_us = now_us;
+
+    if (client->frame_captured_us && !client->frame_first_sent && ret > 0) {
+      metrics_histogram_record_us(client->first_byte_histogram, now_us - client->frame_captured_us);
+      client->frame_first_sent = true;
+    }
+
+    // Each successful zerocopy call is identified by the next sequential id,
+    // the chunk is owned by the kernel until the last call touching it completes
+    if (flags & MSG_ZEROCOPY) {
+      uint32_t id = client->zerocopy_next++;
+
+      size_t sent = ret;
+      for (http_chunk_t *chunk = client->chunks; chunk && sent > 0; chunk = chunk->next) {
+        chunk->zerocopy = true;
+        chunk->zerocopy_id = id;
+        sent -= MIN(sent, chunk->iov.iov_len);
+      }
+    }
+
+    while (client->chunks && ret >= client->chunks->iov.iov_len) {
+      http_chunk_t *chunk = client->chunks;
+      ret -= chunk->iov.iov_len;
+      client->chunks = chunk->next;
+      http_client_sent_chunk(client, chunk);
+    }
+
+    if (client->chunks && ret > 0) {
+      client->chunks->iov.iov_base = (char*)client->chunks->iov.iov_base + ret;
+      client->chunks->iov.iov_len -= ret;
+    }
+  }
+
+  client->chunks_tail = &client->chunks;
+  http_client_set_events(client, EPOLLIN | EPOLLRDHUP);
+
+  if (client->frame_captured_us) {
+    metrics_histogram_record_us(client->last_byte_histogram, now_us - client->frame_captured_us);
+    client->frame_captured_us = 0;
+  }
+  return 0;
+}
+
+static void http_client_complete(http_client_t *client, uint32_t hi)
+{
+  // TCP completes zerocopy calls in order, so the range is cumulative
+  while (client->inflight && (int32_t)(client->inflight->zerocopy_id - hi) <= 0) {
+    http_chunk_t *chunk = client->inflight;
+    client->inflight = chunk->next;
+    if (chunk->counted && client->inflight && client->inflight->opaque == chunk->opaque) {
+      client->inflight->counted = true;
+    } else if (chunk->counted) {
+      client->inflight_frames--;
+    }
+    http_client_free_chunk(chunk);
+  }
+
+  if (!client->inflight) {
+    client->inflight_tail = &client->inflight;
+    client->inflight_opaque = NULL;
+  }
+}
+
+static int http_client_read_errqueue(http_client_t *client)
+{
+  while (1) {
+    char control[128];
+    struct msghdr msg = {
+      .msg_control = control,
+      .msg_controllen = sizeof(control)
+    };
+
+    if (recvmsg(client->fd, &msg, MSG_ERRQUEUE) < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return -1;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+        !(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+        continue;
+      }
+
+      struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+      if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno != 0) {
+        return -1;
+      }
+
+      // The kernel had to copy the data anyway (like on loopback): zerocopy only adds overhead
+      if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+        client->zerocopy = false;
+      }
+
+      http_client_complete(client, serr->ee_data);
+    }
+  }
+
+  int error = 0;
+  socklen_t len = sizeof(error);
+  if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error) {
+    return -1;
+  }
+
+  return 0;
+}
+
+static int http_client_read(http_client_t *client)
+{
+  char data[BUFSIZE];
+
+  // The request was already consumed, anything else is ignored
+  while (1) {
+    ssize_t ret = read(client->fd, data, sizeof(data));
+    if (ret > 0)
+      continue;
+    if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return 0;
+    return -1;
+  }
+}
+
+// The held request is closed once its response is written
+static int http_client_feed_held(http_client_t *client, uint64_t now_us)
+{
+  if (!client->responded) {
+    int ret = client->ready_fn(client, now_us >= client->deadline_us, client->opaque);
+    if (ret <= 0) {
+      return ret;
+    }
+
+    client->responded = true;
+    if (http_client_flush(client) < 0) {
+      return -1;
+    }
+  }
+
+  if (client->chunks) {
+    if (now_us - client->last_write_us > HTTP_CLIENT_WRITE_TIMEOUT_US) {
+      LOG_DEBUG(client, "Write timeout elapsed.");
+      return -1;
+    }
+    return 0;
+  }
+
+  return -1;
+}
+
+static int http_client_feed(http_client_t *client, uint64_t now_us)
+{
+  if (client->ready_fn) {
+    return http_client_feed_held(client, now_us);
+  }
+
+  // Do not queue more if the client is still busy writing the previous frame,
+  // or the kernel still holds too many buffers, to not starve the device
+  if (client->chunks || client->inflight_frames >= HTTP_CLIENT_MAX_INFLIGHT_FRAMES) {
+    if (now_us - client->last_write_us > HTTP_CLIENT_WRITE_TIMEOUT_US) {
+      LOG_DEBUG(client, "Write timeout elapsed.");
+      return -1;
+    }
+    return 0;
+  }
+
+  buffer_t *buf = buffer_lock_get_next(client->buf_lock, &client->counter);
+
+  if (!buf) {
+    uint64_t last_us = MAX(client->last_buf_us, client->last_write_us);
+    if (now_us - last_us > HTTP_CLIENT_FRAME_TIMEOUT_US) {
+      LOG_DEBUG(client, "Timeout getting frame elapsed.");
+      return -1;
+    }
+    return 0;
+  }
+
+  client->last_buf_us = now_us;
+
+  uint64_t captured_time_us = buf->captured_time_us;
+  uint64_t trace = trace_begin();
+  int ret = client->frame_fn(client, buf, client->frames, client->opaque);
+  trace_end(trace, "frame", client->buf_lock->name);
+  buffer_consumed(buf, "http-client");
+
+  if (ret > 0) {
+    client->frames++;
+    client->frame_captured_us = captured_time_us;
+    client->frame_first_sent = false;
+  } else if (ret < 0) {
+    return -1;
+  } else if (!client->frames && now_us - client->start_us > HTTP_CLIENT_FRAME_TIMEOUT_US) {
+    LOG_DEBUG(client, "Deadline getting frame elapsed.");
+    return -1;
+  }
+
+  return http_client_flush(client);
+}
+
+static void http_poller_add_pending(http_poller_t *poller)
+{
+  pthread_mutex_lock(&poller->lock);
+  http_client_t *pending = poller->pending;
+  poller->pending = NULL;
+  pthread_mutex_unlock(&poller->lock);
+
+  while (pending) {
+    http_client_t *client = pending;
+    pending = client->next;
+
+    struct epoll_event ev = {
+      .events = client->events,
+      .data.ptr = client
+    };
+
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_ADD, client->fd, &ev) < 0) {
+      LOG_INFO(client, "Cannot add to epoll: errno=%d", errno);
+      client->events = 0;
+      http_client_close(client, 0);
+      continue;
+    }
+
+    client->next = poller->clients;
+    poller->clients = client;
+  }
+}
+
+static void http_poller_process(http_poller_t *poller)
+{
+  uint64_t now_us = get_monotonic_time_us(NULL, NULL);
+
+  for (http_client_t **clientp = &poller->clients; *clientp; ) {
+    http_client_t *client = *clientp;
+
+    if (!client->closed && http_client_feed(client, now_us) == 0) {
+      clientp = &client->next;
+      continue;
+    }
+
+    *clientp = client->next;
+    http_client_close(client, now_us);
+  }
+
+  // The orphans are released once completed, or reset after the timeout
+  for (http_client_t **clientp = &poller->orphans; *clientp; ) {
+    http_client_t *client = *clientp;
+
+    if (client->inflight && now_us < client->orphan_deadline_us) {
+      clientp = &client->next;
+      continue;
+    }
+
+    *clientp = client->next;
+    http_client_free(client);
+  }
+}
+
+static void *http_poller_thread(http_poller_t *poller)
+{
+  struct epoll_event events[HTTP_CLIENT_MAX_EVENTS];
+
+  trace_thread_name(poller->name);
+
+  while (1) {
+    uint64_t trace = trace_begin();
+    int n = epoll_wait(poller->epoll_fd, events, HTTP_CLIENT_MAX_EVENTS, HTTP_CLIENT_POLL_MS);
+    trace_end(trace, "poll", NULL);
+    if (n < 0 && errno != EINTR) {
+      LOG_INFO(poller, "epoll_wait failed: errno=%d", errno);
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      http_client_t *client = events[i].data.ptr;
+
+      if (!client) {
+        uint64_t value;
+        if (read(poller->wake_fd, &value, sizeof(value)) < 0) {
+          LOG_DEBUG(poller, "Failed to read wake: errno=%d", errno);
+        }
+        continue;
+      }
+
+      if (client->orphan_deadline_us) {
+        if (http_client_read_errqueue(client) < 0) {
+          client->orphan_deadline_us = 1;
+        }
+        continue;
+      } else if (client->closed) {
+        continue;
+      } else if (events[i].events & EPOLLHUP) {
+        client->closed = true;
+      } else if ((events[i].events & EPOLLERR) && http_client_read_errqueue(client) < 0) {
+        client->closed = true;
+      } else if ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && http_client_read(client) < 0) {
+        client->closed = true;
+      } else if ((events[i].events & EPOLLOUT) && http_client_flush(client) < 0) {
+        client->closed = true;
+      }
+    }
+
+    http_poller_add_pending(poller);
+    http_poller_process(poller);
+  }
+
+  return NULL;
+}
+
+static void http_pollers_free(http_poller_t *pollers, unsigned npollers, unsigned nthreads)
+{
+  // The threads have no clients yet, as the pollers are not published
+  for (unsigned i = 0; i < nthreads; i++) {
+    pthread_cancel(pollers[i].thread);
+    pthread_join(pollers[i].thread, NULL);
+  }
+
+  for (unsigned i = 0; i < npollers; i++) {
+    if (pollers[i].epoll_fd >= 0)
+      close(pollers[i].epoll_fd);
+    if (pollers[i].wake_fd >= 0)
+      close(pollers[i].wake_fd);
+    pthread_mutex_destroy(&pollers[i].lock);
+    free(pollers[i].name);
+  }
+
+  free(pollers);
+}
+
+int http_client_start(http_server_options_t *options)
+{
+  if (http_pollers) {
+    return 0;
+  }
+
+  unsigned npollers = MAX(options->stream_threads, 1);
+  unsigned nthreads = 0;
+  http_poller_t *pollers = calloc(npollers, sizeof(http_poller_t));
+
+  for (unsigned i = 0; i < npollers; i++) {
+    pollers[i].epoll_fd = pollers[i].wake_fd = -1;
+    pthread_mutex_init(&pollers[i].lock, NULL);
+  }
+
+  for (unsigned i = 0; i < npollers; i++) {
+    http_poller_t *poller = &pollers[i];
+    char name[32];
+    sprintf(name, "HTTP%d/stream%d", options->port, i);
+
+    poller->name = strdup(name);
+    poller->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    poller->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (poller->epoll_fd < 0 || poller->wake_fd < 0) {
+      LOG_ERROR(poller, "Cannot create epoll: errno=%d", errno);
+    }
+
+    struct epoll_event ev = {
+      .events = EPOLLIN,
+      .data.ptr = NULL
+    };
+
+    if (epoll_ctl(poller->epoll_fd, EPOLL_CTL_ADD, poller->wake_fd, &ev) < 0) {
+      LOG_ERROR(poller, "Cannot add wake fd: errno=%d", errno);
+    }
+  }
+
+  for ( ; nthreads < npollers; nthreads++) {
+    int ret = pthread_create(&pollers[nthreads].thread, NULL, (void *(*)(void*))http_poller_thread, &pollers[nthreads]);
+    if (ret) {
+      LOG_ERROR(&pollers[nthreads], "Cannot create thread: error=%d", ret);
+    }
+  }
+
+  http_zerocopy = options->zerocopy;
+  http_npollers = npollers;
+  http_pollers = pollers;
+  return 0;
+
+error:
+  http_pollers_free(pollers, npollers, nthreads);
+  return -1;
+}
+
+static http_client_t *http_client_new(http_worker_t *worker, FILE *stream, http_client_close_fn close_fn, void *opaque)
+{
+  if (fflush(stream) != 0) {
+    return NULL;
+  }
+
+  // The `stream` is closed by the worker, the client owns a copy of the socket
+  int fd = fcntl(fileno(stream), F_DUPFD_CLOEXEC, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  http_poller_t *poller = &http_pollers[__atomic_fetch_add(&http_next_poller, 1, __ATOMIC_RELAXED) % http_npollers];
+  uint64_t now_us = get_monotonic_time_us(NULL, NULL);
+
+  http_client_t *client = calloc(1, sizeof(http_client_t));
+  asprintf(&client->name, "%s/%s:%d", poller->name, worker->client_host ? worker->client_host : "?", fd);
+  client->fd = fd;
+  client->poller = poller;
+  client->close_fn = close_fn;
+  client->opaque = opaque;
+  client->events = EPOLLIN | EPOLLRDHUP;
+  client->start_us = client->last_buf_us = client->last_write_us = now_us;
+  client->chunks_tail = &client->chunks;
+  client->inflight_tail = &client->inflight;
+
+  int on = 1;
+  if (http_zerocopy && setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0) {
+    client->zerocopy = true;
+  }
+
+  return client;
+}
+
+static void http_client_add(http_client_t *client)
+{
+  http_poller_t *poller = client->poller;
+
+  pthread_mutex_lock(&poller->lock);
+  client->next = poller->pending;
+  poller->pending = client;
+  pthread_mutex_unlock(&poller->lock);
+
+  http_poller_wake(poller);
+}
+
+int http_client_attach(http_worker_t *worker, FILE *stream, buffer_lock_t *buf_lock, http_client_frame_fn frame_fn, http_client_close_fn close_fn, void *opaque)
+{
+  if (!http_pollers || !http_client_register_lock(buf_lock)) {
+    return -1;
+  }
+
+  http_client_t *client = http_client_new(worker, stream, close_fn, opaque);
+  if (!client) {
+    return -1;
+  }
+
+  client->buf_lock = buf_lock;
+  client->frame_fn = frame_fn;
+  client->first_byte_histogram = metrics_histogram("first_byte", buf_lock->name);
+  client->last_byte_histogram = metrics_histogram("last_byte", buf_lock->name);
+
+  buffer_lock_use(buf_lock, 1);
+
+  LOG_INFO(client, "Client streaming '%s' from %s.", worker->request_uri, buf_lock->name);
+
+  http_client_add(client);
+  return 0;
+}
+
+int http_client_hold(http_worker_t *worker, FILE *stream, http_client_ready_fn ready_fn, http_client_close_fn close_fn, void *opaque, uint64_t timeout_us)
+{
+  if (!http_pollers) {
+    return -1;
+  }
+
+  http_client_t *client = http_client_new(worker, stream, close_fn, opaque);
+  if (!client) {
+    return -1;
+  }
+
+  client->ready_fn = ready_fn;
+  client->deadline_us = client->start_us + timeout_us;
+
+  LOG_DEBUG(client, "Client holding '%s'.", worker->request_uri);
+
+  http_client_add(client);
+  return 0;
+}
+
+void http_client_wake()
+{
+  for (unsigned i = 0; i < http_npollers; i++) {
+    http_poller_wake(&http_pollers[i]);
+  }
+}
+
+static http_chunk_t *http_client_append(http_client_t *client, size_t length)
+{
+  http_chunk_t *chunk = malloc(sizeof(http_chunk_t) + length);
+  if (!chunk) {
+    return NULL;
+  }
+
+  chunk->iov.iov_base = chunk->data;
+  chunk->iov.iov_len = length;
+  chunk->release = NULL;
+  chunk->opaque = NULL;
+  chunk->zerocopy = false;
+  chunk->counted = false;
+  chunk->next = NULL;
+  *client->chunks_tail = chunk;
+  client->chunks_tail = &chunk->next;
+  client->wrote = true;
+  return chunk;
+}
+
+int http_client_write(http_client_t *client, const void *data, size_t length)
+{
+  if (!length) {
+    return 0;
+  }
+
+  http_chunk_t *chunk = http_client_append(client, length);
+  if (!chunk) {
+    return -1;
+  }
+
+  memcpy(chunk->data, data, length);
+  return length;
+}
+
+int http_client_printf(http_client_t *client, const char *fmt, ...)
+{
+  va_list arg;
+  va_start(arg, fmt);
+
+  char *body = NULL;
+  int n = vasprintf(&body, fmt, arg);
+  va_end(arg);
+
+  if (n < 0) {
+    return -1;
+  }
+
+  n = http_client_write(client, body, n);
+  free(body);
+  return n;
+}
+
+// Same as `http_write_response`, on the client
+int http_client_write_response(http_client_t *client, const char *status, const char *content_type, const char *body, unsigned content_length)
+{
+  char length_header[64] = "";
+
+  if (content_length == 0 && body)
+    content_length = strlen(body);
+  if (content_length > 0)
+    sprintf(length_header, "Content-Length: %u\r\n", content_length);
+  if (!status)
+    status = "200 OK";
+
+  if (http_client_printf(client, "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s%s\r\n",
+    status, content_type ? content_type : "text/plain", length_header,
+    strstr(status, "200 OK") == status ? "Access-Control-Allow-Origin: *\r\n" : "") < 0) {
+    return -1;
+  }
+
+  if (body && http_client_write(client, body, content_length) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int http_client_write_ref(http_client_t *client, const void *data, size_t length, http_client_release_fn release, void *opaque)
+{
+  if (!length) {
+    if (release) {
+      release(opaque);
+    }
+    return 0;
+  }
+
+  http_chunk_t *chunk = http_client_append(client, 0);
+  if (!chunk) {
+    if (release) {
+      release(opaque);
+    }
+    return -1;
+  }
+
+  chunk->iov.iov_base = (void*)data;
+  chunk->iov.iov_len = length;
+  chunk->release = release;
+  chunk->opaque = opaque;
+  return length;
+}
+
+static void http_client_release_buf(void *opaque)
+{
+  buffer_consumed(opaque, "http-client");
+}
+
+int http_client_write_buf(http_client_t *client, buffer_t *buf)
+{
+  if (!buf->used) {
+    return 0;
+  }
+
+  // The payload is written directly from the mapped buffer, keep it referenced until sent
+  if (!buffer_use(buf)) {
+    return -1;
+  }
+
+  return http_client_write_ref(client, buf->start, buf->used, http_client_release_buf, buf);
+}
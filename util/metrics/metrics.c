@@ -0,0 +1,172 @@
+#include "metrics.h"
+#include "util/opts/log.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+
+#define METRICS_PROMETHEUS_MIN_LE 6 // 64us
+#define METRICS_PROMETHEUS_MAX_LE 24 // ~16.8s
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static metrics_histogram_t *metrics_histograms[METRICS_MAX_HISTOGRAMS];
+static int metrics_nhistograms;
+
+static const double metrics_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+// The values below `2 * METRICS_SUB_BUCKETS` are exact,
+// above they are split into `METRICS_SUB_BUCKETS` per power of two
+static int metrics_bucket_index(uint64_t value_us)
+{
+  if (value_us < 2 * METRICS_SUB_BUCKETS) {
+    return value_us;
+  }
+
+  value_us = MIN(value_us, (2ULL << METRICS_MAX_EXPONENT) - 1);
+
+  int exponent = 63 - __builtin_clzll(value_us);
+  int sub = (value_us >> (exponent - METRICS_SUB_BUCKETS_BITS)) & (METRICS_SUB_BUCKETS - 1);
+  return (exponent - METRICS_SUB_BUCKETS_BITS + 1) * METRICS_SUB_BUCKETS + sub;
+}
+
+// The exclusive upper bound of the bucket
+static uint64_t metrics_bucket_limit_us(int index)
+{
+  if (index < 2 * METRICS_SUB_BUCKETS) {
+    return index + 1;
+  }
+
+  int exponent = index / METRICS_SUB_BUCKETS + METRICS_SUB_BUCKETS_BITS - 1;
+  int sub = index % METRICS_SUB_BUCKETS;
+  return (uint64_t)(METRICS_SUB_BUCKETS + sub + 1) << (exponent - METRICS_SUB_BUCKETS_BITS);
+}
+
+metrics_histogram_t *metrics_histogram(const char *stage, const char *source)
+{
+  metrics_histogram_t *histogram = NULL;
+
+  pthread_mutex_lock(&metrics_lock);
+  for (int i = 0; i < metrics_nhistograms; i++) {
+    if (!strcmp(metrics_histograms[i]->stage, stage) && !strcmp(metrics_histograms[i]->source, source)) {
+      histogram = metrics_histograms[i];
+      goto unlock;
+    }
+  }
+
+  if (metrics_nhistograms >= METRICS_MAX_HISTOGRAMS) {
+    LOG_INFO(NULL, "Too many histograms, ignoring: %s/%s", stage, source);
+    goto unlock;
+  }
+
+  histogram = calloc(1, sizeof(metrics_histogram_t));
+  histogram->stage = strdup(stage);
+  histogram->source = strdup(source);
+
+  // Readers do not take the lock, publish the histogram before the count
+  metrics_histograms[metrics_nhistograms] = histogram;
+  __atomic_store_n(&metrics_nhistograms, metrics_nhistograms + 1, __ATOMIC_RELEASE);
+
+unlock:
+  pthread_mutex_unlock(&metrics_lock);
+  return histogram;
+}
+
+void metrics_histogram_record_us(metrics_histogram_t *histogram, int64_t value_us)
+{
+  if (!histogram) {
+    return;
+  }
+
+  // the timestamps of some devices might be slightly ahead
+  value_us = MAX(value_us, 0);
+
+  __atomic_add_fetch(&histogram->buckets[metrics_bucket_index(value_us)], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&histogram->sum_us, value_us, __ATOMIC_RELAXED);
+}
+
+// Takes a copy of the buckets, and returns their count
+static uint64_t metrics_histogram_snapshot(metrics_histogram_t *histogram, uint64_t *buckets)
+{
+  uint64_t count = 0;
+
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    buckets[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+    count += buckets[i];
+  }
+
+  return count;
+}
+
+static uint64_t metrics_buckets_quantile_us(const uint64_t *buckets, uint64_t count, double quantile)
+{
+  uint64_t rank = quantile * count;
+  uint64_t total = 0;
+
+  for (int i = 0; i < METRICS_BUCKETS; i++) {
+    total += buckets[i];
+    if (total > rank) {
+      return metrics_bucket_limit_us(i) - 1;
+    }
+  }
+
+  return 0;
+}
+
+static void metrics_write_histogram(FILE *stream, metrics_histogram_t *histogram)
+{
+  uint64_t buckets[METRICS_BUCKETS];
+  uint64_t count = metrics_histogram_snapshot(histogram, buckets);
+  uint64_t total = 0;
+  int index = 0;
+
+  // The power of two bounds match the bounds of the buckets
+  for (int exponent = METRICS_PROMETHEUS_MIN_LE; exponent <= METRICS_PROMETHEUS_MAX_LE; exponent++) {
+    for (; index < METRICS_BUCKETS && metrics_bucket_limit_us(index) <= (1ULL << exponent); index++) {
+      total += buckets[index];
+    }
+
+    fprintf(stream, "camera_streamer_stage_latency_seconds_bucket{stage=\"%s\",source=\"%s\",le=\"%.9g\"} %" PRIu64 "\n",
+      histogram->stage, histogram->source, (1ULL << exponent) / 1e6, total);
+  }
+
+  fprintf(stream, "camera_streamer_stage_latency_seconds_bucket{stage=\"%s\",source=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+    histogram->stage, histogram->source, count);
+  // The sum grows without limit, it is printed exactly from the microseconds
+  uint64_t sum_us = __atomic_load_n(&histogram->sum_us, __ATOMIC_RELAXED);
+  fprintf(stream, "camera_streamer_stage_latency_seconds_sum{stage=\"%s\",source=\"%s\"} %" PRIu64 ".%06" PRIu64 "\n",
+    histogram->stage, histogram->source, sum_us / 1000000, sum_us % 1000000);
+  fprintf(stream, "camera_streamer_stage_latency_seconds_count{stage=\"%s\",source=\"%s\"} %" PRIu64 "\n",
+    histogram->stage, histogram->source, count);
+}
+
+static void metrics_write_quantiles(FILE *stream, metrics_histogram_t *histogram)
+{
+  uint64_t buckets[METRICS_BUCKETS];
+  uint64_t count = metrics_histogram_snapshot(histogram, buckets);
+
+  if (!count) {
+    return;
+  }
+
+  for (int i = 0; i < ARRAY_SIZE(metrics_quantiles); i++) {
+    fprintf(stream, "camera_streamer_stage_latency_quantile_seconds{stage=\"%s\",source=\"%s\",quantile=\"%g\"} %g\n",
+      histogram->stage, histogram->source, metrics_quantiles[i],
+      metrics_buckets_quantile_us(buckets, count, metrics_quantiles[i]) / 1e6);
+  }
+}
+
+void metrics_write_prometheus(FILE *stream)
+{
+  int n = __atomic_load_n(&metrics_nhistograms, __ATOMIC_ACQUIRE);
+
+  fprintf(stream, "# HELP camera_streamer_stage_latency_seconds Time since the capture of the frame, when it reached the stage.\n");
+  fprintf(stream, "# TYPE camera_streamer_stage_latency_seconds histogram\n");
+  for (int i = 0; i < n; i++) {
+    metrics_write_histogram(stream, metrics_histograms[i]);
+  }
+
+  fprintf(stream, "# HELP camera_streamer_stage_latency_quantile_seconds The quantiles of camera_streamer_stage_latency_seconds, since the start.\n");
+  fprintf(stream, "# TYPE camera_streamer_stage_latency_quantile_seconds gauge\n");
+  for (int i = 0; i < n; i++) {
+    metrics_write_quantiles(stream, metrics_histograms[i]);
+  }
+}
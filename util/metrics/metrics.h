@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Log-linear histogram of latencies in microseconds: every power of two
+// is split into 8 buckets, so each is recorded with at most 12.5% error.
+// Recording is lock-free, the histograms are never freed.
+
+#define METRICS_SUB_BUCKETS_BITS 3
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BUCKETS_BITS)
+#define METRICS_MAX_EXPONENT 36 // ~19h
+#define METRICS_BUCKETS ((METRICS_MAX_EXPONENT - METRICS_SUB_BUCKETS_BITS + 2) * METRICS_SUB_BUCKETS)
+#define METRICS_MAX_HISTOGRAMS 128
+
+typedef struct metrics_histogram_s {
+  const char *stage;
+  const char *source;
+
+  uint64_t sum_us;
+  uint64_t buckets[METRICS_BUCKETS];
+} metrics_histogram_t;
+
+// Finds or creates the histogram of `stage` for `source`, or returns NULL if full
+metrics_histogram_t *metrics_histogram(const char *stage, const char *source);
+void metrics_histogram_record_us(metrics_histogram_t *histogram, int64_t value_us);
+
+// Writes all histograms in the Prometheus text format
+void metrics_write_prometheus(FILE *stream);
@@ -0,0 +1,149 @@
+#include "mux.h"
+#include "util/opts/log.h"
+
+// Matroska of unknown size, as streamed live: the frames are each written
+// as a `Cluster` with a single `SimpleBlock`
+
+#define MKV_EBML 0x1A45DFA3
+#define MKV_EBML_VERSION 0x4286
+#define MKV_EBML_READ_VERSION 0x42F7
+#define MKV_EBML_MAX_ID_LENGTH 0x42F2
+#define MKV_EBML_MAX_SIZE_LENGTH 0x42F3
+#define MKV_DOC_TYPE 0x4282
+#define MKV_DOC_TYPE_VERSION 0x4287
+#define MKV_DOC_TYPE_READ_VERSION 0x4285
+#define MKV_SEGMENT 0x18538067
+#define MKV_INFO 0x1549A966
+#define MKV_TIMESTAMP_SCALE 0x2AD7B1
+#define MKV_MUXING_APP 0x4D80
+#define MKV_WRITING_APP 0x5741
+#define MKV_TRACKS 0x1654AE6B
+#define MKV_TRACK_ENTRY 0xAE
+#define MKV_TRACK_NUMBER 0xD7
+#define MKV_TRACK_UID 0x73C5
+#define MKV_TRACK_TYPE 0x83
+#define MKV_FLAG_LACING 0x9C
+#define MKV_CODEC_ID 0x86
+#define MKV_CODEC_PRIVATE 0x63A2
+#define MKV_VIDEO 0xE0
+#define MKV_PIXEL_WIDTH 0xB0
+#define MKV_PIXEL_HEIGHT 0xBA
+#define MKV_CLUSTER 0x1F43B675
+#define MKV_TIMESTAMP 0xE7
+#define MKV_SIMPLE_BLOCK 0xA3
+
+#define MKV_TRACK_NUMBER_VIDEO 1
+#define MKV_TRACK_TYPE_VIDEO 1
+#define MKV_UNKNOWN_SIZE 0x01FFFFFFFFFFFFFFULL
+#define MKV_KEYFRAME 0x80
+
+static void mkv_write_id(mux_t *mux, uint32_t id)
+{
+  int bytes = 1;
+
+  while (bytes < 4 && (id >> (8 * bytes))) {
+    bytes++;
+  }
+  mux_write_be(mux, id, bytes);
+}
+
+// Returns the offset of the size of the element, to be completed by `mkv_end_element`
+static size_t mkv_start_element(mux_t *mux, uint32_t id)
+{
+  mkv_write_id(mux, id);
+
+  size_t offset = mux->output_length;
+  mux_write_be(mux, MKV_UNKNOWN_SIZE, 8);
+  return offset;
+}
+
+// The size is written on 8 bytes
+static void mkv_end_element(mux_t *mux, size_t offset)
+{
+  mux_patch_be(mux, offset, (1ULL << 56) | (mux->output_length - offset - 8), 8);
+}
+
+static void mkv_write_uint(mux_t *mux, uint32_t id, uint64_t value)
+{
+  int bytes = 1;
+
+  while (bytes < 8 && (value >> (8 * bytes))) {
+    bytes++;
+  }
+
+  mkv_write_id(mux, id);
+  mux_write_be(mux, 0x80 | bytes, 1);
+  mux_write_be(mux, value, bytes);
+}
+
+static void mkv_write_string(mux_t *mux, uint32_t id, const char *value)
+{
+  size_t length = strlen(value);
+
+  mkv_write_id(mux, id);
+  mux_write_be(mux, (1ULL << 56) | length, 8);
+  mux_write(mux, value, length);
+}
+
+int mux_mkv_write_header(mux_t *mux)
+{
+  size_t ebml = mkv_start_element(mux, MKV_EBML);
+  mkv_write_uint(mux, MKV_EBML_VERSION, 1);
+  mkv_write_uint(mux, MKV_EBML_READ_VERSION, 1);
+  mkv_write_uint(mux, MKV_EBML_MAX_ID_LENGTH, 4);
+  mkv_write_uint(mux, MKV_EBML_MAX_SIZE_LENGTH, 8);
+  mkv_write_string(mux, MKV_DOC_TYPE, "matroska");
+  mkv_write_uint(mux, MKV_DOC_TYPE_VERSION, 4);
+  mkv_write_uint(mux, MKV_DOC_TYPE_READ_VERSION, 2);
+  mkv_end_element(mux, ebml);
+
+  // The segment is never completed
+  mkv_start_element(mux, MKV_SEGMENT);
+
+  size_t info = mkv_start_element(mux, MKV_INFO);
+  mkv_write_uint(mux, MKV_TIMESTAMP_SCALE, 1000000); // 1ms
+  mkv_write_string(mux, MKV_MUXING_APP, "camera-streamer");
+  mkv_write_string(mux, MKV_WRITING_APP, "camera-streamer");
+  mkv_end_element(mux, info);
+
+  size_t tracks = mkv_start_element(mux, MKV_TRACKS);
+  size_t track = mkv_start_element(mux, MKV_TRACK_ENTRY);
+  mkv_write_uint(mux, MKV_TRACK_NUMBER, MKV_TRACK_NUMBER_VIDEO);
+  mkv_write_uint(mux, MKV_TRACK_UID, MKV_TRACK_NUMBER_VIDEO);
+  mkv_write_uint(mux, MKV_TRACK_TYPE, MKV_TRACK_TYPE_VIDEO);
+  mkv_write_uint(mux, MKV_FLAG_LACING, 0);
+  mkv_write_string(mux, MKV_CODEC_ID, "V_MPEG4/ISO/AVC");
+
+  size_t codec_private = mkv_start_element(mux, MKV_CODEC_PRIVATE);
+  mux_write_avcc(mux);
+  mkv_end_element(mux, codec_private);
+
+  size_t video = mkv_start_element(mux, MKV_VIDEO);
+  mkv_write_uint(mux, MKV_PIXEL_WIDTH, mux->width);
+  mkv_write_uint(mux, MKV_PIXEL_HEIGHT, mux->height);
+  mkv_end_element(mux, video);
+
+  mkv_end_element(mux, track);
+  mkv_end_element(mux, tracks);
+  return 0;
+}
+
+int mux_mkv_write_frame(mux_t *mux, const uint8_t *data, size_t length, uint64_t pts_us, uint64_t duration_us, bool is_keyframe)
+{
+  if (!mux_samples_length(data, length)) {
+    return 0;
+  }
+
+  size_t cluster = mkv_start_element(mux, MKV_CLUSTER);
+  mkv_write_uint(mux, MKV_TIMESTAMP, pts_us / 1000);
+
+  size_t block = mkv_start_element(mux, MKV_SIMPLE_BLOCK);
+  mux_write_be(mux, 0x80 | MKV_TRACK_NUMBER_VIDEO, 1);
+  mux_write_be(mux, 0, 2); // relative to the cluster
+  mux_write_be(mux, is_keyframe ? MKV_KEYFRAME : 0, 1);
+  mux_write_samples(mux, data, length);
+  mkv_end_element(mux, block);
+
+  mkv_end_element(mux, cluster);
+  return 0;
+}
@@ -0,0 +1,262 @@
+#include "mux.h"
+#include "util/opts/log.h"
+
+// ISO/IEC 14496-12 fragmented MP4, as written by ffmpeg with
+// `movflags=frag_keyframe+empty_moov+default_base_moof`
+
+#define TRACK_ID 1
+
+#define TRUN_DATA_OFFSET 0x000001
+#define TRUN_SAMPLE_DURATION 0x000100
+#define TRUN_SAMPLE_SIZE 0x000200
+#define TRUN_SAMPLE_FLAGS 0x000400
+#define TFHD_DEFAULT_BASE_IS_MOOF 0x020000
+
+#define SAMPLE_FLAGS_SYNC 0x02000000 // depends on no other
+#define SAMPLE_FLAGS_NON_SYNC 0x01010000 // depends on others, not a sync sample
+
+static const uint32_t mp4_matrix[9] = {
+  0x00010000, 0, 0,
+  0, 0x00010000, 0,
+  0, 0, 0x40000000
+};
+
+// Returns the offset of the box, to be completed by `mp4_end_box`
+static size_t mp4_start_box(mux_t *mux, const char *type)
+{
+  size_t offset = mux->output_length;
+  mux_write_be(mux, 0, 4);
+  mux_write(mux, type, 4);
+  return offset;
+}
+
+static size_t mp4_start_full_box(mux_t *mux, const char *type, int version, int flags)
+{
+  size_t offset = mp4_start_box(mux, type);
+  mux_write_be(mux, version, 1);
+  mux_write_be(mux, flags, 3);
+  return offset;
+}
+
+static void mp4_end_box(mux_t *mux, size_t offset)
+{
+  mux_patch_be(mux, offset, mux->output_length - offset, 4);
+}
+
+static void mp4_write_zeros(mux_t *mux, int bytes)
+{
+  for (; bytes >= 4; bytes -= 4) {
+    mux_write_be(mux, 0, 4);
+  }
+  mux_write_be(mux, 0, bytes);
+}
+
+static void mp4_write_matrix(mux_t *mux)
+{
+  for (int i = 0; i < 9; i++) {
+    mux_write_be(mux, mp4_matrix[i], 4);
+  }
+}
+
+static void mp4_write_ftyp(mux_t *mux)
+{
+  size_t ftyp = mp4_start_box(mux, "ftyp");
+  mux_write(mux, "isom", 4);
+  mux_write_be(mux, 0x200, 4);
+  mux_write(mux, "isomiso6avc1mp41", 16);
+  mp4_end_box(mux, ftyp);
+}
+
+static void mp4_write_mvhd(mux_t *mux)
+{
+  size_t mvhd = mp4_start_full_box(mux, "mvhd", 0, 0);
+  mux_write_be(mux, 0, 4); // creation_time
+  mux_write_be(mux, 0, 4); // modification_time
+  mux_write_be(mux, 1000, 4); // timescale
+  mux_write_be(mux, 0, 4); // duration
+  mux_write_be(mux, 0x00010000, 4); // rate
+  mux_write_be(mux, 0x0100, 2); // volume
+  mp4_write_zeros(mux, 10);
+  mp4_write_matrix(mux);
+  mp4_write_zeros(mux, 24);
+  mux_write_be(mux, TRACK_ID + 1, 4); // next_track_ID
+  mp4_end_box(mux, mvhd);
+}
+
+static void mp4_write_tkhd(mux_t *mux)
+{
+  size_t tkhd = mp4_start_full_box(mux, "tkhd", 0, 3); // enabled, in movie
+  mux_write_be(mux, 0, 4); // creation_time
+  mux_write_be(mux, 0, 4); // modification_time
+  mux_write_be(mux, TRACK_ID, 4);
+  mux_write_be(mux, 0, 4);
+  mux_write_be(mux, 0, 4); // duration
+  mp4_write_zeros(mux, 8);
+  mux_write_be(mux, 0, 2); // layer
+  mux_write_be(mux, 0, 2); // alternate_group
+  mux_write_be(mux, 0, 2); // volume
+  mux_write_be(mux, 0, 2);
+  mp4_write_matrix(mux);
+  mux_write_be(mux, mux->width << 16, 4);
+  mux_write_be(mux, mux->height << 16, 4);
+  mp4_end_box(mux, tkhd);
+}
+
+static void mp4_write_mdhd_hdlr(mux_t *mux)
+{
+  size_t mdhd = mp4_start_full_box(mux, "mdhd", 0, 0);
+  mux_write_be(mux, 0, 4); // creation_time
+  mux_write_be(mux, 0, 4); // modification_time
+  mux_write_be(mux, MUX_TIMESCALE, 4);
+  mux_write_be(mux, 0, 4); // duration
+  mux_write_be(mux, 0x55C4, 2); // language: und
+  mux_write_be(mux, 0, 2);
+  mp4_end_box(mux, mdhd);
+
+  size_t hdlr = mp4_start_full_box(mux, "hdlr", 0, 0);
+  mux_write_be(mux, 0, 4);
+  mux_write(mux, "vide", 4);
+  mp4_write_zeros(mux, 12);
+  mux_write(mux, "VideoHandler", 13);
+  mp4_end_box(mux, hdlr);
+}
+
+static void mp4_write_stsd(mux_t *mux)
+{
+  size_t stsd = mp4_start_full_box(mux, "stsd", 0, 0);
+  mux_write_be(mux, 1, 4); // entry_count
+
+  size_t avc1 = mp4_start_box(mux, "avc1");
+  mp4_write_zeros(mux, 6);
+  mux_write_be(mux, 1, 2); // data_reference_index
+  mp4_write_zeros(mux, 16);
+  mux_write_be(mux, mux->width, 2);
+  mux_write_be(mux, mux->height, 2);
+  mux_write_be(mux, 0x00480000, 4); // horizresolution: 72 dpi
+  mux_write_be(mux, 0x00480000, 4); // vertresolution: 72 dpi
+  mux_write_be(mux, 0, 4);
+  mux_write_be(mux, 1, 2); // frame_count
+  mp4_write_zeros(mux, 32); // compressorname
+  mux_write_be(mux, 0x0018, 2); // depth
+  mux_write_be(mux, 0xFFFF, 2);
+
+  size_t avcc = mp4_start_box(mux, "avcC");
+  mux_write_avcc(mux);
+  mp4_end_box(mux, avcc);
+
+  mp4_end_box(mux, avc1);
+  mp4_end_box(mux, stsd);
+}
+
+// The samples are in the fragments, the tables are empty
+static void mp4_write_stbl(mux_t *mux)
+{
+  size_t stbl = mp4_start_box(mux, "stbl");
+  mp4_write_stsd(mux);
+
+  const char *tables[] = { "stts", "stsc", "stco" };
+  for (int i = 0; i < ARRAY_SIZE(tables); i++) {
+    size_t table = mp4_start_full_box(mux, tables[i], 0, 0);
+    mux_write_be(mux, 0, 4); // entry_count
+    mp4_end_box(mux, table);
+  }
+
+  size_t stsz = mp4_start_full_box(mux, "stsz", 0, 0);
+  mux_write_be(mux, 0, 4); // sample_size
+  mux_write_be(mux, 0, 4); // sample_count
+  mp4_end_box(mux, stsz);
+
+  mp4_end_box(mux, stbl);
+}
+
+static void mp4_write_minf(mux_t *mux)
+{
+  size_t minf = mp4_start_box(mux, "minf");
+
+  size_t vmhd = mp4_start_full_box(mux, "vmhd", 0, 1);
+  mp4_write_zeros(mux, 8); // graphicsmode, opcolor
+  mp4_end_box(mux, vmhd);
+
+  size_t dinf = mp4_start_box(mux, "dinf");
+  size_t dref = mp4_start_full_box(mux, "dref", 0, 0);
+  mux_write_be(mux, 1, 4); // entry_count
+  size_t url = mp4_start_full_box(mux, "url ", 0, 1); // in this file
+  mp4_end_box(mux, url);
+  mp4_end_box(mux, dref);
+  mp4_end_box(mux, dinf);
+
+  mp4_write_stbl(mux);
+  mp4_end_box(mux, minf);
+}
+
+int mux_mp4_write_header(mux_t *mux)
+{
+  mp4_write_ftyp(mux);
+
+  size_t moov = mp4_start_box(mux, "moov");
+  mp4_write_mvhd(mux);
+
+  size_t trak = mp4_start_box(mux, "trak");
+  mp4_write_tkhd(mux);
+  size_t mdia = mp4_start_box(mux, "mdia");
+  mp4_write_mdhd_hdlr(mux);
+  mp4_write_minf(mux);
+  mp4_end_box(mux, mdia);
+  mp4_end_box(mux, trak);
+
+  size_t mvex = mp4_start_box(mux, "mvex");
+  size_t trex = mp4_start_full_box(mux, "trex", 0, 0);
+  mux_write_be(mux, TRACK_ID, 4);
+  mux_write_be(mux, 1, 4); // default_sample_description_index
+  mux_write_be(mux, 0, 4); // default_sample_duration
+  mux_write_be(mux, 0, 4); // default_sample_size
+  mux_write_be(mux, 0, 4); // default_sample_flags
+  mp4_end_box(mux, trex);
+  mp4_end_box(mux, mvex);
+
+  mp4_end_box(mux, moov);
+  return 0;
+}
+
+int mux_mp4_write_frame(mux_t *mux, const uint8_t *data, size_t length, uint64_t pts_us, uint64_t duration_us, bool is_keyframe)
+{
+  size_t samples_length = mux_samples_length(data, length);
+  if (!samples_length) {
+    return 0;
+  }
+
+  size_t moof = mp4_start_box(mux, "moof");
+
+  size_t mfhd = mp4_start_full_box(mux, "mfhd", 0, 0);
+  mux_write_be(mux, mux->frames + 1, 4); // sequence_number
+  mp4_end_box(mux, mfhd);
+
+  size_t traf = mp4_start_box(mux, "traf");
+
+  size_t tfhd = mp4_start_full_box(mux, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+  mux_write_be(mux, TRACK_ID, 4);
+  mp4_end_box(mux, tfhd);
+
+  size_t tfdt = mp4_start_full_box(mux, "tfdt", 1, 0);
+  mux_write_be(mux, pts_us * MUX_TIMESCALE / 1000000, 8); // baseMediaDecodeTime
+  mp4_end_box(mux, tfdt);
+
+  size_t trun = mp4_start_full_box(mux, "trun", 0,
+    TRUN_DATA_OFFSET | TRUN_SAMPLE_DURATION | TRUN_SAMPLE_SIZE | TRUN_SAMPLE_FLAGS);
+  mux_write_be(mux, 1, 4); // sample_count
+  size_t data_offset = mux->output_length;
+  mux_write_be(mux, 0, 4); // data_offset, from the start of `moof`
+  mux_write_be(mux, duration_us * MUX_TIMESCALE / 1000000, 4);
+  mux_write_be(mux, samples_length, 4);
+  mux_write_be(mux, is_keyframe ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC, 4);
+  mp4_end_box(mux, trun);
+
+  mp4_end_box(mux, traf);
+  mp4_end_box(mux, moof);
+
+  size_t mdat = mp4_start_box(mux, "mdat");
+  mux_patch_be(mux, data_offset, mux->output_length - moof, 4);
+  mux_write_samples(mux, data, length);
+  mp4_end_box(mux, mdat);
+  return 0;
+}
@@ -0,0 +1,238 @@
+#include "mux.h"
+#include "util/opts/log.h"
+
+#define NAL_TYPE_SPS 7
+#define NAL_TYPE_PPS 8
+#define NAL_TYPE_AUD 9
+
+// Finds the next NAL unit after a start code, and advances `data` past it
+bool mux_next_nal(const uint8_t **data, const uint8_t *end, mux_nal_t *nal)
+{
+  const uint8_t *ptr = *data;
+
+  for (; ptr + 3 <= end; ptr++) {
+    if (ptr[0] == 0 && ptr[1] == 0 && ptr[2] == 1) {
+      break;
+    }
+  }
+  if (ptr + 3 >= end) {
+    *data = end;
+    return false;
+  }
+
+  nal->data = ptr + 3;
+
+  for (ptr = nal->data; ptr + 3 <= end; ptr++) {
+    if (ptr[0] == 0 && ptr[1] == 0 && (ptr[2] == 1 || (ptr[2] == 0 && ptr + 4 <= end && ptr[3] == 1))) {
+      break;
+    }
+  }
+  if (ptr + 3 > end) {
+    ptr = end;
+  }
+
+  nal->length = ptr - nal->data;
+  nal->type = nal->data[0] & 0x1F;
+  *data = ptr;
+  return true;
+}
+
+void mux_write(mux_t *mux, const void *data, size_t length)
+{
+  if (mux->output_length + length > mux->output_size) {
+    size_t size = MAX(mux->output_size * 2, mux->output_length + length);
+    uint8_t *output = realloc(mux->output, size);
+    if (!output) {
+      mux->output_error = true;
+      return;
+    }
+
+    mux->output = output;
+    mux->output_size = size;
+  }
+
+  memcpy(mux->output + mux->output_length, data, length);
+  mux->output_length += length;
+}
+
+void mux_write_be(mux_t *mux, uint64_t value, int bytes)
+{
+  uint8_t data[8];
+
+  for (int i = 0; i < bytes; i++) {
+    data[i] = value >> (8 * (bytes - i - 1));
+  }
+  mux_write(mux, data, bytes);
+}
+
+void mux_patch_be(mux_t *mux, size_t offset, uint64_t value, int bytes)
+{
+  if (mux->output_error || offset + bytes > mux->output_length) {
+    return;
+  }
+
+  for (int i = 0; i < bytes; i++) {
+    mux->output[offset + i] = value >> (8 * (bytes - i - 1));
+  }
+}
+
+// The parameter sets are in the header, the delimiters are not needed
+static bool mux_is_sample_nal(mux_nal_t *nal)
+{
+  return nal->length > 0 && nal->type != NAL_TYPE_SPS &&
+    nal->type != NAL_TYPE_PPS && nal->type != NAL_TYPE_AUD;
+}
+
+size_t mux_samples_length(const uint8_t *data, size_t length)
+{
+  const uint8_t *end = data + length;
+  size_t total = 0;
+  mux_nal_t nal;
+
+  while (mux_next_nal(&data, end, &nal)) {
+    if (mux_is_sample_nal(&nal)) {
+      total += 4 + nal.length;
+    }
+  }
+
+  return total;
+}
+
+// Writes the NAL units prefixed with their length
+void mux_write_samples(mux_t *mux, const uint8_t *data, size_t length)
+{
+  const uint8_t *end = data + length;
+  mux_nal_t nal;
+
+  while (mux_next_nal(&data, end, &nal)) {
+    if (mux_is_sample_nal(&nal)) {
+      mux_write_be(mux, nal.length, 4);
+      mux_write(mux, nal.data, nal.length);
+    }
+  }
+}
+
+// AVCDecoderConfigurationRecord, used by `avcC` and `CodecPrivate`
+void mux_write_avcc(mux_t *mux)
+{
+  uint8_t config[] = {
+    1, mux->sps[1], mux->sps[2], mux->sps[3],
+    0xFC | 3, // 4 bytes of length
+    0xE0 | 1 // 1 SPS
+  };
+
+  mux_write(mux, config, sizeof(config));
+  mux_write_be(mux, mux->sps_length, 2);
+  mux_write(mux, mux->sps, mux->sps_length);
+  mux_write_be(mux, 1, 1); // 1 PPS
+  mux_write_be(mux, mux->pps_length, 2);
+  mux_write(mux, mux->pps, mux->pps_length);
+}
+
+static bool mux_copy_param(mux_nal_t *nal, uint8_t *param, size_t *param_length)
+{
+  if (nal->length < 4 || nal->length > MUX_MAX_PARAM_SIZE) {
+    return false;
+  }
+
+  memcpy(param, nal->data, nal->length);
+  *param_length = nal->length;
+  return true;
+}
+
+int mux_write_header(mux_t *mux, const uint8_t *data, size_t length)
+{
+  const uint8_t *end = data + length;
+  mux_nal_t nal;
+
+  mux->sps_length = mux->pps_length = 0;
+
+  while (mux_next_nal(&data, end, &nal)) {
+    if (nal.type == NAL_TYPE_SPS && !mux->sps_length && !mux_copy_param(&nal, mux->sps, &mux->sps_length)) {
+      goto error;
+    } else if (nal.type == NAL_TYPE_PPS && !mux->pps_length && !mux_copy_param(&nal, mux->pps, &mux->pps_length)) {
+      goto error;
+    }
+  }
+
+  if (!mux->sps_length || !mux->pps_length) {
+    LOG_INFO(mux, "The key frame has no SPS or PPS.");
+    return -1;
+  }
+
+  int ret = mux->format == MUX_FORMAT_MKV ? mux_mkv_write_header(mux) : mux_mp4_write_header(mux);
+  if (ret < 0 || mux->output_error) {
+    return -1;
+  }
+
+  mux->has_header = true;
+  mux->frames = 0;
+  return 0;
+
+error:
+  LOG_INFO(mux, "The SPS or PPS is invalid.");
+  return -1;
+}
+
+// The parameters cannot change once in the header
+static bool mux_params_changed(mux_t *mux, const uint8_t *data, size_t length)
+{
+  const uint8_t *end = data + length;
+  mux_nal_t nal;
+
+  while (mux_next_nal(&data, end, &nal)) {
+    if (nal.type == NAL_TYPE_SPS && (nal.length != mux->sps_length || memcmp(nal.data, mux->sps, nal.length))) {
+      return true;
+    } else if (nal.type == NAL_TYPE_PPS && (nal.length != mux->pps_length || memcmp(nal.data, mux->pps, nal.length))) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int mux_write_frame(mux_t *mux, const uint8_t *data, size_t length, uint64_t pts_us, bool is_keyframe)
+{
+  if (!mux->has_header) {
+    return -1;
+  }
+
+  if (is_keyframe && mux_params_changed(mux, data, length)) {
+    LOG_INFO(mux, "The SPS or PPS changed.");
+    return -1;
+  }
+
+  // The timestamps start at 0, and have to increase
+  if (!mux->frames) {
+    mux->start_us = pts_us;
+    mux->last_pts_us = 0;
+    mux->last_duration_us = MUX_DEFAULT_DURATION_US;
+    pts_us = 0;
+  } else {
+    pts_us = pts_us > mux->start_us ? pts_us - mux->start_us : 0;
+    pts_us = MAX(pts_us, mux->last_pts_us + 1);
+    mux->last_duration_us = pts_us - mux->last_pts_us;
+  }
+
+  // The duration of the frame is not known yet, the previous one is used
+  int ret = mux->format == MUX_FORMAT_MKV
+    ? mux_mkv_write_frame(mux, data, length, pts_us, mux->last_duration_us, is_keyframe)
+    : mux_mp4_write_frame(mux, data, length, pts_us, mux->last_duration_us, is_keyframe);
+  if (ret < 0 || mux->output_error) {
+    return -1;
+  }
+
+  mux->last_pts_us = pts_us;
+  mux->frames++;
+  return 0;
+}
+
+void mux_close(mux_t *mux)
+{
+  free(mux->output);
+  mux->output = NULL;
+  mux->output_length = mux->output_size = 0;
+  mux->output_error = false;
+  mux->has_header = false;
+  mux->frames = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Writes the Annex-B H264 access units as fragmented MP4 or Matroska,
+// one fragment (`moof`+`mdat`, or `Cluster`) per frame, timed with
+// the capture time of the frame. The SPS and PPS of the first key frame
+// describe the stream in the header.
+
+#define MUX_MAX_PARAM_SIZE 256
+#define MUX_TIMESCALE 90000 // of the MP4 track
+#define MUX_DEFAULT_DURATION_US 33333
+
+typedef enum {
+  MUX_FORMAT_MP4,
+  MUX_FORMAT_MKV
+} mux_format_t;
+
+typedef struct mux_s {
+  const char *name;
+  mux_format_t format;
+  unsigned width, height;
+
+  // the output of the writes, taken by the caller
+  uint8_t *output;
+  size_t output_length, output_size;
+  bool output_error;
+
+  uint8_t sps[MUX_MAX_PARAM_SIZE], pps[MUX_MAX_PARAM_SIZE];
+  size_t sps_length, pps_length;
+
+  bool has_header;
+  uint64_t start_us, last_pts_us, last_duration_us;
+  unsigned frames;
+} mux_t;
+
+// Writes the header, from the SPS and PPS of the key frame `data`
+int mux_write_header(mux_t *mux, const uint8_t *data, size_t length);
+
+// Writes the frame `data` captured at `pts_us` as a fragment
+int mux_write_frame(mux_t *mux, const uint8_t *data, size_t length, uint64_t pts_us, bool is_keyframe);
+
+void mux_close(mux_t *mux);
+
+// Used by the writers
+typedef struct mux_nal_s {
+  const uint8_t *data;
+  size_t length;
+  int type;
+} mux_nal_t;
+
+bool mux_next_nal(const uint8_t **data, const uint8_t *end, mux_nal_t *nal);
+void mux_write(mux_t *mux, const void *data, size_t length);
+void mux_write_be(mux_t *mux, uint64_t value, int bytes);
+void mux_patch_be(mux_t *mux, size_t offset, uint64_t value, int bytes);
+void mux_write_samples(mux_t *mux, const uint8_t *data, size_t length);
+size_t mux_samples_length(const uint8_t *data, size_t length);
+void mux_write_avcc(mux_t *mux);
+
+int mux_mp4_write_header(mux_t *mux);
+int mux_mp4_write_frame(mux_t *mux, const uint8_t *data, size_t length, uint64_t pts_us, uint64_t duration_us, bool is_keyframe);
+int mux_mkv_write_header(mux_t *mux);
+int mux_mkv_write_frame(mux_t *mux, const uint8_t *data, size_t length, uint64_t pts_us, uint64_t duration_us, bool is_keyframe);
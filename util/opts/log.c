@@ -3,6 +3,32 @@
 
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define LOG_RING_SIZE 1024
+#define LOG_RECORD_SIZE 512
+#define LOG_MAX_IOVS 64
+
+// Multi-producer single-consumer ring: the `seq` of the record tells
+// if it is free to be written at `pos` (== pos), or was written (== pos + 1)
+typedef struct log_record_s {
+  unsigned seq;
+  unsigned length;
+  char data[LOG_RECORD_SIZE];
+} log_record_t;
+
+static log_record_t log_records[LOG_RING_SIZE];
+static unsigned log_tail, log_head;
+static unsigned log_published, log_waiting, log_dropped;
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_t log_thread;
+static bool log_started;
+
+unsigned log_generation = 1;
 
 char *
 strstrn(const char *s, const char *find, size_t len)
@@ -42,6 +68,156 @@ bool filter_log(const char *filename)
   return false;
 }
 
+bool log_enabled(const char *filename, bool verbose)
+{
+  return log_options.debug || (verbose && log_options.verbose) || filter_log(filename);
+}
+
+void log_options_changed()
+{
+  __atomic_add_fetch(&log_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void *log_drain_thread(void *opaque)
+{
+  while (1) {
+    struct iovec iovs[LOG_MAX_IOVS];
+    int n = 0;
+
+    unsigned published = __atomic_load_n(&log_published, __ATOMIC_SEQ_CST);
+
+    for (; n < LOG_MAX_IOVS; n++) {
+      log_record_t *record = &log_records[(log_head + n) % LOG_RING_SIZE];
+      if (__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) != log_head + n + 1) {
+        break;
+      }
+      iovs[n].iov_base = record->data;
+      iovs[n].iov_len = record->length;
+    }
+
+    if (n > 0) {
+      if (writev(STDERR_FILENO, iovs, n) < 0) {
+        // nowhere to report it
+      }
+
+      for (int i = 0; i < n; i++) {
+        log_record_t *record = &log_records[(log_head + i) % LOG_RING_SIZE];
+        __atomic_store_n(&record->seq, log_head + i + LOG_RING_SIZE, __ATOMIC_RELEASE);
+      }
+      __atomic_store_n(&log_head, log_head + n, __ATOMIC_RELEASE);
+      continue;
+    }
+
+    unsigned dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+      dprintf(STDERR_FILENO, "log.c: ?: Dropped %u messages.\n", dropped);
+    }
+
+    // Sleep until the next message is published
+    __atomic_store_n(&log_waiting, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &log_published, FUTEX_WAIT_PRIVATE, published, NULL, NULL, 0);
+    __atomic_store_n(&log_waiting, 0, __ATOMIC_SEQ_CST);
+  }
+
+  return NULL;
+}
+
+static void log_wake()
+{
+  if (__atomic_load_n(&log_waiting, __ATOMIC_SEQ_CST)) {
+    syscall(SYS_futex, &log_published, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+static void log_start()
+{
+  for (unsigned i = 0; i < LOG_RING_SIZE; i++) {
+    log_records[i].seq = i;
+  }
+
+  if (pthread_create(&log_thread, NULL, log_drain_thread, NULL) == 0) {
+    pthread_detach(log_thread);
+    log_started = true;
+    atexit(log_flush);
+  }
+}
+
+// Returns NULL if full
+static log_record_t *log_reserve(unsigned *posp)
+{
+  unsigned pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+
+  while (1) {
+    log_record_t *record = &log_records[pos % LOG_RING_SIZE];
+    int diff = (int)(__atomic_load_n(&record->seq, __ATOMIC_ACQUIRE) - pos);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&log_tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *posp = pos;
+        return record;
+      }
+    } else if (diff < 0) {
+      return NULL;
+    } else {
+      pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void log_printf(bool droppable, const char *fmt, ...)
+{
+  va_list arg;
+  unsigned pos;
+
+  pthread_once(&log_once, log_start);
+
+  log_record_t *record = log_started ? log_reserve(&pos) : NULL;
+
+  if (!record && log_started && droppable) {
+    __atomic_add_fetch(&log_dropped, 1, __ATOMIC_RELAXED);
+    return;
+  } else if (!record) {
+    va_start(arg, fmt);
+    vfprintf(stderr, fmt, arg);
+    va_end(arg);
+    return;
+  }
+
+  va_start(arg, fmt);
+  int n = vsnprintf(record->data, sizeof(record->data), fmt, arg);
+  va_end(arg);
+
+  if (n < 0) {
+    n = 0;
+  } else if (n >= sizeof(record->data)) {
+    n = sizeof(record->data);
+    record->data[n - 1] = '\n';
+  }
+  record->length = n;
+
+  __atomic_store_n(&record->seq, pos + 1, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&log_published, 1, __ATOMIC_SEQ_CST);
+  log_wake();
+}
+
+void log_flush()
+{
+  if (!log_started) {
+    return;
+  }
+
+  // Wait for the background thread, but not forever
+  for (int i = 0; i < 100; i++) {
+    if (__atomic_load_n(&log_head, __ATOMIC_ACQUIRE) == __atomic_load_n(&log_tail, __ATOMIC_ACQUIRE)) {
+      break;
+    }
+
+    __atomic_add_fetch(&log_published, 1, __ATOMIC_SEQ_CST);
+    log_wake();
+    usleep(1000);
+  }
+}
+
 int shrink_to_block(int size, int block)
 {
 	return size / block * block;
@@ -37,13 +37,35 @@ extern log_options_t log_options;
 
 bool filter_log(const char *filename);
 
+// The messages are formatted by the caller into a lock-free ring, and written
+// to stderr by a background thread. The debug and verbose messages are dropped
+// if the ring is full, the others are then written directly.
+void log_printf(bool droppable, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_flush();
+
+// Each call site caches if it is enabled, until `log_options_changed` is called
+extern unsigned log_generation;
+bool log_enabled(const char *filename, bool verbose);
+void log_options_changed();
+
+#define LOG_ENABLED(verbose) ({ \
+		static unsigned _log_cache; \
+		unsigned _log_value = __atomic_load_n(&_log_cache, __ATOMIC_RELAXED); \
+		unsigned _log_generation = __atomic_load_n(&log_generation, __ATOMIC_RELAXED); \
+		if ((_log_value >> 1) != _log_generation) { \
+			_log_value = _log_generation << 1 | log_enabled(__FILENAME__, verbose); \
+			__atomic_store_n(&_log_cache, _log_value, __ATOMIC_RELAXED); \
+		} \
+		(_log_value & 1) != 0; \
+	})
+
 // assumes that name is first item
 #define dev_name(dev) (dev ? *(const char**)dev : "?")
-#define LOG_ERROR(dev, _msg, ...)		do { fprintf(stderr, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); goto error; } while(0)
-#define LOG_PERROR(dev, _msg, ...)		do { fprintf(stderr, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); exit(-1); } while(0)
-#define LOG_INFO(dev, _msg, ...)		do { fprintf(stderr, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); } while(0)
-#define LOG_VERBOSE(dev, _msg, ...)	do { if (log_options.debug || log_options.verbose || filter_log(__FILENAME__)) { fprintf(stderr, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); } } while(0)
-#define LOG_DEBUG(dev, _msg, ...)		do { if (log_options.debug || filter_log(__FILENAME__)) { fprintf(stderr, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); } } while(0)
+#define LOG_ERROR(dev, _msg, ...)		do { log_printf(false, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); goto error; } while(0)
+#define LOG_PERROR(dev, _msg, ...)		do { log_flush(); fprintf(stderr, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); exit(-1); } while(0)
+#define LOG_INFO(dev, _msg, ...)		do { log_printf(false, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); } while(0)
+#define LOG_VERBOSE(dev, _msg, ...)	do { if (LOG_ENABLED(true)) { log_printf(true, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); } } while(0)
+#define LOG_DEBUG(dev, _msg, ...)		do { if (LOG_ENABLED(false)) { log_printf(true, "%s: %s: " _msg "\n", __FILENAME__, dev_name(dev), ##__VA_ARGS__); } } while(0)
 
 #define CLOCK_FROM_PARAMS -1
 
@@ -206,6 +206,7 @@ int parse_opts(option_t *options, int argc, char *argv[])
     }
   }
 
+  log_options_changed();
   return 0;
 
 error:
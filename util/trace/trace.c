@@ -0,0 +1,211 @@
+#include "trace.h"
+#include "util/opts/log.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+typedef struct trace_event_s {
+  uint64_t start_ns, end_ns;
+  const char *name;
+  int tid;
+  char source[TRACE_NAME_SIZE];
+} trace_event_t;
+
+// Written only by the owning thread, and read by `trace_collect` without
+// locking: the events overwritten while being read are discarded after
+typedef struct trace_ring_s {
+  int tid;
+  char name[TRACE_NAME_SIZE];
+  bool used;
+  uint64_t head;
+  trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+int trace_collecting;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static trace_ring_t *trace_rings[TRACE_MAX_THREADS];
+static int trace_nrings;
+
+static __thread trace_ring_t *trace_ring;
+static __thread bool trace_no_ring;
+static __thread char trace_name[TRACE_NAME_SIZE];
+
+// The ring of the exited thread is reused by the next one
+static void trace_release_ring(void *opaque)
+{
+  trace_ring_t *ring = opaque;
+  __atomic_store_n(&ring->used, false, __ATOMIC_RELEASE);
+}
+
+static void trace_init()
+{
+  pthread_key_create(&trace_key, trace_release_ring);
+}
+
+static trace_ring_t *trace_get_ring()
+{
+  if (trace_ring || trace_no_ring) {
+    return trace_ring;
+  }
+
+  pthread_once(&trace_once, trace_init);
+  pthread_mutex_lock(&trace_lock);
+
+  for (int i = 0; i < trace_nrings; i++) {
+    if (!__atomic_load_n(&trace_rings[i]->used, __ATOMIC_ACQUIRE)) {
+      trace_ring = trace_rings[i];
+      break;
+    }
+  }
+
+  if (!trace_ring && trace_nrings < TRACE_MAX_THREADS) {
+    trace_ring = calloc(1, sizeof(trace_ring_t));
+    trace_rings[trace_nrings] = trace_ring;
+    __atomic_store_n(&trace_nrings, trace_nrings + 1, __ATOMIC_RELEASE);
+  }
+
+  if (trace_ring) {
+    trace_ring->tid = syscall(SYS_gettid);
+    strcpy(trace_ring->name, trace_name[0] ? trace_name : "thread");
+    __atomic_store_n(&trace_ring->used, true, __ATOMIC_RELEASE);
+    pthread_setspecific(trace_key, trace_ring);
+  } else {
+    trace_no_ring = true;
+  }
+
+  pthread_mutex_unlock(&trace_lock);
+  return trace_ring;
+}
+
+void trace_thread_name(const char *name)
+{
+  snprintf(trace_name, sizeof(trace_name), "%s", name);
+
+  if (trace_ring) {
+    strcpy(trace_ring->name, trace_name);
+  }
+}
+
+void trace_end(uint64_t start_ns, const char *name, const char *source)
+{
+  if (!start_ns) {
+    return;
+  }
+
+  uint64_t end_ns = trace_begin();
+  trace_ring_t *ring = trace_get_ring();
+  if (!ring) {
+    return;
+  }
+
+  trace_event_t *event = &ring->events[ring->head % TRACE_RING_SIZE];
+  event->start_ns = start_ns;
+  event->end_ns = end_ns ? end_ns : start_ns;
+  event->name = name;
+  event->tid = ring->tid;
+  snprintf(event->source, sizeof(event->source), "%s", source ? source : "");
+
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+static void trace_write_string(FILE *stream, const char *str)
+{
+  fputc('"', stream);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', stream);
+    }
+    if ((unsigned char)*str >= 0x20) {
+      fputc(*str, stream);
+    }
+  }
+  fputc('"', stream);
+}
+
+// Writes the events of the `ring` recorded after `since_ns`,
+// and returns the number of them already overwritten
+static int trace_write_ring(FILE *stream, trace_ring_t *ring, uint64_t since_head, uint64_t since_ns, int *nevents)
+{
+  static trace_event_t events[TRACE_RING_SIZE];
+
+  uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  uint64_t first = MAX(head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0, since_head);
+
+  for (uint64_t i = first; i < head; i++) {
+    events[i % TRACE_RING_SIZE] = ring->events[i % TRACE_RING_SIZE];
+  }
+
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+  // The event being written overwrites one more
+  uint64_t written = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1;
+  uint64_t valid = MAX(written > TRACE_RING_SIZE ? written - TRACE_RING_SIZE : 0, since_head);
+
+  for (uint64_t i = MAX(first, valid); i < head; i++) {
+    trace_event_t *event = &events[i % TRACE_RING_SIZE];
+
+    if (event->end_ns < since_ns) {
+      continue;
+    }
+
+    fprintf(stream, "%s\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":",
+      (*nevents)++ ? "," : "", getpid(), event->tid,
+      event->start_ns / 1e3, (event->end_ns - event->start_ns) / 1e3);
+    trace_write_string(stream, event->name);
+    fprintf(stream, ",\"args\":{\"source\":");
+    trace_write_string(stream, event->source);
+    fprintf(stream, "}}");
+  }
+
+  return MIN(valid, head) - since_head;
+}
+
+int trace_collect(FILE *stream, unsigned duration_ms)
+{
+  static int collect_busy;
+
+  // A single collection at a time, as it holds the HTTP worker
+  if (__atomic_exchange_n(&collect_busy, 1, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+
+  duration_ms = MIN(duration_ms, TRACE_MAX_DURATION_MS);
+
+  // The rings created later start at 0
+  uint64_t since_heads[TRACE_MAX_THREADS] = {0};
+  int nrings = __atomic_load_n(&trace_nrings, __ATOMIC_ACQUIRE);
+
+  for (int i = 0; i < nrings; i++) {
+    since_heads[i] = __atomic_load_n(&trace_rings[i]->head, __ATOMIC_ACQUIRE);
+  }
+
+  __atomic_add_fetch(&trace_collecting, 1, __ATOMIC_RELAXED);
+  uint64_t since_ns = trace_begin();
+  usleep(duration_ms * 1000);
+  __atomic_sub_fetch(&trace_collecting, 1, __ATOMIC_RELAXED);
+
+  nrings = __atomic_load_n(&trace_nrings, __ATOMIC_ACQUIRE);
+  int nevents = 0, lost = 0;
+
+  fprintf(stream, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+  for (int i = 0; i < nrings; i++) {
+    trace_ring_t *ring = trace_rings[i];
+
+    fprintf(stream, "%s\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":",
+      nevents++ ? "," : "", getpid(), ring->tid);
+    trace_write_string(stream, ring->name);
+    fprintf(stream, "}}");
+
+    lost += trace_write_ring(stream, ring, since_heads[i], since_ns, &nevents);
+  }
+
+  fprintf(stream, "\n],\"otherData\":{\"duration_ms\":%u,\"lost_events\":%d}}\n", duration_ms, lost);
+
+  __atomic_store_n(&collect_busy, 0, __ATOMIC_RELEASE);
+  return nevents;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+// Events of the pipeline are recorded into per-thread rings, only while
+// a trace is being collected, and written as the Chrome trace-event JSON
+// (to be opened with https://ui.perfetto.dev or chrome://tracing).
+// Otherwise `trace_begin` costs a single relaxed load.
+
+#define TRACE_RING_SIZE 8192 // events per thread
+#define TRACE_MAX_THREADS 64
+#define TRACE_NAME_SIZE 32
+#define TRACE_MAX_DURATION_MS (10*1000)
+
+extern int trace_collecting;
+
+static inline uint64_t trace_begin()
+{
+  if (!__atomic_load_n(&trace_collecting, __ATOMIC_RELAXED)) {
+    return 0;
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Records the event started by `trace_begin`, the `name` has to be static
+void trace_end(uint64_t start_ns, const char *name, const char *source);
+
+// Names the calling thread in the traces
+void trace_thread_name(const char *name);
+
+// Collects the events for `duration_ms`, and writes them to `stream`,
+// returns -1 if another collection is in progress
+int trace_collect(FILE *stream, unsigned duration_ms);
@@ -0,0 +1,2 @@
+#define GIT_VERSION ""
+#define GIT_REVISION "a638900"